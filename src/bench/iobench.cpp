@@ -0,0 +1,138 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <manatools/filesystem.hpp>
+#include <manatools/io.hpp>
+#include <manatools/version.hpp>
+
+namespace fs = manatools::fs;
+namespace io = manatools::io;
+
+constexpr size_t FILE_SIZE = 8 * 1024 * 1024;
+constexpr size_t NUM_JUMPS = 100'000;
+constexpr size_t NUM_WRITES = 1'000'000;
+
+/**
+ * Roughly mimics what the loaders and savers do: lots of small fields, jumping around
+ * to follow pointers, and seeking back to fill in offsets once they're known.
+ */
+
+template <typename IO>
+static u32 readFields(const fs::path& path) {
+	// Reads until the end, which isn't an error here
+	IO file(path, "rb", true, false);
+	u32 sum = 0;
+	u16 a;
+	u32 b;
+
+	while (file.readU16LE(&a) && file.readU32LE(&b) && file.readU16LE(&a))
+		sum += a + b;
+
+	return sum;
+}
+
+template <typename IO>
+static u32 followPointers(const fs::path& path) {
+	IO file(path, "rb");
+	std::mt19937 rng(1);
+	u32 sum = 0;
+
+	for (size_t i = 0; i < NUM_JUMPS; i++) {
+		file.jump(rng() % (FILE_SIZE - 48));
+
+		// Same shape as an MPB split
+		for (size_t f = 0; f < 12; f++) {
+			u32 field;
+			file.readU32LE(&field);
+			sum += field;
+		}
+	}
+
+	return sum;
+}
+
+template <typename IO>
+static u32 writeFixups(const fs::path& path) {
+	IO file(path, "wb");
+
+	for (size_t i = 0; i < NUM_WRITES; i += 64) {
+		auto fixup = file.tell();
+		file.writeU32LE(0);
+
+		for (size_t f = 1; f < 64; f++)
+			file.writeU32LE(i + f);
+
+		auto pos = file.tell();
+		file.jump(fixup);
+		file.writeU32LE(pos);
+		file.jump(pos);
+	}
+
+	return file.tell();
+}
+
+template <typename Func>
+static void bench(const char* name, Func&& func, const fs::path& path) {
+	using clock = std::chrono::steady_clock;
+
+	auto time = [&](auto&& op) {
+		auto start = clock::now();
+		u32 result = op(path);
+		return std::pair(std::chrono::duration<double, std::milli>(clock::now() - start).count(), result);
+	};
+
+	auto [fileTime, fileResult] = time([&](const fs::path& p) { return func.template operator()<io::FileIO>(p); });
+	auto [bufTime, bufResult] = time([&](const fs::path& p) { return func.template operator()<io::BufferedFileIO>(p); });
+
+	printf(
+		"%-16s  FileIO %9.2f ms   BufferedFileIO %9.2f ms   %6.2fx%s\n",
+		name,
+		fileTime,
+		bufTime,
+		fileTime / bufTime,
+		fileResult == bufResult ? "" : "   (results differ!)"
+	);
+}
+
+int main(int argc, char** argv) {
+	if (argc > 2 || (argc == 2 && !strcmp(argv[1], "--help"))) {
+		fprintf(
+			stderr,
+			"iobench - manatools IO backend benchmark [version %s]\n"
+			"\n"
+			"Usage: %s [scratch dir]\n",
+			manatools::versionString,
+			argv[0]
+		);
+		return 1;
+	}
+
+	try {
+		fs::path dir = argc == 2 ? fs::path(argv[1]) : fs::temp_directory_path();
+		fs::path path = dir / "manatools_iobench.bin";
+
+		{
+			std::vector<u8> data(FILE_SIZE);
+			std::mt19937 rng(0);
+			for (auto& b : data)
+				b = rng();
+
+			io::FileIO file(path, "wb");
+			file.writeVec(data);
+		}
+
+		bench("read fields", []<typename IO>(const fs::path& p) { return readFields<IO>(p); }, path);
+		bench("follow pointers", []<typename IO>(const fs::path& p) { return followPointers<IO>(p); }, path);
+		bench("write fixups", []<typename IO>(const fs::path& p) { return writeFixups<IO>(p); }, path);
+
+		fs::remove(path);
+	} catch (const std::runtime_error& err) {
+		fprintf(stderr, "An error occurred: %s\n", err.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,479 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <manatools/filesystem.hpp>
+#include <manatools/io.hpp>
+#include <manatools/midi.hpp>
+#include <manatools/mlt.hpp>
+#include <manatools/mpb.hpp>
+#include <manatools/msb.hpp>
+#include <manatools/msd.hpp>
+#include <manatools/osb.hpp>
+#include <manatools/sf2.hpp>
+#include <manatools/tonedecoder.hpp>
+#include <manatools/toneencoder.hpp>
+#include <manatools/version.hpp>
+
+namespace fs = manatools::fs;
+namespace io = manatools::io;
+namespace mlt = manatools::mlt;
+namespace mpb = manatools::mpb;
+namespace msb = manatools::msb;
+namespace msd = manatools::msd;
+namespace osb = manatools::osb;
+namespace sf2 = manatools::sf2;
+namespace tone = manatools::tone;
+
+/**
+ * Generates synthetic banks and sequences of a given shape, then times the library's
+ * heavier operations on them. Results go to stdout as JSON so that runs from different
+ * builds can be diffed or fed to a script, with progress going to stderr.
+ */
+
+struct Config {
+	uint programs = 64;
+	uint layers = 2;
+	uint splits = 8;          // per layer
+	uint toneSamples = 22050; // per split, so a second at the usual rate
+	uint sequences = 16;
+	uint messages = 4000;     // per sequence
+	double repeats = 0.5;     // chance of a phrase being a repeat of an earlier one, so referenced
+	uint iterations = 5;
+	u32 seed = 0;
+};
+
+struct Result {
+	std::string name;
+	std::vector<double> times; // ms
+	size_t bytes = 0;          // processed per iteration, for throughput
+};
+
+static tone::Tone makeTone(std::mt19937& rng, uint samples) {
+	std::uniform_real_distribution<float> freq(50.0f, 2000.0f);
+	std::normal_distribution<float> noise(0.0f, 500.0f);
+
+	tone::Tone tone;
+	tone.format = tone::Format::PCM16;
+	tone.sampleRate = 22050;
+	tone.data = tone::makeDataPtr(samples * sizeof(s16));
+
+	// A decaying sine with some noise, so the ADPCM encoder has something realistic to chew on
+	auto* pcm = reinterpret_cast<s16*>(tone.data->data());
+	float f = freq(rng);
+	for (uint i = 0; i < samples; i++) {
+		float env = std::exp(-3.0f * i / samples);
+		float s = 20000.0f * env * std::sin(2.0f * 3.14159265f * f * i / tone.sampleRate) + noise(rng);
+		pcm[i] = std::clamp(s, -32768.0f, 32767.0f);
+	}
+
+	return tone;
+}
+
+static mpb::Bank makeMPB(const Config& cfg, std::mt19937& rng) {
+	mpb::Bank bank;
+	bank.velocities.push_back(mpb::Velocity::defaultCurve());
+
+	for (uint p = 0; p < cfg.programs; p++) {
+		auto& program = bank.programs.emplace_back();
+
+		for (uint l = 0; l < std::min<uint>(cfg.layers, mpb::MAX_LAYERS); l++) {
+			auto& layer = program.layers[l].emplace();
+
+			for (uint s = 0; s < cfg.splits; s++) {
+				auto& split = layer.splits.emplace_back();
+				split.startNote = s * 128 / cfg.splits;
+				split.endNote = (s + 1) * 128 / cfg.splits - 1;
+				split.baseNote = (split.startNote + split.endNote) / 2;
+				split.loop = true;
+				split.loopStart = 0;
+				split.loopEnd = std::min<uint>(cfg.toneSamples, 0xFFFF);
+				split.tone = makeTone(rng, cfg.toneSamples);
+			}
+		}
+	}
+
+	return bank;
+}
+
+static osb::Bank makeOSB(const Config& cfg, std::mt19937& rng) {
+	osb::Bank bank;
+
+	for (uint p = 0; p < cfg.programs; p++) {
+		auto& program = bank.programs.emplace_back();
+		program.loop = true;
+		program.loopEnd = std::min<uint>(cfg.toneSamples, 0xFFFF);
+		program.tone = makeTone(rng, cfg.toneSamples);
+	}
+
+	return bank;
+}
+
+/**
+ * Sequences are made of short phrases, some of which are repeats of earlier ones as real
+ * music tends to have, which is what gives the MSD writer something to reference.
+ */
+static msd::MSD makeMSD(const Config& cfg, std::mt19937& rng) {
+	std::uniform_int_distribution<uint> phraseLen(8, 32);
+	std::uniform_int_distribution<uint> byte(0, 127);
+	std::uniform_int_distribution<uint> channel(0, 15);
+	std::uniform_int_distribution<uint> kind(0, 15);
+	std::bernoulli_distribution repeat(cfg.repeats);
+
+	msd::MSD seq;
+	seq.tpqn = 0x10000 / 480;
+	seq.initialTempo = 500;
+
+	std::vector<std::pair<size_t, size_t>> phrases;
+
+	while (seq.messages.size() < cfg.messages) {
+		if (!phrases.empty() && repeat(rng)) {
+			auto [start, len] = phrases[rng() % phrases.size()];
+			for (size_t i = 0; i < len; i++)
+				seq.messages.push_back(seq.messages[start + i]);
+			continue;
+		}
+
+		size_t start = seq.messages.size();
+		size_t len = phraseLen(rng);
+
+		for (size_t i = 0; i < len; i++) {
+			u8 ch = channel(rng);
+			u32 step = (rng() % 4) * 120;
+
+			switch (kind(rng)) {
+				case 0:  seq.messages.push_back(msd::ControlChange { ch, 7, static_cast<u8>(byte(rng)), step }); break;
+				case 1:  seq.messages.push_back(msd::ProgramChange { ch, static_cast<u8>(byte(rng)), step }); break;
+				case 2:  seq.messages.push_back(msd::PitchWheelChange { ch, static_cast<s8>(byte(rng) - 64), step }); break;
+
+				// Sometimes empty, as a bare F0 F7 in a MIDI becomes, which has to load back too
+				case 3: {
+					msd::SysEx sysEx { .step = step, .data = {}, .unk1 = 0 };
+					sysEx.data.resize(rng() % 4);
+					for (auto& b : sysEx.data)
+						b = byte(rng);
+					seq.messages.push_back(std::move(sysEx));
+					break;
+				}
+
+				default: seq.messages.push_back(msd::Note { ch, static_cast<u8>(byte(rng)), static_cast<u8>(byte(rng) | 1), static_cast<u32>(60 + rng() % 960), step }); break;
+			}
+		}
+
+		phrases.emplace_back(start, len);
+	}
+
+	return seq;
+}
+
+static msb::MSB makeMSB(const Config& cfg, std::mt19937& rng) {
+	msb::MSB bank;
+
+	for (uint s = 0; s < cfg.sequences; s++) {
+		auto& sequence = bank.sequences.emplace_back();
+		io::DynBufIO io(sequence.data);
+		makeMSD(cfg, rng).save(io);
+	}
+
+	return bank;
+}
+
+static mlt::MLT makeMLT(const fs::path& msbPath, const fs::path& mpbPath, const fs::path& osbPath) {
+	mlt::MLT mlt;
+	mlt.units.emplace_back("SMSB", io::readFile(msbPath));
+	mlt.units.emplace_back("SMPB", io::readFile(mpbPath));
+	mlt.units.emplace_back("SOSB", io::readFile(osbPath));
+	mlt.units.emplace_back("SFPW", 0, 0, mlt::FPW_ALIGN);
+	mlt.pack(false);
+	return mlt;
+}
+
+// (prepare) is run before every iteration of (op), outside of the timing
+template <typename Prepare, typename Op>
+static Result measure(const char* name, uint iterations, Prepare&& prepare, Op&& op) {
+	using clock = std::chrono::steady_clock;
+	Result result { name, {}, 0 };
+
+	fprintf(stderr, "%-20s", name);
+
+	for (uint i = 0; i < iterations; i++) {
+		prepare();
+
+		auto start = clock::now();
+		result.bytes = op();
+		result.times.push_back(std::chrono::duration<double, std::milli>(clock::now() - start).count());
+	}
+
+	fprintf(stderr, "%10.2f ms\n", *std::ranges::min_element(result.times));
+	return result;
+}
+
+template <typename Op>
+static Result measure(const char* name, uint iterations, Op&& op) {
+	return measure(name, iterations, [] {}, std::forward<Op>(op));
+}
+
+static void printJSON(const Config& cfg, const std::vector<Result>& results) {
+	printf("{\n");
+	printf("\t\"version\": \"%s\",\n", manatools::versionString);
+	printf("\t\"config\": {\n");
+	printf("\t\t\"programs\": %u,\n", cfg.programs);
+	printf("\t\t\"layers\": %u,\n", cfg.layers);
+	printf("\t\t\"splits\": %u,\n", cfg.splits);
+	printf("\t\t\"tone_samples\": %u,\n", cfg.toneSamples);
+	printf("\t\t\"sequences\": %u,\n", cfg.sequences);
+	printf("\t\t\"messages\": %u,\n", cfg.messages);
+	printf("\t\t\"repeats\": %g,\n", cfg.repeats);
+	printf("\t\t\"iterations\": %u,\n", cfg.iterations);
+	printf("\t\t\"seed\": %u\n", cfg.seed);
+	printf("\t},\n");
+	printf("\t\"results\": [\n");
+
+	for (size_t r = 0; r < results.size(); r++) {
+		const auto& result = results[r];
+		auto sorted = result.times;
+		std::ranges::sort(sorted);
+
+		double min = sorted.front();
+		double median = sorted[sorted.size() / 2];
+		double mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+		double mbps = result.bytes / (1024.0 * 1024.0) / (min / 1000.0);
+
+		printf(
+			"\t\t{ \"name\": \"%s\", \"min_ms\": %.3f, \"median_ms\": %.3f, \"mean_ms\": %.3f, \"bytes\": %zu, \"mib_per_s\": %.2f }%s\n",
+			result.name.c_str(),
+			min,
+			median,
+			mean,
+			result.bytes,
+			mbps,
+			r + 1 < results.size() ? "," : ""
+		);
+	}
+
+	printf("\t]\n");
+	printf("}\n");
+}
+
+static std::vector<Result> run(const Config& cfg, const fs::path& dir) {
+	std::vector<Result> results;
+	std::mt19937 rng(cfg.seed);
+
+	fprintf(stderr, "Generating data...\n");
+
+	auto mpbBank = makeMPB(cfg, rng);
+	auto osbBank = makeOSB(cfg, rng);
+	auto msbBank = makeMSB(cfg, rng);
+
+	fs::path mpbPath = dir / "manatools_bench.mpb";
+	fs::path osbPath = dir / "manatools_bench.osb";
+	fs::path msbPath = dir / "manatools_bench.msb";
+	fs::path mltPath = dir / "manatools_bench.mlt";
+	fs::path sf2Path = dir / "manatools_bench.sf2";
+
+	uint n = cfg.iterations;
+
+	// Saves come first so the loads have something to work with
+	results.push_back(measure("mpb.save", n, [&] { mpbBank.save(mpbPath); return fs::file_size(mpbPath); }));
+	results.push_back(measure("mpb.load", n, [&] { mpb::load(mpbPath); return fs::file_size(mpbPath); }));
+	results.push_back(measure("mpb.loadMapped", n, [&] { mpb::loadMapped(mpbPath); return fs::file_size(mpbPath); }));
+
+	results.push_back(measure("osb.save", n, [&] { osbBank.save(osbPath); return fs::file_size(osbPath); }));
+	results.push_back(measure("osb.load", n, [&] { osb::load(osbPath); return fs::file_size(osbPath); }));
+
+	results.push_back(measure("msb.save", n, [&] { msbBank.save(msbPath); return fs::file_size(msbPath); }));
+	results.push_back(measure("msb.load", n, [&] { msb::load(msbPath); return fs::file_size(msbPath); }));
+
+	auto mltFile = makeMLT(msbPath, mpbPath, osbPath);
+	results.push_back(measure("mlt.save", n, [&] { mltFile.save(mltPath); return fs::file_size(mltPath); }));
+	results.push_back(measure("mlt.load", n, [&] { mlt::load(mltPath); return fs::file_size(mltPath); }));
+	results.push_back(measure("mlt.loadMapped", n, [&] { mlt::loadMapped(mltPath); return fs::file_size(mltPath); }));
+
+	// Untouched units are written straight from the mapping
+	fs::path mltCopyPath = dir / "manatools_bench_copy.mlt";
+	auto mappedMLT = mlt::loadMapped(mltPath);
+	results.push_back(measure("mlt.saveMapped", n, [&] { mappedMLT.save(mltCopyPath); return fs::file_size(mltCopyPath); }));
+
+	std::vector<msd::MSD> sequences;
+	results.push_back(measure("msd.parse", n, [&] { sequences.clear(); }, [&] {
+		size_t bytes = 0;
+		for (auto& sequence : msbBank.sequences) {
+			io::DynBufIO io(sequence.data);
+			sequences.push_back(msd::load(io));
+			bytes += sequence.data.size();
+		}
+		return bytes;
+	}));
+
+	results.push_back(measure("msd.compress", n, [&] {
+		size_t bytes = 0;
+		for (auto& seq : sequences) {
+			std::vector<u8> out;
+			io::DynBufIO io(out);
+			seq.save(io, true);
+			bytes += out.size();
+		}
+		return bytes;
+	}));
+
+	results.push_back(measure("midi.export", n, [&] {
+		size_t bytes = 0;
+		for (auto& sequence : msbBank.sequences) {
+			io::DynBufIO in(sequence.data);
+			msd::Reader seq(in);
+
+			std::vector<u8> out;
+			io::DynBufIO io(out);
+			msd::toMIDI(seq).save(io);
+			bytes += out.size();
+		}
+		return bytes;
+	}));
+
+	results.push_back(measure("sf2.export", n, [&] {
+		sf2::fromMPB(mpbBank, "bench").Write(sf2Path.string());
+		return fs::file_size(sf2Path);
+	}));
+
+	// Encoding gives tones new data, so copies of the originals can be encoded over and over
+	std::vector<tone::Tone> originals;
+	size_t pcmBytes = 0;
+
+	for (const auto& program : mpbBank.programs) {
+		for (const auto& layer : program.layers) {
+			if (!layer)
+				continue;
+
+			for (const auto& split : layer->splits) {
+				originals.push_back(split.tone);
+				pcmBytes += split.tone.data->size();
+			}
+		}
+	}
+
+	std::vector<tone::Tone> tones;
+	std::vector<tone::Tone*> tonePtrs;
+
+	auto resetTones = [&] {
+		tones = originals;
+		tonePtrs.clear();
+		for (auto& t : tones)
+			tonePtrs.push_back(&t);
+	};
+
+	results.push_back(measure("adpcm.encode", n, resetTones, [&] {
+		tone::toADPCM(tonePtrs);
+		return pcmBytes;
+	}));
+
+	results.push_back(measure("adpcm.decode", n, [&] {
+		std::vector<s16> pcm;
+		for (const auto& t : tones) {
+			pcm.resize(t.samples());
+			tone::Decoder decoder(&t);
+			decoder.decode(pcm);
+		}
+		return pcmBytes;
+	}));
+
+	for (const auto& path : { mpbPath, osbPath, msbPath, mltPath, mltCopyPath, sf2Path })
+		fs::remove(path);
+
+	return results;
+}
+
+static bool parseArg(const char* arg, const char* value, Config& cfg) {
+	auto uintArg = [&](const char* name, uint& out) {
+		if (strcmp(arg, name))
+			return false;
+		out = std::stoul(value);
+		return true;
+	};
+
+	if (!strcmp(arg, "--repeats")) {
+		cfg.repeats = std::clamp(std::stod(value), 0.0, 1.0);
+		return true;
+	}
+
+	return uintArg("--programs", cfg.programs) ||
+	       uintArg("--layers", cfg.layers) ||
+	       uintArg("--splits", cfg.splits) ||
+	       uintArg("--tone-samples", cfg.toneSamples) ||
+	       uintArg("--sequences", cfg.sequences) ||
+	       uintArg("--messages", cfg.messages) ||
+	       uintArg("--iterations", cfg.iterations) ||
+	       uintArg("--seed", cfg.seed);
+}
+
+int main(int argc, char** argv) {
+	Config cfg;
+	fs::path dir = fs::temp_directory_path();
+
+	try {
+		for (int i = 1; i < argc; i++) {
+			if (!strcmp(argv[i], "--help"))
+				goto invalid;
+
+			if (i + 1 >= argc)
+				goto invalid;
+
+			if (!strcmp(argv[i], "--dir")) {
+				dir = argv[++i];
+			} else if (!parseArg(argv[i], argv[i + 1], cfg)) {
+				goto invalid;
+			} else {
+				i++;
+			}
+		}
+	} catch (const std::logic_error&) {
+		goto invalid;
+	}
+
+	cfg.layers = std::clamp<uint>(cfg.layers, 1, mpb::MAX_LAYERS);
+	cfg.splits = std::clamp<uint>(cfg.splits, 1, mpb::MAX_SPLITS);
+	cfg.programs = std::clamp<uint>(cfg.programs, 1, mpb::MAX_PROGRAMS);
+	cfg.iterations = std::max(cfg.iterations, 1u);
+
+	try {
+		printJSON(cfg, run(cfg, dir));
+	} catch (const std::runtime_error& err) {
+		fprintf(stderr, "An error occurred: %s\n", err.what());
+		return 1;
+	}
+
+	return 0;
+
+invalid:
+	fprintf(
+		stderr,
+		"manatools_bench - manatools benchmark suite [version %s]\n"
+		"\n"
+		"Usage: %s [options]\n"
+		"\n"
+		"Options:\n"
+		"    --programs <n>      Programs per MPB/OSB bank (default 64, max 128)\n"
+		"    --layers <n>        Layers per MPB program (default 2, max 4)\n"
+		"    --splits <n>        Splits per MPB layer (default 8, max 128)\n"
+		"    --tone-samples <n>  Samples per tone (default 22050)\n"
+		"    --sequences <n>     Sequences in the MSB (default 16)\n"
+		"    --messages <n>      Messages per sequence (default 4000)\n"
+		"    --repeats <0-1>     How often sequences repeat earlier phrases, which\n"
+		"                        become references when saved (default 0.5)\n"
+		"    --iterations <n>    Times to run each benchmark (default 5)\n"
+		"    --seed <n>          Seed for generating data (default 0)\n"
+		"    --dir <path>        Scratch directory (default: system temp directory)\n"
+		"\n"
+		"Results are written to stdout as JSON, with the minimum, median and mean time\n"
+		"of every benchmark in milliseconds. Run the same options against two builds\n"
+		"and compare the output to see what changed.\n",
+		manatools::versionString,
+		argv[0]
+	);
+	return 1;
+}
@@ -1,42 +1,75 @@
 #include <algorithm>
 #include <array>
 #include <cassert>
+#include <cstdarg>
 #include <cstdio>
 #include <cstring>
+#include <iterator>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
 
 #include <manatools/filesystem.hpp>
 #include <manatools/io.hpp>
+#include <manatools/threadpool.hpp>
 #include <manatools/version.hpp>
 #include <mio/mmap.hpp>
 
-#define BEGIN_END(c) std::begin(c), std::end(c)
 #define TRY_RET(cond) if (cond) return;
 
 namespace fs = manatools::fs;
 namespace io = manatools::io;
 
-constexpr u8 MLT_FOURCC[4] = {'S', 'M', 'L', 'T'};
-constexpr u8 MPB_FOURCC[4] = {'S', 'M', 'P', 'B'};
-constexpr u8 MDB_FOURCC[4] = {'S', 'M', 'D', 'B'};
-constexpr u8 MSB_FOURCC[4] = {'S', 'M', 'S', 'B'};
-constexpr u8 OSB_FOURCC[4] = {'S', 'O', 'S', 'B'};
-constexpr u8 FPB_FOURCC[4] = {'S', 'F', 'P', 'B'};
-constexpr u8 FOB_FOURCC[4] = {'S', 'F', 'O', 'B'};
 constexpr u8 ENDB_FOURCC[4] = {'E', 'N', 'D', 'B'};
 
-template <typename It1, typename It2, typename Callback>
-void searchAll(It1 first, It1 last, It2 s_first, It2 s_last, Callback cb) {
-	auto it = first;
-	while (it < last) {
-		it = std::search(it, last, s_first, s_last);
-
-		if (it == last)
-			break;
-
-		cb(it);
-
-		it += std::distance(s_first, s_last);
-	}
+struct Signature {
+	u8 fourCC[4];
+	const char* name;
+	bool hasFooter; // Everything but MLT ends with ENDB
+};
+
+// In the order results are listed
+constexpr std::array<Signature, 7> SIGNATURES = {{
+	{ {'S', 'M', 'L', 'T'}, "MLT", false },
+	{ {'S', 'M', 'P', 'B'}, "MPB", true  },
+	{ {'S', 'M', 'D', 'B'}, "MDB", true  },
+	{ {'S', 'M', 'S', 'B'}, "MSB", true  },
+	{ {'S', 'O', 'S', 'B'}, "OSB", true  },
+	{ {'S', 'F', 'P', 'B'}, "FPB", true  },
+	{ {'S', 'F', 'O', 'B'}, "FOB", true  }
+}};
+
+/**
+ * Every signature starts with the same byte, so the search only has to look for that with
+ * memchr (which libc vectorises) and check the rest wherever it turns up, finding all of
+ * them in one pass.
+ */
+constexpr u8 FIRST_BYTE = 'S';
+static_assert(std::ranges::all_of(SIGNATURES, [](const Signature& s) { return s.fourCC[0] == FIRST_BYTE; }));
+
+// Images are split into chunks this big to search in parallel
+constexpr size_t CHUNK_SIZE = 8 * 1024 * 1024;
+
+struct Match {
+	uintptr_t pos;
+	size_t sig;
+};
+
+// A line for stdout or stderr, kept so results print in order no matter what finishes first
+struct Message {
+	bool error;
+	std::string text;
+};
+
+static void addMessage(std::vector<Message>& messages, bool error, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	char buf[256];
+	vsnprintf(buf, std::size(buf), format, args);
+	va_end(args);
+
+	messages.push_back({ error, buf });
 }
 
 void strToLower(char* str) {
@@ -55,133 +88,233 @@ fs::path makeFileName(const fs::path& inPath, uintptr_t pos, const char* name) {
 	return inPath.stem().concat(nameSuffix);
 }
 
-void findFiles(const fs::path& inPath, const fs::path& outPath = fs::path()) {
-	// a ummap_source would be more suitable, but a SpanIO isn't const
-	mio::ummap_sink inSink(inPath.string());
-	io::SpanIO inIO(inSink, true, false);
+// Finds every signature starting in [begin, end)
+static void searchChunk(std::span<const u8> data, size_t begin, size_t end, std::vector<Match>& matches) {
+	if (data.size() < 4)
+		return;
 
-	bool dryRun = outPath.empty();
+	// Signatures may run over the end of the chunk, but not the data
+	end = std::min(end, data.size() - 3);
 
-	auto checkCommon = [&](auto it, const char* name) {
-		uintptr_t startPos = it - inSink.begin();
+	const u8* base = data.data();
+	const u8* cur = base + begin;
+	const u8* last = base + end;
 
-		// EOF is not expected during init, but is later
-		inIO.eofErrors(true);
-		inIO.jump(startPos);
-		inIO.forward(4); // jump over header FourCC
-		inIO.eofErrors(false);
+	while (cur < last) {
+		cur = static_cast<const u8*>(memchr(cur, FIRST_BYTE, last - cur));
+		if (!cur)
+			break;
 
-		u32 version;
-		TRY_RET(!inIO.readU32LE(&version));
-		if (version != 1 && version != 2) {
-			// zx should consistently be suitable for printing a uintptr_t I'd hope
-			fprintf(stderr, "[%08zx] %s FourCC found, but unknown/invalid version encountered.\n", startPos, name);
-			return;
+		for (size_t s = 0; s < SIGNATURES.size(); s++) {
+			if (!memcmp(cur, SIGNATURES[s].fourCC, 4)) {
+				matches.push_back({ uintptr_t(cur - base), s });
+				break;
+			}
 		}
 
-		u32 fileSize;
-		u8 endCC[4];
-		TRY_RET(!inIO.readU32LE(&fileSize));
-		TRY_RET(!inIO.jump(startPos + fileSize));
-		TRY_RET(!inIO.backward(4));
-		TRY_RET(!inIO.readArrT(endCC));
+		cur++;
+	}
+}
 
-		if (memcmp(ENDB_FOURCC, endCC, 4)) {
-			fprintf(stderr, "[%08zx] %s FourCC found, but couldn't find ENDB after supposed fileSize.\n", startPos, name);
-			return;
-		}
+static void checkCommon(io::SpanIO& inIO, uintptr_t startPos, const char* name, const fs::path& inPath,
+                        const fs::path& outPath, std::vector<Message>& messages) {
+	// EOF is not expected during init, but is later
+	inIO.eofErrors(true);
+	inIO.jump(startPos);
+	inIO.forward(4); // jump over header FourCC
+	inIO.eofErrors(false);
+
+	u32 version;
+	TRY_RET(!inIO.readU32LE(&version));
+	if (version != 1 && version != 2) {
+		// zx should consistently be suitable for printing a uintptr_t I'd hope
+		addMessage(messages, true, "[%08zx] %s FourCC found, but unknown/invalid version encountered.\n", startPos, name);
+		return;
+	}
 
-		printf("[%08zx] Found %s, size=%u\n", startPos, name, fileSize);
+	u32 fileSize;
+	u8 endCC[4];
+	TRY_RET(!inIO.readU32LE(&fileSize));
+	TRY_RET(!inIO.jump(startPos + fileSize));
+	TRY_RET(!inIO.backward(4));
+	TRY_RET(!inIO.readArrT(endCC));
 
-		if (!dryRun) {
-			fs::path fileName = makeFileName(inPath, startPos, name);
-			io::FileIO outFile(outPath / fileName, "wb");
-			outFile.writeSpan(inIO.span().subspan(startPos, fileSize));
-		}
-	};
-
-	// More error prone, as there isn't a footer I can easily check against
-	searchAll(BEGIN_END(inSink), BEGIN_END(MLT_FOURCC), [&](auto it) {
-		uintptr_t startPos = it - inSink.begin();
-
-		inIO.eofErrors(true);
-		inIO.jump(startPos);
-		inIO.forward(4);
-		inIO.eofErrors(false);
-
-		u32 numUnits;
-		TRY_RET(!inIO.forward(4)); // perhaps version, but weird
-		TRY_RET(!inIO.readU32LE(&numUnits));
-		TRY_RET(!inIO.forward(20));
-
-		u32 highPtr = 0;
-		u32 highSize = 0;
-
-		/**
-		 * TODO: Don't check for failure every read, and only later?
-		 * Could perhaps remove the need for this dumb macro
-		 */
-		for (u32 i = 0; i < numUnits; i++) {
-			u32 filePtr, fileSize;
-			TRY_RET(!inIO.forward(4 * 4)); // Skip FourCC, bank, and AICA fields
-			TRY_RET(!inIO.readU32LE(&filePtr));
-			TRY_RET(!inIO.readU32LE(&fileSize));
-			TRY_RET(!inIO.forward(8));
-
-			if (filePtr != 0xFFFFFFFF && fileSize != 0xFFFFFFFF) {
-				if (filePtr > highPtr) {
-					highPtr = filePtr;
-					highSize = fileSize;
-				}
+	if (memcmp(ENDB_FOURCC, endCC, 4)) {
+		addMessage(messages, true, "[%08zx] %s FourCC found, but couldn't find ENDB after supposed fileSize.\n", startPos, name);
+		return;
+	}
+
+	addMessage(messages, false, "[%08zx] Found %s, size=%u\n", startPos, name, fileSize);
+
+	if (!outPath.empty()) {
+		fs::create_directories(outPath);
+		fs::path fileName = makeFileName(inPath, startPos, name);
+		io::FileIO outFile(outPath / fileName, "wb");
+		outFile.writeSpan(inIO.span().subspan(startPos, fileSize));
+	}
+}
+
+// More error prone, as there isn't a footer I can easily check against
+static void checkMLT(io::SpanIO& inIO, uintptr_t startPos, const fs::path& inPath,
+                     const fs::path& outPath, std::vector<Message>& messages) {
+	inIO.eofErrors(true);
+	inIO.jump(startPos);
+	inIO.forward(4);
+	inIO.eofErrors(false);
+
+	u32 numUnits;
+	TRY_RET(!inIO.forward(4)); // perhaps version, but weird
+	TRY_RET(!inIO.readU32LE(&numUnits));
+	TRY_RET(!inIO.forward(20));
+
+	u32 highPtr = 0;
+	u32 highSize = 0;
+
+	/**
+	 * TODO: Don't check for failure every read, and only later?
+	 * Could perhaps remove the need for this dumb macro
+	 */
+	for (u32 i = 0; i < numUnits; i++) {
+		u32 filePtr, fileSize;
+		TRY_RET(!inIO.forward(4 * 4)); // Skip FourCC, bank, and AICA fields
+		TRY_RET(!inIO.readU32LE(&filePtr));
+		TRY_RET(!inIO.readU32LE(&fileSize));
+		TRY_RET(!inIO.forward(8));
+
+		if (filePtr != 0xFFFFFFFF && fileSize != 0xFFFFFFFF) {
+			if (filePtr > highPtr) {
+				highPtr = filePtr;
+				highSize = fileSize;
 			}
 		}
+	}
 
-		printf("[%08zx] Found MLT, size=%u\n", startPos, highSize);
+	addMessage(messages, false, "[%08zx] Found MLT, size=%u\n", startPos, highSize);
 
-		if (!dryRun) {
-			fs::path fileName = makeFileName(inPath, startPos, "MLT");
-			io::FileIO outFile(outPath / fileName, "wb");
-			outFile.writeSpan(inIO.span().subspan(startPos, highPtr + highSize));
-		}
-	});
+	if (!outPath.empty()) {
+		fs::create_directories(outPath);
+		fs::path fileName = makeFileName(inPath, startPos, "MLT");
+		io::FileIO outFile(outPath / fileName, "wb");
+		outFile.writeSpan(inIO.span().subspan(startPos, highPtr + highSize));
+	}
+}
 
-	searchAll(BEGIN_END(inSink), BEGIN_END(MPB_FOURCC), [&](auto it) {
-		checkCommon(it, "MPB");
-	});
+// Leave outPath empty for a dry run
+std::vector<Message> findFiles(const fs::path& inPath, const fs::path& outPath = fs::path()) {
+	auto& pool = manatools::ThreadPool::shared();
 
-	searchAll(BEGIN_END(inSink), BEGIN_END(MDB_FOURCC), [&](auto it) {
-		checkCommon(it, "MDB");
-	});
+	mio::ummap_source inSource(inPath.string());
+	std::span<const u8> data(inSource.data(), inSource.size());
 
-	searchAll(BEGIN_END(inSink), BEGIN_END(MSB_FOURCC), [&](auto it) {
-		checkCommon(it, "MSB");
+	// Search every chunk at once, then put them back in order
+	size_t numChunks = (data.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	std::vector<std::vector<Match>> chunkMatches(numChunks);
+
+	pool.parallelFor(numChunks, [&](size_t c) {
+		searchChunk(data, c * CHUNK_SIZE, (c + 1) * CHUNK_SIZE, chunkMatches[c]);
 	});
 
-	searchAll(BEGIN_END(inSink), BEGIN_END(OSB_FOURCC), [&](auto it) {
-		checkCommon(it, "OSB");
+	std::vector<Match> matches;
+	for (const auto& m : chunkMatches)
+		matches.insert(matches.end(), m.begin(), m.end());
+
+	// Listed by type then position, as they always have been
+	std::stable_sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) {
+		return a.sig < b.sig;
 	});
 
-	searchAll(BEGIN_END(inSink), BEGIN_END(FPB_FOURCC), [&](auto it) {
-		checkCommon(it, "FPB");
+	std::vector<std::vector<Message>> results(matches.size());
+
+	pool.parallelFor(matches.size(), [&](size_t i) {
+		// SpanIO isn't const, but it's only read from here
+		io::SpanIO inIO({ const_cast<u8*>(data.data()), data.size() }, true, false);
+
+		const auto& sig = SIGNATURES[matches[i].sig];
+		if (sig.hasFooter) {
+			checkCommon(inIO, matches[i].pos, sig.name, inPath, outPath, results[i]);
+		} else {
+			checkMLT(inIO, matches[i].pos, inPath, outPath, results[i]);
+		}
 	});
 
-	searchAll(BEGIN_END(inSink), BEGIN_END(FOB_FOURCC), [&](auto it) {
-		checkCommon(it, "FOB");
+	std::vector<Message> messages;
+	for (auto& r : results)
+		std::move(r.begin(), r.end(), std::back_inserter(messages));
+
+	return messages;
+}
+
+static void printMessages(const std::vector<Message>& messages) {
+	for (const auto& msg : messages)
+		fputs(msg.text.c_str(), msg.error ? stderr : stdout);
+}
+
+/**
+ * Every file under (inDir) is searched at once, with each one's chunks and matches being
+ * further work for the pool to share out. Results are printed per file as each finishes.
+ * Extracted files go in the same place relative to (outPath) as they were to (inDir).
+ */
+void findFilesRecursive(const fs::path& inDir, const fs::path& outPath = fs::path()) {
+	std::vector<fs::path> files;
+	for (const auto& entry : fs::recursive_directory_iterator(inDir, fs::directory_options::skip_permission_denied)) {
+		if (entry.is_regular_file() && entry.file_size() >= 4)
+			files.push_back(entry.path());
+	}
+
+	std::sort(files.begin(), files.end());
+
+	std::mutex printMutex;
+
+	manatools::ThreadPool::shared().parallelFor(files.size(), [&](size_t i) {
+		const auto& file = files[i];
+		std::vector<Message> messages;
+		std::string failure;
+
+		try {
+			fs::path fileOutPath;
+			if (!outPath.empty())
+				fileOutPath = outPath / fs::relative(file.parent_path(), inDir);
+
+			messages = findFiles(file, fileOutPath);
+		} catch (const std::runtime_error& err) {
+			failure = err.what();
+		}
+
+		if (messages.empty() && failure.empty())
+			return;
+
+		std::lock_guard lock(printMutex);
+		printf("%s:\n", file.string().c_str());
+		printMessages(messages);
+
+		if (!failure.empty())
+			fprintf(stderr, "An error occurred: %s\n", failure.c_str());
+
+		putchar('\n');
+		fflush(stdout);
 	});
 }
 
+static void find(const fs::path& inPath, const fs::path& outPath = fs::path()) {
+	if (fs::is_directory(inPath)) {
+		findFilesRecursive(inPath, outPath);
+	} else {
+		printMessages(findFiles(inPath, outPath));
+	}
+}
+
 int main(int argc, char** argv) {
 	try {
 		if (argc < 3)
 			goto invalid;
 
 		if (!strcmp(argv[1], "list")) {
-			findFiles(argv[2]);
+			find(argv[2]);
 		} else if (!strcmp(argv[1], "extract")) {
 			if (argc < 4)
 				goto invalid;
 
-			findFiles(argv[2], argv[3]);
+			find(argv[2], argv[3]);
 		} else {
 			goto invalid;
 		}
@@ -198,12 +331,13 @@ invalid:
 		"findtool - Dreamcast audio & music file discovery tool [version %s]\n"
 		"https://github.com/dakrk/manatools\n"
 		"\n"
-		"Usage: %s list <in.bin>\n"
-		"       %s extract <in.bin> <outdir>\n"
+		"Usage: %s list <in.bin|indir>\n"
+		"       %s extract <in.bin|indir> <outdir>\n"
 		"\n"
 		"This tool looks through a larger file to find valid files that are supported by\n"
 		"manatools nested inside it. This may help if you're dealing with otherwise\n"
 		"unknown packed formats.\n"
+		"If given a directory, every file inside it is searched, including subdirectories.\n"
 		"\n"
 		"NOTE: This is not a magic tool that will always find everything and extract\n"
 		"perfectly. Some things may be compressed, or data may not be stored\n"
@@ -13,6 +13,7 @@
 #include <QScreen>
 #include <QSlider>
 #include <manatools/io.hpp>
+#include <guicommon/background.hpp>
 #include <guicommon/CSV.hpp>
 #include <guicommon/CursorOverride.hpp>
 #include <guicommon/utils.hpp>
@@ -184,17 +185,21 @@ MainWindow::MainWindow(QWidget* parent) :
 }
 
 bool MainWindow::loadFile(const QString& path) {
-	CursorOverride cursor(Qt::WaitCursor);
+	manatools::fob::Bank loaded;
 
 	try {
-		bank = manatools::fob::load(path.toStdWString());
+		bool done = runInBackground(this, tr("Loading FX output bank..."), [&](const manatools::Progress& progress) {
+			loaded = manatools::fob::load(path.toStdWString(), progress);
+		});
+
+		if (!done)
+			return false;
 	} catch (const std::runtime_error& err) {
-		cursor.restore();
 		QMessageBox::warning(this, tr("Open FX output bank file"), tr("Failed to load FX output bank file: %1").arg(err.what()));
 		return false;
 	}
 
-	cursor.restore();
+	bank = std::move(loaded);
 
 	if (!loadMapFile(path % ".csv")) {
 		loadMapFile(getOutPath(path, true) % "/manatools_fob_map.csv");
@@ -215,7 +220,6 @@ bool MainWindow::loadFile(const QString& path) {
 
 bool MainWindow::saveFile(const QString& path) {
 	bool doSaveMappings = saveMappingsDialog();
-	CursorOverride cursor(Qt::WaitCursor);
 
 	auto index = list->currentIndex();
 	if (index.isValid()) {
@@ -223,9 +227,13 @@ bool MainWindow::saveFile(const QString& path) {
 	}
 
 	try {
-		bank.save(path.toStdWString());
+		bool done = runInBackground(this, tr("Saving FX output bank..."), [&](const manatools::Progress& progress) {
+			bank.save(path.toStdWString(), progress);
+		});
+
+		if (!done)
+			return false;
 	} catch (const std::runtime_error& err) {
-		cursor.restore();
 		QMessageBox::warning(this, tr("Save FX output bank file"), tr("Failed to save FX output bank file: %1").arg(err.what()));
 		return false;
 	}
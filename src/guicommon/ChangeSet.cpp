@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <utility>
+#include "ChangeSet.hpp"
+
+// Anything a view would draw differently
+static constexpr int WATCHED_ROLES[] = {
+	Qt::DisplayRole,
+	Qt::DecorationRole,
+	Qt::ToolTipRole,
+	Qt::FontRole,
+	Qt::BackgroundRole,
+	Qt::ForegroundRole,
+	Qt::CheckStateRole
+};
+
+void ChangeSet::add(int row, int column) {
+	cells[row].insert(column);
+}
+
+void ChangeSet::addRow(int row, int firstColumn, int lastColumn) {
+	if (lastColumn < 0)
+		lastColumn = model->columnCount(parent) - 1;
+
+	auto& columns = cells[row];
+	for (int c = firstColumn; c <= lastColumn; c++)
+		columns.insert(c);
+}
+
+void ChangeSet::watchRow(int row) {
+	if (watched.contains(row))
+		return;
+
+	auto& columns = watched[row];
+	for (int c = 0; c < model->columnCount(parent); c++)
+		columns.push_back(snapshot(row, c));
+}
+
+std::vector<QVariant> ChangeSet::snapshot(int row, int column) const {
+	std::vector<QVariant> values;
+	auto index = model->index(row, column, parent);
+
+	for (int role : WATCHED_ROLES)
+		values.push_back(index.data(role));
+
+	return values;
+}
+
+bool ChangeSet::commit(const QList<int>& roles) {
+	for (const auto& [row, columns] : watched) {
+		// Rows may have gone since, or columns with them
+		if (row >= model->rowCount(parent))
+			continue;
+
+		int numColumns = std::min<int>(columns.size(), model->columnCount(parent));
+		for (int c = 0; c < numColumns; c++) {
+			if (snapshot(row, c) != columns[c])
+				add(row, c);
+		}
+	}
+
+	watched.clear();
+
+	if (cells.empty())
+		return false;
+
+	/**
+	 * Each row's columns become runs of consecutive ones, and consecutive rows with the
+	 * exact same runs become one block, so i.e. a column changing all the way down is one
+	 * rectangle and not one per row.
+	 */
+	using Runs = std::vector<std::pair<int, int>>;
+
+	auto emitBlock = [&](int firstRow, int lastRow, const Runs& runs) {
+		for (const auto& [first, last] : runs) {
+			emit model->dataChanged(
+				model->index(firstRow, first, parent),
+				model->index(lastRow, last, parent),
+				roles
+			);
+		}
+	};
+
+	int blockStart = -1;
+	int prevRow = -1;
+	Runs blockRuns;
+
+	for (const auto& [row, columns] : cells) {
+		Runs runs;
+		for (int c : columns) {
+			if (!runs.empty() && runs.back().second == c - 1)
+				runs.back().second = c;
+			else
+				runs.push_back({ c, c });
+		}
+
+		if (blockStart >= 0 && row == prevRow + 1 && runs == blockRuns) {
+			prevRow = row;
+			continue;
+		}
+
+		if (blockStart >= 0)
+			emitBlock(blockStart, prevRow, blockRuns);
+
+		blockStart = row;
+		prevRow = row;
+		blockRuns = std::move(runs);
+	}
+
+	emitBlock(blockStart, prevRow, blockRuns);
+
+	cells.clear();
+	return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <QAbstractItemModel>
+#include <QList>
+#include <QPersistentModelIndex>
+#include <QVariant>
+#include <map>
+#include <set>
+#include <vector>
+#include "common.hpp"
+
+/**
+ * Collects which cells of a model changed, so views only get dataChanged for those (in as
+ * few rectangles as it takes) rather than whole rows or a model reset, which throws away
+ * the selection and has views lay everything out again.
+ *
+ * Cells can be added directly by whatever knows what it changed, or rows can be watched
+ * before something changes them behind the model's back (i.e. an editor dialog), in which
+ * case commit works out which of their cells now look any different.
+ */
+class GUICOMMON_EXPORT ChangeSet {
+public:
+	explicit ChangeSet(QAbstractItemModel* model, const QModelIndex& parent = {}) :
+		model(model), parent(parent) {}
+
+	void add(int row, int column);
+
+	// (lastColumn) of -1 is the last column
+	void addRow(int row, int firstColumn = 0, int lastColumn = -1);
+
+	// Remembers what (row) looks like now, to compare against on commit
+	void watchRow(int row);
+
+	/**
+	 * Emits dataChanged for everything added, and any watched cells that look different,
+	 * then starts afresh. Returns whether there was anything to emit.
+	 */
+	bool commit(const QList<int>& roles = { Qt::DisplayRole, Qt::EditRole });
+
+private:
+	std::vector<QVariant> snapshot(int row, int column) const;
+
+	QAbstractItemModel* model;
+	QPersistentModelIndex parent;
+
+	std::map<int, std::set<int>> cells;                        // Row to columns
+	std::map<int, std::vector<std::vector<QVariant>>> watched; // Row to each column's roles
+};
@@ -1,8 +1,10 @@
+#include <utility>
 #include "ChannelSelectDialog.hpp"
 
 ChannelSelectDialog::ChannelSelectDialog(uint channels, QWidget* parent) :
 	QDialog(parent),
-	channel(0)
+	channel(0),
+	mixDown(false)
 {
 	setFixedSize(300, 250);
 
@@ -20,6 +22,8 @@ ChannelSelectDialog::ChannelSelectDialog(uint channels, QWidget* parent) :
 		list->addItem(QString::number(i));
 	}
 
+	list->addItem(tr("All (mixed down)"));
+
 	list->setCurrentRow(0);
 	
 	mainLayout->addWidget(text);
@@ -28,8 +32,9 @@ ChannelSelectDialog::ChannelSelectDialog(uint channels, QWidget* parent) :
 	
 	setLayout(mainLayout);
 
-	connect(list, &QListWidget::currentRowChanged, this, [this](int currentRow) {
-		channel = currentRow > 0 ? currentRow : 0;
+	connect(list, &QListWidget::currentRowChanged, this, [this, channels](int currentRow) {
+		mixDown = std::cmp_equal(currentRow, channels);
+		channel = currentRow > 0 && !mixDown ? currentRow : 0;
 	});
 
 	connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
@@ -13,6 +13,9 @@ public:
 	explicit ChannelSelectDialog(uint channels, QWidget* parent = nullptr);
 	uint channel;
 
+	// Set instead of (channel) when the user wants everything mixed down to mono
+	bool mixDown;
+
 private:
 	QVBoxLayout* mainLayout;
 	QLabel* text;
@@ -21,6 +21,15 @@ public:
 		restored = true;
 	}
 
+	// Puts it back after a restore, e.g. once a dialog in the middle of something's closed
+	void override(const QCursor& cursor) {
+		if (!restored)
+			return;
+
+		QApplication::setOverrideCursor(cursor);
+		restored = false;
+	}
+
 private:
 	bool restored = false;
 };
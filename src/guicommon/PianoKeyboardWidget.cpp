@@ -1,13 +1,151 @@
+#include <QKeyEvent>
+#include <QMouseEvent>
 #include <QPainter>
+#include <algorithm>
 #include "PianoKeyboardWidget.hpp"
 
 QSize PianoKeyboardWidget::minimumSizeHint() const {
 	return { 730, 40 };
 }
 
+void PianoKeyboardWidget::releaseAll() {
+	for (int key = 0; key < NUM_KEYS; key++) {
+		if (held_[key])
+			release(key);
+	}
+
+	mouseKey_ = -1;
+	keyboardHeld_.clear();
+}
+
+void PianoKeyboardWidget::press(int key, int velocity) {
+	if (key < 0 || key >= NUM_KEYS)
+		return;
+
+	held_[key] = true;
+	emit noteOn(key, velocity);
+	update();
+}
+
+void PianoKeyboardWidget::release(int key) {
+	if (key < 0 || key >= NUM_KEYS || !held_[key])
+		return;
+
+	held_[key] = false;
+	emit noteOff(key);
+	update();
+}
+
+// Louder the further down the key
+int PianoKeyboardWidget::velocityAt(int key, QPointF pos) const {
+	return std::clamp(1 + static_cast<int>(126 * pos.y() / keyHeight(key)), 1, 127);
+}
+
+void PianoKeyboardWidget::focusOutEvent(QFocusEvent* event) {
+	QWidget::focusOutEvent(event);
+	releaseAll();
+}
+
+int PianoKeyboardWidget::keyboardOffset(int qtKey) {
+	// Lower octave on the bottom two rows, upper octave on the top two
+	static constexpr int LOWER[] = {
+		Qt::Key_Z, Qt::Key_S, Qt::Key_X, Qt::Key_D, Qt::Key_C, Qt::Key_V,
+		Qt::Key_G, Qt::Key_B, Qt::Key_H, Qt::Key_N, Qt::Key_J, Qt::Key_M
+	};
+
+	static constexpr int UPPER[] = {
+		Qt::Key_Q, Qt::Key_2, Qt::Key_W, Qt::Key_3, Qt::Key_E, Qt::Key_R, Qt::Key_5,
+		Qt::Key_T, Qt::Key_6, Qt::Key_Y, Qt::Key_7, Qt::Key_U, Qt::Key_I, Qt::Key_9,
+		Qt::Key_O, Qt::Key_0, Qt::Key_P
+	};
+
+	if (auto it = std::ranges::find(LOWER, qtKey); it != std::end(LOWER))
+		return it - std::begin(LOWER);
+	if (auto it = std::ranges::find(UPPER, qtKey); it != std::end(UPPER))
+		return 12 + (it - std::begin(UPPER));
+
+	return -1;
+}
+
+void PianoKeyboardWidget::keyPressEvent(QKeyEvent* event) {
+	if (event->isAutoRepeat()) {
+		event->accept();
+		return;
+	}
+
+	switch (event->key()) {
+		case Qt::Key_PageUp:
+			keyboardBase_ = std::min(keyboardBase_ + 12, 96);
+			return;
+		case Qt::Key_PageDown:
+			keyboardBase_ = std::max(keyboardBase_ - 12, 0);
+			return;
+	}
+
+	int offset = keyboardOffset(event->key());
+	if (offset < 0 || keyboardHeld_.contains(event->key())) {
+		QWidget::keyPressEvent(event);
+		return;
+	}
+
+	int key = keyboardBase_ + offset;
+	keyboardHeld_.insert(event->key(), key);
+	press(key, 100);
+}
+
+void PianoKeyboardWidget::keyReleaseEvent(QKeyEvent* event) {
+	if (event->isAutoRepeat()) {
+		event->accept();
+		return;
+	}
+
+	auto it = keyboardHeld_.find(event->key());
+	if (it == keyboardHeld_.end()) {
+		QWidget::keyReleaseEvent(event);
+		return;
+	}
+
+	release(it.value());
+	keyboardHeld_.erase(it);
+}
+
+void PianoKeyboardWidget::mousePressEvent(QMouseEvent* event) {
+	QWidget::mousePressEvent(event);
+
+	if (event->button() != Qt::LeftButton)
+		return;
+
+	mouseKey_ = keyAt(event->position());
+	if (mouseKey_ >= 0)
+		press(mouseKey_, velocityAt(mouseKey_, event->position()));
+}
+
+// Dragging across the keys plays each one in turn
+void PianoKeyboardWidget::mouseMoveEvent(QMouseEvent* event) {
+	QWidget::mouseMoveEvent(event);
+
+	if (!(event->buttons() & Qt::LeftButton))
+		return;
+
+	int key = keyAt(event->position());
+	if (key == mouseKey_)
+		return;
+
+	release(mouseKey_);
+	mouseKey_ = key;
+
+	if (key >= 0)
+		press(key, velocityAt(key, event->position()));
+}
+
 void PianoKeyboardWidget::mouseReleaseEvent(QMouseEvent* event) {
 	QWidget::mouseReleaseEvent(event);
-	// TODO: not sure how to detect what key mouse is over and it's annoying me, ugh
+
+	if (event->button() != Qt::LeftButton)
+		return;
+
+	release(mouseKey_);
+	mouseKey_ = -1;
 }
 
 // Ideally this should only paint the difference (event.rect/region)
@@ -27,6 +165,9 @@ void PianoKeyboardWidget::paintEvent(QPaintEvent* event) {
 			QColor color = (i == baseKey_) ? BASE_KEY_COLOR : (i % 12 ? WHITE_KEY_COLOR : C_KEY_COLOR);
 			QColor borderColor = KEY_BORDER_COLOR;
 
+			if (held_[i])
+				color = HELD_KEY_COLOR;
+
 			if (i < keyRangeLow_ || i > keyRangeHigh_) {
 				color = color.darker(250);
 				borderColor = borderColor.darker(250);
@@ -45,6 +186,9 @@ void PianoKeyboardWidget::paintEvent(QPaintEvent* event) {
 		if (!keyIsWhite(i)) {
 			QColor color = (i == baseKey_) ? BASE_KEY_COLOR : BLACK_KEY_COLOR;
 
+			if (i < NUM_KEYS && held_[i])
+				color = QColor(HELD_KEY_COLOR).darker(150);
+
 			if (i < keyRangeLow_ || i > keyRangeHigh_) {
 				color = color.darker(250);
 			} else if (i == keyRangeLow_ || i == keyRangeHigh_) {
@@ -84,3 +228,26 @@ qreal PianoKeyboardWidget::keyX(int key) const {
 		return ((whiteKey + 1) * keyTypeWidth(true)) - (keyTypeWidth(false) / 2);
 	}
 }
+
+int PianoKeyboardWidget::keyAt(QPointF pos) const {
+	if (pos.y() < 0 || pos.y() >= height())
+		return -1;
+
+	// Black keys sit on top of the white ones, so they get first dibs
+	for (int pass = 0; pass < 2; pass++) {
+		bool white = pass == 1;
+		if (!white && pos.y() >= keyTypeHeight(false))
+			continue;
+
+		for (int key = 0; key < NUM_KEYS; key++) {
+			if (keyIsWhite(key) != white)
+				continue;
+
+			qreal x = keyX(key);
+			if (pos.x() >= x && pos.x() < x + keyTypeWidth(white))
+				return key;
+		}
+	}
+
+	return -1;
+}
@@ -1,7 +1,14 @@
 #pragma once
+#include <QHash>
 #include <QWidget>
+#include <bitset>
 #include "common.hpp"
 
+/**
+ * Playable as well as for show. Clicking a key plays it, louder the further down it's
+ * clicked, and the computer keyboard plays two octaves tracker style (Z/S/X... and
+ * Q/2/W...) so chords can be held, with Page Up/Down moving those octaves around.
+ */
 class GUICOMMON_EXPORT PianoKeyboardWidget : public QWidget {
 	Q_OBJECT
 public:
@@ -15,24 +22,22 @@ public:
 	static constexpr auto BASE_KEY_COLOR = Qt::red;
 	static constexpr auto C_KEY_COLOR = Qt::gray;
 	static constexpr auto KEY_BORDER_COLOR = Qt::darkGray;
+	static constexpr auto HELD_KEY_COLOR = Qt::cyan;
 
 	explicit PianoKeyboardWidget(QWidget* parent = nullptr) :
-		QWidget(parent),
-		keyRangeLow_(0),
-		keyRangeHigh_(NUM_KEYS),
-		baseKey_(60) {}
+		PianoKeyboardWidget(0, NUM_KEYS, 60, parent) {}
 
 	PianoKeyboardWidget(int low, int high, int base, QWidget* parent = nullptr) :
 		QWidget(parent),
 		keyRangeLow_(low),
 		keyRangeHigh_(high),
-		baseKey_(base) {}
+		baseKey_(base)
+	{
+		setFocusPolicy(Qt::ClickFocus);
+	}
 
 	PianoKeyboardWidget(QPair<int, int> range, int base, QWidget* parent = nullptr) :
-		QWidget(parent),
-		keyRangeLow_(range.first),
-		keyRangeHigh_(range.second),
-		baseKey_(base) {}
+		PianoKeyboardWidget(range.first, range.second, base, parent) {}
 
 	QSize minimumSizeHint() const override;
 
@@ -72,12 +77,39 @@ public:
 		return keyTypeHeight(keyIsWhite(key));
 	}
 
+	// Key under a point, or -1 if there isn't one
+	int keyAt(QPointF pos) const;
+
+	// Lets go of everything held, i.e. before the program being played changes
+	void releaseAll();
+
+signals:
+	void noteOn(int key, int velocity);
+	void noteOff(int key);
+
 protected:
+	void focusOutEvent(QFocusEvent* event) override;
+	void keyPressEvent(QKeyEvent* event) override;
+	void keyReleaseEvent(QKeyEvent* event) override;
+	void mouseMoveEvent(QMouseEvent* event) override;
+	void mousePressEvent(QMouseEvent* event) override;
 	void mouseReleaseEvent(QMouseEvent* event) override;
 	void paintEvent(QPaintEvent* event) override;
 
 private:
+	// Semitones above the bottom of the computer keyboard's range, or -1
+	static int keyboardOffset(int qtKey);
+
+	void press(int key, int velocity);
+	void release(int key);
+	int velocityAt(int key, QPointF pos) const;
+
 	int keyRangeLow_;
 	int keyRangeHigh_;
 	int baseKey_;
+
+	std::bitset<NUM_KEYS> held_;
+	int mouseKey_ = -1;
+	int keyboardBase_ = 48;
+	QHash<int, int> keyboardHeld_; // Qt key to the note it started, as the octave can move while it's held
 };
@@ -0,0 +1,202 @@
+#include <algorithm>
+
+#include "ProgramPlayer.hpp"
+
+ProgramPlayer::ProgramPlayer(QObject* parent) :
+	QObject(parent),
+	stream(nullptr),
+	events_(MAX_EVENTS)
+{
+	PaError err = Pa_OpenDefaultStream(
+		&stream,
+		0,
+		2,
+		paFloat32,
+		manatools::aica::SAMPLE_RATE,
+		paFramesPerBufferUnspecified,
+		&ProgramPlayer::paStreamCallbackThunk,
+		this
+	);
+
+	if (err != paNoError)
+		stream = nullptr;
+
+	// A few milliseconds is about as often as the callback makes room
+	backlogTimer_.setInterval(5);
+	connect(&backlogTimer_, &QTimer::timeout, this, &ProgramPlayer::flushBacklog);
+}
+
+ProgramPlayer::~ProgramPlayer() {
+	if (stream) {
+		Pa_CloseStream(stream);
+	}
+}
+
+void ProgramPlayer::setProgram(const Program& program, std::span<const Velocity> velocities) {
+	auto instrument = std::make_unique<Instrument>();
+	instrument->program = program;
+	instrument->velocities.assign(velocities.begin(), velocities.end());
+
+	// Cached against the copy's tone data, which is the same data as the original's anyway
+	instrument->tones = manatools::synth::ToneCache(instrument->program);
+
+	setInstrument(std::move(instrument));
+}
+
+void ProgramPlayer::clearProgram() {
+	setInstrument(nullptr);
+}
+
+void ProgramPlayer::setInstrument(std::unique_ptr<Instrument> instrument) {
+	u64 serial = nextSerial_++;
+	post({ .type = Event::Type::SetInstrument, .serial = serial, .instrument = instrument.get() });
+
+	u64 inUse = usingSerial_.load(std::memory_order_acquire);
+	std::erase_if(instruments_, [inUse](const auto& entry) {
+		return entry.first < inUse;
+	});
+
+	if (instrument)
+		instruments_.emplace_back(serial, std::move(instrument));
+}
+
+void ProgramPlayer::noteOn(int note, int velocity) {
+	if (note < 0 || note > 127)
+		return;
+
+	post({
+		.type = Event::Type::NoteOn,
+		.note = static_cast<u8>(note),
+		.velocity = static_cast<u8>(std::clamp(velocity, 1, 127))
+	});
+
+	// Only started on first use, so just opening an editor doesn't hold onto the device
+	if (stream && !started) {
+		started = Pa_StartStream(stream) == paNoError;
+	}
+}
+
+void ProgramPlayer::noteOff(int note) {
+	if (note < 0 || note > 127)
+		return;
+
+	post({ .type = Event::Type::NoteOff, .note = static_cast<u8>(note) });
+}
+
+void ProgramPlayer::allNotesOff() {
+	post({ .type = Event::Type::AllNotesOff });
+}
+
+void ProgramPlayer::post(const Event& event) {
+	// Anything already waiting goes first, so events never get reordered
+	if (backlog_.empty() && events_.write({ &event, 1 })) {
+		// Sent straight away
+	} else {
+		using enum Event::Type;
+
+		// Neither leaves anything before it sounding, so notes still waiting before it are moot
+		if (event.type == AllNotesOff || event.type == SetInstrument) {
+			std::erase_if(backlog_, [](const Event& e) {
+				return e.type == NoteOn || e.type == NoteOff || e.type == AllNotesOff;
+			});
+		}
+
+		backlog_.push_back(event);
+		flushBacklog();
+
+		if (!backlog_.empty() && !backlogTimer_.isActive())
+			backlogTimer_.start();
+	}
+
+	// Nothing else is going to pick it up until the stream's running
+	if (!started)
+		handleEvents();
+}
+
+void ProgramPlayer::flushBacklog() {
+	while (!backlog_.empty() && events_.write({ &backlog_.front(), 1 }))
+		backlog_.pop_front();
+
+	if (backlog_.empty())
+		backlogTimer_.stop();
+}
+
+void ProgramPlayer::handleEvents() {
+	Event event;
+	while (events_.read({ &event, 1 })) {
+		using enum Event::Type;
+		switch (event.type) {
+			case NoteOn: {
+				voices_.noteOff(noteIDs_[event.note]);
+				noteIDs_[event.note] = 0;
+
+				if (instrument_) {
+					noteIDs_[event.note] = voices_.noteOn(0, event.note, event.velocity,
+					                                      instrument_->program, instrument_->tones,
+					                                      instrument_->velocities);
+				}
+				break;
+			}
+
+			case NoteOff: {
+				voices_.noteOff(noteIDs_[event.note]);
+				noteIDs_[event.note] = 0;
+				break;
+			}
+
+			case AllNotesOff: {
+				voices_.allNotesOff();
+				std::ranges::fill(noteIDs_, 0);
+				break;
+			}
+
+			case SetInstrument: {
+				voices_.reset();
+				std::ranges::fill(noteIDs_, 0);
+				instrument_ = event.instrument;
+				usingSerial_.store(event.serial, std::memory_order_release);
+				break;
+			}
+		}
+	}
+}
+
+int ProgramPlayer::paStreamCallback(void* output, unsigned long frameCount) {
+	float* out = static_cast<float*>(output);
+
+	handleEvents();
+
+	constexpr size_t BLOCK = manatools::synth::VoicePool::BLOCK;
+	float mixL[BLOCK];
+	float mixR[BLOCK];
+
+	// Voices work at the scale of 16-bit samples
+	constexpr float SCALE = 1.0f / 32768.0f;
+
+	while (frameCount) {
+		size_t n = std::min<size_t>(frameCount, BLOCK);
+		std::fill_n(mixL, n, 0.0f);
+		std::fill_n(mixR, n, 0.0f);
+
+		voices_.mix(mixL, mixR, n);
+
+		for (size_t i = 0; i < n; i++) {
+			*out++ = std::clamp(mixL[i] * SCALE, -1.0f, 1.0f);
+			*out++ = std::clamp(mixR[i] * SCALE, -1.0f, 1.0f);
+		}
+
+		frameCount -= n;
+	}
+
+	return paContinue;
+}
+
+int ProgramPlayer::paStreamCallbackThunk(const void* input, void* output, unsigned long frameCount,
+	                                     const PaStreamCallbackTimeInfo* timeInfo,
+	                                     PaStreamCallbackFlags statusFlags, void* userData)
+{
+	(void)input;
+	(void)timeInfo;
+	(void)statusFlags;
+	return static_cast<ProgramPlayer*>(userData)->paStreamCallback(output, frameCount);
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <QObject>
+#include <QTimer>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <span>
+#include <vector>
+#include <portaudio.h>
+#include <manatools/aica.hpp>
+#include <manatools/mpb.hpp>
+#include <manatools/ringbuffer.hpp>
+#include <manatools/synth.hpp>
+#include "common.hpp"
+
+/**
+ * Plays an MPB program live, for auditioning it from the piano keyboard. Any number of keys
+ * can be held at once, up to the synth's voice limit, past which the quietest or oldest
+ * voices get stolen.
+ *
+ * The stream callback owns the voice pool outright, and the GUI thread only ever queues
+ * events up for it, so nothing locks or allocates while audio's running.
+ */
+class GUICOMMON_EXPORT ProgramPlayer : public QObject {
+	Q_OBJECT
+public:
+	typedef manatools::mpb::Program Program;
+	typedef manatools::mpb::Velocity Velocity;
+
+	explicit ProgramPlayer(QObject* parent = nullptr);
+	~ProgramPlayer();
+
+	/**
+	 * Takes a copy of (program) and decodes all of its tones up front, so this is the slow
+	 * part rather than starting notes. Anything still sounding gets cut off.
+	 */
+	void setProgram(const Program& program, std::span<const Velocity> velocities);
+	void clearProgram();
+
+public slots:
+	void noteOn(int note, int velocity);
+	void noteOff(int note);
+	void allNotesOff();
+
+private:
+	Q_DISABLE_COPY(ProgramPlayer)
+
+	static constexpr size_t MAX_EVENTS = 256;
+
+	// Everything voices point into, kept together so it's handed over and freed as one
+	struct Instrument {
+		Program program;
+		std::vector<Velocity> velocities;
+		manatools::synth::ToneCache tones;
+	};
+
+	struct Event {
+		enum class Type : u8 {
+			NoteOn,
+			NoteOff,
+			AllNotesOff,
+			SetInstrument
+		};
+
+		Type type = Type::AllNotesOff;
+		u8 note = 0;
+		u8 velocity = 0;
+		u64 serial = 0;
+		const Instrument* instrument = nullptr;
+	};
+
+	void setInstrument(std::unique_ptr<Instrument> instrument);
+	void post(const Event& event);
+	void flushBacklog();
+	void handleEvents();
+
+	int paStreamCallback(void* output, unsigned long frameCount);
+
+	static int paStreamCallbackThunk(const void* input, void* output, unsigned long frameCount,
+	                                 const PaStreamCallbackTimeInfo* timeInfo,
+	                                 PaStreamCallbackFlags statusFlags, void* userData);
+
+	PaStream* stream;
+	bool started = false;
+
+	manatools::RingBuffer<Event> events_;
+
+	/**
+	 * Events that didn't fit in events_, waiting (in order) for the callback to make room, so
+	 * a burst of them never loses a note off or instrument change. GUI thread only.
+	 */
+	std::deque<Event> backlog_;
+	QTimer backlogTimer_;
+
+	// Instruments stay alive until the callback has moved past them, which it signals by storing the newer one's serial
+	std::vector<std::pair<u64, std::unique_ptr<Instrument>>> instruments_;
+	u64 nextSerial_ = 1;
+	std::atomic<u64> usingSerial_ = 0;
+
+	// Only touched by the stream callback, or the GUI thread before the stream's started
+	manatools::synth::VoicePool voices_;
+	const Instrument* instrument_ = nullptr;
+	u32 noteIDs_[128] {};
+};
@@ -2,10 +2,11 @@
 
 TonePlayer::TonePlayer(double sampleRate, QObject* parent) :
 	QObject(parent),
+	ring_(sampleRate * BUFFER_DURATION),
 	maxPadFrames(sampleRate * MAX_PAD_DURATION),
-	stream(nullptr),
 	padFrames(0),
-	endPadFrames(0)
+	endPadFrames(0),
+	stream(nullptr)
 {
 	PaError err;
 
@@ -28,7 +29,10 @@ TonePlayer::TonePlayer(double sampleRate, QObject* parent) :
 	if (err != paNoError) {
 		Pa_CloseStream(stream);
 		stream = nullptr;
+		return;
 	}
+
+	decodeThread_ = std::jthread([this](std::stop_token stop) { decodeLoop(stop); });
 }
 
 TonePlayer::~TonePlayer() {
@@ -39,19 +43,18 @@ TonePlayer::~TonePlayer() {
 
 void TonePlayer::setTone(const Tone& tone) {
 	tone_ = tone;
-	decoder.setTone(&tone_);
+	pendingTone_.store(std::make_shared<const Tone>(tone));
+	restart();
 	emit toneChanged();
 }
 
 void TonePlayer::play() {
-	if (!stream || !decoder.tone())
+	if (!stream)
 		return;
 
 	bool wasPlaying = isPlaying();
 
-	decoder.reset();
-	padFrames = 0;
-	endPadFrames = 0;
+	restart();
 
 	if (!wasPlaying) {
 		Pa_StopStream(stream);
@@ -69,9 +72,80 @@ void TonePlayer::stop() {
 	}
 }
 
+void TonePlayer::restart() {
+	{
+		std::lock_guard lock(wakeMutex_);
+		requestedGen_.fetch_add(1);
+	}
+
+	wake_.notify_one();
+}
+
+void TonePlayer::decodeLoop(std::stop_token stop) {
+	manatools::tone::Decoder decoder;
+	std::shared_ptr<const Tone> tone;
+	bool ended = true;
+	u32 gen = readyGen_.load();
+
+	s16 scratch[1024];
+
+	while (!stop.stop_requested()) {
+		u32 wanted = requestedGen_.load();
+
+		if (wanted != gen) {
+			if (auto next = pendingTone_.exchange(nullptr)) {
+				tone = std::move(next);
+				decoder.setTone(tone.get());
+			}
+
+			decoder.reset();
+			gen = wanted;
+			ended = !tone;
+
+			// Anything already in the ring from before now gets skipped by the callback
+			size_t pos = ring_.writePos();
+			startPos_.store(pos, std::memory_order_relaxed);
+			endPos_.store(ended ? pos : NO_END, std::memory_order_relaxed);
+			readyGen_.store(gen, std::memory_order_release);
+		}
+
+		if (!ended && ring_.writeAvailable() >= std::size(scratch)) {
+			size_t samples = decoder.decode(scratch, std::size(scratch));
+			ring_.write({ scratch, samples });
+
+			if (samples < std::size(scratch)) {
+				ended = true;
+				endPos_.store(ring_.writePos(), std::memory_order_release);
+			}
+
+			continue;
+		}
+
+		// Either full or done, so sleep until there's room again or something new to play
+		std::unique_lock lock(wakeMutex_);
+		wake_.wait_for(lock, stop, REFILL_INTERVAL, [&]() {
+			return requestedGen_.load() != gen;
+		});
+	}
+}
+
 int TonePlayer::paStreamCallback(void* output, unsigned long frameCount) {
 	s16* out = static_cast<s16*>(output);
 
+	u32 gen = readyGen_.load(std::memory_order_acquire);
+	if (gen != playingGen_) {
+		playingGen_ = gen;
+		ring_.skipTo(startPos_.load(std::memory_order_relaxed));
+		padFrames = 0;
+		endPadFrames = 0;
+	}
+
+	// The decode thread hasn't caught up with a restart yet, so don't play what's left of the old one
+	if (gen != requestedGen_.load(std::memory_order_relaxed)) {
+		std::fill(out, out + frameCount, 0);
+		return paContinue;
+	}
+
 	/**
 	 * Pad the beginning of the stream to try and prevent PortAudio from cutting it off
 	 * depending on system and backend
@@ -82,11 +156,17 @@ int TonePlayer::paStreamCallback(void* output, unsigned long frameCount) {
 		return paContinue;
 	}
 
-	size_t samples = decoder.decode(out, frameCount);
+	size_t samples = ring_.read({ out, frameCount });
 
 	// Also pad the end, too
 	if (samples < frameCount) {
 		std::fill(out + samples, out + frameCount, 0);
+
+		// Ran dry before the end of the tone, so the decode thread's just behind
+		if (ring_.readPos() != endPos_.load(std::memory_order_acquire)) {
+			return paContinue;
+		}
+
 		endPadFrames += frameCount - samples;
 
 		if (endPadFrames < maxPadFrames) {
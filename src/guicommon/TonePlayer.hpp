@@ -1,12 +1,27 @@
 #pragma once
 #include <QObject>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <portaudio.h>
 #include <manatools/aica.hpp>
+#include <manatools/ringbuffer.hpp>
 #include <manatools/tone.hpp>
 #include <manatools/tonedecoder.hpp>
 #include <manatools/utils.hpp>
 #include "common.hpp"
 
+/**
+ * Plays a tone through PortAudio. Decoding happens on a thread of its own that keeps a
+ * ring buffer topped up, so all the stream callback ever does is copy out of it, and a
+ * slow decode can't make the audio glitch.
+ *
+ * New tones and restarts are handed over to the decode thread by bumping a generation
+ * counter, and the callback drops anything left over from an older generation.
+ */
 class GUICOMMON_EXPORT TonePlayer : public QObject {
 	Q_OBJECT
 public:
@@ -40,6 +55,15 @@ private:
 	Q_DISABLE_COPY(TonePlayer)
 
 	static constexpr float MAX_PAD_DURATION = 0.05; // 50ms
+	static constexpr float BUFFER_DURATION = 0.25;  // 250ms
+	static constexpr auto REFILL_INTERVAL = std::chrono::milliseconds(20);
+
+	// endPos_ while the decode thread hasn't reached the end of the tone yet
+	static constexpr size_t NO_END = SIZE_MAX;
+
+	// Starts playback over from the beginning of the latest tone
+	void restart();
+	void decodeLoop(std::stop_token stop);
 
 	int paStreamCallback(void* output, unsigned long frameCount);
 	void paStreamFinished();
@@ -51,10 +75,28 @@ private:
 	static void paStreamFinishedThunk(void* userData);
 
 	Tone tone_;
-	manatools::tone::Decoder decoder;
 
+	// Handed to the decode thread with the next generation
+	std::atomic<std::shared_ptr<const Tone>> pendingTone_;
+
+	manatools::RingBuffer<s16> ring_;
+	std::atomic<u32> requestedGen_ = 0; // Bumped by the GUI thread
+	std::atomic<u32> readyGen_ = 0;     // Set by the decode thread once it's caught up
+	std::atomic<size_t> startPos_ = 0;  // Ring position the ready generation starts at...
+	std::atomic<size_t> endPos_ = 0;    // ...and ends at
+
+	// Only for waking the decode thread up early
+	std::mutex wakeMutex_;
+	std::condition_variable_any wake_;
+
+	// Only touched by the stream callback
+	u32 playingGen_ = 0;
 	unsigned long maxPadFrames;
-	PaStream* stream;
 	unsigned long padFrames;
 	unsigned long endPadFrames;
+
+	PaStream* stream;
+
+	// Last so that it stops before anything it uses goes away
+	std::jthread decodeThread_;
 };
@@ -0,0 +1,155 @@
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPainterPath>
+#include <QWheelEvent>
+#include <algorithm>
+#include <cmath>
+
+#include "WaveformWidget.hpp"
+
+// Most zoomed in, as pixels per sample
+static constexpr double MAX_ZOOM = 32.0;
+
+WaveformWidget::WaveformWidget(QWidget* parent) :
+	QFrame(parent)
+{
+	setFrameShape(Panel);
+	setFrameShadow(Sunken);
+	setStyleSheet("background-color: rgba(0, 0, 0, 48);");
+	setMinimumHeight(60);
+}
+
+void WaveformWidget::setTone(const Tone& tone) {
+	peaks_ = manatools::tone::Peaks(tone);
+	resetView();
+}
+
+void WaveformWidget::resetView() {
+	fitted_ = true;
+	viewStart_ = 0;
+	samplesPerPixel_ = fitSamplesPerPixel();
+	update();
+}
+
+double WaveformWidget::fitSamplesPerPixel() const {
+	return std::max(1.0, static_cast<double>(peaks_.samples())) / std::max(1, contentsRect().width());
+}
+
+void WaveformWidget::clampView() {
+	samplesPerPixel_ = std::clamp(samplesPerPixel_, 1.0 / MAX_ZOOM, fitSamplesPerPixel());
+	double maxStart = peaks_.samples() - samplesPerPixel_ * contentsRect().width();
+	viewStart_ = std::clamp(viewStart_, 0.0, std::max(0.0, maxStart));
+}
+
+void WaveformWidget::mouseDoubleClickEvent(QMouseEvent* event) {
+	QFrame::mouseDoubleClickEvent(event);
+	resetView();
+}
+
+void WaveformWidget::mousePressEvent(QMouseEvent* event) {
+	QFrame::mousePressEvent(event);
+	dragX_ = event->position().x();
+}
+
+void WaveformWidget::mouseMoveEvent(QMouseEvent* event) {
+	QFrame::mouseMoveEvent(event);
+
+	if (!(event->buttons() & Qt::LeftButton))
+		return;
+
+	qreal x = event->position().x();
+	viewStart_ -= (x - dragX_) * samplesPerPixel_;
+	dragX_ = x;
+
+	clampView();
+	update();
+}
+
+void WaveformWidget::resizeEvent(QResizeEvent* event) {
+	QFrame::resizeEvent(event);
+
+	if (fitted_)
+		samplesPerPixel_ = fitSamplesPerPixel();
+
+	clampView();
+}
+
+void WaveformWidget::wheelEvent(QWheelEvent* event) {
+	if (!peaks_.samples()) {
+		QFrame::wheelEvent(event);
+		return;
+	}
+
+	// Keep whatever sample is under the cursor where it is
+	qreal x = event->position().x() - contentsRect().x();
+	double anchor = viewStart_ + x * samplesPerPixel_;
+
+	samplesPerPixel_ *= std::pow(0.8, event->angleDelta().y() / 120.0);
+	clampView();
+
+	viewStart_ = anchor - x * samplesPerPixel_;
+	clampView();
+
+	fitted_ = samplesPerPixel_ >= fitSamplesPerPixel();
+	event->accept();
+	update();
+}
+
+void WaveformWidget::paintEvent(QPaintEvent* event) {
+	QFrame::paintEvent(event);
+
+	if (!peaks_.samples())
+		return;
+
+	QPainter painter(this);
+	QRect rect = contentsRect();
+	painter.setClipRect(rect);
+
+	qreal mid = rect.y() + rect.height() / 2.0;
+	qreal scale = (rect.height() / 2.0) / 32768.0;
+
+	auto pcm = peaks_.pcm();
+
+	if (samplesPerPixel_ < 1.0) {
+		// Zoomed in far enough to see individual samples, so join them up
+		painter.setRenderHint(QPainter::Antialiasing);
+		painter.setPen(PEAK_COLOR);
+
+		size_t first = static_cast<size_t>(viewStart_);
+		size_t last = std::min(pcm.size(), static_cast<size_t>(viewStart_ + rect.width() * samplesPerPixel_) + 2);
+
+		QPainterPath path;
+		for (size_t i = first; i < last; i++) {
+			QPointF point { rect.x() + (i - viewStart_) / samplesPerPixel_, mid - pcm[i] * scale };
+			i == first ? path.moveTo(point) : path.lineTo(point);
+		}
+
+		painter.drawPath(path);
+	} else {
+		// One column per pixel, each summarised from however few buckets cover it
+		for (int x = 0; x < rect.width(); x++) {
+			size_t start = static_cast<size_t>(viewStart_ + x * samplesPerPixel_);
+			size_t end = static_cast<size_t>(viewStart_ + (x + 1) * samplesPerPixel_);
+			if (start >= pcm.size())
+				break;
+
+			auto bucket = peaks_.range(start, std::max(end, start + 1));
+			qreal px = rect.x() + x + 0.5;
+
+			painter.setPen(PEAK_COLOR);
+			painter.drawLine(QLineF { px, mid - bucket.max * scale, px, mid - bucket.min * scale });
+
+			painter.setPen(RMS_COLOR);
+			painter.drawLine(QLineF { px, mid - bucket.rms * scale, px, mid + bucket.rms * scale });
+		}
+	}
+
+	if (loopOn_ && loopEnd_ > loopStart_) {
+		painter.setPen(QPen(LOOP_COLOR, 1, Qt::DashLine));
+
+		for (size_t sample : { loopStart_, loopEnd_ }) {
+			qreal x = rect.x() + (sample - viewStart_) / samplesPerPixel_;
+			painter.drawLine(QLineF { x, static_cast<qreal>(rect.top()), x, static_cast<qreal>(rect.bottom()) });
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <QColor>
+#include <QFrame>
+#include <manatools/tone.hpp>
+#include <manatools/tonepeaks.hpp>
+#include "common.hpp"
+
+/**
+ * Draws a tone from a peak pyramid, so repainting costs the same however long the tone is
+ * or however far it's zoomed in or out. Scroll to zoom around the cursor, drag to move
+ * around, and double click to see the whole thing again.
+ */
+class GUICOMMON_EXPORT WaveformWidget : public QFrame {
+	Q_OBJECT
+public:
+	typedef manatools::tone::Tone Tone;
+
+	inline static const QColor PEAK_COLOR { 80, 140, 220 };
+	inline static const QColor RMS_COLOR { 150, 200, 255 };
+	inline static const QColor LOOP_COLOR { 230, 120, 40 };
+
+	explicit WaveformWidget(QWidget* parent = nullptr);
+
+	void setTone(const Tone& tone);
+
+	void setLoop(bool on, size_t start, size_t end) {
+		loopOn_ = on;
+		loopStart_ = start;
+		loopEnd_ = end;
+		update();
+	}
+
+	// Fits the whole tone in view
+	void resetView();
+
+protected:
+	void mouseDoubleClickEvent(QMouseEvent* event) override;
+	void mouseMoveEvent(QMouseEvent* event) override;
+	void mousePressEvent(QMouseEvent* event) override;
+	void paintEvent(QPaintEvent* event) override;
+	void resizeEvent(QResizeEvent* event) override;
+	void wheelEvent(QWheelEvent* event) override;
+
+private:
+	void clampView();
+	double fitSamplesPerPixel() const;
+
+	manatools::tone::Peaks peaks_;
+
+	double viewStart_ = 0;      // First sample in view
+	double samplesPerPixel_ = 1;
+	bool fitted_ = true;        // Keep fitting the whole tone as the widget's resized
+
+	bool loopOn_ = false;
+	size_t loopStart_ = 0;
+	size_t loopEnd_ = 0;
+
+	qreal dragX_ = 0;
+};
@@ -0,0 +1,74 @@
+#include <atomic>
+#include <exception>
+#include <QDeadlineTimer>
+#include <QEventLoop>
+#include <QProgressDialog>
+#include <QThread>
+#include <guicommon/CursorOverride.hpp>
+
+#include "background.hpp"
+
+// Anything quicker than this isn't worth a dialog flashing up
+constexpr int DIALOG_DELAY_MS = 400;
+
+bool runInBackground(QWidget* parent, const QString& label,
+                     const std::function<void(const manatools::Progress&)>& work) {
+	CursorOverride cursor(Qt::WaitCursor);
+
+	QProgressDialog dialog(label, QObject::tr("Cancel"), 0, 0, parent);
+	dialog.setWindowModality(Qt::WindowModal);
+	dialog.setAutoClose(false);
+	dialog.setAutoReset(false);
+
+	std::atomic_bool cancel = false;
+	bool cancelled = false;
+	std::exception_ptr error;
+
+	/**
+	 * Called on the worker thread, so the dialog's only ever touched back on this one.
+	 * Anything still queued once the dialog's gone out of scope is just dropped by Qt.
+	 */
+	manatools::Progress progress([&](size_t done, size_t total) {
+		QMetaObject::invokeMethod(&dialog, [&dialog, done, total]() {
+			dialog.setMaximum(static_cast<int>(total));
+			dialog.setValue(static_cast<int>(done));
+		}, Qt::QueuedConnection);
+
+		return !cancel;
+	});
+
+	QThread* thread = QThread::create([&]() {
+		try {
+			work(progress);
+		} catch (const manatools::Cancelled&) {
+			cancelled = true;
+		} catch (...) {
+			error = std::current_exception();
+		}
+	});
+
+	QEventLoop loop;
+	QObject::connect(thread, &QThread::finished, &loop, &QEventLoop::quit);
+	QObject::connect(&dialog, &QProgressDialog::canceled, &dialog, [&]() {
+		cancel = true;
+		dialog.setLabelText(QObject::tr("Cancelling..."));
+		dialog.show(); // Cancelling hides it, but there could still be a bit to go
+	});
+
+	thread->start();
+
+	// Nothing can be clicked while blocked here, which is fine for short enough a time
+	if (!thread->wait(QDeadlineTimer(DIALOG_DELAY_MS))) {
+		cursor.restore();
+		dialog.show();
+		loop.exec();
+	}
+
+	thread->wait();
+	delete thread;
+
+	if (error)
+		std::rethrow_exception(error);
+
+	return !cancelled;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <QString>
+#include <QWidget>
+#include <functional>
+#include <manatools/progress.hpp>
+#include "common.hpp"
+
+/**
+ * Runs (work) on a thread of its own so the window keeps painting. Quick ones are waited
+ * on like before with just a wait cursor, but anything that takes longer gets a window
+ * modal progress dialog (blocking (parent) so nothing (work) uses changes under it) which
+ * can cancel it through the Progress it's handed.
+ *
+ * Returns false if it was cancelled. Anything else (work) throws is rethrown here, on the
+ * calling thread. (work) mustn't touch any widgets.
+ */
+GUICOMMON_EXPORT bool runInBackground(QWidget* parent, const QString& label,
+                                      const std::function<void(const manatools::Progress&)>& work);
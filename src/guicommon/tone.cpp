@@ -1,9 +1,15 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <optional>
 #include <QComboBox>
 #include <QFileDialog>
 #include <QMessageBox>
 #include <guicommon/ChannelSelectDialog.hpp>
 #include <guicommon/CursorOverride.hpp>
+#include <manatools/resampler.hpp>
 #include <manatools/tonedecoder.hpp>
+#include <manatools/toneencoder.hpp>
 #include <manatools/wav.hpp>
 #include <sndfile.hh>
 
@@ -54,48 +60,69 @@ bool importFile(Tone& tone, Metadata* metadata, const QString& path, QWidget* pa
 		return false;
 	}
 
+	auto channels = sndFile.channels();
+	std::vector<float> weights(channels, 0.0f);
+	weights[0] = 1.0f;
+
+	if (channels > 1) {
+		cursor.restore();
+
+		ChannelSelectDialog dialog(channels, parent);
+		if (dialog.exec() != QDialog::Accepted)
+			return false;
+
+		if (dialog.mixDown) {
+			std::fill(weights.begin(), weights.end(), 1.0f / channels);
+		} else {
+			weights[0] = 0.0f;
+			weights[dialog.channel] = 1.0f;
+		}
+
+		cursor.override(Qt::WaitCursor);
+	}
+
+	/**
+	 * Files too long for a tone get offered a lower sample rate that just fits, rather than
+	 * being turned away. Mixing down and resampling then happen together further down.
+	 */
+	const double inRate = sndFile.samplerate();
+	double outRate = inRate;
+
 	// have to use cmp_greater due to dumb signedness stuff
 	if (std::cmp_greater(sndFile.frames(), manatools::tone::MAX_SAMPLES)) {
+		using manatools::resampler::Resampler;
+		outRate = std::floor(inRate * manatools::tone::MAX_SAMPLES / sndFile.frames());
+
+		// The resampler rounds its own way, so make extra sure it lands under the limit
+		while (outRate > 1 && Resampler::outputSize(inRate, outRate, sndFile.frames()) > manatools::tone::MAX_SAMPLES)
+			outRate--;
+
 		cursor.restore();
-		QMessageBox::warning(
+		const auto answer = QMessageBox::question(
 			parent,
 			tr("Import tone"),
 			tr(
-				"Cannot use imported sound file as it contains more than %1 samples (%2).\n\n"
-				"Tip: Try reducing its sample rate."
-			).arg(manatools::tone::MAX_SAMPLES).arg(sndFile.frames())
+				"Imported sound file contains more than %1 samples (%2).\n\n"
+				"Resample it from %3 Hz to %4 Hz so that it fits?"
+			).arg(manatools::tone::MAX_SAMPLES).arg(sndFile.frames()).arg(inRate).arg(outRate)
 		);
-		return false;
-	}
 
-	// TODO: Allow downmixing channels?
-	auto channels = sndFile.channels();
-	uint channel = 0;
-	if (channels > 1) {
-		ChannelSelectDialog dialog(channels, parent);
-		if (dialog.exec() == QDialog::Accepted) {
-			channel = dialog.channel;
-		} else {
+		if (answer != QMessageBox::Yes)
 			return false;
-		}
+
+		cursor.override(Qt::WaitCursor);
 	}
 
 	// Otherwise reading floats would result in the output just being zeros
 	sndFile.command(SFC_SET_SCALE_FLOAT_INT_READ, nullptr, true);
 
-	std::vector<s16> readBuf(READ_SIZE * channels);
-	Tone newTone;
-	newTone.format = manatools::tone::Format::PCM16,
-	newTone.sampleRate = sndFile.samplerate();
-	newTone.data = manatools::tone::makeDataPtr(sndFile.frames() * sizeof(s16));	
+	std::vector<s16> frames(sndFile.frames() * channels);
 
 	sf_count_t framesRead;
 	sf_count_t totalFramesRead = 0;
-	while ((framesRead = sndFile.readf(readBuf.data(), READ_SIZE)) > 0) {
-		for (sf_count_t i = 0; i < framesRead; i++) {
-			s16* data = reinterpret_cast<s16*>(newTone.data->data());
-			data[totalFramesRead + i] = readBuf[i * channels + channel];
-		}
+	while (totalFramesRead < sndFile.frames() &&
+	       (framesRead = sndFile.readf(frames.data() + totalFramesRead * channels, READ_SIZE)) > 0)
+	{
 		totalFramesRead += framesRead;
 	}
 
@@ -105,6 +132,15 @@ bool importFile(Tone& tone, Metadata* metadata, const QString& path, QWidget* pa
 		return false;
 	}
 
+	manatools::resampler::Resampler resampler(inRate, outRate);
+	const std::vector<s16> samples = resampler.process(frames, weights);
+
+	Tone newTone;
+	newTone.format = manatools::tone::Format::PCM16,
+	newTone.sampleRate = static_cast<u32>(outRate);
+	newTone.data = manatools::tone::makeDataPtr(samples.size() * sizeof(s16));
+	std::memcpy(newTone.data->data(), samples.data(), samples.size() * sizeof(s16));
+
 	if (metadata) {
 		/**
 		 * Loop end is also used as tone data length.
@@ -112,7 +148,7 @@ bool importFile(Tone& tone, Metadata* metadata, const QString& path, QWidget* pa
 		 */
 		metadata->loop = false;
 		metadata->loopStart = 0;
-		metadata->loopEnd = sndFile.frames();
+		metadata->loopEnd = samples.size();
 
 		SF_INSTRUMENT instrument;
 		if (sndFile.command(SFC_GET_INSTRUMENT, &instrument, sizeof(instrument))) {
@@ -122,8 +158,8 @@ bool importFile(Tone& tone, Metadata* metadata, const QString& path, QWidget* pa
 
 				auto loop = instrument.loops[0];
 				metadata->loop = loop.mode != SF_LOOP_NONE;
-				metadata->loopStart = loop.start;
-				metadata->loopEnd = loop.end;
+				metadata->loopStart = std::min(resampler.mapPosition(loop.start), samples.size());
+				metadata->loopEnd = std::min(resampler.mapPosition(loop.end), samples.size());
 			}
 
 			if (metadata->isInstrument) {
@@ -159,14 +195,25 @@ bool importFile(Tone& tone, Metadata* metadata, const QString& path, QWidget* pa
 	return true;
 }
 
-QString exportFolderDialog(const QString& basePath, FileType* type, QWidget* parent) {
+QString exportFolderDialog(const QString& basePath, FileType* type, u32* sampleRate, QWidget* parent) {
 	QFileDialog* dialog = new QFileDialog(parent, tr("Export tones"), basePath);
 	QLabel* lbl = new QLabel(tr("Export type:"));
 	QComboBox* cb = new QComboBox();
+	QLabel* rateLbl = new QLabel(tr("WAV sample rate:"));
+	QComboBox* rateCb = new QComboBox();
 
 	cb->addItem(tr("WAV file (*.wav)"), QVariant::fromValue(FileType::WAV));
 	cb->addItem(tr("Raw tone data (*.dat)"), QVariant::fromValue(FileType::DAT));
 
+	rateCb->addItem(tr("Original"), 0u);
+	for (u32 rate : { 44100u, 22050u, 11025u })
+		rateCb->addItem(tr("%1 Hz").arg(rate), rate);
+
+	// Raw tone data gets written as is
+	QObject::connect(cb, &QComboBox::currentIndexChanged, rateCb, [cb, rateCb] {
+		rateCb->setEnabled(cb->currentData().value<FileType>() == FileType::WAV);
+	});
+
 	dialog->setAcceptMode(QFileDialog::AcceptSave);
 	dialog->setFileMode(QFileDialog::Directory);
 	dialog->setOption(QFileDialog::DontUseNativeDialog); // inconsistency much? needed for custom widget
@@ -178,6 +225,8 @@ QString exportFolderDialog(const QString& basePath, FileType* type, QWidget* par
 	 */
 	dialog->layout()->addWidget(lbl);
 	dialog->layout()->addWidget(cb);
+	dialog->layout()->addWidget(rateLbl);
+	dialog->layout()->addWidget(rateCb);
 
 	if (dialog->exec() == QDialog::Accepted) {
 		const auto urls = dialog->selectedUrls();
@@ -199,6 +248,10 @@ QString exportFolderDialog(const QString& basePath, FileType* type, QWidget* par
 			*type = cbData.value<FileType>();
 		}
 
+		if (sampleRate) {
+			*sampleRate = rateCb->currentData().toUInt();
+		}
+
 		return url.toLocalFile();
 	}
 
@@ -241,7 +294,9 @@ bool exportDialog(const Tone& tone, const Metadata* metadata, const QString& bas
 	return exportFile(tone, metadata, path, type, parent);
 }
 
-bool exportFile(const Tone& tone, const Metadata* metadata, const QString& path, FileType type, QWidget* parent) {
+bool exportFile(const Tone& tone, const Metadata* metadata, const QString& path, FileType type, QWidget* parent,
+                u32 sampleRate)
+{
 	CursorOverride cursor(Qt::WaitCursor);
 
 	if (!tone.data) {
@@ -254,32 +309,48 @@ bool exportFile(const Tone& tone, const Metadata* metadata, const QString& path,
 		switch (type) {
 			case FileType::WAV: {
 				// TODO: hmm. could probably replace this with libsndfile
-				manatools::wav::WAV<s16> wav(1, tone.sampleRate);
+				if (!sampleRate)
+					sampleRate = tone.sampleRate;
+
+				manatools::resampler::Resampler resampler(tone.sampleRate, sampleRate);
+				std::optional<manatools::wav::SamplerChunk> sampler;
 
 				if (metadata && metadata->loop) {
-					wav.sampler = {
+					const u32 loopStart = resampler.mapPosition(metadata->loopStart);
+					const u32 loopEnd = resampler.mapPosition(metadata->loopEnd);
+
+					sampler = {
 						.midiUnityNote = 60,
 						.midiPitchFraction = 0,
 						.loops = {
 							{
-								.start = metadata->loopStart,
-								.end = metadata->loopEnd - 1u // WAV plays last sample
+								.start = loopStart,
+								.end = loopEnd - 1u // WAV plays last sample
 							}
 						}
 					};
 				}
 
+				// Straight from the decoder to the file, unless it needs the whole tone to resample
+				if (sampleRate == tone.sampleRate) {
+					manatools::tone::saveWAV(tone, path.toStdWString(), sampler);
+					break;
+				}
+
 				manatools::tone::Decoder decoder(&tone);
-				wav.data.resize(tone.samples());
-				decoder.decode(wav.data);
-				
+				std::vector<s16> samples(tone.samples());
+				decoder.decode(samples);
+
+				manatools::wav::WAV<s16> wav(1, sampleRate);
+				wav.data = resampler.process(samples);
+				wav.sampler = sampler;
 				wav.save(path.toStdWString());
 				break;
 			}
 
 			case FileType::DAT: {
 				manatools::io::FileIO file(path.toStdWString(), "wb");
-				file.writeVec(*tone.data);
+				file.writeSpan(tone.data->span());
 				break;
 			}
 
@@ -300,44 +371,17 @@ bool convertToADPCM(Tone& tone, QWidget* parent) {
 	if (!tone.data)
 		return false;
 
-	using enum manatools::tone::Format;
-	switch (tone.format) {
-		case ADPCM: {
-			return true;
-		}
-
-		case PCM16: {
-			if (tone.data->size() % 2) {
-				QMessageBox::warning(
-					parent,
-					tr("Convert to ADPCM"),
-					tr("Cannot convert tone to ADPCM: Size of PCM-16 data must be a multiple of 2 bytes.")
-				);
-				return false;
-			}
-
-			Tone newTone;
-			newTone.format = ADPCM,
-			// really not sure about this whole divide and ceil stuff
-			newTone.data = manatools::tone::makeDataPtr(std::ceil(tone.samples() / 2.));
-
-			manatools::yadpcm::Context adpcmCtx;
-			adpcmCtx.encode(reinterpret_cast<s16*>(tone.data->data()), newTone.data->data(), tone.samples());
-
-			tone = newTone;
-			break;
-		}
-
-		case PCM8: {
-			/**
-			 * TODO: PCM8 to PCM16, which can then be passed to yadpcm::encode
-			 * (PCM8 in the switch case could then possibly be moved above PCM16 as to fallthrough
-			 * to reduce duplicate code)
-			 */
-			return false;
-		}
+	if (tone.format == manatools::tone::Format::PCM16 && tone.data->size() % 2) {
+		QMessageBox::warning(
+			parent,
+			tr("Convert to ADPCM"),
+			tr("Cannot convert tone to ADPCM: Size of PCM-16 data must be a multiple of 2 bytes.")
+		);
+		return false;
 	}
 
+	CursorOverride cursor(Qt::WaitCursor);
+	manatools::tone::toADPCM(tone);
 	return true;
 }
 
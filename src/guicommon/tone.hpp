@@ -77,10 +77,14 @@ namespace tone {
 	GUICOMMON_EXPORT bool importDialog(Tone& tone, Metadata* metadata, const QString& basePath, QWidget* parent = nullptr);
 	GUICOMMON_EXPORT bool importFile(Tone& tone, Metadata* metadata, const QString& path, QWidget* parent = nullptr);
 
-	GUICOMMON_EXPORT QString exportFolderDialog(const QString& basePath, FileType* type, QWidget* parent = nullptr);
+	// (sampleRate) gets 0 if WAVs should keep each tone's own rate
+	GUICOMMON_EXPORT QString exportFolderDialog(const QString& basePath, FileType* type, u32* sampleRate,
+	                                            QWidget* parent = nullptr);
 	GUICOMMON_EXPORT bool exportDialog(const Tone& tone, const Metadata* metadata, const QString& basePath,
 	                                   const QString& baseName, const QString& tonePath, QWidget* parent = nullptr);
-	GUICOMMON_EXPORT bool exportFile(const Tone& tone, const Metadata* metadata, const QString& path, FileType type, QWidget* parent = nullptr);
+	// WAVs are resampled to (sampleRate) on the way out, unless it's 0
+	GUICOMMON_EXPORT bool exportFile(const Tone& tone, const Metadata* metadata, const QString& path, FileType type,
+	                                 QWidget* parent = nullptr, u32 sampleRate = 0);
 
 	GUICOMMON_EXPORT bool convertToADPCM(Tone& tone, QWidget* parent = nullptr);
 } // namespace tone
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+#include "batch.hpp"
+#include "io.hpp"
+
+namespace manatools::batch {
+
+static bool hasExtension(const fs::path& path, std::span<const std::string_view> extensions) {
+	std::string ext = path.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+
+	return std::ranges::find(extensions, ext) != extensions.end();
+}
+
+static Input makeInput(const fs::path& path, const fs::path& relDir = fs::path()) {
+	std::error_code ec;
+	size_t size = fs::file_size(path, ec);
+	return { path, relDir, ec ? 0 : size };
+}
+
+static void collectDirectory(const fs::path& dir, std::span<const std::string_view> extensions,
+                             std::vector<Input>& inputs)
+{
+	std::vector<fs::path> files;
+	for (const auto& entry : fs::recursive_directory_iterator(dir, fs::directory_options::skip_permission_denied)) {
+		if (entry.is_regular_file() && hasExtension(entry.path(), extensions))
+			files.push_back(entry.path());
+	}
+
+	std::sort(files.begin(), files.end());
+
+	for (const auto& file : files)
+		inputs.push_back(makeInput(file, fs::relative(file.parent_path(), dir)));
+}
+
+static void collectManifest(const fs::path& manifest, std::vector<Input>& inputs) {
+	auto bytes = io::readFile(manifest);
+	std::string_view text(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+
+	while (!text.empty()) {
+		size_t end = text.find('\n');
+		std::string_view line = text.substr(0, end);
+		text.remove_prefix(end == text.npos ? text.size() : end + 1);
+
+		// Trim, which also gets rid of the \r from CRLF files
+		while (!line.empty() && std::isspace(static_cast<unsigned char>(line.front())))
+			line.remove_prefix(1);
+		while (!line.empty() && std::isspace(static_cast<unsigned char>(line.back())))
+			line.remove_suffix(1);
+
+		if (line.empty() || line.front() == '#')
+			continue;
+
+		fs::path path(line);
+		if (path.is_relative())
+			path = manifest.parent_path() / path;
+
+		inputs.push_back(makeInput(path));
+	}
+}
+
+std::vector<Input> collect(std::span<const char* const> args, std::span<const std::string_view> extensions) {
+	std::vector<Input> inputs;
+
+	for (const char* arg : args) {
+		if (arg[0] == '@') {
+			collectManifest(arg + 1, inputs);
+		} else if (fs::is_directory(arg)) {
+			collectDirectory(arg, extensions, inputs);
+		} else {
+			inputs.push_back(makeInput(arg));
+		}
+	}
+
+	return inputs;
+}
+
+bool isBatch(const char* arg) {
+	return arg[0] == '@' || fs::is_directory(arg);
+}
+
+void Report::print() const {
+	double mib = bytes / (1024.0 * 1024.0);
+
+	printf("Processed %zu files (%.1f MiB) in %.2f s, %.1f files/s, %.1f MiB/s\n",
+	       files, mib, seconds, seconds > 0 ? files / seconds : 0.0, seconds > 0 ? mib / seconds : 0.0);
+
+	if (failures.empty())
+		return;
+
+	fprintf(stderr, "%zu of %zu files failed:\n", failures.size(), files);
+	for (const auto& failure : failures)
+		fprintf(stderr, "  %s: %s\n", failure.path.string().c_str(), failure.message.c_str());
+}
+
+} // namespace manatools::batch
@@ -0,0 +1,153 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "filesystem.hpp"
+#include "threadpool.hpp"
+#include "types.hpp"
+
+namespace manatools::batch {
+	struct Input {
+		fs::path path;
+
+		// Where it was relative to the directory it was found in, for outputs to mirror
+		fs::path relDir;
+
+		size_t size = 0;
+	};
+
+	/**
+	 * Expands the paths given to a tool into the files to work on. Directories are walked
+	 * recursively for files ending in one of (extensions), ignoring case as disc images
+	 * love upper case names, and "@list.txt" reads one path per line from a manifest (with
+	 * blank lines and ones starting with # skipped, and relative paths being relative to
+	 * the manifest). Anything else is taken as it is.
+	 *
+	 * What's found in a directory is sorted, so the order never changes between runs.
+	 */
+	std::vector<Input> collect(std::span<const char* const> args, std::span<const std::string_view> extensions);
+
+	// Whether (arg) is a directory or manifest, rather than a single file
+	bool isBatch(const char* arg);
+
+	struct Failure {
+		fs::path path;
+		std::string message;
+	};
+
+	struct Report {
+		size_t files = 0;
+		size_t bytes = 0;
+		double seconds = 0;
+		std::vector<Failure> failures;
+
+		// Throughput to stdout, then every failure to stderr
+		void print() const;
+	};
+
+	/**
+	 * Calls prepare(input) for every input across the shared thread pool, which should do
+	 * all the loading and decoding and return whatever's to be written, then commit(input,
+	 * prepared) for each strictly in the order given. Writing in order means everything that
+	 * depends on what was written first (i.e. tone::Store's deduplication) comes out exactly
+	 * the same as doing one file after another, just without waiting on each to decode.
+	 *
+	 * Commits happen on whichever thread finishes the next prepare in line, one at a time.
+	 * Any exception from either stops that one input and is noted in the report, rather
+	 * than stopping everything.
+	 *
+	 * Only so many inputs past the next to commit are prepared ahead of it, so one slow file
+	 * early on doesn't leave everything after it sitting prepared in memory. The pool hands
+	 * out inputs in order, so whoever has the next one to commit never has to wait.
+	 */
+	template <typename Prepare, typename Commit>
+	Report run(std::span<const Input> inputs, Prepare&& prepare, Commit&& commit) {
+		using Prepared = std::invoke_result_t<Prepare&, const Input&>;
+
+		struct Slot {
+			std::optional<Prepared> prepared;
+			std::string error;
+			bool ready = false;
+		};
+
+		auto start = std::chrono::steady_clock::now();
+
+		std::vector<Slot> slots(inputs.size());
+		std::mutex mutex;
+		std::condition_variable windowMoved;
+		size_t nextCommit = 0;
+		bool committing = false;
+
+		// Enough that nobody's waiting while there's work, but no more
+		const size_t window = 2 * (ThreadPool::shared().size() + 1);
+
+		Report report;
+		report.files = inputs.size();
+		for (const auto& input : inputs)
+			report.bytes += input.size;
+
+		ThreadPool::shared().parallelFor(inputs.size(), [&](size_t i) {
+			{
+				std::unique_lock lock(mutex);
+				windowMoved.wait(lock, [&] { return i < nextCommit + window; });
+			}
+
+			try {
+				slots[i].prepared.emplace(prepare(inputs[i]));
+			} catch (const std::exception& err) {
+				slots[i].error = err.what();
+			} catch (...) {
+				// Whatever it was, the slot still has to be marked ready or nothing after it commits
+				slots[i].error = "Unknown error";
+			}
+
+			std::unique_lock lock(mutex);
+			slots[i].ready = true;
+
+			// Someone else is already going, and will pick this one up when it's its turn
+			if (committing)
+				return;
+
+			committing = true;
+
+			while (nextCommit < slots.size() && slots[nextCommit].ready) {
+				size_t c = nextCommit++;
+				auto& slot = slots[c];
+				lock.unlock();
+
+				if (slot.prepared) {
+					try {
+						commit(inputs[c], *slot.prepared);
+					} catch (const std::exception& err) {
+						slot.error = err.what();
+					} catch (...) {
+						slot.error = "Unknown error";
+					}
+
+					// Nothing more needs it, and a slow file early on could leave a lot waiting
+					slot.prepared.reset();
+				}
+
+				lock.lock();
+				if (!slot.error.empty())
+					report.failures.push_back({ inputs[c].path, std::move(slot.error) });
+
+				windowMoved.notify_all();
+			}
+
+			committing = false;
+		});
+
+		report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return report;
+	}
+} // namespace manatools::batch
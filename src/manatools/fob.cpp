@@ -3,8 +3,8 @@
 
 namespace manatools::fob {
 
-Bank load(const fs::path& path) {
-	io::FileIO io(path, "rb");
+Bank load(const fs::path& path, const Progress& progress) {
+	io::BufferedFileIO io(path, "rb");
 	Bank bank;
 
 	FourCC magic;
@@ -29,7 +29,10 @@ Bank load(const fs::path& path) {
 	io.readU32LE(&mixerDataPos);
 	io.jump(mixerDataPos);
 
-	for (auto& mixer : bank.mixers) {
+	for (size_t m = 0; m < numMixers; m++) {
+		progress.update(m, numMixers);
+
+		auto& mixer = bank.mixers[m];
 		for (uint i = 0; i < CHANNELS; i++) {
 			u8 pan;
 			io.readU8(&mixer.level[i]);
@@ -38,10 +41,12 @@ Bank load(const fs::path& path) {
 		}
 	}
 
+	progress.update(numMixers, numMixers);
+
 	return bank;
 }
 
-void Bank::save(const fs::path& path) {
+void Bank::save(const fs::path& path, const Progress& progress) {
 	io::DynBufIO::VecType outBuf;
 	io::DynBufIO io(outBuf);
 
@@ -54,7 +59,10 @@ void Bank::save(const fs::path& path) {
 	io.writeU32LE(io.tell() + 8); // mixer data offset
 	io.writeU32LE(0); // unknown/padding?
 
-	for (auto& mixer : mixers) {
+	for (size_t m = 0; m < mixers.size(); m++) {
+		progress.update(m, mixers.size());
+
+		const auto& mixer = mixers[m];
 		for (uint i = 0; i < CHANNELS; i++) {
 			io.writeU8(mixer.level[i]);
 			io.writeU8(Mixer::toPanPot(mixer.pan[i]));
@@ -77,6 +85,9 @@ void Bank::save(const fs::path& path) {
 
 	io.writeFourCC(FOB_END);
 
+	// Last chance to back out, as after this the file's getting written over
+	progress.update(mixers.size(), mixers.size());
+
 	io::FileIO file(path, "wb");
 	file.writeVec(io.vec());
 }
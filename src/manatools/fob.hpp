@@ -4,6 +4,7 @@
 
 #include "filesystem.hpp"
 #include "fourcc.hpp"
+#include "progress.hpp"
 #include "types.hpp"
 
 namespace manatools::fob {
@@ -20,10 +21,12 @@ namespace manatools::fob {
 	};
 
 	struct Bank {
-		void save(const fs::path& path);
+		// (progress) is updated once per mixer
+		void save(const fs::path& path, const Progress& progress = {});
 		u32 version = 2;
 		std::vector<Mixer> mixers;
 	};
 
-	Bank load(const fs::path& path);
+	// (progress) is updated once per mixer
+	Bank load(const fs::path& path, const Progress& progress = {});
 } // namespace manatools::fob
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <cstdio>
 #include <cstring>
 #include <system_error>
@@ -199,6 +200,343 @@ bool FileIO::close() {
 	return true;
 }
 
+/* ======================== *
+ *      BufferedFileIO      *
+ * ======================== */
+
+BufferedFileIO::~BufferedFileIO() {
+	// Writing back what's left can throw, and there's nobody to tell from here
+	try {
+		close();
+	} catch (...) {}
+}
+
+/**
+ * Gets the FILE to (pos) ready to (op). Switching between reading and writing without a
+ * seek in between is undefined, so the seek is only skipped when the FILE is already
+ * there and it's carrying on doing the same thing.
+ */
+bool BufferedFileIO::fileSeek(long pos, Op op) {
+	if (filePos_ == pos && (lastOp_ == op || lastOp_ == Op::None)) {
+		lastOp_ = op;
+		return true;
+	}
+
+	if (fseek(handle_, pos, SEEK_SET)) {
+		filePos_ = -1;
+		lastOp_ = Op::None;
+		setError(POSIX_ERROR_CODE(errno));
+		return false;
+	}
+
+	filePos_ = pos;
+	lastOp_ = op;
+	return true;
+}
+
+long BufferedFileIO::fileEnd() {
+	if (fileEnd_ != -1)
+		return fileEnd_;
+
+	if (fseek(handle_, 0, SEEK_END)) {
+		filePos_ = -1;
+		setError(POSIX_ERROR_CODE(errno));
+		return -1;
+	}
+
+	filePos_ = fileEnd_ = ftell(handle_);
+	lastOp_ = Op::None;
+	return fileEnd_;
+}
+
+// Call after writing (bytes) to the FILE
+void BufferedFileIO::wrote(size_t bytes) {
+	filePos_ += bytes;
+
+	if (fileEnd_ != -1)
+		fileEnd_ = std::max(fileEnd_, filePos_);
+}
+
+bool BufferedFileIO::writeBack() {
+	if (dirtyBegin_ == dirtyEnd_)
+		return true;
+
+	// Cleared first so an exception thrown from here doesn't try writing it all again
+	size_t begin = dirtyBegin_;
+	size_t len = dirtyEnd_ - dirtyBegin_;
+	dirtyBegin_ = dirtyEnd_ = 0;
+
+	if (!fileSeek(winStart_ + long(begin), Op::Write))
+		return false;
+
+	size_t written = fwrite(buf_.data() + begin, 1, len, handle_);
+	wrote(written);
+
+	if (written != len) {
+		filePos_ = -1;
+		setError(Error::WriteError);
+		return false;
+	}
+
+	return true;
+}
+
+size_t BufferedFileIO::read(void* buf, size_t size, size_t count) {
+	if (!handle_) {
+		setError(Error::FileNotOpen);
+		return 0;
+	}
+
+	u8* out = static_cast<u8*>(buf);
+	size_t bytes = size * count;
+	size_t done = 0;
+
+	while (done < bytes) {
+		if (inWindow(pos_)) {
+			size_t offset = pos_ - winStart_;
+			size_t len = std::min(bytes - done, winLen_ - offset);
+
+			memcpy(out + done, buf_.data() + offset, len);
+			done += len;
+			pos_ += len;
+			continue;
+		}
+
+		if (!writeBack())
+			break;
+
+		size_t remaining = bytes - done;
+
+		// Going through the window would only be an extra copy
+		if (remaining >= bufSize_) {
+			if (!fileSeek(pos_, Op::Read))
+				break;
+
+			size_t len = fread(out + done, 1, remaining, handle_);
+			filePos_ += len;
+			done += len;
+			pos_ += len;
+			break;
+		}
+
+		/**
+		 * Carrying on from the end of the window probably means reading through the file,
+		 * so fill all of it. Otherwise it's likely just following a pointer to read a few
+		 * fields, where filling the whole window would mostly be wasted.
+		 */
+		bool sequential = pos_ == winStart_ + long(winLen_);
+		long start = sequential ? pos_ : pos_ & ~long(RANDOM_READ_SIZE - 1);
+		size_t len = sequential ? bufSize_ : std::min(bufSize_, RANDOM_READ_SIZE);
+
+		if (start + long(len) <= pos_)
+			start = pos_;
+
+		if (!fileSeek(start, Op::Read))
+			break;
+
+		buf_.resize(bufSize_);
+		winStart_ = start;
+		winLen_ = fread(buf_.data(), 1, len, handle_);
+		filePos_ += winLen_;
+
+		if (!inWindow(pos_))
+			break;
+	}
+
+	if (done != bytes) {
+		if (ferror(handle_)) {
+			filePos_ = -1;
+			setError(Error::ReadError);
+		} else {
+			eof_ = true;
+			setError(Error::EndOfFile);
+		}
+	}
+
+	return size ? done / size : 0;
+}
+
+size_t BufferedFileIO::write(const void* buf, size_t size, size_t count) {
+	if (!handle_) {
+		setError(Error::FileNotOpen);
+		return 0;
+	}
+
+	const u8* in = static_cast<const u8*>(buf);
+	size_t bytes = size * count;
+
+	if (!bytes)
+		return 0;
+
+	if (bytes >= bufSize_) {
+		if (!writeBack() || !fileSeek(pos_, Op::Write))
+			return 0;
+
+		// Whatever's in the window might be about to be out of date
+		winLen_ = 0;
+
+		size_t written = fwrite(in, 1, bytes, handle_);
+		wrote(written);
+		pos_ += written;
+
+		if (written != bytes) {
+			filePos_ = -1;
+			setError(Error::WriteError);
+		}
+
+		return written / size;
+	}
+
+	/**
+	 * Writes can only carry on from somewhere already in the window, so that every byte
+	 * between the start of it and the end of what's been written is always valid.
+	 * The exception is skipping past the end of the file, which the file would fill with
+	 * zeroes anyway, so that's done here instead.
+	 */
+	size_t offset = pos_ - winStart_;
+	bool fits = pos_ >= winStart_ && offset + bytes <= bufSize_ && !buf_.empty();
+
+	if (fits && offset > winLen_) {
+		long end = fileEnd();
+		fits = end != -1 && winStart_ + long(winLen_) >= end;
+		if (fits)
+			std::fill(buf_.begin() + winLen_, buf_.begin() + offset, 0);
+	}
+
+	if (!fits) {
+		if (!writeBack())
+			return 0;
+
+		buf_.resize(bufSize_);
+		winStart_ = pos_;
+		winLen_ = 0;
+		offset = 0;
+	}
+
+	memcpy(buf_.data() + offset, in, bytes);
+
+	if (dirtyBegin_ == dirtyEnd_) {
+		dirtyBegin_ = offset;
+		dirtyEnd_ = offset + bytes;
+	} else {
+		dirtyBegin_ = std::min(dirtyBegin_, offset);
+		dirtyEnd_ = std::max(dirtyEnd_, offset + bytes);
+	}
+
+	winLen_ = std::max(winLen_, offset + bytes);
+	pos_ += bytes;
+
+	return count;
+}
+
+bool BufferedFileIO::seek(long offset, Seek origin) {
+	if (!handle_) {
+		setError(Error::FileNotOpen);
+		return false;
+	}
+
+	long pos = 0;
+	switch (origin) {
+		case Seek::Set: {
+			pos = offset;
+			break;
+		}
+
+		case Seek::Cur: {
+			pos = pos_ + offset;
+			break;
+		}
+
+		case Seek::End: {
+			// Only the file knows where its end is, and anything pending may move it
+			if (!writeBack())
+				return false;
+
+			if (fseek(handle_, 0, SEEK_END)) {
+				filePos_ = -1;
+				setError(POSIX_ERROR_CODE(errno));
+				return false;
+			}
+
+			filePos_ = ftell(handle_);
+			lastOp_ = Op::None;
+			pos = filePos_ + offset;
+			break;
+		}
+
+		default: {
+			assert(!"Invalid seek origin");
+		}
+	}
+
+	eof_ = false;
+
+	if (pos < 0) {
+		setError(POSIX_ERROR_CODE(EINVAL));
+		return false;
+	}
+
+	pos_ = pos;
+	return true;
+}
+
+long BufferedFileIO::tell() {
+	if (!handle_) {
+		setError(Error::FileNotOpen);
+		return -1;
+	}
+
+	return pos_;
+}
+
+bool BufferedFileIO::flush() {
+	if (!handle_) {
+		setError(Error::FileNotOpen);
+		return false;
+	}
+
+	return writeBack() && FileIO::flush();
+}
+
+bool BufferedFileIO::close() {
+	if (!handle_)
+		return false;
+
+	bool ok = writeBack();
+
+	pos_ = 0;
+	filePos_ = -1;
+	fileEnd_ = -1;
+	lastOp_ = Op::None;
+	winStart_ = 0;
+	winLen_ = 0;
+
+	return FileIO::close() && ok;
+}
+
+bool BufferedFileIO::bufferSize(size_t size) {
+	if (!writeBack())
+		return false;
+
+	bufSize_ = std::max<size_t>(size, 1);
+	buf_ = {};
+	winLen_ = 0;
+	return true;
+}
+
+std::vector<u8> readFile(const fs::path& path) {
+	FileIO file(path, "rb");
+	file.end();
+
+	std::vector<u8> buf(file.tell());
+	file.jump(0);
+
+	if (!buf.empty())
+		file.readVec(buf);
+
+	return buf;
+}
+
 /* ======================== *
  *         DynBufIO         *
  * ======================== */
@@ -240,7 +578,7 @@ size_t DynBufIO::write(const void* buf, size_t size, size_t count) {
 	memcpy(vec_.data() + cur_, buf, bytes);
 	cur_ += bytes;
 
-	return size;
+	return count;
 }
 
 bool DynBufIO::seek(long offset, Seek origin) {
@@ -310,7 +648,7 @@ size_t SpanIO::write(const void* buf, size_t size, size_t count) {
 	memcpy(span_.data() + cur_, buf, bytes);
 	cur_ += bytes;
 
-	return size;
+	return count;
 }
 
 bool SpanIO::seek(long offset, Seek origin) {
@@ -12,6 +12,9 @@
 // messy and not very good but whatever. works well enough.
 
 namespace manatools::io {
+	template <typename Backend>
+	class Reader;
+
 	class DataIO {
 	public:
 		DataIO(const DataIO&) = delete;
@@ -40,6 +43,7 @@ namespace manatools::io {
 		bool readU16BE(u16* out);
 		bool readU32LE(u32* out);
 		bool readU32BE(u32* out);
+		bool readVLQ(u32* out);
 		bool readBool(bool* out);
 		bool readFourCC(FourCC* out)                       { return read(out->data(), sizeof(char), 4) == 4; }
 
@@ -146,6 +150,10 @@ namespace manatools::io {
 		std::error_code make_error_code(Error e);
 
 	protected:
+		// Reader reports errors the same way anything else reading this would
+		template <typename Backend>
+		friend class Reader;
+
 		DataIO(bool exceptions, bool eofErrors) :
 			exceptions_(exceptions),
 			eofErrors_(eofErrors) {}
@@ -183,6 +191,26 @@ namespace manatools::io {
 	DEFINE_READ_FUNC(u32, LE, U32LE)
 	DEFINE_READ_FUNC(u32, BE, U32BE)
 
+	// At most 4 bytes are read, which is as much as MIDI allows
+	inline bool DataIO::readVLQ(u32* out) {
+		u32 value = 0;
+
+		for (int i = 0; i < 4; i++) {
+			u8 b;
+			if (!readU8(&b)) {
+				*out = 0;
+				return false;
+			}
+
+			value = (value << 7) | (b & 0x7F);
+			if (!(b & 0x80))
+				break;
+		}
+
+		*out = value;
+		return true;
+	}
+
 	inline bool DataIO::readBool(bool* out) {
 		u8 b;
 		bool ret = readU8(&b);
@@ -278,13 +306,64 @@ namespace manatools::io {
 		bool seek(long offset, Seek origin) override;
 		long tell() override;
 
-		bool flush();
-		bool close();
+		virtual bool flush();
+		virtual bool close();
 
-	private:
+	protected:
 		FILE* handle_ = nullptr;
 	};
 
+	/**
+	 * FileIO that goes through its own (large) window of the file rather than calling into
+	 * stdio for every field. Seeks only move a position around, and the window is only
+	 * refilled or written back when something outside of it is touched, so jumping around
+	 * a file to read pointers and writing fixups back don't cost anything extra.
+	 * Reads and writes bigger than the window skip it entirely.
+	 */
+	class BufferedFileIO : public FileIO {
+	public:
+		static constexpr size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+		static constexpr size_t RANDOM_READ_SIZE = 4 * 1024; // Used when jumping somewhere new
+
+		using FileIO::FileIO;
+		~BufferedFileIO() override;
+
+		size_t read(void* buf, size_t size, size_t count) override;
+		size_t write(const void* buf, size_t size, size_t count) override;
+		bool seek(long offset, Seek origin) override;
+		long tell() override;
+
+		bool flush() override;
+		bool close() override;
+
+		size_t bufferSize() const { return bufSize_; }
+		bool bufferSize(size_t size);
+
+	private:
+		// What the FILE did last, since stdio needs a seek between reading and writing
+		enum class Op : u8 { None, Read, Write };
+
+		bool writeBack();
+		bool fileSeek(long pos, Op op);
+		long fileEnd();
+		void wrote(size_t bytes);
+		bool inWindow(long pos) const { return pos >= winStart_ && pos < winStart_ + long(winLen_); }
+
+		std::vector<u8> buf_;
+		size_t bufSize_ = DEFAULT_BUFFER_SIZE;
+
+		long pos_ = 0;       // Where the user thinks we are
+		long filePos_ = -1;  // Where the FILE actually is, -1 if unknown
+		long fileEnd_ = -1;  // Size of the file as far as the FILE knows, -1 if unknown
+		Op lastOp_ = Op::None;
+		long winStart_ = 0;  // File offset of buf_[0]
+		size_t winLen_ = 0;  // Bytes of buf_ that are valid
+
+		// Range of the window that's been written to and not yet written back
+		size_t dirtyBegin_ = 0;
+		size_t dirtyEnd_ = 0;
+	};
+
 	class DynBufIO : public DataIO {
 	public:
 		typedef std::vector<u8> VecType;
@@ -298,6 +377,7 @@ namespace manatools::io {
 		long tell() override;
 
 		VecType& vec()                         { return vec_; }
+		std::span<const u8> bytes() const      { return vec_; }
 		
 		VecType::size_type size() const        { return vec_.size(); }
 		VecType::size_type capacity() const    { return vec_.capacity(); }
@@ -326,6 +406,7 @@ namespace manatools::io {
 		long tell() override;
 
 		SpanType span()                         { return span_; }
+		std::span<const u8> bytes() const       { return span_; }
 		SpanType::size_type size() const        { return span_.size(); }
 
 	private:
@@ -333,6 +414,9 @@ namespace manatools::io {
 		size_t cur_;
 	};
 
+	// Reads all of (path) into memory in one go, for parsing with SpanIO or Reader
+	std::vector<u8> readFile(const fs::path& path);
+
 	/**
 	 * IO code was written at the beginning of the project and I was full of "what if"s when it
 	 * came to error handling, so I allowed multiple types, because EOF might not always be an
@@ -351,9 +435,18 @@ namespace manatools::io {
 			origExceptions(io.exceptions(exceptions)),
 			origEOFErrors(io.eofErrors(eofErrors)) {}
 
+		/**
+		 * Putting exceptions back on throws if there's still an error set, which from a
+		 * destructor (likely while already unwinding from that same error) terminates.
+		 * The error's left on (io) for whoever's interested instead.
+		 */
 		~ErrorHandler() {
-			io.exceptions(origExceptions);
+			io.exceptions(false);
 			io.eofErrors(origEOFErrors);
+
+			try {
+				io.exceptions(origExceptions);
+			} catch (...) {}
 		}
 
 	private:
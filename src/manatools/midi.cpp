@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 
@@ -128,8 +129,237 @@ void File::save(io::DataIO& io) {
 }
 
 void File::save(const fs::path& path) {
-	io::FileIO io(path, "wb");
+	io::BufferedFileIO io(path, "wb");
 	save(io);
 }
 
+File load(io::DataIO& io) {
+	io::ErrorHandler errHandler(io, true, true);
+	File file;
+
+	FourCC magic;
+	u32 headerSize;
+	u16 format;
+	u16 numTracks;
+
+	io.readFourCC(&magic);
+	if (magic != HEADER_MAGIC) {
+		throw std::runtime_error("Invalid MIDI file");
+	}
+
+	io.readU32BE(&headerSize);
+	auto headerEnd = io.tell() + headerSize;
+
+	io.readU16BE(&format);
+	io.readU16BE(&numTracks);
+	io.readU16BE(&file.division);
+	io.jump(headerEnd);
+
+	if (format > 1) {
+		throw std::runtime_error("Unsupported MIDI format: " + std::to_string(format));
+	}
+
+	if (file.division & 0x8000) {
+		throw std::runtime_error("SMPTE MIDI timing is not supported");
+	}
+
+	// Absolute time for each event, as tracks need merging before deltas mean anything
+	struct TimedEvent {
+		u32 time;
+		Event event;
+	};
+
+	std::vector<TimedEvent> timed;
+	u32 endTime = 0;
+
+	for (u16 t = 0; t < numTracks;) {
+		u32 chunkSize;
+		io.readFourCC(&magic);
+		io.readU32BE(&chunkSize);
+
+		auto chunkEnd = io.tell() + chunkSize;
+
+		// Skip over any chunks we don't know of, as the spec says to
+		if (magic != TRACK_MAGIC) {
+			io.jump(chunkEnd);
+			continue;
+		}
+
+		t++;
+
+		// Each track is already in order, so they can be merged in one go afterwards
+		auto trackStart = timed.size();
+		u32 time = 0;
+		u8 runningStatus = 0;
+
+		while (io.tell() < chunkEnd) {
+			u32 delta;
+			io.readVLQ(&delta);
+			time += delta;
+
+			u8 statusByte;
+			io.readU8(&statusByte);
+
+			if (statusByte < 0x80) {
+				if (!runningStatus) {
+					char err[64];
+					snprintf(err, std::size(err), "MIDI data byte without a status at 0x%lx", io.tell() - 1);
+					throw std::runtime_error(err);
+				}
+
+				io.backward(1);
+				statusByte = runningStatus;
+			}
+
+			u8 channel = statusByte & 0x0F;
+			u8 a, b;
+
+			switch (static_cast<Status>(statusByte & 0xF0)) {
+				case Status::NoteOff:
+					io.readU8(&a); io.readU8(&b);
+					timed.push_back({ time, NoteOff { 0, channel, a, b } });
+					runningStatus = statusByte;
+					continue;
+
+				case Status::NoteOn:
+					io.readU8(&a); io.readU8(&b);
+					timed.push_back({ time, NoteOn { 0, channel, a, b } });
+					runningStatus = statusByte;
+					continue;
+
+				case Status::PolyKeyPressure:
+					io.readU8(&a); io.readU8(&b);
+					timed.push_back({ time, PolyKeyPressure { 0, channel, a, b } });
+					runningStatus = statusByte;
+					continue;
+
+				case Status::ControlChange:
+					io.readU8(&a); io.readU8(&b);
+					timed.push_back({ time, ControlChange { 0, channel, a, b } });
+					runningStatus = statusByte;
+					continue;
+
+				case Status::ProgramChange:
+					io.readU8(&a);
+					timed.push_back({ time, ProgramChange { 0, channel, a } });
+					runningStatus = statusByte;
+					continue;
+
+				case Status::ChannelPressure:
+					io.readU8(&a);
+					timed.push_back({ time, ChannelPressure { 0, channel, a } });
+					runningStatus = statusByte;
+					continue;
+
+				case Status::PitchWheelChange: {
+					io.readU8(&a); io.readU8(&b);
+					s16 pitch = ((b & 0x7F) << 7 | (a & 0x7F)) - 0x2000;
+					timed.push_back({ time, PitchWheelChange { 0, channel, pitch } });
+					runningStatus = statusByte;
+					continue;
+				}
+
+				default: {
+					// System messages, handled below
+				}
+			}
+
+			// System messages cancel running status
+			runningStatus = 0;
+
+			if (statusByte == static_cast<u8>(Status::SysEx) || statusByte == static_cast<u8>(Status::EndOfSysEx)) {
+				u32 len;
+				auto lenPos = io.tell();
+				io.readVLQ(&len);
+
+				// Kept as it would be written back out, length and all
+				std::vector<u8> data(io.tell() - lenPos + len);
+				io.jump(lenPos);
+				io.readVec(data);
+
+				// 0xF7 escapes aren't anything File can represent
+				if (statusByte == static_cast<u8>(Status::SysEx))
+					timed.push_back({ time, SysEx { 0, std::move(data) } });
+
+				continue;
+			}
+
+			if (statusByte == static_cast<u8>(Status::MetaEvent)) {
+				u8 type;
+				u32 len;
+				io.readU8(&type);
+				io.readVLQ(&len);
+				auto dataEnd = io.tell() + len;
+
+				switch (static_cast<MetaEvents>(type)) {
+					case MetaEvents::Marker: {
+						std::string text(len, '\0');
+						io.read(text.data(), sizeof(char), len);
+						timed.push_back({ time, MetaEvent { Marker { 0, std::move(text) } } });
+						break;
+					}
+
+					case MetaEvents::SetTempo: {
+						u8 t[3] = {};
+						io.read(t, sizeof(u8), std::min<u32>(len, 3));
+						SetTempo event { 0, 0 };
+						event.tempo = (t[0] << 16) | (t[1] << 8) | t[2];
+						timed.push_back({ time, MetaEvent { event } });
+						break;
+					}
+
+					case MetaEvents::EndOfTrack: {
+						endTime = std::max(endTime, time);
+						break;
+					}
+
+					default: {
+						// Anything else is skipped
+					}
+				}
+
+				io.jump(dataEnd);
+				continue;
+			}
+
+			char err[64];
+			snprintf(err, std::size(err), "Unknown MIDI message encountered at 0x%lx: %x", io.tell() - 1, statusByte);
+			throw std::runtime_error(err);
+		}
+
+		io.jump(chunkEnd);
+		endTime = std::max(endTime, time);
+
+		std::inplace_merge(
+			timed.begin(), timed.begin() + trackStart, timed.end(),
+			[](const TimedEvent& lhs, const TimedEvent& rhs) { return lhs.time < rhs.time; }
+		);
+	}
+
+	file.events.reserve(timed.size() + 1);
+
+	u32 lastTime = 0;
+	for (auto& [time, event] : timed) {
+		u32 delta = time - lastTime;
+		lastTime = time;
+
+		std::visit([&](auto& e) {
+			if constexpr (std::is_same_v<std::decay_t<decltype(e)>, MetaEvent>)
+				std::visit([&](auto& meta) { meta.delta = delta; }, e);
+			else
+				e.delta = delta;
+		}, event);
+
+		file.events.push_back(std::move(event));
+	}
+
+	file.events.push_back(MetaEvent { EndOfTrack { endTime - lastTime } });
+	return file;
+}
+
+File load(const fs::path& path) {
+	io::BufferedFileIO io(path, "rb");
+	return load(io);
+}
+
 } // namespace manatools::midi
@@ -1,4 +1,5 @@
 #pragma once
+#include <stdexcept>
 #include <string>
 #include <variant>
 #include <vector>
@@ -259,4 +260,11 @@ namespace manatools::midi {
 
 		std::vector<Event> events;
 	};
+
+	/**
+	 * Loads SMF0 and SMF1 files, merging every track of the latter into one. Events File
+	 * can't represent are skipped, and EndOfTrack is only included once, at the very end.
+	 */
+	File load(io::DataIO& io);
+	File load(const fs::path& path);
 } // namespace manatools::midi
@@ -1,9 +1,16 @@
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <limits>
+#include <memory>
+#include <numeric>
+#include <span>
 #include <vector>
 
+#include <mio/mmap.hpp>
+
 #include "mlt.hpp"
+#include "mltalloc.hpp"
 #include "io.hpp"
 #include "types.hpp"
 #include "utils.hpp"
@@ -30,8 +37,20 @@ s8 maxBank(FourCC type) {
 	}
 }
 
-MLT MLT::load(const fs::path& path) {
-	io::FileIO io(path, "rb");
+// Owner of mapped unit data, so save can tell when it's about to write over the mapped file
+struct Mapping {
+	Mapping(const fs::path& path) : map(path.native()), path(path) {}
+
+	mio::mmap_source map;
+	fs::path path;
+};
+
+/**
+ * Everything but the unit data itself is read from (io), and (loadData) is called with
+ * each unit and the offset and size of its data to fill it in however the caller likes.
+ */
+template <typename LoadData>
+static MLT loadMLT(io::DataIO& io, const Progress& progress, LoadData&& loadData) {
 	MLT mlt;
 
 	FourCC magic;
@@ -47,7 +66,10 @@ MLT MLT::load(const fs::path& path) {
 	io.forward(20);
 
 	for (u32 i = 0; i < numUnits; i++) {
+		progress.update(i, numUnits);
+
 		Unit unit;
+		u32 fileDataPtr;
 		u32 fileDataSize;
 
 		io.readFourCC(&unit.fourCC);
@@ -55,17 +77,14 @@ MLT MLT::load(const fs::path& path) {
 		io.forward(3);
 		io.readU32LE(&unit.aicaDataPtr);
 		io.readU32LE(&unit.aicaDataSize);
-		io.readU32LE(&unit.fileDataPtr_);
+		io.readU32LE(&fileDataPtr);
 		io.readU32LE(&fileDataSize);
 		io.forward(8);
 
-		if (unit.fileDataPtr_ != UNUSED && fileDataSize != UNUSED) {
+		if (fileDataPtr != UNUSED && fileDataSize != UNUSED) {
 			// At least we get the data size from the get-go, unlike a certain other format
-			unit.data.resize(fileDataSize);
-
 			auto pos = io.tell();
-			io.jump(unit.fileDataPtr_);
-			io.readVec(unit.data);
+			loadData(unit, fileDataPtr, fileDataSize);
 			io.jump(pos);
 		}
 
@@ -74,11 +93,59 @@ MLT MLT::load(const fs::path& path) {
 
 	assert(mlt.units.size() == numUnits);
 
+	progress.update(numUnits, numUnits);
+
 	return mlt;
 }
 
-void MLT::save(const fs::path& path) {
-	io::FileIO io(path, "wb");
+MLT MLT::load(const fs::path& path, const Progress& progress) {
+	io::BufferedFileIO io(path, "rb");
+
+	return loadMLT(io, progress, [&](Unit& unit, u32 start, u32 size) {
+		unit.fileDataPtr_ = start;
+		unit.data_.resize(size);
+		io.jump(start);
+		io.readVec(unit.data_);
+	});
+}
+
+MLT MLT::loadMapped(const fs::path& path, const Progress& progress) {
+	auto mapping = std::make_shared<Mapping>(path);
+	auto bytes = std::span(reinterpret_cast<const u8*>(mapping->map.data()), mapping->map.size());
+
+	// SpanIO wants a mutable span, but it's only ever read from here
+	io::SpanIO io({ const_cast<u8*>(bytes.data()), bytes.size() });
+
+	return loadMLT(io, progress, [&](Unit& unit, u32 start, u32 size) {
+		if (start > bytes.size() || size > bytes.size() - start)
+			throw std::runtime_error("MLT unit data out of bounds");
+
+		unit.fileDataPtr_ = start;
+		unit.view_ = bytes.subspan(start, size);
+		unit.owner_ = mapping;
+	});
+}
+
+void MLT::save(const fs::path& path, const Progress& progress) {
+	/**
+	 * Units viewing the file about to be written over need their own copies first.
+	 * Every owner is a Mapping, as loadMapped is the only thing that sets them.
+	 */
+	if (fs::exists(path)) {
+		for (auto& unit : units) {
+			if (!unit.isView())
+				continue;
+
+			auto mapping = std::static_pointer_cast<const Mapping>(unit.owner_);
+			if (fs::equivalent(mapping->path, path))
+				unit.detach();
+		}
+	}
+
+	// Units are streamed straight into the file, so this is the only chance to back out
+	progress.update(0, units.size());
+
+	io::BufferedFileIO io(path, "wb");
 	char err[80];
 
 	io.writeFourCC(MLT_MAGIC);
@@ -119,7 +186,7 @@ void MLT::save(const fs::path& path) {
 		io.writeU32LE(0);
 		io.writeU32LE(0);
 
-		if (unit.data.size() >= std::numeric_limits<u32>::max()) {
+		if (unit.dataSize() >= std::numeric_limits<u32>::max()) {
 			throw std::runtime_error("MLT unit too large");
 		}
 
@@ -129,17 +196,20 @@ void MLT::save(const fs::path& path) {
 	}
 
 	for (size_t i = 0; i < units.size(); i++) {
+		progress.report(i, units.size());
+
 		auto& unit = units[i];
 		auto pos = io.tell();
 
 		io.jump(unitOffsets[i]);
 
-		if (!unit.data.empty()) {
+		// Views are written straight from the mapped file, without being copied anywhere first
+		if (unit.hasData()) {
 			unit.fileDataPtr_ = pos;
 			io.writeU32LE(unit.fileDataPtr_);
-			io.writeU32LE(unit.data.size());
+			io.writeU32LE(unit.dataSize());
 			io.jump(pos);
-			io.writeVec(unit.data);
+			io.writeSpan(unit.data());
 		} else {
 			unit.fileDataPtr_ = UNUSED;
 			io.writeU32LE(unit.fileDataPtr_);
@@ -155,10 +225,27 @@ void MLT::save(const fs::path& path) {
 	 */
 	auto pos = io.tell();
 	io.writeN<u8>(0x00, utils::roundUp(pos, UNIT_ALIGN) - pos);
+
+	progress.report(units.size(), units.size());
+}
+
+// Notes (unit) down as changed if it has, and returns whether it has
+static bool noteChange(const Unit& unit, u32 origPtr, u32 origSize, size_t idx, Changes* changes) {
+	if (unit.aicaDataPtr == origPtr && unit.aicaDataSize == origSize)
+		return false;
+
+	if (changes)
+		changes->aica.push_back(idx);
+
+	return true;
 }
 
-bool MLT::adjust() {
+bool MLT::adjust(Changes* changes) {
 	bool dataChanged = false;
+
+	if (units.empty())
+		return false;
+
 	auto& first = units[0];
 	u32 origPtr = first.aicaDataPtr;
 	u32 origSize = first.aicaDataSize;
@@ -166,8 +253,7 @@ bool MLT::adjust() {
 	first.aicaDataPtr = utils::roundUp(std::max(first.aicaDataPtr, AICA_BASE), first.alignment());
 	first.aicaDataSize = utils::roundUp(first.aicaDataSize, UNIT_ALIGN);
 
-	if (first.aicaDataPtr != origPtr || first.aicaDataSize != origSize)
-		dataChanged = true;
+	dataChanged |= noteChange(first, origPtr, origSize, 0, changes);
 
 	for (size_t i = 1; i < units.size(); i++) {
 		auto& prev = units[i - 1];
@@ -184,33 +270,33 @@ bool MLT::adjust() {
 		if (cur.aicaDataPtr < minPtr)
 			cur.aicaDataPtr = minPtr;
 
-		if (cur.aicaDataPtr != origPtr || cur.aicaDataSize != origSize)
-			dataChanged = true;
+		dataChanged |= noteChange(cur, origPtr, origSize, i, changes);
 	}
 
 	return dataChanged;
 }
 
-bool MLT::pack(bool useAICASizes) {
+bool MLT::pack(bool useAICASizes, Changes* changes) {
 	bool dataChanged = false;
 	u32 curAICAOffset = AICA_BASE;
 
-	for (auto& unit : units) {
+	for (size_t i = 0; i < units.size(); i++) {
+		auto& unit = units[i];
 		u32 origPtr = unit.aicaDataPtr;
-		u32 origSize;
+		u32 origSize = unit.aicaDataSize;
+		u32 size;
 
 		// Don't read the file sizes for units that don't store data in the file
 		if (useAICASizes || !unit.shouldHaveData()) {
-			origSize = unit.aicaDataSize;
+			size = unit.aicaDataSize;
 		} else {
-			origSize = unit.data.size();
+			size = unit.dataSize();
 		}
 
 		unit.aicaDataPtr = utils::roundUp(curAICAOffset, unit.alignment());
-		unit.aicaDataSize = utils::roundUp(origSize, UNIT_ALIGN);
+		unit.aicaDataSize = utils::roundUp(size, UNIT_ALIGN);
 
-		if (unit.aicaDataPtr != origPtr || unit.aicaDataSize != origSize)
-			dataChanged = true;
+		dataChanged |= noteChange(unit, origPtr, origSize, i, changes);
 
 		curAICAOffset = unit.aicaDataPtr + unit.aicaDataSize;
 	}
@@ -218,13 +304,126 @@ bool MLT::pack(bool useAICASizes) {
 	return dataChanged;
 }
 
-void MLT::move(size_t srcIdx, size_t count, size_t destIdx) {
+/**
+ * Best fit decreasing, with the FPW's 0x1000 alignment going first as it's the awkward one,
+ * and smaller units then filling in whatever it left before them. As there's only ever the
+ * one FPW and every size is a multiple of 0x20 that's as tight as it gets, but made up MLTs
+ * with several could still do better in list order, so that's tried too.
+ */
+static std::vector<u32> bestFitLayout(const std::deque<Unit>& units, u64& highWater) {
+	// No limit, so everything gets somewhere even if it doesn't all fit in AICA RAM
+	Allocator ram(AICA_BASE, std::numeric_limits<u32>::max());
+
+	std::vector<size_t> order(units.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		const auto& unitA = units[a];
+		const auto& unitB = units[b];
+		if (unitA.alignment() != unitB.alignment())
+			return unitA.alignment() > unitB.alignment();
+		return unitA.aicaDataSize > unitB.aicaDataSize;
+	});
+
+	std::vector<u32> offsets(units.size());
+	for (size_t i : order) {
+		const auto& unit = units[i];
+		offsets[i] = *ram.allocate(utils::roundUp(unit.aicaDataSize, UNIT_ALIGN), unit.alignment());
+	}
+
+	highWater = ram.highWater();
+	return offsets;
+}
+
+static std::vector<u32> listOrderLayout(const std::deque<Unit>& units, u64& highWater) {
+	std::vector<u32> offsets(units.size());
+	u64 offset = AICA_BASE;
+
+	for (size_t i = 0; i < units.size(); i++) {
+		offsets[i] = static_cast<u32>(utils::roundUp<u64>(offset, units[i].alignment()));
+		offset = offsets[i] + u64(utils::roundUp(units[i].aicaDataSize, UNIT_ALIGN));
+	}
+
+	highWater = units.empty() ? 0 : offset;
+	return offsets;
+}
+
+bool MLT::repack(Changes* changes) {
+	u64 bestFitTop, listOrderTop;
+	auto offsets = bestFitLayout(units, bestFitTop);
+	auto listOffsets = listOrderLayout(units, listOrderTop);
+	if (listOrderTop < bestFitTop)
+		offsets = std::move(listOffsets);
+
+	// By where units are now, as they're about to be reordered
+	std::vector<bool> changed(units.size());
+
+	for (size_t i = 0; i < units.size(); i++) {
+		auto& unit = units[i];
+		u32 size = utils::roundUp(unit.aicaDataSize, UNIT_ALIGN);
+
+		changed[i] = unit.aicaDataPtr != offsets[i] || unit.aicaDataSize != size;
+
+		unit.aicaDataPtr = offsets[i];
+		unit.aicaDataSize = size;
+	}
+
+	// Back into memory order, with empty units before anything starting at the same place
+	std::vector<size_t> order(units.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		const auto& unitA = units[a];
+		const auto& unitB = units[b];
+		if (unitA.aicaDataPtr != unitB.aicaDataPtr)
+			return unitA.aicaDataPtr < unitB.aicaDataPtr;
+		return unitA.aicaDataSize < unitB.aicaDataSize;
+	});
+
+	bool reordered = !std::ranges::is_sorted(order);
+	bool dataChanged = reordered || std::ranges::find(changed, true) != changed.end();
+
+	if (reordered) {
+		std::deque<Unit> sorted;
+		for (size_t i : order)
+			sorted.push_back(std::move(units[i]));
+
+		units = std::move(sorted);
+	}
+
+	if (changes) {
+		if (reordered)
+			changes->from = order;
+
+		for (size_t i = 0; i < order.size(); i++) {
+			if (changed[order[i]])
+				changes->aica.push_back(i);
+		}
+	}
+
+	return dataChanged;
+}
+
+void MLT::move(size_t srcIdx, size_t count, size_t destIdx, Changes* changes) {
 	auto begin = units.begin();
 
+	if (changes) {
+		// Same rotation as the units get, just on where each one came from
+		changes->from.resize(units.size());
+		std::iota(changes->from.begin(), changes->from.end(), 0);
+	}
+
 	if (destIdx > srcIdx) {
 		std::rotate(begin + srcIdx, begin + srcIdx + count, begin + destIdx);
+		if (changes) {
+			auto from = changes->from.begin();
+			std::rotate(from + srcIdx, from + srcIdx + count, from + destIdx);
+		}
 	} else {
 		std::rotate(begin + destIdx, begin + srcIdx, begin + srcIdx + count);
+		if (changes) {
+			auto from = changes->from.begin();
+			std::rotate(from + destIdx, from + srcIdx, from + srcIdx + count);
+		}
+
 		auto it = begin + destIdx;
 		auto end = it + count;
 
@@ -239,7 +438,9 @@ void MLT::move(size_t srcIdx, size_t count, size_t destIdx) {
 		
 		// all alignment related stuff can be dealt with with a subsequent `adjust` call
 		while (it < end) {
+			u32 origPtr = it->aicaDataPtr;
 			it->aicaDataPtr = startOffset;
+			noteChange(*it, origPtr, it->aicaDataSize, it - begin, changes);
 			startOffset = it->aicaDataPtr + it->aicaDataSize;
 			it++;
 		}
@@ -1,9 +1,12 @@
 #pragma once
 #include <deque>
+#include <memory>
+#include <span>
 #include <vector>
 
 #include "filesystem.hpp"
 #include "fourcc.hpp"
+#include "progress.hpp"
 #include "types.hpp"
 
 namespace manatools::mlt {
@@ -30,14 +33,43 @@ namespace manatools::mlt {
 		Unit(FourCC fourCC, s8 bank = 0, u32 aicaDataPtr = 0, u32 aicaDataSize = 0) :
 			fourCC(fourCC), bank(bank), aicaDataPtr(aicaDataPtr), aicaDataSize(aicaDataSize) {}
 
-		Unit(FourCC fourCC, const std::vector<u8>& data, s8 bank = 0, u32 aicaDataPtr = 0, u32 aicaDataSize = 0) :
-			fourCC(fourCC), bank(bank), aicaDataPtr(aicaDataPtr), aicaDataSize(aicaDataSize), data(data) {}
+		Unit(FourCC fourCC, std::vector<u8> data, s8 bank = 0, u32 aicaDataPtr = 0, u32 aicaDataSize = 0) :
+			fourCC(fourCC), bank(bank), aicaDataPtr(aicaDataPtr), aicaDataSize(aicaDataSize), data_(std::move(data)) {}
 
 		FourCC fourCC;
 		s8 bank;
 		u32 aicaDataPtr;
 		u32 aicaDataSize;
-		std::vector<u8> data;
+
+		/**
+		 * A unit's file data is either its own, or a view into a mapped MLT (see loadMapped)
+		 * that's only copied once something wants to change it.
+		 */
+		bool isView() const                  { return owner_ != nullptr; }
+		std::span<const u8> data() const     { return isView() ? view_ : std::span<const u8>(data_); }
+		size_t dataSize() const              { return data().size(); }
+		bool hasData() const                 { return !data().empty(); }
+
+		std::vector<u8>& mutableData() {
+			detach();
+			return data_;
+		}
+
+		void setData(std::vector<u8> data) {
+			view_ = {};
+			owner_.reset();
+			data_ = std::move(data);
+		}
+
+		// Takes a copy of the data being viewed, if any
+		void detach() {
+			if (!isView())
+				return;
+
+			data_.assign(view_.begin(), view_.end());
+			view_ = {};
+			owner_.reset();
+		}
 
 		s8 maxBank() const { return mlt::maxBank(fourCC); }
 		bool bankInRange() const { return mlt::bankInRange(fourCC, bank); }
@@ -48,15 +80,55 @@ namespace manatools::mlt {
 	private:
 		friend struct MLT;
 		u32 fileDataPtr_ = UNUSED;
+
+		std::vector<u8> data_;
+		std::span<const u8> view_;
+		std::shared_ptr<const void> owner_;
 	};
 
-	struct MLT {
-		static MLT load(const fs::path& path);
-		void save(const fs::path& path);
+	/**
+	 * What adjust, pack, repack or move did to units, so anything showing them can update just
+	 * the ones that changed rather than everything.
+	 */
+	struct Changes {
+		// Where each unit was before, by where it is now. Empty if nothing was reordered
+		std::vector<size_t> from;
+
+		// Units (by where they are now) whose AICA offset or size changed, in order
+		std::vector<size_t> aica;
+	};
 
-		bool adjust();
-		bool pack(bool useAICASizes);
-		void move(size_t srcIdx, size_t count, size_t destIdx);
+	struct MLT {
+		// (progress) is updated once per unit
+		static MLT load(const fs::path& path, const Progress& progress = {});
+
+		/**
+		 * Same as load, but the file is memory mapped and unit data is left in place as views
+		 * into it, so only the unit table is read up front. Saving streams untouched units
+		 * straight from the mapping, and saving over the mapped file itself is fine, but don't
+		 * let anything else write to it while units still view it.
+		 */
+		static MLT loadMapped(const fs::path& path, const Progress& progress = {});
+
+		/**
+		 * (progress) is updated once per unit, but as units are written straight into the
+		 * file it can only be cancelled before anything's written.
+		 */
+		void save(const fs::path& path, const Progress& progress = {});
+
+		// (changes), if given, gets what was changed added to it
+		bool adjust(Changes* changes = nullptr);
+		bool pack(bool useAICASizes, Changes* changes = nullptr);
+
+		/**
+		 * Lays units out to use as little AICA RAM as it can, going by their AICA sizes, and
+		 * reorders them to match where they ended up (as adjust expects). Unlike pack, the
+		 * order they were in doesn't matter, so units that need bigger alignment don't leave
+		 * holes behind them. Whether it all fits under AICA_MAX is for the caller to check.
+		 */
+		bool repack(Changes* changes = nullptr);
+
+		void move(size_t srcIdx, size_t count, size_t destIdx, Changes* changes = nullptr);
 
 		u32 aicaNextOffset(u32 offset) const;
 		uintptr_t aicaUsed() const;
@@ -68,7 +140,11 @@ namespace manatools::mlt {
 		std::deque<Unit> units;
 	};
 
-	inline MLT load(const fs::path& path) {
-		return MLT::load(path);
+	inline MLT load(const fs::path& path, const Progress& progress = {}) {
+		return MLT::load(path, progress);
+	}
+
+	inline MLT loadMapped(const fs::path& path, const Progress& progress = {}) {
+		return MLT::loadMapped(path, progress);
 	}
 } // namespace manatools::mlt
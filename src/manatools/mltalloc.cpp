@@ -0,0 +1,118 @@
+#include <algorithm>
+
+#include "mltalloc.hpp"
+#include "utils.hpp"
+
+namespace manatools::mlt {
+
+Allocator::Allocator(const MLT& mlt) :
+	Allocator()
+{
+	rebuild(mlt);
+}
+
+void Allocator::clear() {
+	ranges_.clear();
+	ends_.clear();
+}
+
+void Allocator::rebuild(const MLT& mlt) {
+	clear();
+	for (const auto& unit : mlt.units)
+		insert(unit.aicaDataPtr, unit.aicaDataSize);
+}
+
+void Allocator::insert(u32 offset, u32 size) {
+	u64 end = u64(offset) + size;
+	ranges_.emplace(offset, end);
+	ends_.insert(end);
+}
+
+bool Allocator::erase(u32 offset, u32 size) {
+	u64 end = u64(offset) + size;
+	auto [begin, last] = ranges_.equal_range(offset);
+
+	for (auto it = begin; it != last; it++) {
+		if (it->second == end) {
+			ranges_.erase(it);
+			ends_.erase(ends_.find(end));
+			return true;
+		}
+	}
+
+	return false;
+}
+
+u32 Allocator::nextOffset(u32 offset) const {
+	auto it = ranges_.upper_bound(offset);
+	return it != ranges_.end() ? it->first : limit_;
+}
+
+u64 Allocator::highWater() const {
+	return ends_.empty() ? 0 : *ends_.rbegin();
+}
+
+std::vector<Allocator::Range> Allocator::gaps() const {
+	std::vector<Range> gaps;
+
+	// Ranges are in order of where they start, so anything before (covered) is taken
+	u64 covered = base_;
+	for (const auto& [start, end] : ranges_) {
+		if (start > covered)
+			gaps.push_back({ static_cast<u32>(covered), std::min(start, limit_) });
+
+		covered = std::max(covered, end);
+		if (covered >= limit_)
+			return gaps;
+	}
+
+	if (covered < limit_)
+		gaps.push_back({ static_cast<u32>(covered), limit_ });
+
+	return gaps;
+}
+
+u32 Allocator::gapBytes() const {
+	u64 top = highWater();
+	u32 total = 0;
+
+	for (const auto& gap : gaps()) {
+		if (gap.start >= top)
+			break;
+		total += static_cast<u32>(std::min<u64>(gap.end, top) - gap.start);
+	}
+
+	return total;
+}
+
+std::optional<u32> Allocator::find(u32 size, u32 align, Fit fit) const {
+	std::optional<u32> best;
+	u64 bestLeft = 0;
+
+	for (const auto& gap : gaps()) {
+		// 64-bit, as the limit can be right up against the top of u32
+		u64 offset = utils::roundUp<u64>(gap.start, align);
+		if (offset + size > gap.end)
+			continue;
+
+		if (fit == Fit::First)
+			return static_cast<u32>(offset);
+
+		u64 left = gap.end - (offset + size);
+		if (!best || left < bestLeft) {
+			best = static_cast<u32>(offset);
+			bestLeft = left;
+		}
+	}
+
+	return best;
+}
+
+std::optional<u32> Allocator::allocate(u32 size, u32 align, Fit fit) {
+	auto offset = find(size, align, fit);
+	if (offset)
+		insert(*offset, size);
+	return offset;
+}
+
+} // namespace manatools::mlt
@@ -0,0 +1,76 @@
+#pragma once
+#include <map>
+#include <optional>
+#include <set>
+#include <vector>
+
+#include "mlt.hpp"
+#include "types.hpp"
+
+namespace manatools::mlt {
+	/**
+	 * Ordered index of which parts of AICA RAM are taken, so finding what comes after an
+	 * offset or how high memory goes is a lookup rather than a walk over every unit, and
+	 * free space can be handed out without shoving everything after it along.
+	 *
+	 * Ranges are allowed to overlap, as some MLTs in the wild do that on purpose (i.e. a PSR
+	 * buffer over a bank that's only needed at boot), and empty ones are kept too so that
+	 * nextOffset and highWater agree with MLT::aicaNextOffset and MLT::aicaUsed.
+	 */
+	class Allocator {
+	public:
+		enum class Fit {
+			First, // Lowest gap that fits
+			Best   // Gap with the least left over, so big gaps are kept for big units
+		};
+
+		struct Range {
+			u32 start;
+			u32 end;
+
+			u32 size() const { return end - start; }
+		};
+
+		explicit Allocator(u32 base = AICA_BASE, u32 limit = AICA_MAX) : base_(base), limit_(limit) {}
+
+		// Indexes where every unit in (mlt) currently is
+		explicit Allocator(const MLT& mlt);
+
+		void clear();
+		void rebuild(const MLT& mlt);
+
+		void insert(u32 offset, u32 size);
+
+		// Returns false if there wasn't a range at exactly (offset) with (size)
+		bool erase(u32 offset, u32 size);
+
+		// Start of the first range after (offset), or the limit if there aren't any
+		u32 nextOffset(u32 offset) const;
+
+		// End of the highest range, or 0 if there are none. 64-bit, as a unit can end past 4GB
+		u64 highWater() const;
+
+		// Free space between base and the limit, in order
+		std::vector<Range> gaps() const;
+
+		// Free space below the high water mark, i.e. what repacking could get back
+		u32 gapBytes() const;
+
+		// Where (size) bytes aligned to (align) would go, if they fit anywhere under the limit
+		std::optional<u32> find(u32 size, u32 align, Fit fit = Fit::Best) const;
+
+		// Same as find, but takes the space too
+		std::optional<u32> allocate(u32 size, u32 align, Fit fit = Fit::Best);
+
+		u32 base() const  { return base_; }
+		u32 limit() const { return limit_; }
+
+	private:
+		u32 base_;
+		u32 limit_;
+
+		// Ends are 64-bit so a bogus offset and size from a file can't wrap around to look small
+		std::multimap<u32, u64> ranges_; // Start to end
+		std::multiset<u64> ends_;
+	};
+} // namespace manatools::mlt
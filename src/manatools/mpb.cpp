@@ -1,15 +1,25 @@
+#include <array>
 #include <cassert>
 #include <cstring>
+#include <limits>
 #include <map>
+#include <memory>
+#include <optional>
+#include <span>
 #include <stdexcept>
 #include <unordered_map>
 #include <utility>
 
+#include <mio/mmap.hpp>
+
 #include "mpb.hpp"
 #include "io.hpp"
+#include "reader.hpp"
 #include "tone.hpp"
+#include "tonestore.hpp"
 #include "types.hpp"
 #include "utils.hpp"
+#include "writer.hpp"
 
 #define WRITEBITS(dest, src, offset, size) (dest = utils::writeBits(dest, src, offset, size))
 
@@ -20,8 +30,16 @@ enum SplitFlags {
 	sfLoop  = 1 << 1
 };
 
-Bank load(const fs::path& path, bool guessToneSize) {
-	io::FileIO io(path, "rb");
+constexpr size_t LAYER_SIZE = 16;
+constexpr size_t SPLIT_SIZE = 48;
+
+/**
+ * Everything but the tone data itself is read from (in), and (loadTone) is called with
+ * the offset and size of each tone to get its data however the caller likes.
+ */
+template <typename LoadTone>
+static Bank loadBank(io::SpanIO& in, bool guessToneSize, const Progress& progress, LoadTone&& loadTone) {
+	io::Reader<io::SpanIO> io(in);
 	Bank bank;
 	std::map<u32, u32> tonePtrMap;
 
@@ -66,6 +84,8 @@ Bank load(const fs::path& path, bool guessToneSize) {
 	// ============ Programs ============
 	io.jump(ptrPrograms);
 	for (u32 p = 0; p < numPrograms; p++) {
+		progress.update(p, numPrograms);
+
 		Program program;
 
 		u32 ptrProgram;
@@ -90,14 +110,15 @@ Bank load(const fs::path& path, bool guessToneSize) {
 				u32 numSplits;
 				u32 ptrSplits;
 
-				io.readU32LE(&numSplits);
-				io.readU32LE(&ptrSplits);
+				auto rec = io.record<LAYER_SIZE>();
+				rec.readU32LE(&numSplits);
+				rec.readU32LE(&ptrSplits);
 
-				io.readU16LE(&layer.delay);
-				io.readU16LE(&layer.unk1);
-				io.readU8(&layer.bendRangeHigh);
-				io.readU8(&layer.bendRangeLow);
-				io.readU16LE(&layer.unk2);
+				rec.readU16LE(&layer.delay);
+				rec.readU16LE(&layer.unk1);
+				rec.readU8(&layer.bendRangeHigh);
+				rec.readU8(&layer.bendRangeLow);
+				rec.readU16LE(&layer.unk2);
 
 				layer.splits.reserve(numSplits);
 
@@ -108,11 +129,13 @@ Bank load(const fs::path& path, bool guessToneSize) {
 				for (u32 s = 0; s < numSplits; s++) {
 					Split split;
 
+					auto rec = io.record<SPLIT_SIZE>();
+
 					u8 jump;
-					io.readU8(&jump);
+					rec.readU8(&jump);
 
 					u8 flags;
-					io.readU8(&flags);
+					rec.readU8(&flags);
 					split.unkFlags = flags & 0b11111100;
 
 					if (flags & sfADPCM)
@@ -128,14 +151,14 @@ Bank load(const fs::path& path, bool guessToneSize) {
 					split.loop = flags & sfLoop;
 
 					u16 ptrToneData;
-					io.readU16LE(&ptrToneData);
+					rec.readU16LE(&ptrToneData);
 					split.ptrToneData_ = ptrToneData + ((jump & 0x7F) << 16);
 
-					io.readU16LE(&split.loopStart);
-					io.readU16LE(&split.loopEnd);
+					rec.readU16LE(&split.loopStart);
+					rec.readU16LE(&split.loopEnd);
 
 					u32 ampBitfield;
-					io.readU32LE(&ampBitfield);
+					rec.readU32LE(&ampBitfield);
 					split.amp.attackRate     = utils::readBits(ampBitfield,  0, 5);
 					split.amp.decayRate1     = utils::readBits(ampBitfield,  6, 5); // 1 unknown bit before this
 					split.amp.decayRate2     = utils::readBits(ampBitfield, 11, 5);
@@ -145,7 +168,7 @@ Bank load(const fs::path& path, bool guessToneSize) {
 					split.amp.LPSLNK         = utils::readBits(ampBitfield, 30, 1); // 1 unknown bit after this
 
 					u16 pitchBitfield;
-					io.readU16LE(&pitchBitfield);
+					rec.readU16LE(&pitchBitfield);
 					split.pitch.FNS = utils::readBits(pitchBitfield, 0, 11);
 					split.pitch.OCT = utils::readBits(pitchBitfield, 11, 4);
 
@@ -157,7 +180,7 @@ Bank load(const fs::path& path, bool guessToneSize) {
 					}
 
 					u16 lfoBitfield;
-					io.readU16LE(&lfoBitfield);
+					rec.readU16LE(&lfoBitfield);
 					split.lfo.ampDepth   = utils::readBits(lfoBitfield,  0, 3);
 					split.lfo.ampWave    = static_cast<LFOWaveType>(utils::readBits(lfoBitfield,  3, 2)); // ugh
 					split.lfo.pitchDepth = utils::readBits(lfoBitfield,  5, 3);
@@ -166,51 +189,51 @@ Bank load(const fs::path& path, bool guessToneSize) {
 					split.lfo.sync       = utils::readBits(lfoBitfield, 15, 1);
 
 					u8 fxBitfield;
-					io.readU8(&fxBitfield);
+					rec.readU8(&fxBitfield);
 					split.fx.inputCh = utils::readBits(fxBitfield, 0, 4);
 					split.fx.level   = utils::readBits(fxBitfield, 4, 4);
 
-					io.readU8(&split.unk1);
+					rec.readU8(&split.unk1);
 
 					u8 pan;
-					io.readU8(&pan);
+					rec.readU8(&pan);
 					split.panPot = Split::fromPanPot(pan);
-					io.readU8(&split.directLevel);
+					rec.readU8(&split.directLevel);
 
 					u8 filterBitfield;
-					io.readU8(&filterBitfield);
+					rec.readU8(&filterBitfield);
 					split.filter.resonance = utils::readBits(filterBitfield, 0, 5);
 					split.filter.on        = !utils::readBits(filterBitfield, 5, 1);
 					split.filter.voff      = utils::readBits(filterBitfield, 6, 1);
 
-					io.readU8(&split.oscillatorLevel);
+					rec.readU8(&split.oscillatorLevel);
 					split.oscillatorLevel = ~split.oscillatorLevel;
 
-					io.readU16LE(&split.filter.startLevel);
-					io.readU16LE(&split.filter.attackLevel);
-					io.readU16LE(&split.filter.decayLevel1);
-					io.readU16LE(&split.filter.decayLevel2);
-					io.readU16LE(&split.filter.releaseLevel);
-					io.readU8(&split.filter.decayRate1);
-					io.readU8(&split.filter.attackRate);
-					io.readU8(&split.filter.releaseRate);
-					io.readU8(&split.filter.decayRate2);
+					rec.readU16LE(&split.filter.startLevel);
+					rec.readU16LE(&split.filter.attackLevel);
+					rec.readU16LE(&split.filter.decayLevel1);
+					rec.readU16LE(&split.filter.decayLevel2);
+					rec.readU16LE(&split.filter.releaseLevel);
+					rec.readU8(&split.filter.decayRate1);
+					rec.readU8(&split.filter.attackRate);
+					rec.readU8(&split.filter.releaseRate);
+					rec.readU8(&split.filter.decayRate2);
 
-					io.readU8(&split.startNote);
-					io.readU8(&split.endNote);
-					io.readU8(&split.baseNote);
-					io.readS8(&split.fineTune);
+					rec.readU8(&split.startNote);
+					rec.readU8(&split.endNote);
+					rec.readU8(&split.baseNote);
+					rec.readS8(&split.fineTune);
 
-					io.readU16LE(&split.unk2);
+					rec.readU16LE(&split.unk2);
 
-					io.readU8(&split.velocityCurveID);
-					io.readU8(&split.velocityLow);
-					io.readU8(&split.velocityHigh);
+					rec.readU8(&split.velocityCurveID);
+					rec.readU8(&split.velocityLow);
+					rec.readU8(&split.velocityHigh);
 
-					io.readBool(&split.drumMode);
-					io.readU8(&split.drumGroupID);
+					rec.readBool(&split.drumMode);
+					rec.readU8(&split.drumGroupID);
 
-					io.readU8(&split.unk3);
+					rec.readU8(&split.unk3);
 
 					u8 bitdepth = tone::bitdepth(split.tone.format);
 					u32 endBytes = std::ceil(split.loopEnd * (bitdepth / 8.0));
@@ -241,7 +264,7 @@ Bank load(const fs::path& path, bool guessToneSize) {
 	io.jump(ptrVelocities);
 	for (u32 i = 0; i < numVelocities; i++) {
 		Velocity velocity;
-		io.readArrT(velocity.data);
+		io.record<sizeof(velocity.data)>().readArrT(velocity.data);
 		bank.velocities.push_back(std::move(velocity));
 	}
 
@@ -288,10 +311,7 @@ Bank load(const fs::path& path, bool guessToneSize) {
 			size = it->second;
 		}
 
-		io.jump(start);
-		auto toneData = tone::makeDataPtr(size);
-		io.readVec(*toneData);
-		toneDataMap.insert({ start, toneData });
+		toneDataMap.insert({ start, loadTone(start, size) });
 	}
 
 	for (auto& program : bank.programs) {
@@ -312,121 +332,110 @@ Bank load(const fs::path& path, bool guessToneSize) {
 		}
 	}
 
+	progress.update(numPrograms, numPrograms);
+
 	// And the copy *should* be elided
 	return bank;
 }
 
-void Bank::save(const fs::path& path) {
-	io::DynBufIO::VecType outBuf;
-	io::DynBufIO io(outBuf);
+Bank load(const fs::path& path, bool guessToneSize, const Progress& progress) {
+	auto buf = io::readFile(path);
+	io::SpanIO io(buf);
 
-	// ============ Start header ============
+	return loadBank(io, guessToneSize, progress, [&](u32 start, size_t size) {
+		io.jump(start);
+		auto toneData = tone::makeDataPtr(size);
+		io.readSpan(toneData->mutableSpan());
+		return toneData;
+	});
+}
 
-	io.writeFourCC(drum ? MDB_MAGIC : MPB_MAGIC);
-	io.writeU32LE(version);
+Bank loadMapped(const fs::path& path, bool guessToneSize, const Progress& progress) {
+	auto map = std::make_shared<mio::mmap_source>(path.native());
+	auto bytes = std::span(reinterpret_cast<const u8*>(map->data()), map->size());
 
-	auto fileSizePos = io.tell();
-	io.writeU32LE(0);
-	io.writeU32LE(0); // unknown
+	// SpanIO wants a mutable span, but it's only ever read from here
+	io::SpanIO io({ const_cast<u8*>(bytes.data()), bytes.size() });
 
-	auto ptrProgramPtrsPos = io.tell();
-	io.writeU32LE(0);
+	return loadBank(io, guessToneSize, progress, [&](u32 start, size_t size) {
+		if (start > bytes.size() || size > bytes.size() - start)
+			throw std::runtime_error("MPB tone data out of bounds");
 
-	if (programs.size() >= MAX_PROGRAMS)
-		throw std::runtime_error("Too many programs in MPB");
-	io.writeU32LE(programs.size());
+		return std::make_shared<tone::Data>(bytes.subspan(start, size), map);
+	});
+}
 
-	auto ptrVelocitiesPos = io.tell();
-	io.writeU32LE(0);
+constexpr size_t HEADER_SIZE         = 48;
+constexpr size_t PROGRAM_HEADER_SIZE = MAX_LAYERS * sizeof(u32) + 8;
+constexpr size_t VELOCITY_SIZE       = sizeof(Velocity::data);
+constexpr size_t UNK1_SIZE           = 12;
+constexpr size_t UNK2_SIZE           = 4;
 
-	if (velocities.size() >= MAX_VELOCITIES)
-		throw std::runtime_error("Too many velocities in MPB");
-	io.writeU32LE(velocities.size());
+/**
+ * Where everything in a saved bank goes, all worked out before anything is written so the
+ * file can be written front to back in one go, rather than going back to fill in pointers.
+ */
+struct Layout {
+	u32 programPtrs = 0;
+	u32 velocities  = 0;
+	u32 unk1        = 0;
+	u32 unk2        = 0;
+
+	std::vector<u32> programs;
+	std::vector<std::array<u32, MAX_LAYERS>> layers; // 0 where there's no layer
+	std::vector<std::array<u32, MAX_LAYERS>> splits;
+
+	std::vector<tone::DataPtr> splitTones; // Every split's tone, in the order splits are written
+	std::vector<tone::DataPtr> tones;      // Unique tones, in the order they're written
+	std::unordered_map<const tone::Data*, u32> tonePtrs;
+
+	u32 end  = 0; // Where the checksum goes, after the last tone
+	u32 size = 0; // The whole file, including the checksum, end magic and padding
+};
 
-	auto ptrUnk1Pos = io.tell();
-	io.writeU32LE(0);
-	io.writeU32LE(1); // numUnk1
+static Layout planBank(const Bank& bank) {
+	Layout layout;
 
-	auto ptrUnk2Pos = io.tell();
-	io.writeU32LE(0);
-	io.writeU32LE(1); // numUnk2
+	if (bank.programs.size() >= MAX_PROGRAMS)
+		throw std::runtime_error("Too many programs in MPB");
 
-	// ============ End header ============
+	if (bank.velocities.size() >= MAX_VELOCITIES)
+		throw std::runtime_error("Too many velocities in MPB");
 
-	/**
-	 * Write an empty array, which shall later contain offsets to each program
-	 * once they are known.
-	 */
-	auto programPtrsPos = io.tell();
-	io.jump(ptrProgramPtrsPos);
-	io.writeU32LE(programPtrsPos);
-	io.jump(programPtrsPos);
-	for (size_t i = 0; i < programs.size(); i++) {
-		io.writeU32LE(0);
-	}
+	size_t pos = HEADER_SIZE;
 
-	// Write an array containing each velocity curve, which are 128 bytes each
-	auto velocitiesPos = io.tell();
-	io.jump(ptrVelocitiesPos);
-	io.writeU32LE(velocitiesPos);
-	io.jump(velocitiesPos);
-	for (const auto& velocity : velocities) {
-		io.writeArrT(velocity.data);
-	}
+	layout.programPtrs = pos;
+	pos += bank.programs.size() * sizeof(u32);
 
-	/**
-	 * I have zero clue what these are and they always seem to be the same
-	 * almost-null data but I still feel I'm required to write them properly.
-	 * TODO: Copy data from loaded file in case it differs?
-	 */
-	auto unk1Pos = io.tell();
-	io.jump(ptrUnk1Pos);
-	io.writeU32LE(unk1Pos);
-	io.jump(unk1Pos);
-	io.writeU32LE(0x00800000);
-	io.writeU32LE(0x00800080);
-	io.writeU32LE(0x00000080);
+	layout.velocities = pos;
+	pos += bank.velocities.size() * VELOCITY_SIZE;
 
-	auto unk2Pos = io.tell();
-	io.jump(ptrUnk2Pos);
-	io.writeU32LE(unk2Pos);
-	io.jump(unk2Pos);
-	io.writeU32LE(0);
+	layout.unk1 = pos;
+	pos += UNK1_SIZE;
 
-	std::vector<std::vector<u32>> splitPtrs(programs.size());
+	layout.unk2 = pos;
+	pos += UNK2_SIZE;
 
-	for (size_t p = 0; p < programs.size(); p++) {
-		const auto& program = programs[p];
+	layout.programs.resize(bank.programs.size());
+	layout.layers.resize(bank.programs.size());
+	layout.splits.resize(bank.programs.size());
 
-		// Write the position of this program to the program pointer array
-		auto programPos = io.tell();
-		io.jump(programPtrsPos + (p * sizeof(u32)));
-		io.writeU32LE(programPos);
-		io.jump(programPos);
+	// Each program's header, then its layers, then every layer's splits
+	for (size_t p = 0; p < bank.programs.size(); p++) {
+		const auto& program = bank.programs[p];
 
-		// Write an empty layer pointer array
-		for (size_t i = 0; i < program.layers.size(); i++) {
-			io.writeU32LE(0);
-		}
+		layout.programs[p] = pos;
+		pos += PROGRAM_HEADER_SIZE;
 
-		/**
-		 * 8 unknown (seemingly unused) bytes
-		 * TODO: copy these from loaded file too?
-		 */
-		for (int i = 0; i < 2; i++) {
-			io.writeU32LE(0);
+		for (size_t l = 0; l < MAX_LAYERS; l++) {
+			layout.layers[p][l] = program.layers[l] ? pos : 0;
+			if (program.layers[l])
+				pos += LAYER_SIZE;
 		}
 
-		std::vector<u32> ptrSplitsPtrs(program.layers.size());
-
-		for (size_t l = 0; l < program.layers.size(); l++) {
+		for (size_t l = 0; l < MAX_LAYERS; l++) {
 			const auto& layer = program.layers[l];
-
-			// Write the position of this layer to the program's layer pointer array
-			auto layerPos = io.tell();
-			io.jump(programPos + (l * sizeof(u32)));
-			io.writeU32LE(layer ? layerPos : 0);
-			io.jump(layerPos);
+			layout.splits[p][l] = 0;
 
 			if (!layer)
 				continue;
@@ -437,211 +446,289 @@ void Bank::save(const fs::path& path) {
 				throw std::runtime_error(err);
 			}
 
-			io.writeU32LE(layer->splits.size());
+			layout.splits[p][l] = pos;
+			pos += layer->splits.size() * SPLIT_SIZE;
+		}
+	}
 
-			ptrSplitsPtrs[l] = io.tell();
-			io.writeU32LE(0);
+	/**
+	 * Tone data goes after everything else, as it should ideally be written consecutively.
+	 * Tones with the same contents are written once, even if they weren't loaded as the
+	 * same data.
+	 *
+	 * OSB requires padding, presumably because Manatee requires the magic to be aligned to
+	 * read it, but MPB doesn't have data magic so I wouldn't think that to be applicable,
+	 * and after inspecting numerous files this seems to be true.
+	 */
+	tone::Store toneStore;
 
-			io.writeU16LE(layer->delay);
-			io.writeU16LE(layer->unk1);
-			io.writeU8(layer->bendRangeHigh);
-			io.writeU8(layer->bendRangeLow);
-			io.writeU16LE(layer->unk2);
+	for (size_t p = 0; p < bank.programs.size(); p++) {
+		for (size_t l = 0; l < MAX_LAYERS; l++) {
+			const auto& layer = bank.programs[p].layers[l];
+			if (!layer)
+				continue;
+
+			for (size_t s = 0; s < layer->splits.size(); s++) {
+				const auto& split = layer->splits[s];
+				auto toneData = toneStore.intern(split.tone.data);
+				layout.splitTones.push_back(toneData);
+
+				if (!toneData || layout.tonePtrs.contains(toneData.get()))
+					continue;
+
+				if (split.tone.samples() >= tone::MAX_SAMPLES) {
+					char err[96];
+					snprintf(err, std::size(err), "Too many samples (>%zu) in MPB tone %zu:%zu:%zu", tone::MAX_SAMPLES, p, l, s);
+					throw std::runtime_error(err);
+				}
+
+				layout.tonePtrs[toneData.get()] = pos;
+				layout.tones.push_back(toneData);
+				pos += toneData->size();
+			}
 		}
+	}
 
-		splitPtrs[p].resize(program.layers.size());
+	layout.end = pos;
 
-		for (size_t l = 0; l < program.layers.size(); l++) {
-			const auto& layer = program.layers[l];
+	// Version 1 does not store a checksum
+	if ((bank.version & 0xFF) >= 2)
+		pos += sizeof(u32);
 
-			if (!layer)
-				continue;
+	// Almost same situation as MLT, I hope this is right though
+	pos += 4; // MPB_END
+	pos = utils::roundUp(pos, 32);
 
-			assert(ptrSplitsPtrs[l]);
+	if (pos > std::numeric_limits<u32>::max())
+		throw std::runtime_error("MPB too large");
 
-			// Write the position of where this layer's split data starts
-			auto splitsPos = io.tell();
-			io.jump(ptrSplitsPtrs[l]);
-			io.writeU32LE(splitsPos);
-			io.jump(splitsPos);
+	layout.size = pos;
+	return layout;
+}
 
-			splitPtrs[p][l] = splitsPos;
+// Splits without tone data are left pointing at nothing
+static void writeSplit(io::Writer& io, const Split& split, std::optional<u32> tonePos, u32 version) {
+	// The only unknown flags I've seen in the wild are the 2 MSBs
+	u8 flags = split.unkFlags & 0b11111100;
 
-			for (size_t s = 0; s < layer->splits.size(); s++) {
-				const auto& split = layer->splits[s];
+	if (split.loop)
+		flags |= sfLoop;
+
+	if (split.tone.format == tone::Format::ADPCM)
+		flags |= sfADPCM;
 
-				// The only unknown flags I've seen in the wild are the 2 MSBs
-				u8 flags = split.unkFlags & 0b11111100;
+	u8 jump = 0;
+	if (tonePos) {
+		jump = (*tonePos >> 16) & 0x7F;
+		if (split.tone.format == tone::Format::PCM8)
+			jump |= 0x80;
+	}
 
-				if (split.loop)
-					flags |= sfLoop;
+	io.writeU8(jump);
+	io.writeU8(flags);
+	io.writeU16LE(tonePos.value_or(0) & 0xFFFF); // ptrToneData
+
+	io.writeU16LE(split.loopStart);
+	io.writeU16LE(split.loopEnd);
+
+	u32 ampBits = 0;
+	WRITEBITS(ampBits, split.amp.attackRate,      0, 5);
+	WRITEBITS(ampBits, split.amp.decayRate1,      6, 5);
+	WRITEBITS(ampBits, split.amp.decayRate2,     11, 5);
+	WRITEBITS(ampBits, split.amp.releaseRate,    16, 5);
+	WRITEBITS(ampBits, split.amp.decayLevel,     21, 5);
+	WRITEBITS(ampBits, split.amp.keyRateScaling, 26, 4);
+	WRITEBITS(ampBits, split.amp.LPSLNK,         30, 1);
+	io.writeU32LE(ampBits);
+
+	u16 pitchBits = 0;
+	WRITEBITS(pitchBits, split.pitch.FNS, 0, 11);
+
+	u8 pitchOCT = split.pitch.OCT & 0b0111;
+	if (split.pitch.OCT < 0) {
+		pitchOCT |= 0b1000;
+	}
 
-				if (split.tone.format == tone::Format::ADPCM)
-					flags |= sfADPCM;
+	WRITEBITS(pitchBits, pitchOCT, 11, 4);
+	io.writeU16LE(pitchBits);
+
+	u16 lfoBits = 0;
+	WRITEBITS(lfoBits, split.lfo.ampDepth,   0, 3);
+	WRITEBITS(lfoBits, static_cast<u8>(split.lfo.ampWave), 3, 2);
+	WRITEBITS(lfoBits, split.lfo.pitchDepth, 5, 3);
+	WRITEBITS(lfoBits, static_cast<u8>(split.lfo.pitchWave), 8, 2);
+	WRITEBITS(lfoBits, split.lfo.frequency, 10, 5);
+	WRITEBITS(lfoBits, split.lfo.sync,      15, 1);
+	io.writeU16LE(lfoBits);
+
+	u8 fxBits = 0;
+	WRITEBITS(fxBits, split.fx.inputCh, 0, 4);
+	WRITEBITS(fxBits, split.fx.level,   4, 4);
+	io.writeU8(fxBits);
+
+	io.writeU8(split.unk1);
+
+	io.writeU8(Split::toPanPot(split.panPot, version));
+	io.writeU8(split.directLevel);
+
+	u8 filterBits = 0;
+	WRITEBITS(filterBits, split.filter.resonance, 0, 5);
+	WRITEBITS(filterBits, !split.filter.on,       5, 1);
+	WRITEBITS(filterBits, split.filter.voff,      6, 1);
+	io.writeU8(filterBits);
+
+	io.writeU8(~split.oscillatorLevel);
+
+	io.writeU16LE(split.filter.startLevel);
+	io.writeU16LE(split.filter.attackLevel);
+	io.writeU16LE(split.filter.decayLevel1);
+	io.writeU16LE(split.filter.decayLevel2);
+	io.writeU16LE(split.filter.releaseLevel);
+	io.writeU8(split.filter.decayRate1);
+	io.writeU8(split.filter.attackRate);
+	io.writeU8(split.filter.releaseRate);
+	io.writeU8(split.filter.decayRate2);
+
+	io.writeU8(split.startNote);
+	io.writeU8(split.endNote);
+	io.writeU8(split.baseNote);
+	io.writeS8(split.fineTune);
+
+	io.writeU16LE(split.unk2);
+
+	io.writeU8(split.velocityCurveID);
+	io.writeU8(split.velocityLow);
+	io.writeU8(split.velocityHigh);
+
+	io.writeBool(split.drumMode);
+	io.writeU8(split.drumGroupID);
+
+	io.writeU8(split.unk3);
+}
 
-				io.writeU8(0); // jump (filled in later)
-				io.writeU8(flags);
-				io.writeU16LE(0); // ptrToneData (filled in later)
+void Bank::save(const fs::path& path, const Progress& progress) {
+	auto layout = planBank(*this);
+	std::vector<u8> outBuf(layout.size);
+	io::Writer io(outBuf);
 
-				io.writeU16LE(split.loopStart);
-				io.writeU16LE(split.loopEnd);
+	// ============ Start header ============
 
-				u32 ampBits = 0;
-				WRITEBITS(ampBits, split.amp.attackRate,      0, 5);
-				WRITEBITS(ampBits, split.amp.decayRate1,      6, 5);
-				WRITEBITS(ampBits, split.amp.decayRate2,     11, 5);
-				WRITEBITS(ampBits, split.amp.releaseRate,    16, 5);
-				WRITEBITS(ampBits, split.amp.decayLevel,     21, 5);
-				WRITEBITS(ampBits, split.amp.keyRateScaling, 26, 4);
-				WRITEBITS(ampBits, split.amp.LPSLNK,         30, 1);
-				io.writeU32LE(ampBits);
+	io.writeFourCC(drum ? MDB_MAGIC : MPB_MAGIC);
 
-				u16 pitchBits = 0;
-				WRITEBITS(pitchBits, split.pitch.FNS, 0, 11);
+	// The checksum covers everything after the magic
+	io.resetSum();
 
-				u8 pitchOCT = split.pitch.OCT & 0b0111;
-				if (split.pitch.OCT < 0) {
-					pitchOCT |= 0b1000;
-				}
+	io.writeU32LE(version);
+	io.writeU32LE((version & 0xFF) >= 2 ? layout.end + 8 : layout.end + 4);
+	io.writeU32LE(0); // unknown
 
-				WRITEBITS(pitchBits, pitchOCT, 11, 4);
-				io.writeU16LE(pitchBits);
-
-				u16 lfoBits = 0;
-				WRITEBITS(lfoBits, split.lfo.ampDepth,   0, 3);
-				WRITEBITS(lfoBits, static_cast<u8>(split.lfo.ampWave), 3, 2);
-				WRITEBITS(lfoBits, split.lfo.pitchDepth, 5, 3);
-				WRITEBITS(lfoBits, static_cast<u8>(split.lfo.pitchWave), 8, 2);
-				WRITEBITS(lfoBits, split.lfo.frequency, 10, 5);
-				WRITEBITS(lfoBits, split.lfo.sync,      15, 1);
-				io.writeU16LE(lfoBits);
-
-				u8 fxBits = 0;
-				WRITEBITS(fxBits, split.fx.inputCh, 0, 4);
-				WRITEBITS(fxBits, split.fx.level,   4, 4);
-				io.writeU8(fxBits);
-
-				io.writeU8(split.unk1);
-
-				io.writeU8(Split::toPanPot(split.panPot, version));
-				io.writeU8(split.directLevel);
-
-				u8 filterBits = 0;
-				WRITEBITS(filterBits, split.filter.resonance, 0, 5);
-				WRITEBITS(filterBits, !split.filter.on,       5, 1);
-				WRITEBITS(filterBits, split.filter.voff,      6, 1);
-				io.writeU8(filterBits);
-
-				io.writeU8(~split.oscillatorLevel);
-
-				io.writeU16LE(split.filter.startLevel);
-				io.writeU16LE(split.filter.attackLevel);
-				io.writeU16LE(split.filter.decayLevel1);
-				io.writeU16LE(split.filter.decayLevel2);
-				io.writeU16LE(split.filter.releaseLevel);
-				io.writeU8(split.filter.decayRate1);
-				io.writeU8(split.filter.attackRate);
-				io.writeU8(split.filter.releaseRate);
-				io.writeU8(split.filter.decayRate2);
-
-				io.writeU8(split.startNote);
-				io.writeU8(split.endNote);
-				io.writeU8(split.baseNote);
-				io.writeS8(split.fineTune);
-
-				io.writeU16LE(split.unk2);
-
-				io.writeU8(split.velocityCurveID);
-				io.writeU8(split.velocityLow);
-				io.writeU8(split.velocityHigh);
-
-				io.writeBool(split.drumMode);
-				io.writeU8(split.drumGroupID);
-
-				io.writeU8(split.unk3);
-			}
-		}
+	io.writeU32LE(layout.programPtrs);
+	io.writeU32LE(programs.size());
+
+	io.writeU32LE(layout.velocities);
+	io.writeU32LE(velocities.size());
+
+	io.writeU32LE(layout.unk1);
+	io.writeU32LE(1); // numUnk1
+
+	io.writeU32LE(layout.unk2);
+	io.writeU32LE(1); // numUnk2
+
+	// ============ End header ============
+
+	assert(io.tell() == layout.programPtrs);
+	for (u32 programPos : layout.programs) {
+		io.writeU32LE(programPos);
+	}
+
+	// Each velocity curve is 128 bytes
+	assert(io.tell() == layout.velocities);
+	for (const auto& velocity : velocities) {
+		io.writeArrT(velocity.data);
 	}
 
 	/**
-	 * Finally, we can write each split's tone data as everything else has finished being written,
-	 * as tone data should ideally be written consecutively.
+	 * I have zero clue what these are and they always seem to be the same
+	 * almost-null data but I still feel I'm required to write them properly.
+	 * TODO: Copy data from loaded file in case it differs?
 	 */
-	std::unordered_map<tone::DataPtr, u32> tonePtrs;
+	assert(io.tell() == layout.unk1);
+	io.writeU32LE(0x00800000);
+	io.writeU32LE(0x00800080);
+	io.writeU32LE(0x00000080);
+
+	assert(io.tell() == layout.unk2);
+	io.writeU32LE(0);
+
+	size_t splitIdx = 0;
+
 	for (size_t p = 0; p < programs.size(); p++) {
+		progress.update(p, programs.size());
+
 		const auto& program = programs[p];
 
-		for (size_t l = 0; l < program.layers.size(); l++) {
-			const auto& layer = program.layers[l];
+		assert(io.tell() == layout.programs[p]);
+		for (u32 layerPos : layout.layers[p]) {
+			io.writeU32LE(layerPos);
+		}
+
+		/**
+		 * 8 unknown (seemingly unused) bytes
+		 * TODO: copy these from loaded file too?
+		 */
+		io.forward(8);
 
+		for (size_t l = 0; l < MAX_LAYERS; l++) {
+			const auto& layer = program.layers[l];
 			if (!layer)
 				continue;
 
-			assert(splitPtrs[p][l]);
-
-			for (size_t s = 0; s < layer->splits.size(); s++) {
-				const auto& split = layer->splits[s];
-				const auto& toneData = split.tone.data;
-
-				if (!toneData)
-					continue;
+			assert(io.tell() == layout.layers[p][l]);
+			io.writeU32LE(layer->splits.size());
+			io.writeU32LE(layout.splits[p][l]);
+			io.writeU16LE(layer->delay);
+			io.writeU16LE(layer->unk1);
+			io.writeU8(layer->bendRangeHigh);
+			io.writeU8(layer->bendRangeLow);
+			io.writeU16LE(layer->unk2);
+		}
 
-				if (!tonePtrs.contains(toneData)) {
-					if (split.tone.samples() >= tone::MAX_SAMPLES) {
-						char err[96];
-						snprintf(err, std::size(err), "Too many samples (>%zu) in MPB tone %zu:%zu:%zu", tone::MAX_SAMPLES, p, l, s);
-						throw std::runtime_error(err);
-					}
-					
-					/**
-					 * OSB requires padding, presumably because Manatee requires the magic to be
-					 * aligned to read it, but MPB doesn't have data magic so I wouldn't think that
-					 * to be applicable, and after inspecting numerous files this seems to be true.
-					 */
-					tonePtrs[toneData] = io.tell();
-					io.writeVec(*toneData);
-				}
+		for (size_t l = 0; l < MAX_LAYERS; l++) {
+			const auto& layer = program.layers[l];
+			if (!layer)
+				continue;
 
-				auto tonePos = tonePtrs[toneData];
-				u8 jump = (tonePos >> 16) & 0x7F;
-				if (split.tone.format == tone::Format::PCM8)
-					jump |= 0x80;
+			assert(io.tell() == layout.splits[p][l]);
+			for (const auto& split : layer->splits) {
+				const auto& toneData = layout.splitTones[splitIdx++];
+				std::optional<u32> tonePos;
+				if (toneData)
+					tonePos = layout.tonePtrs.at(toneData.get());
 
-				auto pos = io.tell();
-				io.jump(splitPtrs[p][l]);
-				io.forward(48 * s);              // jump to current split, where each split is 48 bytes, ugh
-				io.writeU8(jump);                // jump
-				io.forward(1);                   // don't need to rewrite flags
-				io.writeU16LE(tonePos & 0xFFFF); // ptrToneData
-				io.jump(pos);
+				writeSplit(io, split, tonePos, version);
 			}
 		}
 	}
 
-	auto endPos = io.tell();
-	io.jump(fileSizePos);
-	io.writeU32LE((version & 0xFF) >= 2 ? endPos + 8 : endPos + 4);
-	io.jump(endPos);
+	for (const auto& toneData : layout.tones) {
+		assert(io.tell() == layout.tonePtrs.at(toneData.get()));
+		io.writeSpan(toneData->span());
+	}
 
-	// Version 1 does not store a checksum
-	if ((version & 0xFF) >= 2) {
-		u32 checksum = 0;
-		for (long i = 4; i < endPos; i++) {
-			checksum += io.vec()[i];
-		}
+	assert(io.tell() == layout.end);
 
-		io.writeU32LE(checksum);
+	if ((version & 0xFF) >= 2) {
+		io.writeU32LE(io.sum());
 	}
 
 	io.writeFourCC(MPB_END);
 
-	// Almost same situation as MLT, I hope this is right though
-	auto pos = io.tell();
-	io.writeN<u8>(0x00, utils::roundUp(pos, 32) - pos);
+	// Last chance to back out, as after this the file's getting written over
+	progress.update(programs.size(), programs.size());
 
-	// Finally write the file
+	// Everything left is padding, which the buffer already starts out as
 	io::FileIO file(path, "wb");
-	file.writeVec(io.vec());
+	file.writeVec(outBuf);
 }
 
 const Program* Bank::program(size_t programIdx) const {
@@ -8,6 +8,7 @@
 #include "common.hpp"
 #include "filesystem.hpp"
 #include "fourcc.hpp"
+#include "progress.hpp"
 #include "tone.hpp"
 #include "types.hpp"
 
@@ -103,7 +104,8 @@ namespace manatools::mpb {
 	};
 
 	struct Bank {
-		void save(const fs::path& path);
+		// (progress) is updated once per program
+		void save(const fs::path& path, const Progress& progress = {});
 
 		/**
 		 * Convenience methods that return nullptr if bounds checks don't pass, as to avoid
@@ -123,5 +125,13 @@ namespace manatools::mpb {
 		std::vector<Velocity> velocities;
 	};
 
-	Bank load(const fs::path& path, bool guessToneSize = true);
+	// (progress) is updated once per program
+	Bank load(const fs::path& path, bool guessToneSize = true, const Progress& progress = {});
+
+	/**
+	 * Same as load, but the file is memory mapped and tone data is left in place as views
+	 * into it, so nothing's copied. The mapping stays around for as long as any tone data
+	 * from it does, so don't write over the file while that's the case.
+	 */
+	Bank loadMapped(const fs::path& path, bool guessToneSize = true, const Progress& progress = {});
 } // namespace manatools::mpb
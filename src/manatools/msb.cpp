@@ -3,11 +3,12 @@
 #include "msb.hpp"
 #include "io.hpp"
 #include "types.hpp"
+#include "utils.hpp"
 
 namespace manatools::msb {
 
 MSB load(const fs::path& path) {
-	io::FileIO io(path, "rb");
+	io::BufferedFileIO io(path, "rb");
 	MSB msb;
 	std::vector<u32> ptrsSeqData;
 
@@ -56,4 +57,56 @@ MSB load(const fs::path& path) {
 	return msb;
 }
 
+void MSB::save(const fs::path& path) {
+	io::DynBufIO::VecType outBuf;
+	io::DynBufIO io(outBuf);
+
+	io.writeFourCC(MSB_MAGIC);
+	io.writeU32LE(version);
+
+	auto fileSizePos = io.tell();
+	io.writeU32LE(0);
+	io.writeU32LE(sequences.size());
+
+	auto seqPtrsPos = io.tell();
+	io.writeN<u32>(0, sequences.size());
+
+	for (size_t i = 0; i < sequences.size(); i++) {
+		const auto& sequence = sequences[i];
+
+		/**
+		 * Sequences are aligned as MSD headers have 32-bit fields. Loading takes a sequence's
+		 * size from the pointer to the next, so the padding gets read back as part of it,
+		 * but that's harmless as it's past the end of track message.
+		 */
+		io.writeN<u8>(0x00, utils::roundUp(io.tell(), 4) - io.tell());
+
+		// Empty sequences still get a pointer, as the size of the one before comes from it
+		auto pos = io.tell();
+		io.jump(seqPtrsPos + i * 4);
+		io.writeU32LE(pos);
+		io.jump(pos);
+		io.writeVec(sequence.data);
+	}
+
+	auto endPos = io.tell();
+	io.jump(fileSizePos);
+	io.writeU32LE(version >= 2 ? endPos + 8 : endPos + 4);
+	io.jump(endPos);
+
+	if (version >= 2) {
+		u32 checksum = 0;
+		for (long i = 4; i < endPos; i++) {
+			checksum += io.vec()[i];
+		}
+
+		io.writeU32LE(checksum);
+	}
+
+	io.writeFourCC(MSB_END);
+
+	io::FileIO file(path, "wb");
+	file.writeVec(io.vec());
+}
+
 } // namespace manatools::msb
@@ -7,12 +7,14 @@
 
 namespace manatools::msb {
 	constexpr FourCC MSB_MAGIC("SMSB");
+	constexpr FourCC MSB_END("ENDB");
 
 	struct MSD {
 		std::vector<u8> data;
 	};
 
 	struct MSB {
+		void save(const fs::path& path);
 		u32 version = 2;
 		std::vector<MSD> sequences;
 	};
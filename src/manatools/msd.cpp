@@ -1,10 +1,31 @@
+#include <array>
+#include <cassert>
 #include <cstring>
+#include <queue>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
 
 #include "msd.hpp"
 
 #define IN_RANGE(val, min, max) (min <= val && val <= max)
 
+template <class... Ts>
+struct overloaded : Ts... { using Ts::operator()...; };
+
+struct NoteQueueItem {
+	u32 endTime;
+	u32 order; // Notes ending at the same time are stopped in the order they started
+	u8 channel;
+	u8 note;
+	u8 velocity;
+
+	// Reversed, so the priority queue puts the note ending soonest on top
+	bool operator<(const NoteQueueItem& rhs) const {
+		return endTime != rhs.endTime ? endTime > rhs.endTime : order > rhs.order;
+	}
+};
+
 namespace manatools::msd {
 
 static u16 readVar(io::DataIO& io, u8 data) {
@@ -21,31 +42,173 @@ static u16 readVar(io::DataIO& io, u8 data) {
 	return out;
 }
 
-MSD load(io::DataIO& io) {
-	io::ErrorHandler errHandler(io, true, true);
-	MSD msd;
+// Counterpart to readVar, for the messages where the size flag is in the same byte as other data
+static void writeVar(io::DataIO& io, u8 data, u16 value) {
+	if (value > 0xFF) {
+		io.writeU8(data | 0x80);
+		io.writeU16BE(value);
+	} else {
+		io.writeU8(data);
+		io.writeU8(value);
+	}
+}
 
-	// we could be reading from anywhere in a file, store the beginning of *our* data
-	auto startPos = io.tell();
+static u8 varFlag(u16 value) {
+	return value > 0xFF ? 0x80 : 0x00;
+}
+
+static void writeVarValue(io::DataIO& io, u16 value) {
+	if (value > 0xFF)
+		io.writeU16BE(value);
+	else
+		io.writeU8(value);
+}
+
+/**
+ * Writes as many step extend messages as needed to bring (step) down to (max), and returns
+ * what is left to be written in the message itself.
+ */
+static u32 writeStepExt(io::DataIO& io, u32 step, u32 max) {
+	while (step > max) {
+		u8 i = std::size(STEP_EXT_TABLE) - 1;
+		while (STEP_EXT_TABLE[i] > step)
+			i--;
+
+		io.writeU8(static_cast<u8>(Status::StepExtend) | i);
+		step -= STEP_EXT_TABLE[i];
+	}
+
+	return step;
+}
+
+static void writeMessage(io::DataIO& io, const Note& msg) {
+	u32 step = writeStepExt(io, msg.step, 0xFFFF);
+
+	// Gate can take up to 4 bytes, so there's never any need for gate extend messages
+	u8 gateBytes = 1;
+	while (gateBytes < 4 && (msg.gate >> (gateBytes * 8)))
+		gateBytes++;
 
-	u32 gateExt = 0;
-	u32 stepExt = 0;
+	u8 status = ((gateBytes - 1) << 5) | (msg.channel & 0x0F);
+	if (step > 0xFF)
+		status |= 0x10;
 
+	io.writeU8(status);
+	io.writeU8(msg.note);
+	io.writeU8(msg.velocity);
+
+	while (gateBytes-- > 0)
+		io.writeU8(msg.gate >> (gateBytes * 8));
+
+	writeVarValue(io, step);
+}
+
+static void writeMessage(io::DataIO& io, const ControlChange& msg) {
+	u16 step = writeStepExt(io, msg.step, 0xFFFF);
+	io.writeU8(static_cast<u8>(Status::ControlChange) | (msg.channel & 0x0F));
+	io.writeU8((msg.controller & 0x7F) | varFlag(step));
+	io.writeU8(msg.value);
+	writeVarValue(io, step);
+}
+
+static void writeMessage(io::DataIO& io, const ProgramChange& msg) {
+	u16 step = writeStepExt(io, msg.step, 0xFFFF);
+	io.writeU8(static_cast<u8>(Status::ProgramChange) | (msg.channel & 0x0F));
+	writeVar(io, msg.program & 0x7F, step);
+}
+
+static void writeMessage(io::DataIO& io, const ChannelPressure& msg) {
+	u16 step = writeStepExt(io, msg.step, 0xFFFF);
+	io.writeU8(static_cast<u8>(Status::ChannelPressure) | (msg.channel & 0x0F));
+	writeVar(io, msg.pressure & 0x7F, step);
+}
+
+static void writeMessage(io::DataIO& io, const PitchWheelChange& msg) {
+	u16 step = writeStepExt(io, msg.step, 0xFFFF);
+	io.writeU8(static_cast<u8>(Status::PitchWheelChange) | (msg.channel & 0x0F));
+	writeVar(io, (msg.pitch + 64) & 0x7F, step);
+}
+
+static void writeMessage(io::DataIO& io, const Loop& msg) {
+	u16 step = writeStepExt(io, msg.step, 0xFFFF);
+	io.writeU8(static_cast<u8>(Status::Loop));
+	writeVar(io, msg.unk1 & 0x7F, step);
+}
+
+static void writeMessage(io::DataIO& io, const TempoChange& msg) {
+	u8 step = writeStepExt(io, msg.step, 0xFF);
+	io.writeU8(static_cast<u8>(Status::TempoChange));
+	io.writeU16BE(msg.tempo);
+	io.writeU8(step);
+}
+
+static void writeMessage(io::DataIO& io, const SysEx& msg) {
+	if (msg.data.size() > 0xFF)
+		throw std::runtime_error("MSD SysEx message data too long");
+
+	u8 step = writeStepExt(io, msg.step, 0xFF);
+	io.writeU8(static_cast<u8>(Status::SysEx));
+	io.writeU8(step);
+	io.writeU8(msg.data.size());
+	io.writeVec(msg.data);
+
+	// As with loading, the size of this oddly depends on the step
+	if (step & 0x80)
+		io.writeU16BE(msg.unk1);
+	else
+		io.writeU8(msg.unk1);
+}
+
+Reader::Reader(io::DataIO& io) :
+	io_(io),
+	errHandler_(io, true, true),
+	// we could be reading from anywhere in a file, store the beginning of *our* data
+	startPos_(io.tell())
+{
 	FourCC magic;
 	io.readFourCC(&magic);
 	if (magic != MSD_MAGIC) {
 		throw std::runtime_error("Invalid MSD data");
 	}
 
-	io.readU32LE(&msd.tpqn);
-	io.readU32LE(&msd.initialTempo);
+	io.readU32LE(&tpqn_);
+	io.readU32LE(&initialTempo_);
+}
+
+bool Reader::next(Message& out) {
+	auto& io = io_;
+
+	while (!ended_) {
+		// Go back to where we were once every message in the reference has been read
+		while (refDepth_ && !refs_[refDepth_ - 1].remaining) {
+			io.jump(refs_[--refDepth_].returnPos);
+		}
 
-	auto readMessageImpl = [&](const auto& self) {
 		u8 statusByte;
 		io.readU8(&statusByte);
 		u8 channel = statusByte & 0x0F;
 		u8 status = statusByte & 0xF0;
 
+		/**
+		 * Extend messages are not included in a reference's length, they only add on to the
+		 * time of the next actual message, so keep going until that's encountered.
+		 */
+
+		// Gate time extend
+		if (IN_RANGE(statusByte, 0x88, 0x8B)) {
+			gateExt_ += GATE_EXT_TABLE[statusByte & 3];
+			continue;
+		}
+
+		// Step time extend
+		if (IN_RANGE(statusByte, 0x8C, 0x8F)) {
+			stepExt_ += STEP_EXT_TABLE[statusByte & 3];
+			continue;
+		}
+
+		if (refDepth_)
+			refs_[refDepth_ - 1].remaining--;
+
 		// Note event
 		if (IN_RANGE(status, 0x00, 0x7F)) {
 			Note msg(channel);
@@ -79,11 +242,11 @@ MSD load(io::DataIO& io) {
 			 * No sort of protection to prevent gate/step time overflows, but realistically
 			 * nothing would/can be above 32 bits in size anyway
 			 */
-			msg.gate = gate + gateExt;
-			msg.step = step + stepExt;
+			msg.gate = gate + gateExt_;
+			msg.step = step + stepExt_;
 
-			gateExt = stepExt = 0;
-			msd.messages.push_back(msg);
+			gateExt_ = stepExt_ = 0;
+			out = std::move(msg);
 			return true;
 		}
 
@@ -97,10 +260,10 @@ MSD load(io::DataIO& io) {
 				// remove leftmost bit as that's used to indicate step data size
 				msg.controller = type & 0x7F;
 				io.readU8(&msg.value);
-				msg.step = readVar(io, type) + stepExt;
+				msg.step = readVar(io, type) + stepExt_;
 
-				stepExt = 0;
-				msd.messages.push_back(msg);
+				stepExt_ = 0;
+				out = std::move(msg);
 				return true;
 			}
 
@@ -110,10 +273,10 @@ MSD load(io::DataIO& io) {
 				u8 data;
 				io.readU8(&data);
 				msg.program = data & 0x7F;
-				msg.step = readVar(io, data) + stepExt;
+				msg.step = readVar(io, data) + stepExt_;
 
-				stepExt = 0;
-				msd.messages.push_back(msg);
+				stepExt_ = 0;
+				out = std::move(msg);
 				return true;
 			}
 
@@ -123,10 +286,10 @@ MSD load(io::DataIO& io) {
 				u8 data;
 				io.readU8(&data);
 				msg.pressure = data & 0x7F;
-				msg.step = readVar(io, data) + stepExt;
+				msg.step = readVar(io, data) + stepExt_;
 
-				stepExt = 0;
-				msd.messages.push_back(msg);
+				stepExt_ = 0;
+				out = std::move(msg);
 				return true;
 			}
 
@@ -137,10 +300,10 @@ MSD load(io::DataIO& io) {
 				io.readU8(&data);
 				// Convert pitch from to range of -64 to 63 (from 0 to 127)
 				msg.pitch = (data & 0x7F) - 64;
-				msg.step = readVar(io, data) + stepExt;
+				msg.step = readVar(io, data) + stepExt_;
 
-				stepExt = 0;
-				msd.messages.push_back(msg);
+				stepExt_ = 0;
+				out = std::move(msg);
 				return true;
 			}
 
@@ -157,18 +320,15 @@ MSD load(io::DataIO& io) {
 				io.readU16BE(&offset);
 				io.readU8(&length);
 
-				auto pos = io.tell();
-				io.jump(startPos + offset);
-				for (u8 i = 0; i < length; i++) {
-					/**
-					 * call ourself recursively. magic
-					 * TODO: pass count of how much references we're currently reading as
-					 * to prevent an infinite loop from a bad file?
-					 */
-					self(self);
+				if (refDepth_ == MAX_REFERENCE_DEPTH) {
+					char err[80];
+					snprintf(err, std::size(err), "MSD references nested too deeply at 0x%lx", io.tell());
+					throw std::runtime_error(err);
 				}
-				io.jump(pos);
-				return true;
+
+				refs_[refDepth_++] = { io.tell(), length };
+				io.jump(startPos_ + offset);
+				continue;
 			}
 
 			case Status::Loop: {
@@ -177,15 +337,18 @@ MSD load(io::DataIO& io) {
 				u8 data;
 				io.readU8(&data);
 				msg.unk1 = data & 0x7F;
-				msg.step = readVar(io, data) + stepExt;
+				msg.step = readVar(io, data) + stepExt_;
 
-				stepExt = 0;
-				msd.messages.push_back(msg);
+				stepExt_ = 0;
+				out = std::move(msg);
 				return true;
 			}
 
 			case Status::EndOfTrack: {
-				return false;
+				// Only ends the track outside of a reference, where it just counts towards its length
+				if (!refDepth_)
+					ended_ = true;
+				continue;
 			}
 
 			case Status::TempoChange: {
@@ -198,10 +361,10 @@ MSD load(io::DataIO& io) {
 				 */
 				io.readU16BE(&msg.tempo);
 				u8 step; io.readU8(&step);
-				msg.step = step + stepExt;
+				msg.step = step + stepExt_;
 
-				stepExt = 0;
-				msd.messages.push_back(msg);
+				stepExt_ = 0;
+				out = std::move(msg);
 				return true;
 			}
 
@@ -209,18 +372,21 @@ MSD load(io::DataIO& io) {
 				SysEx msg;
 
 				u8 step; io.readU8(&step);
-				msg.step = step + stepExt;
+				msg.step = step + stepExt_;
 
 				// TODO: Length could be VLQ, but no IO method to do that yet...
 				u8 len; io.readU8(&len);
 				msg.data.resize(len);
-				io.readVec(msg.data);
+
+				// Empty ones (i.e. from a bare F0 F7 in a MIDI) are fine, but reading nothing counts as EOF
+				if (len)
+					io.readVec(msg.data);
 
 				// Unknown, but seemingly changes value depending on step
 				msg.unk1 = readVar(io, step);
 
-				stepExt = 0;
-				msd.messages.push_back(msg);
+				stepExt_ = 0;
+				out = std::move(msg);
 				return true;
 			}
 
@@ -229,48 +395,401 @@ MSD load(io::DataIO& io) {
 			}
 		}
 
-		/**
-		 * Extend messages are not included in a reference's length, so the handlers for
-		 * extend messages process a new message themselves, which should keep them in a
-		 * loop until the next actual message is encountered.
-		 */
+		char err[64];
+		snprintf(err, std::size(err), "Unknown MSD message encountered at 0x%lx: %x", io.tell(), statusByte);
+		throw std::runtime_error(err);
+	}
 
-		// Gate time extend
-		if (IN_RANGE(statusByte, 0x88, 0x8B)) {
-			gateExt += GATE_EXT_TABLE[statusByte & 3];
-			self(self);
-			return true;
+	return false;
+}
+
+MSD load(io::DataIO& io) {
+	Reader reader(io);
+	MSD msd;
+
+	msd.tpqn = reader.tpqn();
+	msd.initialTempo = reader.initialTempo();
+
+	for (const auto& msg : reader) {
+		msd.messages.push_back(msg);
+	}
+
+	return msd;
+}
+
+MSD load(const fs::path& path) {
+	io::BufferedFileIO io(path, "rb");
+	return load(io);
+}
+
+midi::File toMIDI(Reader& seq) {
+	midi::File midiFile;
+
+	midiFile.division = 0x10000 / seq.tpqn();
+
+	std::priority_queue<NoteQueueItem> noteQueue;
+	u32 noteOrder = 0;
+	u32 curTime = 0;
+	u32 lastTime = 0;
+	u32 delta = 0;
+	bool startLoop = true;
+
+	/**
+	 * Note offs are stopped in order of when they end, so times are never out of order, and
+	 * every note due by now is stopped before the next message (including one starting the
+	 * same note again at that time).
+	 */
+	auto processNoteQueue = [&](bool flush = false) {
+		while (!noteQueue.empty() && (flush || noteQueue.top().endTime <= curTime)) {
+			const auto& item = noteQueue.top();
+			u32 delta = item.endTime - lastTime;
+			lastTime = item.endTime;
+			midiFile.events.push_back(midi::NoteOff { delta, item.channel, item.note, item.velocity });
+			noteQueue.pop();
 		}
+	};
 
-		// Step time extend
-		if (IN_RANGE(statusByte, 0x8C, 0x8F)) {
-			stepExt += STEP_EXT_TABLE[statusByte & 3];
-			self(self);
-			return true;
+	for (const msd::Message& m : seq) {
+		processNoteQueue();
+
+		delta = curTime - lastTime;
+		lastTime = curTime;
+
+		std::visit(overloaded {
+			[&](const msd::Note& msg) {
+				midiFile.events.push_back(midi::NoteOn { delta, msg.channel, msg.note, msg.velocity });
+				noteQueue.push({ curTime + msg.gate, noteOrder++, msg.channel, msg.note, msg.velocity });
+				curTime += msg.step;
+			},
+
+			[&](const msd::ControlChange& msg) {
+				midiFile.events.push_back(midi::ControlChange { delta, msg.channel, msg.controller, msg.value });
+				curTime += msg.step;
+			},
+
+			[&](const msd::ProgramChange& msg) {
+				midiFile.events.push_back(midi::ProgramChange { delta, msg.channel, msg.program });
+				curTime += msg.step;
+			},
+
+			[&](const msd::ChannelPressure& msg) {
+				midiFile.events.push_back(midi::ChannelPressure { delta, msg.channel, msg.pressure });
+				curTime += msg.step;
+			},
+
+			[&](const msd::PitchWheelChange& msg) {
+				s16 pitch = ((msg.pitch + 64) << 7) - 8192;
+				midiFile.events.push_back(midi::PitchWheelChange { delta, msg.channel, pitch });
+				curTime += msg.step;
+			},
+
+			[&](const msd::Loop& msg) {
+				// Insert a CC31 for Dreamcast compatibility, and loopStart/loopEnd for other software
+				midiFile.events.push_back(midi::ControlChange { delta, 0, 31, msg.unk1 });
+				midiFile.events.push_back(midi::MetaEvent { midi::Marker { 0, startLoop ? "loopStart" : "loopEnd" } });
+				startLoop = !startLoop;
+				curTime += msg.step;
+			},
+
+			[&](const msd::TempoChange& msg) {
+				midiFile.events.push_back(midi::MetaEvent { midi::SetTempo { delta, static_cast<u32>(msg.tempo * 1000) } });
+				curTime += msg.step;
+			},
+
+			[&](const msd::SysEx& msg) {
+				/**
+				 * A bit confused here...
+				 * MIDI documents say messages are like:
+				 *   0xF0 <MMA> <Data (could contain size and 0xF7)>
+				 * Yet Sekaiju and whatever MIDI hexpat ImHex comes with seems to do it like:
+				 *   0xF0 <Size> <Data (could contain MMA and 0xF7)>
+				 * Not sure what's right here, and what I should do.
+				 */
+				auto data = msg.data;
+				data.insert(data.begin(), data.size() + 1);
+				data.push_back(static_cast<u8>(midi::Status::EndOfSysEx));
+
+				midiFile.events.push_back(midi::SysEx { delta, data });
+				curTime += msg.step;
+			},
+
+			[](const auto& msg) {
+				(void)msg;
+				assert(!"Recognised MSD message left unhandled");
+			}
+		}, m);
+	}
+
+	// flush remaining note offs, and end the track after the last message's step
+	processNoteQueue(true);
+	midiFile.events.push_back(midi::EndOfTrack { curTime > lastTime ? curTime - lastTime : 0 });
+
+	return midiFile;
+}
+
+MSD fromMIDI(const midi::File& in) {
+	if (!in.division || (in.division & 0x8000)) {
+		throw std::runtime_error("Unsupported MIDI timing division");
+	}
+
+	MSD msd;
+	msd.tpqn = 0x10000 / in.division;
+	msd.initialTempo = 500; // 120 BPM, unless the MIDI sets its own at the start
+
+	// MIDI controller msbtool exports loops as, for Dreamcast compatibility
+	constexpr u8 LOOP_CONTROLLER = 31;
+
+	/**
+	 * Each channel and note has a slot for the note message currently sounding on it, so
+	 * gate times are filled in as soon as the note off turns up, all in the one pass.
+	 * A note started again before being stopped ends the one before it.
+	 */
+	struct OpenNote {
+		size_t index;
+		u32 time;
+	};
+
+	constexpr size_t NO_NOTE = SIZE_MAX;
+	std::array<OpenNote, 16 * 128> openNotes;
+	openNotes.fill({ NO_NOTE, 0 });
+
+	u32 time = 0;
+	u32 lastTime = 0;
+	u32 lastLoopTime = UINT32_MAX;
+
+	auto endNote = [&](u8 channel, u8 note) {
+		auto& open = openNotes[(channel & 0x0F) * 128 + (note & 0x7F)];
+		if (open.index != NO_NOTE) {
+			std::get<Note>(msd.messages[open.index]).gate = time - open.time;
+			open.index = NO_NOTE;
 		}
+	};
 
-		char err[64];
-		snprintf(err, std::size(err), "Unknown MSD message encountered at 0x%lx: %x", io.tell(), statusByte);
-		throw std::runtime_error(err);
+	// A message's step is the time until the next, so is known once the next is added
+	auto setLastStep = [&](u32 step) {
+		if (!msd.messages.empty())
+			std::visit([&](auto& msg) { msg.step = step; }, msd.messages.back());
+	};
+
+	auto add = [&](Message msg) {
+		setLastStep(time - lastTime);
+		lastTime = time;
+		msd.messages.push_back(std::move(msg));
 	};
 
+	for (const auto& e : in.events) {
+		std::visit(overloaded {
+			[&](const midi::NoteOn& event) {
+				time += event.delta;
+				endNote(event.channel, event.note);
+
+				if (event.velocity) {
+					add(Note { event.channel, event.note, event.velocity });
+					openNotes[(event.channel & 0x0F) * 128 + (event.note & 0x7F)] = { msd.messages.size() - 1, time };
+				}
+			},
+
+			[&](const midi::NoteOff& event) {
+				time += event.delta;
+				endNote(event.channel, event.note);
+			},
+
+			[&](const midi::PolyKeyPressure& event) {
+				time += event.delta;
+			},
+
+			[&](const midi::ControlChange& event) {
+				time += event.delta;
+
+				if (event.controller == LOOP_CONTROLLER) {
+					add(Loop { static_cast<u8>(event.value & 0x7F) });
+					lastLoopTime = time;
+				} else {
+					add(ControlChange { event.channel, static_cast<u8>(event.controller & 0x7F), event.value });
+				}
+			},
+
+			[&](const midi::ProgramChange& event) {
+				time += event.delta;
+				add(ProgramChange { event.channel, static_cast<u8>(event.program & 0x7F) });
+			},
+
+			[&](const midi::ChannelPressure& event) {
+				time += event.delta;
+				add(ChannelPressure { event.channel, static_cast<u8>(event.pressure & 0x7F) });
+			},
+
+			[&](const midi::PitchWheelChange& event) {
+				time += event.delta;
+				add(PitchWheelChange { event.channel, static_cast<s8>(((event.pitch + 8192) >> 7) - 64) });
+			},
+
+			[&](const midi::SysEx& event) {
+				time += event.delta;
+
+				// Strip the length in front and the 0xF7 at the end, as the MSD message has neither
+				SysEx msg;
+				size_t start = 0;
+				while (start < event.data.size() && (event.data[start++] & 0x80));
+
+				size_t end = event.data.size();
+				if (end > start && event.data[end - 1] == static_cast<u8>(midi::Status::EndOfSysEx))
+					end--;
+
+				msg.data.assign(event.data.begin() + start, event.data.begin() + end);
+				add(std::move(msg));
+			},
+
+			[&](const midi::MetaEvent& meta) {
+				std::visit(overloaded {
+					[&](const midi::Marker& event) {
+						time += event.delta;
+
+						// msbtool puts these alongside CC31, so only count them if that's missing
+						if ((event.text == "loopStart" || event.text == "loopEnd") && lastLoopTime != time) {
+							add(Loop {});
+							lastLoopTime = time;
+						}
+					},
+
+					[&](const midi::EndOfTrack& event) {
+						time += event.delta;
+					},
+
+					[&](const midi::SetTempo& event) {
+						time += event.delta;
+
+						// usecs per quarter note in MIDI, msecs in MSD
+						u16 tempo = (event.tempo + 500) / 1000;
+						if (!time)
+							msd.initialTempo = tempo;
+
+						add(TempoChange { tempo });
+					}
+				}, meta);
+			}
+		}, e);
+	}
+
+	// Anything still sounding lasts until the end
+	for (const auto& open : openNotes) {
+		if (open.index != NO_NOTE)
+			std::get<Note>(msd.messages[open.index]).gate = time - open.time;
+	}
+
+	setLastStep(time - lastTime);
+	return msd;
+}
+
+void MSD::save(io::DataIO& io, bool compress) {
+	io::ErrorHandler errHandler(io, true, true);
+	auto startPos = io.tell();
+
+	io.writeFourCC(MSD_MAGIC);
+	io.writeU32LE(tpqn);
+	io.writeU32LE(initialTempo);
+
 	/**
-	 * My GCC version doesn't support C++23 "deducing this" and my Clang version crashes
-	 * when trying to do it, so go back to the method of using two lambdas to be able to
-	 * call them recursively
+	 * Encode every message up front, along with whatever extend messages it needs, as that's
+	 * the unit a reference counts in. Each distinct encoding is then given an ID, so finding
+	 * repeats is a matter of comparing integers rather than bytes.
 	 */
-	auto readMessage = [&]() {
-		return readMessageImpl(readMessageImpl);
+	io::DynBufIO::VecType encoded;
+	io::DynBufIO encodedIO(encoded);
+	std::vector<size_t> unitStarts;
+	unitStarts.reserve(messages.size() + 1);
+
+	for (const auto& message : messages) {
+		unitStarts.push_back(encodedIO.tell());
+		std::visit([&](const auto& msg) { writeMessage(encodedIO, msg); }, message);
+	}
+	unitStarts.push_back(encodedIO.tell());
+
+	const size_t numUnits = messages.size();
+	auto unitBytes = [&](size_t u) {
+		return std::span<const u8>(encoded).subspan(unitStarts[u], unitStarts[u + 1] - unitStarts[u]);
 	};
 
-	while (readMessage());
+	if (!compress) {
+		io.writeVec(encoded);
+		io.writeU8(static_cast<u8>(Status::EndOfTrack));
+		return;
+	}
 
-	return msd;
+	std::vector<u32> ids(numUnits);
+	{
+		std::unordered_map<std::string_view, u32> idMap;
+		for (size_t u = 0; u < numUnits; u++) {
+			auto bytes = unitBytes(u);
+			std::string_view key(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+			ids[u] = idMap.try_emplace(key, idMap.size()).first->second;
+		}
+	}
+
+	/**
+	 * Greedy LZ77 over the unit IDs. For each ID, (head) holds the latest unit with it that
+	 * was written out in full, and (prev) chains on to the one before that. Only those can
+	 * be referenced, and only if they're still within reach of a reference's 16-bit offset.
+	 * A reference costs 4 bytes, so a run is only worth it if it's longer than that.
+	 */
+	constexpr size_t NONE = SIZE_MAX;
+	constexpr size_t MAX_CHAIN = 256;
+	constexpr size_t REFERENCE_SIZE = 4;
+
+	std::vector<size_t> head(numUnits, NONE);
+	std::vector<size_t> prev(numUnits, NONE);
+	std::vector<long> unitPos(numUnits, -1); // Relative to the start of the MSD, or -1 if referenced
+
+	for (size_t u = 0; u < numUnits;) {
+		size_t bestStart = NONE;
+		size_t bestLength = 0;
+		size_t bestSaved = 0;
+
+		size_t chain = 0;
+		for (size_t c = head[ids[u]]; c != NONE && chain < MAX_CHAIN; c = prev[c], chain++) {
+			if (unitPos[c] > static_cast<long>(MAX_REFERENCE_OFFSET))
+				continue;
+
+			size_t length = 0;
+			size_t bytes = 0;
+			while (length < MAX_REFERENCE_LENGTH && u + length < numUnits && c + length < u &&
+			       unitPos[c + length] >= 0 && ids[c + length] == ids[u + length]) {
+				bytes += unitStarts[u + length + 1] - unitStarts[u + length];
+				length++;
+			}
+
+			if (bytes > REFERENCE_SIZE && bytes - REFERENCE_SIZE > bestSaved) {
+				bestStart = c;
+				bestLength = length;
+				bestSaved = bytes - REFERENCE_SIZE;
+			}
+		}
+
+		if (bestStart != NONE) {
+			io.writeU8(static_cast<u8>(Status::Reference));
+			io.writeU16BE(unitPos[bestStart]);
+			io.writeU8(bestLength);
+			u += bestLength;
+			continue;
+		}
+
+		unitPos[u] = io.tell() - startPos;
+		io.writeSpan(unitBytes(u));
+		prev[u] = head[ids[u]];
+		head[ids[u]] = u;
+		u++;
+	}
+
+	io.writeU8(static_cast<u8>(Status::EndOfTrack));
 }
 
-MSD load(const fs::path& path) {
-	io::FileIO io(path, "rb");
-	return load(io);
+void MSD::save(const fs::path& path, bool compress) {
+	io::DynBufIO::VecType outBuf;
+	io::DynBufIO io(outBuf);
+	save(io, compress);
+
+	io::FileIO file(path, "wb");
+	file.writeVec(io.vec());
 }
 
 } // namespace manatools::msd
@@ -1,11 +1,14 @@
 #pragma once
+#include <iterator>
 #include <variant>
 #include <vector>
 
 #include "filesystem.hpp"
 #include "fourcc.hpp"
 #include "io.hpp"
+#include "midi.hpp"
 #include "types.hpp"
+#include "utils.hpp"
 
 /**
  * TODO: MSB contains a version field, while an MSD doesn't...
@@ -14,6 +17,10 @@
 namespace manatools::msd {
 	constexpr FourCC MSD_MAGIC("SMSD");
 
+	// References can only point within the first 64KiB, and span at most 255 messages
+	constexpr u32 MAX_REFERENCE_OFFSET = 0xFFFF;
+	constexpr u32 MAX_REFERENCE_LENGTH = 0xFF;
+
 	constexpr u16 GATE_EXT_TABLE[] = { 0x200, 0x800, 0x1000, 0x2000 };
 	constexpr u16 STEP_EXT_TABLE[] = { 0x100, 0x200, 0x800, 0x1000 };
 
@@ -99,11 +106,105 @@ namespace manatools::msd {
 	>;
 
 	struct MSD {
+		/**
+		 * With (compress), repeated runs of messages are written once, and later runs are
+		 * replaced with references to the first. References only ever point at messages
+		 * written out in full, so they are never nested.
+		 */
+		void save(io::DataIO& io, bool compress = true);
+		void save(const fs::path& path, bool compress = true);
+
 		u32 tpqn;
 		u32 initialTempo;
 		std::vector<Message> messages;
 	};
 
+	/**
+	 * Reads the messages of an MSD one at a time as they're asked for, rather than
+	 * collecting all of them first, so a sequence can be processed in constant memory.
+	 * References are followed with a bounded stack of where to return to, and nesting
+	 * them deeper than MAX_REFERENCE_DEPTH (such as a reference that ends up referring
+	 * to itself) is treated as an error.
+	 * (io) must outlive the reader, and shouldn't be used by anything else until done.
+	 */
+	class Reader {
+	public:
+		static constexpr size_t MAX_REFERENCE_DEPTH = 16;
+
+		Reader(io::DataIO& io);
+
+		u32 tpqn() const { return tpqn_; }
+		u32 initialTempo() const { return initialTempo_; }
+
+		// Returns false once the end of the track has been reached
+		bool next(Message& out);
+
+		class Iterator {
+		public:
+			using iterator_category = std::input_iterator_tag;
+			using difference_type = std::ptrdiff_t;
+			using value_type = Message;
+
+			Iterator() : reader_(nullptr) {}
+			Iterator(Reader* reader) : reader_(reader) { ++*this; }
+
+			const Message& operator*() const { return msg_; }
+			const Message* operator->() const { return &msg_; }
+
+			Iterator& operator++() {
+				if (reader_ && !reader_->next(msg_))
+					reader_ = nullptr;
+				return *this;
+			}
+
+			void operator++(int) { ++*this; }
+
+			bool operator==(std::default_sentinel_t) const { return !reader_; }
+
+		private:
+			Reader* reader_;
+			Message msg_;
+		};
+
+		Iterator begin() { return Iterator(this); }
+		std::default_sentinel_t end() { return std::default_sentinel; }
+
+	private:
+		MT_DISABLE_COPY(Reader)
+
+		struct Reference {
+			long returnPos;
+			u8 remaining;
+		};
+
+		io::DataIO& io_;
+		io::ErrorHandler errHandler_;
+		long startPos_;
+
+		u32 tpqn_ = 0;
+		u32 initialTempo_ = 0;
+
+		u32 gateExt_ = 0;
+		u32 stepExt_ = 0;
+
+		Reference refs_[MAX_REFERENCE_DEPTH];
+		size_t refDepth_ = 0;
+		bool ended_ = false;
+	};
+
 	MSD load(io::DataIO& io);
 	MSD load(const fs::path& path);
+
+	/**
+	 * Notes are split back into note on/off pairs, and loops become both a CC31 (which the
+	 * Dreamcast tools understand) and loopStart/loopEnd markers (which other software does).
+	 */
+	midi::File toMIDI(Reader& seq);
+
+	/**
+	 * Note on/off pairs become notes with gate times, and CC31 or loopStart/loopEnd markers
+	 * become loops, as msbtool exports them. Timing is converted the same lossy way, and
+	 * events with no MSD equivalent (such as polyphonic key pressure) are dropped.
+	 */
+	MSD fromMIDI(const midi::File& in);
 } // namespace manatools::msd
@@ -6,7 +6,9 @@
 
 #include "osb.hpp"
 #include "io.hpp"
+#include "reader.hpp"
 #include "tone.hpp"
+#include "tonestore.hpp"
 #include "types.hpp"
 #include "utils.hpp"
 
@@ -19,9 +21,121 @@ enum ProgramFlags {
 	pfLoop  = 1 << 1
 };
 
+// Version 1 has a smaller loop time field and less padding after it
+constexpr size_t PROGRAM_SIZE_V1 = 0x34;
+constexpr size_t PROGRAM_SIZE_V2 = 0x3C;
+
+template <size_t Size>
+static void readProgram(io::Record<Size> rec, Program& program, u32 version) {
+	FourCC magic;
+	rec.readFourCC(&magic);
+	if (magic != OSP_MAGIC) {
+		throw std::runtime_error("Encountered invalid OSB data");
+	}
+
+	u8 jump;
+	rec.readU8(&jump);
+
+	u8 flags;
+	rec.readU8(&flags);
+	program.unkFlags = flags & 0b11111100;
+
+	if (flags & pfADPCM)
+		program.tone.format = tone::Format::ADPCM;
+	else if (jump & 0x80)
+		program.tone.format = tone::Format::PCM8;
+	else
+		program.tone.format = tone::Format::PCM16;
+
+	// TODO: Guess from base note & the other byte after it
+	program.tone.sampleRate = 44100;
+
+	program.loop = flags & pfLoop;
+
+	u16 ptrToneData;
+	rec.readU16LE(&ptrToneData);
+	program.ptrToneData_ = ptrToneData + ((jump & 0x7F) << 16);
+
+	rec.readU16LE(&program.loopStart);
+	rec.readU16LE(&program.loopEnd);
+
+	u32 ampBitfield;
+	rec.readU32LE(&ampBitfield);
+	program.amp.attackRate     = utils::readBits(ampBitfield,  0, 5);
+	program.amp.decayRate1     = utils::readBits(ampBitfield,  6, 5); // 1 unknown bit before this
+	program.amp.decayRate2     = utils::readBits(ampBitfield, 11, 5);
+	program.amp.releaseRate    = utils::readBits(ampBitfield, 16, 5);
+	program.amp.decayLevel     = utils::readBits(ampBitfield, 21, 5);
+	program.amp.keyRateScaling = utils::readBits(ampBitfield, 26, 4);
+	program.amp.LPSLNK         = utils::readBits(ampBitfield, 30, 1); // 1 unknown bit after this
+
+	u16 pitchBitfield;
+	rec.readU16LE(&pitchBitfield);
+	program.pitch.FNS = utils::readBits(pitchBitfield, 0, 11);
+	program.pitch.OCT = utils::readBits(pitchBitfield, 11, 4);
+	program.pitch.OCT = (program.pitch.OCT & 0x7) - (program.pitch.OCT & 0x8);
+
+	u16 lfoBitfield;
+	rec.readU16LE(&lfoBitfield);
+	program.lfo.ampDepth   = utils::readBits(lfoBitfield,  0, 3);
+	program.lfo.ampWave    = static_cast<LFOWaveType>(utils::readBits(lfoBitfield,  3, 2)); // ugh
+	program.lfo.pitchDepth = utils::readBits(lfoBitfield,  5, 3);
+	program.lfo.pitchWave  = static_cast<LFOWaveType>(utils::readBits(lfoBitfield,  8, 2)); // ughh
+	program.lfo.frequency  = utils::readBits(lfoBitfield, 10, 5);
+	program.lfo.sync       = utils::readBits(lfoBitfield, 15, 1);
+
+	u8 fxBitfield;
+	rec.readU8(&fxBitfield);
+	program.fx.inputCh = utils::readBits(fxBitfield, 0, 4);
+	program.fx.level   = utils::readBits(fxBitfield, 4, 4);
+
+	rec.readU8(&program.unk1);
+
+	u8 pan;
+	rec.readU8(&pan);
+	program.panPot = Program::fromPanPot(pan);
+	rec.readU8(&program.directLevel);
+
+	u8 filterBitfield;
+	rec.readU8(&filterBitfield);
+	program.filter.resonance = utils::readBits(filterBitfield, 0, 5);
+	program.filter.on        = !utils::readBits(filterBitfield, 5, 1);
+	program.filter.voff      = utils::readBits(filterBitfield, 6, 1);
+
+	rec.readU8(&program.oscillatorLevel);
+	program.oscillatorLevel = ~program.oscillatorLevel;
+
+	rec.readU16LE(&program.filter.startLevel);
+	rec.readU16LE(&program.filter.attackLevel);
+	rec.readU16LE(&program.filter.decayLevel1);
+	rec.readU16LE(&program.filter.decayLevel2);
+	rec.readU16LE(&program.filter.releaseLevel);
+	rec.readU8(&program.filter.decayRate1);
+	rec.readU8(&program.filter.attackRate);
+	rec.readU8(&program.filter.releaseRate);
+	rec.readU8(&program.filter.decayRate2);
+
+	// See save code for annotations
+	if (version <= 1) {
+		u16 loopTime;
+		rec.readU16LE(&loopTime);
+		program.loopTime = loopTime;
+		rec.readU8(&program.baseNote);
+		rec.readU8(&program.freqAdjust);
+		rec.forward(8);
+	} else {
+		rec.readU32LE(&program.loopTime);
+		rec.readU8(&program.baseNote);
+		rec.readU8(&program.freqAdjust);
+		rec.forward(14);
+	}
+}
+
 // Pretty much just copied from mpb.cpp
-Bank load(const fs::path& path, bool guessToneSize) {
-	io::FileIO io(path, "rb");
+Bank load(const fs::path& path, bool guessToneSize, const Progress& progress) {
+	auto buf = io::readFile(path);
+	io::SpanIO in(buf);
+	io::Reader io(in);
 	Bank bank;
 	std::map<u32, u32> tonePtrMap;
 
@@ -45,6 +159,8 @@ Bank load(const fs::path& path, bool guessToneSize) {
 	bank.programs.reserve(numPrograms);
 
 	for (u32 p = 0; p < numPrograms; p++) {
+		progress.update(p, numPrograms);
+
 		u32 ptrProgram;
 		io.readU32LE(&ptrProgram);
 
@@ -53,106 +169,10 @@ Bank load(const fs::path& path, bool guessToneSize) {
 
 		Program program;
 
-		io.readFourCC(&magic);
-		if (magic != OSP_MAGIC) {
-			throw std::runtime_error("Encountered invalid OSB data");
-		}
-
-		u8 jump;
-		io.readU8(&jump);
-
-		u8 flags;
-		io.readU8(&flags);
-		program.unkFlags = flags & 0b11111100;
-
-		if (flags & pfADPCM)
-			program.tone.format = tone::Format::ADPCM;
-		else if (jump & 0x80)
-			program.tone.format = tone::Format::PCM8;
-		else
-			program.tone.format = tone::Format::PCM16;
-
-		// TODO: Guess from base note & the other byte after it
-		program.tone.sampleRate = 44100;
-
-		program.loop = flags & pfLoop;
-
-		u16 ptrToneData;
-		io.readU16LE(&ptrToneData);
-		program.ptrToneData_ = ptrToneData + ((jump & 0x7F) << 16);
-
-		io.readU16LE(&program.loopStart);
-		io.readU16LE(&program.loopEnd);
-
-		u32 ampBitfield;
-		io.readU32LE(&ampBitfield);
-		program.amp.attackRate     = utils::readBits(ampBitfield,  0, 5);
-		program.amp.decayRate1     = utils::readBits(ampBitfield,  6, 5); // 1 unknown bit before this
-		program.amp.decayRate2     = utils::readBits(ampBitfield, 11, 5);
-		program.amp.releaseRate    = utils::readBits(ampBitfield, 16, 5);
-		program.amp.decayLevel     = utils::readBits(ampBitfield, 21, 5);
-		program.amp.keyRateScaling = utils::readBits(ampBitfield, 26, 4);
-		program.amp.LPSLNK         = utils::readBits(ampBitfield, 30, 1); // 1 unknown bit after this
-
-		u16 pitchBitfield;
-		io.readU16LE(&pitchBitfield);
-		program.pitch.FNS = utils::readBits(pitchBitfield, 0, 11);
-		program.pitch.OCT = utils::readBits(pitchBitfield, 11, 4);
-		program.pitch.OCT = (program.pitch.OCT & 0x7) - (program.pitch.OCT & 0x8);
-
-		u16 lfoBitfield;
-		io.readU16LE(&lfoBitfield);
-		program.lfo.ampDepth   = utils::readBits(lfoBitfield,  0, 3);
-		program.lfo.ampWave    = static_cast<LFOWaveType>(utils::readBits(lfoBitfield,  3, 2)); // ugh
-		program.lfo.pitchDepth = utils::readBits(lfoBitfield,  5, 3);
-		program.lfo.pitchWave  = static_cast<LFOWaveType>(utils::readBits(lfoBitfield,  8, 2)); // ughh
-		program.lfo.frequency  = utils::readBits(lfoBitfield, 10, 5);
-		program.lfo.sync       = utils::readBits(lfoBitfield, 15, 1);
-
-		u8 fxBitfield;
-		io.readU8(&fxBitfield);
-		program.fx.inputCh = utils::readBits(fxBitfield, 0, 4);
-		program.fx.level   = utils::readBits(fxBitfield, 4, 4);
-
-		io.readU8(&program.unk1);
-
-		u8 pan;
-		io.readU8(&pan);
-		program.panPot = Program::fromPanPot(pan);
-		io.readU8(&program.directLevel);
-
-		u8 filterBitfield;
-		io.readU8(&filterBitfield);
-		program.filter.resonance = utils::readBits(filterBitfield, 0, 5);
-		program.filter.on        = !utils::readBits(filterBitfield, 5, 1);
-		program.filter.voff      = utils::readBits(filterBitfield, 6, 1);
-
-		io.readU8(&program.oscillatorLevel);
-		program.oscillatorLevel = ~program.oscillatorLevel;
-
-		io.readU16LE(&program.filter.startLevel);
-		io.readU16LE(&program.filter.attackLevel);
-		io.readU16LE(&program.filter.decayLevel1);
-		io.readU16LE(&program.filter.decayLevel2);
-		io.readU16LE(&program.filter.releaseLevel);
-		io.readU8(&program.filter.decayRate1);
-		io.readU8(&program.filter.attackRate);
-		io.readU8(&program.filter.releaseRate);
-		io.readU8(&program.filter.decayRate2);
-
-		// See save code for annotations
 		if (bank.version <= 1) {
-			u16 loopTime;
-			io.readU16LE(&loopTime);
-			program.loopTime = loopTime;
-			io.readU8(&program.baseNote);
-			io.readU8(&program.freqAdjust);
-			io.forward(8);
+			readProgram(io.record<PROGRAM_SIZE_V1>(), program, bank.version);
 		} else {
-			io.readU32LE(&program.loopTime);
-			io.readU8(&program.baseNote);
-			io.readU8(&program.freqAdjust);
-			io.forward(14);
+			readProgram(io.record<PROGRAM_SIZE_V2>(), program, bank.version);
 		}
 
 		u8 bitdepth = tone::bitdepth(program.tone.format);
@@ -198,9 +218,9 @@ Bank load(const fs::path& path, bool guessToneSize) {
 			size = it->second;
 		}
 
-		io.jump(start);
+		in.jump(start);
 		auto toneData = tone::makeDataPtr(size);
-		io.readVec(*toneData);
+		in.readSpan(toneData->mutableSpan());
 		toneDataMap.insert({ start, toneData });
 	}
 
@@ -215,10 +235,12 @@ Bank load(const fs::path& path, bool guessToneSize) {
 		}
 	}
 
+	progress.update(numPrograms, numPrograms);
+
 	return bank;
 }
 
-void Bank::save(const fs::path& path) {
+void Bank::save(const fs::path& path, const Progress& progress) {
 	io::DynBufIO::VecType outBuf;
 	io::DynBufIO io(outBuf);
 
@@ -331,11 +353,16 @@ void Bank::save(const fs::path& path) {
 		io.writeFourCC(OSP_END);
 	}
 
+	// Tones with the same contents are written once even if they weren't loaded as the same data
+	tone::Store toneStore;
 	std::unordered_map<tone::DataPtr, u32> tonePtrs;
+	// Tones are the bulk of it, so this is the loop that reports progress
 	for (size_t p = 0; p < programs.size(); p++) {
+		progress.update(p, programs.size());
+
 		assert(programPtrs[p]);
 		const auto& program = programs[p];
-		const auto& toneData = program.tone.data;
+		const auto toneData = toneStore.intern(program.tone.data);
 		
 		if (!toneData)
 			continue;
@@ -359,7 +386,7 @@ void Bank::save(const fs::path& path) {
 			size_t padding = utils::roundUp(toneData->size(), 4) - toneData->size();
 			io.writeFourCC(OSD_MAGIC);
 			tonePtrs[toneData] = io.tell();
-			io.writeVec(*toneData);
+			io.writeSpan(toneData->span());
 			io.writeN<u8>(0x00, padding);
 			io.writeFourCC(OSD_END);
 		}
@@ -396,6 +423,9 @@ void Bank::save(const fs::path& path) {
 	auto pos = io.tell();
 	io.writeN<u8>(0xFF, utils::roundUp(pos, 32) - pos);
 
+	// Last chance to back out, as after this the file's getting written over
+	progress.update(programs.size(), programs.size());
+
 	io::FileIO file(path, "wb");
 	file.writeVec(io.vec());
 }
@@ -5,6 +5,7 @@
 #include "common.hpp"
 #include "filesystem.hpp"
 #include "fourcc.hpp"
+#include "progress.hpp"
 #include "tone.hpp"
 #include "types.hpp"
 
@@ -62,10 +63,12 @@ namespace manatools::osb {
 	};
 
 	struct Bank {
-		void save(const fs::path& path);
+		// (progress) is updated once per program
+		void save(const fs::path& path, const Progress& progress = {});
 		u32 version = 2;
 		std::vector<Program> programs;
 	};
 
-	Bank load(const fs::path& path, bool guessToneSize = true);
+	// (progress) is updated once per program
+	Bank load(const fs::path& path, bool guessToneSize = true, const Progress& progress = {});
 } // namespace manatools::osb
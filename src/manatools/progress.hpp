@@ -0,0 +1,54 @@
+#pragma once
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+#include "types.hpp"
+
+namespace manatools {
+	/**
+	 * Thrown out of a load or save when its Progress callback asks for it to stop.
+	 * It's a runtime_error so anything that already catches those still copes, but
+	 * catch this first if you don't want to show an error for something the user did.
+	 */
+	class Cancelled : public std::runtime_error {
+	public:
+		Cancelled() : std::runtime_error("Cancelled") {}
+	};
+
+	/**
+	 * Handed to loaders and savers that can take a while, so they can say how far along
+	 * they are (in programs, units, or whatever the format is made of) and be stopped.
+	 * The callback is called on whichever thread is doing the work, and returns false
+	 * to cancel. A default constructed one does nothing, so it's free to pass around.
+	 *
+	 * Savers only honour cancelling up until they start writing to the file, so a save
+	 * that's cancelled never leaves half a file behind.
+	 */
+	class Progress {
+	public:
+		using Callback = std::function<bool(size_t done, size_t total)>;
+
+		Progress() = default;
+		Progress(Callback callback) : callback_(std::move(callback)) {}
+
+		// Throws Cancelled if the callback wants to stop
+		void update(size_t done, size_t total) const {
+			if (callback_ && !callback_(done, total))
+				throw Cancelled();
+		}
+
+		// For once there's no going back, where asking to stop is ignored
+		void report(size_t done, size_t total) const {
+			if (callback_)
+				callback_(done, total);
+		}
+
+		explicit operator bool() const {
+			return static_cast<bool>(callback_);
+		}
+
+	private:
+		Callback callback_;
+	};
+} // namespace manatools
@@ -0,0 +1,151 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <concepts>
+#include <cstring>
+#include <span>
+
+#include "endian.hpp"
+#include "fourcc.hpp"
+#include "io.hpp"
+#include "types.hpp"
+#include "utils.hpp"
+
+namespace manatools::io {
+	// Any DataIO that can hand out everything it holds as one contiguous block
+	template <typename T>
+	concept ContiguousIO = std::derived_from<T, DataIO> && requires(const T& io) {
+		{ io.bytes() } -> std::convertible_to<std::span<const u8>>;
+	};
+
+	/**
+	 * A fixed size chunk of data that's already been bounds checked, so reading fields
+	 * from it is just a copy. Reading past the end of it is a bug in the caller, not
+	 * something that can happen because of bad data.
+	 */
+	template <size_t Size>
+	class Record {
+	public:
+		explicit Record(const u8* data) : data_(data) {}
+
+		void readU8(u8* out)               { read(out); }
+		void readS8(s8* out)               { read(out); }
+		void readU16LE(u16* out)           { read(out); *out = LE(*out); }
+		void readU16BE(u16* out)           { read(out); *out = BE(*out); }
+		void readU32LE(u32* out)           { read(out); *out = LE(*out); }
+		void readU32BE(u32* out)           { read(out); *out = BE(*out); }
+		void readBool(bool* out)           { u8 b; read(&b); *out = b; }
+		void readFourCC(FourCC* out)       { copy(out->data(), 4); }
+
+		template <typename T, size_t N>
+		void readArrT(T (&buf)[N])         { copy(buf, sizeof(T) * N); }
+
+		void forward(size_t count) {
+			assert(cur_ + count <= Size);
+			cur_ += count;
+		}
+
+		size_t tell() const                { return cur_; }
+
+	private:
+		template <typename T>
+		void read(T* out) {
+			copy(out, sizeof(T));
+		}
+
+		void copy(void* out, size_t count) {
+			assert(cur_ + count <= Size);
+			memcpy(out, data_ + cur_, count);
+			cur_ += count;
+		}
+
+		const u8* data_;
+		size_t cur_ = 0;
+	};
+
+	/**
+	 * Reads from a contiguous DataIO without going through any virtual calls, with the bounds
+	 * checked once per record rather than for every field.
+	 * Picks up from wherever (io) was and puts it back to wherever this got to when done.
+	 * Errors are reported through (io), so its exception and EOF settings (and ErrorHandler)
+	 * work the same as if it were being read from directly.
+	 */
+	template <typename Backend>
+	class Reader {
+		static_assert(ContiguousIO<Backend>, "Reader needs a contiguous backend");
+
+	public:
+		explicit Reader(Backend& io) : io_(io), cur_(io.tell()) {}
+
+		~Reader() {
+			io_.jump(cur_);
+		}
+
+		size_t tell() const                { return cur_; }
+		void jump(size_t pos)              { io_.eof_ = false; cur_ = pos; }
+		void forward(size_t count)         { io_.eof_ = false; cur_ += count; }
+
+		/**
+		 * Returns the next (Size) bytes to read fields from. If there aren't enough left the
+		 * error goes through (io), and if that doesn't throw, the record reads back zeroes.
+		 */
+		template <size_t Size>
+		Record<Size> record() {
+			static_assert(Size <= MAX_RECORD, "Record too large");
+
+			auto bytes = io_.bytes();
+
+			if (cur_ > bytes.size() || Size > bytes.size() - cur_) {
+				io_.eof_ = true;
+				io_.setError(DataIO::Error::EndOfFile);
+				return Record<Size>(zeroes_.data());
+			}
+
+			const u8* data = bytes.data() + cur_;
+			cur_ += Size;
+			return Record<Size>(data);
+		}
+
+		// For one-off fields, where there's nothing to batch
+		bool readU8(u8* out)               { return readOne(out, [](u8 v) { return v; }); }
+		bool readU16LE(u16* out)           { return readOne(out, [](u16 v) { return LE(v); }); }
+		bool readU32LE(u32* out)           { return readOne(out, [](u32 v) { return LE(v); }); }
+
+		bool readFourCC(FourCC* out) {
+			auto rec = record<4>();
+			rec.readFourCC(out);
+			return io_.good();
+		}
+
+		// Maximum record size, needed for having something to read from when there's an error
+		static constexpr size_t MAX_RECORD = 256;
+
+	private:
+		MT_DISABLE_COPY(Reader)
+
+		template <typename T, typename F>
+		bool readOne(T* out, F&& convert) {
+			auto bytes = io_.bytes();
+
+			if (cur_ > bytes.size() || sizeof(T) > bytes.size() - cur_) {
+				// Zeroed like record() hands out zeroes, so callers ignoring errors get something defined
+				*out = {};
+				io_.eof_ = true;
+				io_.setError(DataIO::Error::EndOfFile);
+				return false;
+			}
+
+			T v;
+			memcpy(&v, bytes.data() + cur_, sizeof(T));
+			*out = convert(v);
+			cur_ += sizeof(T);
+			return true;
+		}
+
+		Backend& io_;
+		size_t cur_;
+
+		static constexpr std::array<u8, MAX_RECORD> zeroes_{};
+	};
+} // namespace manatools::io
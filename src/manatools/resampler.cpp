@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <stdexcept>
+
+#include "resampler.hpp"
+#include "threadpool.hpp"
+#include "utils.hpp"
+#include "yadpcm.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define RESAMPLER_X86
+	#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	#define RESAMPLER_NEON
+	#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+	#define RESAMPLER_TARGET(isa) __attribute__((target(isa)))
+#else
+	#define RESAMPLER_TARGET(isa)
+#endif
+
+namespace manatools::resampler {
+
+// Where the passband ends, as a fraction of the lower of the two Nyquist frequencies
+static constexpr double ROLLOFF = 0.95;
+
+// Kaiser window shape, about 80 dB of stopband rejection
+static constexpr double KAISER_BETA = 8.0;
+
+// Output samples per job when spreading a tone across the thread pool
+static constexpr size_t CHUNK = 4096;
+
+// Zeroth order modified Bessel function of the first kind, which std::cyl_bessel_i would be if every standard library had it
+static double besselI0(double x) {
+	double sum = 1.0;
+	double term = 1.0;
+	double halfX = x / 2.0;
+
+	for (int k = 1; k < 64; k++) {
+		term *= halfX / k;
+		sum += term * term;
+		if (term * term < sum * 1e-17)
+			break;
+	}
+
+	return sum;
+}
+
+static double sinc(double x) {
+	if (x == 0.0)
+		return 1.0;
+	return std::sin(std::numbers::pi * x) / (std::numbers::pi * x);
+}
+
+static s16 toS16(float v) {
+	return static_cast<s16>(std::lrint(std::clamp(v, -32768.0f, 32767.0f)));
+}
+
+/* ======================== *
+ *      Dot products        *
+ * ======================== */
+
+/**
+ * Both neighbouring phases are applied to the same window at once, so the input only gets
+ * loaded the one time. (n) is always a multiple of 8.
+ */
+static void dot2Scalar(const float* a, const float* b, const float* x, size_t n, float& outA, float& outB) {
+	float sumA = 0;
+	float sumB = 0;
+	for (size_t i = 0; i < n; i++) {
+		sumA += a[i] * x[i];
+		sumB += b[i] * x[i];
+	}
+	outA = sumA;
+	outB = sumB;
+}
+
+#ifdef RESAMPLER_X86
+
+RESAMPLER_TARGET("sse2") static float hsumSSE(__m128 v) {
+	__m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 sums = _mm_add_ps(v, shuf);
+	shuf = _mm_movehl_ps(shuf, sums);
+	return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+
+RESAMPLER_TARGET("sse2") static void dot2SSE2(const float* a, const float* b, const float* x, size_t n,
+                                              float& outA, float& outB)
+{
+	__m128 sumA0 = _mm_setzero_ps();
+	__m128 sumA1 = _mm_setzero_ps();
+	__m128 sumB0 = _mm_setzero_ps();
+	__m128 sumB1 = _mm_setzero_ps();
+
+	for (size_t i = 0; i < n; i += 8) {
+		__m128 x0 = _mm_loadu_ps(x + i);
+		__m128 x1 = _mm_loadu_ps(x + i + 4);
+		sumA0 = _mm_add_ps(sumA0, _mm_mul_ps(_mm_loadu_ps(a + i), x0));
+		sumA1 = _mm_add_ps(sumA1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), x1));
+		sumB0 = _mm_add_ps(sumB0, _mm_mul_ps(_mm_loadu_ps(b + i), x0));
+		sumB1 = _mm_add_ps(sumB1, _mm_mul_ps(_mm_loadu_ps(b + i + 4), x1));
+	}
+
+	outA = hsumSSE(_mm_add_ps(sumA0, sumA1));
+	outB = hsumSSE(_mm_add_ps(sumB0, sumB1));
+}
+
+RESAMPLER_TARGET("avx2") static void dot2AVX2(const float* a, const float* b, const float* x, size_t n,
+                                              float& outA, float& outB)
+{
+	__m256 sumA = _mm256_setzero_ps();
+	__m256 sumB = _mm256_setzero_ps();
+
+	for (size_t i = 0; i < n; i += 8) {
+		__m256 xi = _mm256_loadu_ps(x + i);
+		sumA = _mm256_add_ps(sumA, _mm256_mul_ps(_mm256_loadu_ps(a + i), xi));
+		sumB = _mm256_add_ps(sumB, _mm256_mul_ps(_mm256_loadu_ps(b + i), xi));
+	}
+
+	__m128 a4 = _mm_add_ps(_mm256_castps256_ps128(sumA), _mm256_extractf128_ps(sumA, 1));
+	__m128 b4 = _mm_add_ps(_mm256_castps256_ps128(sumB), _mm256_extractf128_ps(sumB, 1));
+	outA = hsumSSE(a4);
+	outB = hsumSSE(b4);
+}
+
+#endif // RESAMPLER_X86
+
+#ifdef RESAMPLER_NEON
+
+static void dot2NEON(const float* a, const float* b, const float* x, size_t n, float& outA, float& outB) {
+	float32x4_t sumA0 = vdupq_n_f32(0);
+	float32x4_t sumA1 = vdupq_n_f32(0);
+	float32x4_t sumB0 = vdupq_n_f32(0);
+	float32x4_t sumB1 = vdupq_n_f32(0);
+
+	for (size_t i = 0; i < n; i += 8) {
+		float32x4_t x0 = vld1q_f32(x + i);
+		float32x4_t x1 = vld1q_f32(x + i + 4);
+		sumA0 = vfmaq_f32(sumA0, vld1q_f32(a + i), x0);
+		sumA1 = vfmaq_f32(sumA1, vld1q_f32(a + i + 4), x1);
+		sumB0 = vfmaq_f32(sumB0, vld1q_f32(b + i), x0);
+		sumB1 = vfmaq_f32(sumB1, vld1q_f32(b + i + 4), x1);
+	}
+
+	outA = vaddvq_f32(vaddq_f32(sumA0, sumA1));
+	outB = vaddvq_f32(vaddq_f32(sumB0, sumB1));
+}
+
+#endif // RESAMPLER_NEON
+
+using Dot2 = void (*)(const float*, const float*, const float*, size_t, float&, float&);
+
+// Goes by whatever the ADPCM decoder's using, so setting its kernel switches this one too
+static Dot2 bestDot2() {
+	switch (yadpcm::kernel()) {
+	#ifdef RESAMPLER_X86
+		case yadpcm::Kernel::AVX2: return dot2AVX2;
+		case yadpcm::Kernel::SSE2: return dot2SSE2;
+	#endif
+
+	#ifdef RESAMPLER_NEON
+		case yadpcm::Kernel::NEON: return dot2NEON;
+	#endif
+
+		default: return dot2Scalar;
+	}
+}
+
+/* ======================== *
+ *        Resampler         *
+ * ======================== */
+
+// 32.32 fixed point input samples per output sample
+static u64 fixedStep(double inRate, double outRate) {
+	if (!(inRate > 0) || !(outRate > 0))
+		throw std::runtime_error("Sample rates must be above zero");
+
+	u64 step = static_cast<u64>(std::llround(inRate / outRate * 4294967296.0));
+	if (!step)
+		throw std::runtime_error("Ratio between sample rates is too large");
+
+	return step;
+}
+
+static size_t outputSizeFor(u64 step, size_t inFrames) {
+	return ((static_cast<u64>(inFrames) << 32) + step - 1) / step;
+}
+
+Resampler::Resampler(double inRate, double outRate) :
+	inRate_(inRate),
+	outRate_(outRate),
+	step_(fixedStep(inRate, outRate))
+{
+
+	// Nothing to filter, samples just get copied through
+	if (inRate == outRate)
+		return;
+
+	// Cutoff in cycles per input sample, times two so 1.0 is the input's Nyquist frequency
+	double cutoff = std::min(1.0, outRate / inRate) * ROLLOFF;
+
+	size_t half = static_cast<size_t>(std::ceil(ZERO_CROSSINGS / cutoff));
+	taps_ = utils::roundUp<size_t>(half * 2, 8);
+	half = taps_ / 2;
+
+	table_.resize((PHASES + 1) * taps_);
+	double windowNorm = besselI0(KAISER_BETA);
+
+	for (uint p = 0; p <= PHASES; p++) {
+		float* row = table_.data() + p * taps_;
+		double frac = static_cast<double>(p) / PHASES;
+		double sum = 0;
+
+		// Tap k lines up with input sample (base - half + 1 + k), for an output at base + frac
+		for (size_t k = 0; k < taps_; k++) {
+			double t = static_cast<double>(k) - (half - 1) - frac;
+			double x = t / half;
+			double window = std::abs(x) < 1.0 ? besselI0(KAISER_BETA * std::sqrt(1.0 - x * x)) / windowNorm : 0.0;
+			double h = cutoff * sinc(cutoff * t) * window;
+
+			row[k] = static_cast<float>(h);
+			sum += h;
+		}
+
+		// Unity gain at DC for every phase, or there'd be a faint ripple at the table's rate
+		for (size_t k = 0; k < taps_; k++)
+			row[k] = static_cast<float>(row[k] / sum);
+	}
+}
+
+size_t Resampler::outputSize(size_t inFrames) const {
+	return outputSizeFor(step_, inFrames);
+}
+
+size_t Resampler::outputSize(double inRate, double outRate, size_t inFrames) {
+	return outputSizeFor(fixedStep(inRate, outRate), inFrames);
+}
+
+size_t Resampler::mapPosition(size_t inPos) const {
+	return ((static_cast<u64>(inPos) << 32) + step_ / 2) / step_;
+}
+
+std::vector<s16> Resampler::process(std::span<const s16> in) const {
+	const float weight = 1.0f;
+	return process(in, { &weight, 1 });
+}
+
+std::vector<s16> Resampler::process(std::span<const s16> in, std::span<const float> weights) const {
+	size_t channels = weights.size();
+	if (!channels)
+		return {};
+
+	size_t frames = in.size() / channels;
+	size_t pad = taps_ / 2;
+
+	// Downmixing happens on the way into the padded buffer the filter reads from
+	std::vector<float> padded(frames + taps_ * 2);
+
+	for (size_t i = 0; i < frames; i++) {
+		const s16* frame = in.data() + i * channels;
+		float sum = 0;
+		for (size_t c = 0; c < channels; c++)
+			sum += frame[c] * weights[c];
+		padded[pad + i] = sum;
+	}
+
+	return run(padded, frames);
+}
+
+std::vector<s16> Resampler::run(std::vector<float>& padded, size_t frames) const {
+	std::vector<s16> out(outputSize(frames));
+
+	if (!taps_) {
+		for (size_t i = 0; i < out.size(); i++)
+			out[i] = toS16(padded[i]);
+		return out;
+	}
+
+	Dot2 dot2 = bestDot2();
+	size_t chunks = (out.size() + CHUNK - 1) / CHUNK;
+
+	ThreadPool::shared().parallelFor(chunks, [&](size_t chunk) {
+		size_t end = std::min(out.size(), (chunk + 1) * CHUNK);
+
+		for (size_t n = chunk * CHUNK; n < end; n++) {
+			u64 pos = n * step_;
+			size_t base = pos >> 32;
+
+			// Phase, and how far it is towards the next one
+			u64 phasePos = (pos & 0xFFFFFFFF) * PHASES;
+			size_t phase = phasePos >> 32;
+			float blend = (phasePos & 0xFFFFFFFF) * (1.0f / 4294967296.0f);
+
+			const float* rowA = table_.data() + phase * taps_;
+			const float* rowB = rowA + taps_;
+
+			float a, b;
+			dot2(rowA, rowB, padded.data() + base + 1, taps_, a, b);
+			out[n] = toS16(a + (b - a) * blend);
+		}
+	});
+
+	return out;
+}
+
+std::vector<s16> resample(std::span<const s16> in, double inRate, double outRate) {
+	return Resampler(inRate, outRate).process(in);
+}
+
+} // namespace manatools::resampler
@@ -0,0 +1,64 @@
+#pragma once
+#include <span>
+#include <vector>
+
+#include "types.hpp"
+
+namespace manatools::resampler {
+	/**
+	 * Polyphase windowed-sinc resampler for whole tones. The filter is a Kaiser windowed sinc
+	 * tabled at PHASES fractional positions, with the output interpolated between the two
+	 * nearest, so any pair of rates works and not just nice ratios. When going down in rate
+	 * the cutoff goes down with it (and the filter gets longer) so nothing aliases.
+	 *
+	 * The dot products go through SSE2/AVX2/NEON kernels where the CPU has them, picked the
+	 * same way the ADPCM decoder picks its own.
+	 */
+	class Resampler {
+	public:
+		static constexpr uint PHASES = 256;
+
+		// Zero crossings either side of the centre at full bandwidth
+		static constexpr uint ZERO_CROSSINGS = 16;
+
+		Resampler(double inRate, double outRate);
+
+		double inRate() const  { return inRate_; }
+		double outRate() const { return outRate_; }
+
+		// How many samples come out for (inFrames) going in
+		size_t outputSize(size_t inFrames) const;
+
+		// Same as above, without building a filter just to find out
+		static size_t outputSize(double inRate, double outRate, size_t inFrames);
+
+		// Where (inPos) in the input ends up in the output, i.e. for moving loop points
+		size_t mapPosition(size_t inPos) const;
+
+		std::vector<s16> process(std::span<const s16> in) const;
+
+		/**
+		 * Same as above, but (in) has (weights.size()) interleaved channels, which are mixed
+		 * down to mono with those weights as they're read in. One weight of 1 and the rest 0
+		 * picks out a single channel.
+		 */
+		std::vector<s16> process(std::span<const s16> in, std::span<const float> weights) const;
+
+	private:
+		std::vector<s16> run(std::vector<float>& padded, size_t frames) const;
+
+		double inRate_;
+		double outRate_;
+
+		// 32.32 fixed point input samples per output sample
+		u64 step_;
+
+		// Taps per phase, a multiple of 8 for the kernels
+		size_t taps_ = 0;
+
+		// PHASES + 1 rows of taps_, the last being the first shifted along by one
+		std::vector<float> table_;
+	};
+
+	std::vector<s16> resample(std::span<const s16> in, double inRate, double outRate);
+} // namespace manatools::resampler
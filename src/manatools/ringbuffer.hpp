@@ -0,0 +1,95 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <span>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace manatools {
+	/**
+	 * Lock-free ring buffer for exactly one producer thread and one consumer thread, i.e.
+	 * a decoder feeding an audio callback. Nothing in here ever blocks or allocates after
+	 * construction, so the consumer side is safe to call from a real-time thread.
+	 *
+	 * Positions are running totals of everything ever written/read rather than offsets into
+	 * the buffer, so they also work as timestamps, e.g. "the tone ended at write position X".
+	 */
+	template <typename T>
+	class RingBuffer {
+	public:
+		// Rounded up to a power of two
+		explicit RingBuffer(size_t capacity) :
+			buf_(std::bit_ceil(std::max<size_t>(capacity, 2))),
+			mask_(buf_.size() - 1) {}
+
+		size_t capacity() const {
+			return buf_.size();
+		}
+
+		// Producer side
+
+		size_t writePos() const {
+			return write_.load(std::memory_order_relaxed);
+		}
+
+		size_t writeAvailable() const {
+			return capacity() - (writePos() - read_.load(std::memory_order_acquire));
+		}
+
+		// Writes as much of in as fits, and returns how much that was
+		size_t write(std::span<const T> in) {
+			size_t pos = writePos();
+			size_t len = std::min(in.size(), writeAvailable());
+			size_t first = std::min(len, capacity() - (pos & mask_));
+
+			std::copy_n(in.begin(), first, buf_.begin() + (pos & mask_));
+			std::copy_n(in.begin() + first, len - first, buf_.begin());
+
+			write_.store(pos + len, std::memory_order_release);
+			return len;
+		}
+
+		// Consumer side
+
+		size_t readPos() const {
+			return read_.load(std::memory_order_relaxed);
+		}
+
+		size_t readAvailable() const {
+			return write_.load(std::memory_order_acquire) - readPos();
+		}
+
+		// Reads as much as there is up to out.size(), and returns how much that was
+		size_t read(std::span<T> out) {
+			size_t pos = readPos();
+			size_t len = std::min(out.size(), readAvailable());
+			size_t first = std::min(len, capacity() - (pos & mask_));
+
+			std::copy_n(buf_.begin() + (pos & mask_), first, out.begin());
+			std::copy_n(buf_.begin(), len - first, out.begin() + first);
+
+			read_.store(pos + len, std::memory_order_release);
+			return len;
+		}
+
+		// Throws away everything before pos, or everything there is if that hasn't been written yet
+		void skipTo(size_t pos) {
+			size_t end = write_.load(std::memory_order_acquire);
+			read_.store(std::clamp(pos, readPos(), end), std::memory_order_release);
+		}
+
+	private:
+		MT_DISABLE_COPY(RingBuffer)
+
+		static constexpr size_t CACHE_LINE = 64;
+
+		std::vector<T> buf_;
+		size_t mask_;
+
+		// Kept on separate cache lines so the two threads don't keep stealing them from each other
+		alignas(CACHE_LINE) std::atomic<size_t> write_ = 0;
+		alignas(CACHE_LINE) std::atomic<size_t> read_ = 0;
+	};
+} // namespace manatools
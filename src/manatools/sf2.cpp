@@ -1,9 +1,12 @@
 #include <cmath>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "aica.hpp"
 #include "sf2.hpp"
 #include "mpb.hpp"
+#include "threadpool.hpp"
 #include "tonedecoder.hpp"
 #include "utils.hpp"
 
@@ -34,6 +37,106 @@ static s16 msecsToTimecent(double msecs, bool high) {
 	return std::roundf(timecentClamp(1200 * std::log2(msecs / 1000), high));
 }
 
+static s8 pitchCorrection(const mpb::Split& split) {
+	// not 100% sure about the exact accuracy of the fine tune
+	return static_cast<s8>(roundf(utils::remap(split.fineTune, -128, 127, -48, 47)));
+}
+
+// Loop offsets are split into a fine part and a coarse part in units of 32768 samples
+static void addLoopOffset(std::vector<SFGeneratorItem>& items, SFGenerator fine, SFGenerator coarse, s32 offset) {
+	if (offset == 0)
+		return;
+
+	s32 coarsePart = offset / 32768;
+	s32 finePart = offset % 32768;
+
+	if (finePart)
+		items.emplace_back(fine, static_cast<s16>(finePart));
+	if (coarsePart)
+		items.emplace_back(coarse, static_cast<s16>(coarsePart));
+}
+
+/**
+ * Every distinct tone in the bank becomes one SF2 sample, however many splits use it. Drum
+ * kits in particular tend to point dozens of splits at the same tone, which would otherwise
+ * get decoded and stored again for each of them.
+ */
+class SampleTable {
+public:
+	explicit SampleTable(const mpb::Bank& mpb) {
+		std::vector<const tone::Tone*> tones;
+
+		for (const auto& program : mpb.programs) {
+			for (const auto& layer : program.layers) {
+				if (!layer)
+					continue;
+
+				for (const auto& split : layer->splits) {
+					auto [it, added] = entries_.try_emplace(split.tone.data.get());
+					if (added && split.tone.data)
+						tones.push_back(&split.tone);
+				}
+			}
+		}
+
+		// The map isn't changed from here on, only the entries already in it
+		ThreadPool::shared().parallelFor(tones.size(), [&](size_t i) {
+			auto& pcm = entries_.at(tones[i]->data.get()).pcm;
+			pcm.resize(tones[i]->samples());
+
+			tone::Decoder decoder(tones[i]);
+			pcm.resize(decoder.decode(pcm));
+		});
+	}
+
+	/**
+	 * The first split to use a tone decides the sample's loop, root key and correction. Any
+	 * later split that differs gets generators in (items) to override them for its zone.
+	 */
+	std::shared_ptr<SFSample> get(SoundFont& sf2, const std::string& name, const mpb::Split& split,
+	                              std::vector<SFGeneratorItem>& items)
+	{
+		auto& entry = entries_.at(split.tone.data.get());
+
+		if (!entry.sample) {
+			entry.sample = sf2.NewSample(
+				name,
+				std::move(entry.pcm),
+				split.loopStart,
+				split.loopEnd,
+				aica::SAMPLE_RATE,
+				split.baseNote,
+				pitchCorrection(split)
+			);
+			return entry.sample;
+		}
+
+		const auto& sample = *entry.sample;
+
+		if (split.baseNote != sample.original_key())
+			items.emplace_back(SFGenerator::kOverridingRootKey, static_cast<s16>(split.baseNote));
+
+		if (s8 correction = pitchCorrection(split); correction != sample.correction())
+			items.emplace_back(SFGenerator::kFineTune, static_cast<s16>(correction - sample.correction()));
+
+		addLoopOffset(items, SFGenerator::kStartloopAddrsOffset, SFGenerator::kStartloopAddrsCoarseOffset,
+		              static_cast<s32>(split.loopStart) - static_cast<s32>(sample.start_loop()));
+		addLoopOffset(items, SFGenerator::kEndloopAddrsOffset, SFGenerator::kEndloopAddrsCoarseOffset,
+		              static_cast<s32>(split.loopEnd) - static_cast<s32>(sample.end_loop()));
+
+		return entry.sample;
+	}
+
+private:
+	struct Entry {
+		std::vector<s16> pcm;
+		std::shared_ptr<SFSample> sample;
+	};
+
+	// Splits without any tone data all share the one empty sample, under nullptr
+	std::unordered_map<const tone::Data*, Entry> entries_;
+};
+
 SoundFont fromMPB(const mpb::Bank& mpb, const std::string& bankName) {
 	SoundFont sf2;
 
@@ -42,6 +145,8 @@ SoundFont fromMPB(const mpb::Bank& mpb, const std::string& bankName) {
 	sf2.set_product("Sega Dreamcast");
 	sf2.set_software("manatools");
 
+	SampleTable samples(mpb);
+
 	for (size_t p = 0; p < mpb.programs.size(); p++) {
 		const auto& program = mpb.programs[p];
 
@@ -56,24 +161,6 @@ SoundFont fromMPB(const mpb::Bank& mpb, const std::string& bankName) {
 
 			for (size_t s = 0; s < layer->splits.size(); s++) {
 				const auto& split = layer->splits[s];
-				std::vector<s16> sampleData;
-
-				if (split.tone.data) {
-					tone::Decoder decoder(&split.tone);
-					sampleData.resize(split.tone.samples());
-					decoder.decode(sampleData);
-				}
-
-				// not 100% sure about the exact accuracy of the fine tune
-				auto sample = sf2.NewSample(
-					instrument->name() + ":" += std::to_string(s),
-					sampleData,
-					split.loopStart,
-					split.loopEnd,
-					aica::SAMPLE_RATE,
-					split.baseNote,
-					static_cast<s8>(roundf(utils::remap(split.fineTune, -128, 127, -48, 47)))
-				);
 
 				u8 ampAtkEffRate = split.effectiveRate(split.amp.attackRate);
 				u8 ampRelEffRate = split.effectiveRate(split.amp.releaseRate);
@@ -94,6 +181,8 @@ SoundFont fromMPB(const mpb::Bank& mpb, const std::string& bankName) {
 				if (split.drumMode)
 					generatorItems.emplace_back(SFGenerator::kExclusiveClass, split.drumGroupID);
 
+				auto sample = samples.get(sf2, instrument->name() + ":" += std::to_string(s), split, generatorItems);
+
 				/**
 				 * TODO: Envelopes, LFO, direct level, all that stuff
 				 * 
@@ -0,0 +1,562 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "synth.hpp"
+#include "threadpool.hpp"
+#include "tonedecoder.hpp"
+
+template <class... Ts>
+struct overloaded : Ts... { using Ts::operator()...; };
+
+namespace manatools::synth {
+
+// Envelopes work in the AICA's 10-bit attenuation units, with the full range being about 96 dB
+static constexpr float MAX_ATTENUATION = 1023.0f;
+static constexpr float DB_PER_STEP = 96.0f / 1023.0f;
+
+static float dbToGain(float db) {
+	return std::pow(10.0f, db / 20.0f);
+}
+
+static s16 toS16(float v) {
+	return static_cast<s16>(std::lrint(std::clamp(v, -32768.0f, 32767.0f)));
+}
+
+// Per sample change in attenuation for an effective rate, from how long (table) says the full range takes
+static float envelopeRate(const double (&table)[64], u8 effRate) {
+	double msecs = table[effRate];
+	if (msecs < 0)
+		return 0;
+	if (msecs == 0)
+		return MAX_ATTENUATION;
+	return MAX_ATTENUATION / (msecs * aica::SAMPLE_RATE / 1000.0);
+}
+
+ToneCache::ToneCache(const mpb::Bank& bank) {
+	std::vector<const tone::Tone*> tones;
+	for (const auto& program : bank.programs)
+		collect(program, tones);
+	decode(tones);
+}
+
+ToneCache::ToneCache(const mpb::Program& program) {
+	std::vector<const tone::Tone*> tones;
+	collect(program, tones);
+	decode(tones);
+}
+
+std::span<const s16> ToneCache::find(const tone::Data* data) const {
+	auto it = pcm_.find(data);
+	if (it == pcm_.end())
+		return {};
+	return it->second;
+}
+
+void ToneCache::collect(const mpb::Program& program, std::vector<const tone::Tone*>& tones) {
+	for (const auto& layer : program.layers) {
+		if (!layer)
+			continue;
+
+		for (const auto& split : layer->splits) {
+			const auto* data = split.tone.data.get();
+			if (data && pcm_.try_emplace(data).second)
+				tones.push_back(&split.tone);
+		}
+	}
+}
+
+void ToneCache::decode(const std::vector<const tone::Tone*>& tones) {
+	// The map isn't changed from here on, only the vectors already in it
+	ThreadPool::shared().parallelFor(tones.size(), [&](size_t i) {
+		auto& pcm = pcm_.at(tones[i]->data.get());
+		pcm.resize(tones[i]->samples());
+
+		tone::Decoder decoder(tones[i]);
+		pcm.resize(decoder.decode(pcm));
+	});
+}
+
+void VoicePool::updateChannel(u8 ch) {
+	for (auto& voice : voices_) {
+		if (voice.env != EnvState::Off && voice.channel == (ch & 0x0F)) {
+			updateGain(voice);
+			updatePitch(voice);
+		}
+	}
+}
+
+u32 VoicePool::noteOn(u8 ch, u8 note, u8 velocity, const mpb::Program& program, const ToneCache& tones,
+                      std::span<const mpb::Velocity> velocities)
+{
+	u32 id = nextID_++;
+	ch &= 0x0F;
+	velocity &= 0x7F;
+
+	// Every layer plays the first of its splits that covers the note and velocity
+	for (const auto& layer : program.layers) {
+		if (!layer)
+			continue;
+
+		for (const auto& split : layer->splits) {
+			if (note < split.startNote || note > split.endNote ||
+			    velocity < split.velocityLow || velocity > split.velocityHigh)
+				continue;
+
+			auto pcm = tones.find(split.tone.data.get());
+			if (pcm.empty())
+				break;
+
+			// Drums in the same group cut each other off
+			if (split.drumMode) {
+				for (auto& voice : voices_) {
+					if (voice.env != EnvState::Off && voice.channel == ch &&
+					    voice.split->drumMode && voice.split->drumGroupID == split.drumGroupID)
+						keyOff(voice);
+				}
+			}
+
+			auto& voice = allocVoice();
+			voice = {};
+			voice.env = EnvState::Attack;
+			voice.keyOn = true;
+			voice.channel = ch;
+			voice.note = note;
+			voice.id = id;
+			voice.order = nextOrder_++;
+
+			voice.layer = &*layer;
+			voice.split = &split;
+			voice.pcm = pcm.data();
+
+			voice.end = pcm.size();
+			voice.loop = split.loop && split.loopStart < split.loopEnd && split.loopStart < voice.end;
+			voice.loopStart = split.loopStart;
+			voice.loopEnd = std::min<u32>(split.loopEnd, voice.end);
+			voice.delay = layer->delay * 4 * aica::SAMPLE_RATE / 1000;
+
+			voice.attackRate  = envelopeRate(aica::AEGAttackTime, split.effectiveRate(split.amp.attackRate));
+			voice.decayRate1  = envelopeRate(aica::AEGDSRTime, split.effectiveRate(split.amp.decayRate1));
+			voice.decayRate2  = envelopeRate(aica::AEGDSRTime, split.effectiveRate(split.amp.decayRate2));
+			voice.releaseRate = envelopeRate(aica::AEGDSRTime, split.effectiveRate(split.amp.releaseRate));
+			voice.decayLevel  = split.amp.decayLevel * 32.0f;
+
+			float vel = velocity;
+			if (split.velocityCurveID < velocities.size())
+				vel = velocities[split.velocityCurveID].data[velocity];
+
+			// Direct level is 3 dB a step with 0 being silent, oscillator level 3 dB every 16 as in sf2.cpp
+			u8 directLevel = std::min<u8>(split.directLevel, 15);
+			float levelDB = -(15 - directLevel) * 3.0f - (255 - split.oscillatorLevel) * (3.0f / 16.0f);
+			voice.level = directLevel ? (vel / 127.0f) * dbToGain(levelDB) : 0.0f;
+
+			updateGain(voice);
+			updatePitch(voice);
+			break;
+		}
+	}
+
+	return id;
+}
+
+void VoicePool::noteOff(u32 id) {
+	for (auto& voice : voices_) {
+		if (voice.keyOn && voice.id == id)
+			keyOff(voice);
+	}
+}
+
+void VoicePool::allNotesOff() {
+	for (auto& voice : voices_) {
+		if (voice.keyOn)
+			keyOff(voice);
+	}
+}
+
+bool VoicePool::held(u32 id) const {
+	return std::ranges::any_of(voices_, [id](const Voice& voice) {
+		return voice.keyOn && voice.id == id;
+	});
+}
+
+void VoicePool::reset() {
+	for (auto& voice : voices_)
+		voice = {};
+}
+
+bool VoicePool::active() const {
+	return std::ranges::any_of(voices_, [](const Voice& voice) {
+		return voice.env != EnvState::Off;
+	});
+}
+
+void VoicePool::mix(float* outL, float* outR, size_t count) {
+	while (count) {
+		size_t n = std::min(count, BLOCK);
+
+		for (auto& voice : voices_) {
+			if (voice.env != EnvState::Off)
+				renderVoice(voice, outL, outR, n);
+		}
+
+		outL += n;
+		outR += n;
+		count -= n;
+	}
+}
+
+void VoicePool::keyOff(Voice& voice) {
+	voice.keyOn = false;
+	if (voice.env != EnvState::Off)
+		voice.env = EnvState::Release;
+}
+
+// A free voice if there is one, otherwise the quietest releasing voice, otherwise the oldest
+VoicePool::Voice& VoicePool::allocVoice() {
+	Voice* best = nullptr;
+
+	for (auto& voice : voices_) {
+		if (voice.env == EnvState::Off)
+			return voice;
+
+		if (!best) {
+			best = &voice;
+			continue;
+		}
+
+		bool releasing = voice.env == EnvState::Release;
+		bool bestReleasing = best->env == EnvState::Release;
+
+		if (releasing != bestReleasing) {
+			if (releasing)
+				best = &voice;
+		} else if (releasing ? voice.att > best->att : voice.order < best->order) {
+			best = &voice;
+		}
+	}
+
+	return *best;
+}
+
+void VoicePool::updateGain(Voice& voice) {
+	const auto& ch = channels_[voice.channel];
+
+	// Pan is 3 dB a step on the opposite side, with the furthest step being silent
+	int pan = voice.split->panPot + static_cast<int>(std::lround((ch.pan - 64) * 15 / 64.0));
+	pan = std::clamp(pan, -15, 15);
+
+	float left  = pan <= 0 ? 1.0f : pan == 15  ? 0.0f : dbToGain(-3.0f * pan);
+	float right = pan >= 0 ? 1.0f : pan == -15 ? 0.0f : dbToGain(3.0f * pan);
+
+	float channel = (ch.volume / 127.0f) * (ch.expression / 127.0f);
+	voice.gainL = voice.level * channel * left;
+	voice.gainR = voice.level * channel * right;
+}
+
+void VoicePool::updatePitch(Voice& voice) {
+	const auto& split = *voice.split;
+	const auto& layer = *voice.layer;
+	s8 bend = channels_[voice.channel].pitch;
+
+	// Fine tune scaled the same as in sf2.cpp, to cents
+	double semitones = voice.note - split.baseNote;
+	semitones += utils::remap(split.fineTune, -128, 127, -48, 47) / 100.0;
+	semitones += bend >= 0 ? bend / 63.0 * layer.bendRangeHigh : bend / 64.0 * layer.bendRangeLow;
+
+	// OCT/FNS give the rate at the base note, relative to the output's
+	double rate = std::ldexp((1024.0 + split.pitch.FNS) / 1024.0, split.pitch.OCT);
+	rate *= std::exp2(semitones / 12.0);
+
+	voice.step = static_cast<u64>(rate * 4294967296.0);
+}
+
+void VoicePool::renderVoice(Voice& voice, float* outL, float* outR, size_t count) {
+	float samples[BLOCK];
+	size_t start = 0;
+
+	// Nothing plays, and the envelope doesn't move, until the layer's delay is up
+	if (voice.delay) {
+		start = std::min(voice.delay, count);
+		voice.delay -= start;
+		if (start == count)
+			return;
+	}
+
+	std::fill_n(samples, start, 0.0f);
+
+	const s16* pcm = voice.pcm;
+	size_t i = start;
+
+	// Linear interpolation, as the AICA does
+	for (; i < count; i++) {
+		u32 index = voice.pos >> 32;
+		if (index >= voice.end) {
+			voice.env = EnvState::Off;
+			break;
+		}
+
+		u32 nextIndex = index + 1;
+		if (voice.loop && nextIndex >= voice.loopEnd)
+			nextIndex = voice.loopStart;
+
+		float s0 = pcm[index];
+		float s1 = nextIndex < voice.end ? pcm[nextIndex] : 0.0f;
+		float frac = (voice.pos & 0xFFFFFFFF) * (1.0f / 4294967296.0f);
+		samples[i] = s0 + (s1 - s0) * frac;
+
+		voice.pos += voice.step;
+		if (voice.loop && (voice.pos >> 32) >= voice.loopEnd)
+			voice.pos -= static_cast<u64>(voice.loopEnd - voice.loopStart) << 32;
+	}
+
+	std::fill(samples + i, samples + count, 0.0f);
+
+	// Step the envelope over the block, then ramp the gain between where it started and ended
+	float attStart = voice.att;
+	float n = count - start;
+
+	switch (voice.env) {
+		case EnvState::Attack: {
+			voice.att = std::max(voice.att - voice.attackRate * n, 0.0f);
+
+			// With LPSLNK, decay starts once the loop start is passed rather than at full volume
+			bool done = voice.split->amp.LPSLNK ? (voice.pos >> 32) >= voice.loopStart : voice.att <= 0;
+			if (done)
+				voice.env = EnvState::Decay1;
+			break;
+		}
+
+		case EnvState::Decay1: {
+			voice.att += voice.decayRate1 * n;
+			if (voice.att >= voice.decayLevel) {
+				voice.att = std::max(voice.decayLevel, attStart);
+				voice.env = EnvState::Decay2;
+			}
+			break;
+		}
+
+		case EnvState::Decay2: {
+			voice.att = std::min(voice.att + voice.decayRate2 * n, MAX_ATTENUATION);
+			break;
+		}
+
+		case EnvState::Release: {
+			voice.att = std::min(voice.att + voice.releaseRate * n, MAX_ATTENUATION);
+			break;
+		}
+
+		case EnvState::Off: {
+			break;
+		}
+	}
+
+	if (voice.att >= MAX_ATTENUATION && voice.env != EnvState::Attack)
+		voice.env = EnvState::Off;
+
+	float gainStart = dbToGain(-attStart * DB_PER_STEP);
+	float gainEnd = voice.env == EnvState::Off ? 0.0f : dbToGain(-voice.att * DB_PER_STEP);
+	float gainStep = (gainEnd - gainStart) / count;
+	float gainL = voice.gainL;
+	float gainR = voice.gainR;
+
+	// Plain loop over contiguous floats with no branches, which compilers vectorise
+	for (size_t j = 0; j < count; j++) {
+		float s = samples[j] * (gainStart + gainStep * j);
+		outL[j] += s * gainL;
+		outR[j] += s * gainR;
+	}
+}
+
+Renderer::Renderer(const mpb::Bank& bank) :
+	bank_(bank),
+	tones_(bank) {}
+
+// State for a single render, so a Renderer can be shared
+class Mixer {
+public:
+	Mixer(const Renderer& renderer, const RenderOptions& options) :
+		renderer_(renderer),
+		bank_(renderer.bank_),
+		options_(options) {}
+
+	std::vector<s16> run(const msd::MSD& seq);
+
+private:
+	struct NoteOff {
+		u64 tick;
+		u32 id;
+	};
+
+	void noteOn(const msd::Note& msg, u64 tick);
+
+	void advanceTo(u64 tick);
+	void renderTicks(u64 ticks);
+	void renderSamples(size_t count);
+
+	const Renderer& renderer_;
+	const mpb::Bank& bank_;
+	const RenderOptions& options_;
+
+	VoicePool voices_;
+	u8 programs_[16] {};
+	std::vector<NoteOff> noteOffs_;
+
+	u64 tick_ = 0;
+	double samplesPerTick_ = 0;
+	double sampleClock_ = 0;
+	std::vector<s16> out_;
+};
+
+std::vector<s16> Mixer::run(const msd::MSD& seq) {
+	// MSD timing works as it does for MIDI exports, which use (0x10000 / tpqn) ticks per quarter note
+	double ticksPerQuarter = seq.tpqn ? 65536.0 / seq.tpqn : 480.0;
+	auto setTempo = [&](u32 msecsPerQuarter) {
+		if (!msecsPerQuarter)
+			msecsPerQuarter = 500;
+		samplesPerTick_ = (msecsPerQuarter / 1000.0) * aica::SAMPLE_RATE / ticksPerQuarter;
+	};
+
+	setTempo(seq.initialTempo);
+
+	size_t loopStart = 0;
+	bool inLoop = false;
+	uint loopsDone = 0;
+
+	for (size_t m = 0; m < seq.messages.size();) {
+		const auto& message = seq.messages[m];
+		size_t next = m + 1;
+
+		std::visit(overloaded {
+			[&](const msd::Note& msg) {
+				noteOn(msg, tick_);
+			},
+
+			[&](const msd::ControlChange& msg) {
+				auto& ch = voices_.channel(msg.channel);
+				switch (msg.controller) {
+					case 7:  ch.volume = msg.value; break;
+					case 10: ch.pan = msg.value; break;
+					case 11: ch.expression = msg.value; break;
+					default: return;
+				}
+
+				voices_.updateChannel(msg.channel);
+			},
+
+			[&](const msd::ProgramChange& msg) {
+				programs_[msg.channel & 0x0F] = msg.program;
+			},
+
+			[&](const msd::ChannelPressure&) {},
+
+			[&](const msd::PitchWheelChange& msg) {
+				voices_.channel(msg.channel).pitch = msg.pitch;
+				voices_.updateChannel(msg.channel);
+			},
+
+			// As with MIDI exports, loop messages alternate between the start and end of the loop
+			[&](const msd::Loop&) {
+				if (!inLoop) {
+					loopStart = m + 1;
+					inLoop = true;
+				} else if (loopsDone < options_.loops) {
+					loopsDone++;
+					next = loopStart;
+				} else {
+					inLoop = false;
+				}
+			},
+
+			[&](const msd::TempoChange& msg) {
+				setTempo(msg.tempo);
+			},
+
+			[&](const msd::SysEx&) {}
+		}, message);
+
+		u32 step = std::visit([](const auto& msg) { return msg.step; }, message);
+		advanceTo(tick_ + step);
+		m = next;
+	}
+
+	// Let anything still held or ringing out finish, up to the tail length
+	size_t limit = out_.size() / 2 + static_cast<size_t>(options_.tailSeconds * aica::SAMPLE_RATE);
+	u64 ticksPerBlock = std::max<u64>(1, VoicePool::BLOCK / samplesPerTick_);
+
+	while (out_.size() / 2 < limit && voices_.active())
+		advanceTo(tick_ + ticksPerBlock);
+
+	return std::move(out_);
+}
+
+void Mixer::noteOn(const msd::Note& msg, u64 tick) {
+	const auto* program = bank_.program(programs_[msg.channel & 0x0F]);
+	if (!program)
+		return;
+
+	u32 id = voices_.noteOn(msg.channel, msg.note, msg.velocity, *program, renderer_.tones_, bank_.velocities);
+	noteOffs_.push_back({ tick + msg.gate, id });
+}
+
+void Mixer::advanceTo(u64 tick) {
+	while (true) {
+		// Let go of whatever's due, and forget notes whose voices have all been stolen since
+		std::erase_if(noteOffs_, [&](const NoteOff& off) {
+			if (off.tick <= tick_) {
+				voices_.noteOff(off.id);
+				return true;
+			}
+
+			return !voices_.held(off.id);
+		});
+
+		if (tick_ >= tick)
+			break;
+
+		u64 next = tick;
+		for (const auto& off : noteOffs_)
+			next = std::min(next, off.tick);
+
+		renderTicks(next - tick_);
+		tick_ = next;
+	}
+}
+
+void Mixer::renderTicks(u64 ticks) {
+	sampleClock_ += ticks * samplesPerTick_;
+	size_t target = static_cast<size_t>(sampleClock_);
+	size_t rendered = out_.size() / 2;
+
+	if (target > rendered)
+		renderSamples(target - rendered);
+}
+
+void Mixer::renderSamples(size_t count) {
+	float mixL[VoicePool::BLOCK];
+	float mixR[VoicePool::BLOCK];
+
+	while (count) {
+		size_t n = std::min(count, VoicePool::BLOCK);
+		std::fill_n(mixL, n, 0.0f);
+		std::fill_n(mixR, n, 0.0f);
+
+		voices_.mix(mixL, mixR, n);
+
+		size_t pos = out_.size();
+		out_.resize(pos + n * 2);
+		for (size_t i = 0; i < n; i++) {
+			out_[pos + i * 2]     = toS16(mixL[i] * options_.gain);
+			out_[pos + i * 2 + 1] = toS16(mixR[i] * options_.gain);
+		}
+
+		count -= n;
+	}
+}
+
+wav::WAV<s16> Renderer::render(const msd::MSD& seq, const RenderOptions& options) const {
+	wav::WAV<s16> wav(2, aica::SAMPLE_RATE);
+	wav.data = Mixer(*this, options).run(seq);
+	return wav;
+}
+
+} // namespace manatools::synth
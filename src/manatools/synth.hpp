@@ -0,0 +1,179 @@
+#pragma once
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "aica.hpp"
+#include "mpb.hpp"
+#include "msd.hpp"
+#include "tone.hpp"
+#include "types.hpp"
+#include "utils.hpp"
+#include "wav.hpp"
+
+namespace manatools::synth {
+	constexpr uint VOICES = 64;
+
+	struct RenderOptions {
+		// How many extra times to play the section between a sequence's loop messages
+		uint loops = 0;
+
+		// Longest to let voices ring out for after the sequence ends, in seconds
+		double tailSeconds = 5.0;
+
+		// Applied to the final mix before it's clipped to 16 bits
+		float gain = 1.0f;
+	};
+
+	/**
+	 * Decoded copies of tones, looked up by the tone data they came from, so voices can play
+	 * straight out of memory rather than decoding in the middle of a mix. Tones are only
+	 * known by address, so they have to outlive the cache.
+	 */
+	class ToneCache {
+	public:
+		ToneCache() = default;
+		explicit ToneCache(const mpb::Bank& bank);
+		explicit ToneCache(const mpb::Program& program);
+
+		// Empty if the tone was never added, or has no data
+		std::span<const s16> find(const tone::Data* data) const;
+
+	private:
+		void collect(const mpb::Program& program, std::vector<const tone::Tone*>& tones);
+		void decode(const std::vector<const tone::Tone*>& tones);
+
+		std::unordered_map<const tone::Data*, std::vector<s16>> pcm_;
+	};
+
+	/**
+	 * The fixed set of VOICES voices that Renderer plays sequences through, which also works
+	 * on its own for playing notes live. Nothing in here allocates, locks or decodes, and
+	 * stealing a voice just reuses its slot, so it's fine to drive from an audio callback.
+	 *
+	 * Voices point into the program and cache they were started from, so both have to stay
+	 * put until the voices finish, or reset is called.
+	 */
+	class VoicePool {
+	public:
+		struct Channel {
+			s8 pitch = 0;
+			u8 volume = 100;
+			u8 expression = 127;
+			u8 pan = 64;
+		};
+
+		// Envelopes are stepped, and voices mixed, this many samples at a time
+		static constexpr size_t BLOCK = 32;
+
+		Channel& channel(u8 ch) {
+			return channels_[ch & 0x0F];
+		}
+
+		// For voices already playing on a channel to pick up changes made to it
+		void updateChannel(u8 ch);
+
+		/**
+		 * Starts a voice on every layer of the program that has a split covering the note and
+		 * velocity, and returns an ID that noteOff takes to let go of all of them.
+		 */
+		u32 noteOn(u8 ch, u8 note, u8 velocity, const mpb::Program& program, const ToneCache& tones,
+		           std::span<const mpb::Velocity> velocities);
+
+		void noteOff(u32 id);
+		void allNotesOff();
+
+		// Whether anything started by that noteOn is still held, rather than released or stolen
+		bool held(u32 id) const;
+
+		// Cuts everything off on the spot
+		void reset();
+
+		bool active() const;
+
+		// Adds (count) samples of every playing voice onto outL and outR
+		void mix(float* outL, float* outR, size_t count);
+
+	private:
+		enum class EnvState {
+			Off,
+			Attack,
+			Decay1,
+			Decay2,
+			Release
+		};
+
+		struct Voice {
+			EnvState env = EnvState::Off;
+			bool keyOn = false;
+			u8 channel = 0;
+			u8 note = 0;
+			u32 id = 0;
+			u32 order = 0;
+
+			const mpb::Layer* layer = nullptr;
+			const mpb::Split* split = nullptr;
+			const s16* pcm = nullptr;
+
+			// Position and step are 32.32 fixed point, in samples
+			u64 pos = 0;
+			u64 step = 0;
+			u32 end = 0;
+			bool loop = false;
+			u32 loopStart = 0;
+			u32 loopEnd = 0;
+			size_t delay = 0;
+
+			float att = 1023.0f; // Silent, in envelope attenuation units
+			float attackRate = 0;
+			float decayRate1 = 0;
+			float decayRate2 = 0;
+			float releaseRate = 0;
+			float decayLevel = 0;
+
+			float level = 0; // Everything but the envelope and channel
+			float gainL = 0;
+			float gainR = 0;
+		};
+
+		void keyOff(Voice& voice);
+		Voice& allocVoice();
+		void updateGain(Voice& voice);
+		void updatePitch(Voice& voice);
+		void renderVoice(Voice& voice, float* outL, float* outR, size_t count);
+
+		Channel channels_[16];
+		Voice voices_[VOICES];
+		u32 nextOrder_ = 0;
+		u32 nextID_ = 1;
+	};
+
+	/**
+	 * Plays MSD sequences against an MPB bank offline, in a rough approximation of what the
+	 * AICA and sound driver would do, with up to 64 voices at 44100 Hz.
+	 *
+	 * Covered are pitch (OCT/FNS, base note, fine tune and pitch bend), the amplitude
+	 * envelope (including key rate scaling and LPSLNK), tone loops, layer delays, velocity
+	 * curves, direct level, oscillator level and pan, plus channel volume (CC7), pan (CC10)
+	 * and expression (CC11). Not covered are the filter, LFOs, DSP effects, and the quirk of
+	 * ADPCM tones sounding an octave higher at high OCT values.
+	 *
+	 * Every tone in the bank is decoded once up front, so render can be called from several
+	 * threads at once. (bank) must outlive the renderer.
+	 */
+	class Renderer {
+	public:
+		Renderer(const mpb::Bank& bank);
+
+		// Interleaved stereo at aica::SAMPLE_RATE
+		wav::WAV<s16> render(const msd::MSD& seq, const RenderOptions& options = {}) const;
+
+	private:
+		MT_DISABLE_COPY(Renderer)
+
+		friend class Mixer;
+
+		const mpb::Bank& bank_;
+		ToneCache tones_;
+	};
+} // namespace manatools::synth
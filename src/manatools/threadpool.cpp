@@ -0,0 +1,109 @@
+#include "threadpool.hpp"
+
+namespace manatools {
+
+// Which pool and queue the current thread works for, if any
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local size_t currentWorker = 0;
+
+ThreadPool::ThreadPool(uint threads) {
+	queues_.reserve(threads);
+	for (uint i = 0; i < threads; i++) {
+		queues_.push_back(std::make_unique<Queue>());
+	}
+
+	workers_.reserve(threads);
+	for (uint i = 0; i < threads; i++) {
+		workers_.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(mutex_);
+		stopping_ = true;
+	}
+
+	cv_.notify_all();
+
+	for (auto& worker : workers_) {
+		worker.join();
+	}
+}
+
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+	return pool;
+}
+
+void ThreadPool::post(Job job) {
+	size_t q = currentPool == this ? currentWorker : nextQueue_++ % queues_.size();
+
+	{
+		std::lock_guard lock(queues_[q]->mutex);
+		queues_[q]->jobs.push_back(std::move(job));
+	}
+
+	{
+		std::lock_guard lock(mutex_);
+		pending_++;
+	}
+
+	cv_.notify_one();
+}
+
+bool ThreadPool::take(size_t worker, Job& job) {
+	// Newest from our own queue, as whatever it needs is most likely still in cache
+	{
+		auto& own = *queues_[worker];
+		std::lock_guard lock(own.mutex);
+		if (!own.jobs.empty()) {
+			job = std::move(own.jobs.back());
+			own.jobs.pop_back();
+			return true;
+		}
+	}
+
+	// Oldest from everyone else's, as it's likely the biggest bit of work left
+	for (size_t i = 1; i < queues_.size(); i++) {
+		auto& other = *queues_[(worker + i) % queues_.size()];
+		std::lock_guard lock(other.mutex);
+		if (!other.jobs.empty()) {
+			job = std::move(other.jobs.front());
+			other.jobs.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::workerLoop(size_t worker) {
+	currentPool = this;
+	currentWorker = worker;
+
+	while (true) {
+		{
+			std::unique_lock lock(mutex_);
+			cv_.wait(lock, [this] { return stopping_ || pending_; });
+
+			// Finish off whatever's queued before stopping, futures may be waiting on it
+			if (!pending_)
+				return;
+
+			pending_--;
+		}
+
+		/**
+		 * Having claimed one off pending_ means there's a job somewhere that nobody else
+		 * has claimed, but it might be mid-push, so keep looking until it turns up.
+		 */
+		Job job;
+		while (!take(worker, job))
+			std::this_thread::yield();
+
+		job();
+	}
+}
+
+} // namespace manatools
@@ -0,0 +1,142 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "types.hpp"
+#include "utils.hpp"
+
+namespace manatools {
+	/**
+	 * Fixed size pool of worker threads.
+	 * The thread calling parallelFor also takes work itself, so nesting calls from
+	 * inside a job can't deadlock, and a pool with zero workers is still usable.
+	 *
+	 * Every worker has its own queue. Jobs posted from a worker go on its own queue and
+	 * it takes the newest first, while idle workers steal the oldest from everyone else,
+	 * so nested work (i.e. files, then chunks of each file) spreads out by itself.
+	 */
+	class ThreadPool {
+	public:
+		explicit ThreadPool(uint threads);
+		~ThreadPool();
+
+		// One worker per core minus one, as the caller of parallelFor works too
+		static ThreadPool& shared();
+
+		uint size() const {
+			return workers_.size();
+		}
+
+		template <typename F>
+		auto submit(F&& func) -> std::future<std::invoke_result_t<F>>;
+
+		/**
+		 * Calls func(i) for every i in [0, count), spread across the pool, and blocks
+		 * until all are done. The first exception thrown by func is rethrown here.
+		 */
+		template <typename F>
+		void parallelFor(size_t count, F&& func);
+
+	private:
+		MT_DISABLE_COPY(ThreadPool)
+
+		using Job = std::move_only_function<void()>;
+
+		struct Queue {
+			std::mutex mutex;
+			std::deque<Job> jobs;
+		};
+
+		void post(Job job);
+		bool take(size_t worker, Job& job);
+		void workerLoop(size_t worker);
+
+		std::vector<std::thread> workers_;
+		std::vector<std::unique_ptr<Queue>> queues_;
+		std::atomic<size_t> nextQueue_ = 0;
+
+		// Only for sleeping when there's nothing to do
+		std::mutex mutex_;
+		std::condition_variable cv_;
+		size_t pending_ = 0;
+		bool stopping_ = false;
+	};
+
+	template <typename F>
+	auto ThreadPool::submit(F&& func) -> std::future<std::invoke_result_t<F>> {
+		std::packaged_task<std::invoke_result_t<F>()> task(std::forward<F>(func));
+		auto future = task.get_future();
+
+		if (workers_.empty()) {
+			task();
+		} else {
+			post(std::move(task));
+		}
+
+		return future;
+	}
+
+	template <typename F>
+	void ThreadPool::parallelFor(size_t count, F&& func) {
+		if (count <= 1 || workers_.empty()) {
+			for (size_t i = 0; i < count; i++)
+				func(i);
+			return;
+		}
+
+		/**
+		 * Helpers may only get scheduled after everything's already been claimed and we've
+		 * returned, so anything they touch has to outlive this call. They never call func
+		 * in that case, so referencing it is fine.
+		 */
+		struct State {
+			std::atomic<size_t> next = 0;
+			std::atomic<size_t> done = 0;
+			std::mutex mutex;
+			std::condition_variable cv;
+			std::exception_ptr error;
+		};
+
+		auto state = std::make_shared<State>();
+
+		auto run = [state, count, &func]() {
+			size_t i;
+			while ((i = state->next.fetch_add(1)) < count) {
+				try {
+					func(i);
+				} catch (...) {
+					std::lock_guard lock(state->mutex);
+					if (!state->error)
+						state->error = std::current_exception();
+				}
+
+				if (state->done.fetch_add(1) + 1 == count) {
+					std::lock_guard lock(state->mutex);
+					state->cv.notify_all();
+				}
+			}
+		};
+
+		size_t helpers = std::min<size_t>(count - 1, workers_.size());
+		for (size_t i = 0; i < helpers; i++)
+			post(run);
+
+		run();
+
+		std::unique_lock lock(state->mutex);
+		state->cv.wait(lock, [&] { return state->done == count; });
+
+		if (state->error)
+			std::rethrow_exception(state->error);
+	}
+} // namespace manatools
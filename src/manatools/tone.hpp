@@ -2,6 +2,7 @@
 #include <cassert>
 #include <cmath>
 #include <memory>
+#include <span>
 #include <vector>
 
 #include "types.hpp"
@@ -20,7 +21,65 @@ namespace manatools::tone {
 		PCM16
 	};
 
-	typedef std::vector<u8> Data;
+	/**
+	 * Tone data is usually owned, but can also be a read-only view into memory belonging to
+	 * something else, such as a memory mapped file, which is kept alive for as long as the
+	 * view is. A view has to be detached before anything non-const is used, so a copy of
+	 * the whole thing never happens by accident (i.e. from a non-const pointer reading).
+	 */
+	class Data {
+	public:
+		Data() = default;
+		explicit Data(size_t bytes) : owned_(bytes) {}
+
+		Data(std::span<const u8> view, std::shared_ptr<const void> owner) :
+			view_(view), owner_(std::move(owner)) {}
+
+		bool isView() const               { return owner_ != nullptr; }
+
+		const u8* data() const            { return isView() ? view_.data() : owned_.data(); }
+		size_t size() const               { return isView() ? view_.size() : owned_.size(); }
+		bool empty() const                { return size() == 0; }
+
+		std::span<const u8> span() const  { return { data(), size() }; }
+		const u8* begin() const           { return data(); }
+		const u8* end() const             { return data() + size(); }
+		u8 operator[](size_t i) const     { return data()[i]; }
+
+		u8* data() {
+			assert(!isView() && "Tone data has to be detached before changing it");
+			return owned_.data();
+		}
+
+		std::span<u8> mutableSpan() {
+			assert(!isView() && "Tone data has to be detached before changing it");
+			return owned_;
+		}
+
+		void resize(size_t bytes) {
+			assert(!isView() && "Tone data has to be detached before changing it");
+			owned_.resize(bytes);
+		}
+
+		/**
+		 * Takes a copy of the data being viewed, if any, so it can be changed. Not safe to
+		 * call while anything else might be reading it, as what it points to moves.
+		 */
+		void detach() {
+			if (!isView())
+				return;
+
+			owned_.assign(view_.begin(), view_.end());
+			view_ = {};
+			owner_.reset();
+		}
+
+	private:
+		std::vector<u8> owned_;
+		std::span<const u8> view_;
+		std::shared_ptr<const void> owner_;
+	};
+
 	typedef std::shared_ptr<Data> DataPtr;
 
 	inline DataPtr makeDataPtr(size_t bytes) {
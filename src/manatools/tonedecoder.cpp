@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <bit>
 #include <cassert>
 
@@ -6,46 +7,159 @@
 
 namespace manatools::tone {
 
+Checkpoints::Checkpoints(const Tone& tone, size_t interval) {
+	if (tone.format != Format::ADPCM || !tone.data)
+		return;
+
+	interval_ = utils::roundUp(std::max<size_t>(interval, 2), 2);
+
+	const u8* in = tone.data->span().data();
+	size_t samples = tone.samples();
+	std::vector<s16> scratch(interval_);
+	yadpcm::Context ctx;
+
+	states_.reserve(samples / interval_ + 1);
+
+	for (size_t pos = 0; pos < samples; pos += interval_) {
+		states_.push_back({ ctx.history, ctx.stepSize });
+		in += ctx.decode(in, scratch.data(), std::min(interval_, samples - pos));
+	}
+}
+
+void Decoder::seek(size_t sample) {
+	if (!tone_ || !tone_->data) {
+		pos = 0;
+		return;
+	}
+
+	sample = std::min(sample, tone_->samples());
+
+	if (tone_->format != Format::ADPCM) {
+		pos = sample;
+		return;
+	}
+
+	// Carrying on from here is the cheapest unless a checkpoint gets closer
+	bool forward = sample >= pos;
+
+	if (checkpoints_ && !checkpoints_->empty()) {
+		size_t cp = std::min(sample / checkpoints_->interval(), checkpoints_->size() - 1);
+		size_t cpPos = cp * checkpoints_->interval();
+
+		if (!forward || cpPos > pos) {
+			const auto& state = (*checkpoints_)[cp];
+			adpcmCtx.reset();
+			adpcmCtx.history = state.history;
+			adpcmCtx.stepSize = state.stepSize;
+			pos = cpPos;
+			forward = true;
+		}
+	}
+
+	if (!forward)
+		reset();
+
+	s16 scratch[1024];
+	while (pos < sample) {
+		if (!decodeRaw(scratch, std::min(std::size(scratch), sample - pos)))
+			break;
+	}
+}
+
 size_t Decoder::decode(s16* out, size_t numSamples) {
-	Data* toneData = tone_->data.get();
+	if (!tone_ || !tone_->data)
+		return 0;
+
+	size_t done = 0;
+
+	while (done < numSamples) {
+		size_t limit = tone_->samples();
+
+		if (looping()) {
+			if (pos == loopStart_ && !loopState_)
+				loopState_ = adpcmCtx;
+
+			// Stop at the loop start first to keep the state there
+			if (pos < loopStart_)
+				limit = std::min(limit, loopStart_);
+			else if (pos < loopEnd_)
+				limit = std::min(limit, loopEnd_);
+		}
+
+		if (pos < limit)
+			done += decodeRaw(out + done, std::min(numSamples - done, limit - pos));
+
+		if (pos < limit)
+			break; // Ran out of data
+
+		if (!looping() || pos < loopEnd_) {
+			if (pos >= tone_->samples())
+				break;
+			continue;
+		}
+
+		if (loopState_) {
+			adpcmCtx = *loopState_;
+			pos = loopStart_;
+		} else {
+			seek(loopStart_);
+		}
+	}
+
+	return done;
+}
+
+size_t Decoder::decodeRaw(s16* out, size_t numSamples) {
+	const Data* toneData = tone_->data.get();
 	if (!toneData)
 		return 0;
 
 	auto toneSize = toneData->size();
-	if (pos >= toneSize)
-		return 0;
 
 	using enum Format;
 	switch (tone_->format) {
 		case ADPCM: {
-			size_t len = std::min(numSamples, (toneSize - pos) * 2);
-			pos += adpcmCtx.decode(toneData->data() + pos, out, len);
+			// Odd positions are halfway through a byte, which adpcmCtx keeps track of
+			size_t total = toneSize * 2;
+			if (pos >= total)
+				return 0;
+
+			size_t len = std::min(numSamples, total - pos);
+			adpcmCtx.decodeParallel(toneData->data() + (pos >> 1), out, len);
+			pos += len;
 			return len;
 		}
 
 		case PCM16: {
-			size_t len = std::min(numSamples * 2, toneSize - pos);
+			size_t bytePos = pos * 2;
+			if (bytePos >= toneSize)
+				return 0;
+
+			size_t len = std::min(numSamples * 2, toneSize - bytePos);
 
 			size_t i;
 			for (i = 0; i < len; i += 2) {
-				u8 low = (*toneData)[pos + i];
+				u8 low = (*toneData)[bytePos + i];
 				u8 high = 0;
 
 				// except what are the chances that it's not, really
 				// don't even know why I'm handling cases where size isn't a multiple of 2
 				if ((i + 1) < len)
-					high = (*toneData)[pos + i + 1];
+					high = (*toneData)[bytePos + i + 1];
 
 				// Hack for the WAV save method's own byte swapping, argh
 				// TODO: revisit this
 				out[i >> 1] = std::byteswap(static_cast<s16>((low << 8) | high));
 			}
 
-			pos += len;
+			pos += i >> 1;
 			return i >> 1;
 		}
 
 		case PCM8: {
+			if (pos >= toneSize)
+				return 0;
+
 			size_t len = std::min(numSamples, toneSize - pos);
 			for (size_t i = 0; i < len; i++) {
 				out[i] = static_cast<s16>((*toneData)[pos + i] << 8);
@@ -63,4 +177,32 @@ size_t Decoder::decode(s16* out, size_t numSamples) {
 	return 0;
 }
 
+void saveWAV(const Tone& tone, io::DataIO& io, const std::optional<wav::SamplerChunk>& sampler) {
+	constexpr size_t BLOCK_SIZE = 4096;
+
+	size_t samples = tone.data ? tone.samples() : 0;
+	wav::Writer<s16> writer(io, 1, tone.sampleRate, samples, sampler);
+
+	Decoder decoder(&tone);
+	s16 block[BLOCK_SIZE];
+
+	for (size_t pos = 0; pos < samples;) {
+		size_t len = std::min(BLOCK_SIZE, samples - pos);
+		size_t decoded = decoder.decode(block, len);
+
+		// Shouldn't happen, but the header's already promised this many samples
+		std::fill(block + decoded, block + len, 0);
+
+		writer.write({ block, len });
+		pos += len;
+	}
+
+	writer.finish();
+}
+
+void saveWAV(const Tone& tone, const fs::path& path, const std::optional<wav::SamplerChunk>& sampler) {
+	io::BufferedFileIO io(path, "wb");
+	saveWAV(tone, io, sampler);
+}
+
 } // namespace manatools::tone
@@ -1,21 +1,57 @@
 #pragma once
+#include <optional>
 #include <span>
+#include <vector>
 
+#include "filesystem.hpp"
+#include "io.hpp"
 #include "tone.hpp"
 #include "types.hpp"
 #include "utils.hpp"
+#include "wav.hpp"
 #include "yadpcm.hpp"
 
 namespace manatools::tone {
 	/**
-	 * TODO: Allow taking in loop points.
-	 * (Not quite sure how I'd approach that with ADPCM yet)
+	 * ADPCM decoder state every (interval) samples through a tone, so decoding can start
+	 * from anywhere after decoding at most (interval - 1) samples, rather than everything
+	 * before it. Building them takes a decode of the whole tone, so they're worth keeping
+	 * around and sharing between decoders of the same tone.
+	 * Non-ADPCM tones don't need any, and get none.
 	 */
+	class Checkpoints {
+	public:
+		static constexpr size_t DEFAULT_INTERVAL = 4096;
+
+		struct State {
+			s16 history;
+			s16 stepSize;
+		};
+
+		Checkpoints() = default;
+
+		// (interval) is rounded up to an even number, so every checkpoint starts on a byte
+		Checkpoints(const Tone& tone, size_t interval = DEFAULT_INTERVAL);
+
+		size_t interval() const             { return interval_; }
+		size_t size() const                 { return states_.size(); }
+		bool empty() const                  { return states_.empty(); }
+
+		// State at sample (i * interval)
+		const State& operator[](size_t i) const { return states_[i]; }
+
+	private:
+		size_t interval_ = 0;
+		std::vector<State> states_;
+	};
+
 	class Decoder {
 	public:
 		Decoder() : tone_(nullptr) {}
-		Decoder(const Tone* tone) : tone_(tone) {}
+		Decoder(const Tone* tone, const Checkpoints* checkpoints = nullptr) :
+			tone_(tone), checkpoints_(checkpoints) {}
 
+		// Back to the start, keeping the loop
 		void reset() {
 			pos = 0;
 			adpcmCtx.reset();
@@ -25,12 +61,55 @@ namespace manatools::tone {
 			return tone_;
 		}
 
-		void setTone(const Tone* tone) {
+		// Clears the loop, as it'll most likely be for the old tone
+		void setTone(const Tone* tone, const Checkpoints* checkpoints = nullptr) {
 			tone_ = tone;
+			checkpoints_ = checkpoints;
+			clearLoop();
 			reset();
 		}
 
-		// Returns number of samples read
+		// (checkpoints) must be for the current tone, and outlive the decoder or be unset first
+		void setCheckpoints(const Checkpoints* checkpoints) {
+			checkpoints_ = checkpoints;
+		}
+
+		// In samples
+		size_t position() const {
+			return pos;
+		}
+
+		/**
+		 * Moves to (sample), clamped to the end of the tone. For ADPCM this decodes forward
+		 * from the closest of the current position, the nearest checkpoint before (sample)
+		 * (if there are checkpoints), or the start.
+		 */
+		void seek(size_t sample);
+
+		/**
+		 * Once (end) is reached, decoding carries on from (start) rather than stopping, as
+		 * the AICA does. The ADPCM state at (start) is kept the first time it's passed so
+		 * every loop after that picks up from it right away.
+		 * Ignored if (end) isn't after (start).
+		 */
+		void setLoop(size_t start, size_t end) {
+			loopStart_ = start;
+			loopEnd_ = end;
+			loopState_.reset();
+		}
+
+		void clearLoop() {
+			setLoop(0, 0);
+		}
+
+		bool looping() const {
+			return loopEnd_ > loopStart_;
+		}
+
+		/**
+		 * Returns number of samples read, which when looping is always (numSamples) unless
+		 * the loop is past the end of the tone.
+		 */
 		size_t decode(s16* out, size_t numSamples);
 		size_t decode(std::span<s16> out) {
 			return decode(out.data(), out.size());
@@ -39,9 +118,23 @@ namespace manatools::tone {
 	private:
 		MT_DISABLE_COPY(Decoder)
 
-		const Tone* tone_;
+		// Decodes up to (numSamples) from (pos) on, without caring about the loop
+		size_t decodeRaw(s16* out, size_t numSamples);
 
+		const Tone* tone_;
+		const Checkpoints* checkpoints_ = nullptr;
 		size_t pos = 0;
 		yadpcm::Context adpcmCtx;
+
+		size_t loopStart_ = 0;
+		size_t loopEnd_ = 0;
+		std::optional<yadpcm::Context> loopState_;
 	};
+
+	/**
+	 * Saves (tone) as a mono 16-bit WAV at its own sample rate, decoding it a block at a time
+	 * straight into the file rather than all at once into memory first.
+	 */
+	void saveWAV(const Tone& tone, io::DataIO& io, const std::optional<wav::SamplerChunk>& sampler = std::nullopt);
+	void saveWAV(const Tone& tone, const fs::path& path, const std::optional<wav::SamplerChunk>& sampler = std::nullopt);
 } // namespace manatools::tone
@@ -0,0 +1,109 @@
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+#include "threadpool.hpp"
+#include "tonedecoder.hpp"
+#include "toneencoder.hpp"
+#include "yadpcm.hpp"
+
+namespace manatools::tone {
+
+// Leaves (tone) untouched so tones sharing data can all be given the result afterwards
+static EncodeResult encode(const Tone& tone, const EncodeOptions& options, DataPtr& out) {
+	EncodeResult result;
+
+	if (!tone.data || tone.format == Format::ADPCM)
+		return result;
+
+	std::vector<s16> pcm(tone.samples());
+	Decoder decoder(&tone);
+	pcm.resize(decoder.decode(pcm));
+
+	out = makeDataPtr((pcm.size() + 1) / 2);
+
+	yadpcm::Context ctx;
+	size_t written;
+	if (options.searchWidth) {
+		written = ctx.encodeSearch(pcm.data(), out->data(), pcm.size(), options.searchWidth);
+	} else {
+		written = ctx.encode(pcm.data(), out->data(), pcm.size());
+	}
+	ctx.flush(out->data() + written);
+
+	std::vector<s16> decoded(pcm.size());
+	yadpcm::Context().decode(out->data(), decoded.data(), decoded.size());
+
+	result.converted = true;
+	result.samples = pcm.size();
+	result.snr = snr(pcm, decoded);
+	return result;
+}
+
+EncodeResult toADPCM(Tone& tone, const EncodeOptions& options) {
+	DataPtr data;
+	EncodeResult result = encode(tone, options, data);
+
+	if (result.converted) {
+		tone.format = Format::ADPCM;
+		tone.data = data;
+	}
+
+	return result;
+}
+
+std::vector<EncodeResult> toADPCM(std::span<Tone* const> tones, const EncodeOptions& options) {
+	std::vector<EncodeResult> results(tones.size());
+
+	// First tone using each bit of data does the encoding for everything else sharing it
+	std::unordered_map<const Data*, size_t> owners;
+	std::vector<size_t> jobs;
+	std::vector<size_t> owner(tones.size());
+
+	for (size_t i = 0; i < tones.size(); i++) {
+		auto [it, inserted] = owners.try_emplace(tones[i]->data.get(), i);
+		owner[i] = it->second;
+		if (inserted)
+			jobs.push_back(i);
+	}
+
+	std::vector<DataPtr> outData(tones.size());
+
+	ThreadPool::shared().parallelFor(jobs.size(), [&](size_t j) {
+		size_t i = jobs[j];
+		results[i] = encode(*tones[i], options, outData[i]);
+	});
+
+	// Every job's done, so nothing's reading the old data any more
+	for (size_t i = 0; i < tones.size(); i++) {
+		size_t o = owner[i];
+		results[i] = results[o];
+
+		if (results[i].converted) {
+			tones[i]->format = Format::ADPCM;
+			tones[i]->data = outData[o];
+		}
+	}
+
+	return results;
+}
+
+double snr(std::span<const s16> reference, std::span<const s16> decoded) {
+	double signal = 0;
+	double noise = 0;
+
+	size_t len = std::min(reference.size(), decoded.size());
+	for (size_t i = 0; i < len; i++) {
+		double ref = reference[i];
+		double err = ref - decoded[i];
+		signal += ref * ref;
+		noise += err * err;
+	}
+
+	if (noise == 0)
+		return std::numeric_limits<double>::infinity();
+
+	return 10 * std::log10(signal / noise);
+}
+
+} // namespace manatools::tone
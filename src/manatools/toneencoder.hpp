@@ -0,0 +1,39 @@
+#pragma once
+#include <span>
+#include <vector>
+
+#include "tone.hpp"
+#include "types.hpp"
+
+namespace manatools::tone {
+	struct EncodeOptions {
+		/**
+		 * 0 uses the plain encoder, anything else uses yadpcm::Context::encodeSearch with
+		 * that many candidates, which sounds better but takes a fair bit longer.
+		 */
+		uint searchWidth = 0;
+	};
+
+	struct EncodeResult {
+		bool converted = false; // false if the tone was already ADPCM or had no data
+		size_t samples = 0;
+		double snr = 0;         // In dB, compared to what the tone decodes back to
+	};
+
+	/**
+	 * Converts (tone) to ADPCM in place. PCM8 tones are widened to PCM16 first.
+	 * The tone is given new data rather than writing over the old, so anything else
+	 * sharing it is left alone.
+	 */
+	EncodeResult toADPCM(Tone& tone, const EncodeOptions& options = {});
+
+	/**
+	 * Same as above for many tones at once, spread across the shared thread pool.
+	 * Tones sharing the same data are only encoded once and keep sharing afterwards.
+	 * Results are in the same order as (tones).
+	 */
+	std::vector<EncodeResult> toADPCM(std::span<Tone* const> tones, const EncodeOptions& options = {});
+
+	// Signal-to-noise ratio of (decoded) against (reference) in dB, infinity if they're identical
+	double snr(std::span<const s16> reference, std::span<const s16> decoded);
+} // namespace manatools::tone
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "tonedecoder.hpp"
+#include "tonepeaks.hpp"
+
+namespace manatools::tone {
+
+// Running totals that buckets are built from and merged into
+struct Accumulator {
+	s16 min = std::numeric_limits<s16>::max();
+	s16 max = std::numeric_limits<s16>::min();
+	double sumSquares = 0;
+	size_t count = 0;
+
+	void add(s16 sample) {
+		min = std::min(min, sample);
+		max = std::max(max, sample);
+		sumSquares += static_cast<double>(sample) * sample;
+		count++;
+	}
+
+	void add(const Peaks::Bucket& bucket, size_t bucketCount) {
+		min = std::min(min, bucket.min);
+		max = std::max(max, bucket.max);
+		sumSquares += static_cast<double>(bucket.rms) * bucket.rms * bucketCount;
+		count += bucketCount;
+	}
+
+	Peaks::Bucket bucket() const {
+		if (!count)
+			return {};
+
+		return { min, max, static_cast<float>(std::sqrt(sumSquares / count)) };
+	}
+};
+
+Peaks::Peaks(const Tone& tone) {
+	pcm_.resize(tone.samples());
+
+	Decoder decoder(&tone);
+	pcm_.resize(decoder.decode(pcm_));
+
+	if (pcm_.empty())
+		return;
+
+	auto& base = levels_.emplace_back((pcm_.size() + BASE_BUCKET - 1) / BASE_BUCKET);
+	for (size_t b = 0; b < base.size(); b++) {
+		Accumulator acc;
+		size_t end = std::min((b + 1) * BASE_BUCKET, pcm_.size());
+
+		for (size_t i = b * BASE_BUCKET; i < end; i++)
+			acc.add(pcm_[i]);
+
+		base[b] = acc.bucket();
+	}
+
+	// Each level pairs up the buckets of the one below, until there's only one left
+	while (levels_.back().size() > 1) {
+		size_t l = levels_.size() - 1;
+		size_t childSize = bucketSize(l);
+		size_t numBuckets = (levels_[l].size() + 1) / 2;
+
+		std::vector<Bucket> next(numBuckets);
+		for (size_t b = 0; b < numBuckets; b++) {
+			Accumulator acc;
+
+			for (size_t c = b * 2; c < std::min(b * 2 + 2, levels_[l].size()); c++) {
+				size_t count = std::min(childSize, pcm_.size() - c * childSize);
+				acc.add(levels_[l][c], count);
+			}
+
+			next[b] = acc.bucket();
+		}
+
+		levels_.push_back(std::move(next));
+	}
+}
+
+Peaks::Bucket Peaks::range(size_t start, size_t end) const {
+	end = std::min(end, pcm_.size());
+
+	Accumulator acc;
+	size_t pos = start;
+
+	while (pos < end) {
+		// Off the bucket grid, or not enough left for a whole bucket, so go sample by sample
+		if (pos % BASE_BUCKET || end - pos < BASE_BUCKET) {
+			size_t stop = std::min(end, (pos / BASE_BUCKET + 1) * BASE_BUCKET);
+			for (; pos < stop; pos++)
+				acc.add(pcm_[pos]);
+			continue;
+		}
+
+		// Otherwise take the biggest bucket that starts here and fits
+		size_t l = 0;
+		while (l + 1 < levels_.size() && pos % bucketSize(l + 1) == 0 && pos + bucketSize(l + 1) <= end)
+			l++;
+
+		acc.add(levels_[l][pos / bucketSize(l)], bucketSize(l));
+		pos += bucketSize(l);
+	}
+
+	return acc.bucket();
+}
+
+} // namespace manatools::tone
@@ -0,0 +1,45 @@
+#pragma once
+#include <span>
+#include <vector>
+
+#include "tone.hpp"
+#include "types.hpp"
+
+namespace manatools::tone {
+	/**
+	 * Min/max/RMS summaries of a tone at every power of two zoom level, for drawing
+	 * waveforms. Built with a single decode of the tone, after which summarising any range
+	 * of samples only looks at a handful of buckets, no matter how long the range is.
+	 */
+	class Peaks {
+	public:
+		// Samples per bucket on the finest level, each level after that doubles it
+		static constexpr size_t BASE_BUCKET = 16;
+
+		struct Bucket {
+			s16 min = 0;
+			s16 max = 0;
+			float rms = 0;
+		};
+
+		Peaks() = default;
+		explicit Peaks(const Tone& tone);
+
+		size_t samples() const                      { return pcm_.size(); }
+		size_t levels() const                       { return levels_.size(); }
+		size_t bucketSize(size_t level) const       { return BASE_BUCKET << level; }
+
+		std::span<const s16> pcm() const            { return pcm_; }
+		std::span<const Bucket> level(size_t l) const { return levels_[l]; }
+
+		/**
+		 * Exact summary of samples [start, end), put together from the biggest buckets that
+		 * fit inside it, and the odd sample left over at either edge.
+		 */
+		Bucket range(size_t start, size_t end) const;
+
+	private:
+		std::vector<s16> pcm_;
+		std::vector<std::vector<Bucket>> levels_;
+	};
+} // namespace manatools::tone
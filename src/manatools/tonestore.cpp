@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <string>
+
+#include "endian.hpp"
+#include "io.hpp"
+#include "tonestore.hpp"
+
+namespace manatools::tone {
+
+static constexpr u64 mix(u64 v) {
+	v ^= v >> 30;
+	v *= 0xBF58476D1CE4E5B9ull;
+	v ^= v >> 27;
+	v *= 0x94D049BB133111EBull;
+	v ^= v >> 31;
+	return v;
+}
+
+// Eight bytes at a time, then whatever's left over, with the size mixed in so zero padding counts
+u64 Store::hash(std::span<const u8> bytes) {
+	constexpr u64 MULTIPLIER = 0x9E3779B97F4A7C15ull;
+
+	u64 h = mix(bytes.size() + MULTIPLIER);
+	size_t i = 0;
+
+	for (; i + 8 <= bytes.size(); i += 8) {
+		u64 word;
+		memcpy(&word, bytes.data() + i, 8);
+		h = (h ^ mix(LE(word))) * MULTIPLIER;
+	}
+
+	if (i < bytes.size()) {
+		u64 word = 0;
+		for (size_t j = 0; i + j < bytes.size(); j++)
+			word |= u64(bytes[i + j]) << (j * 8);
+		h = (h ^ mix(word)) * MULTIPLIER;
+	}
+
+	return mix(h);
+}
+
+/* ======================== *
+ *          Hasher          *
+ * ======================== */
+
+size_t Store::Hasher::read(void*, size_t, size_t) {
+	setError(Error::InvalidOperation);
+	return 0;
+}
+
+size_t Store::Hasher::write(const void* buf, size_t size, size_t count) {
+	const u8* in = static_cast<const u8*>(buf);
+	size_t bytes = size * count;
+	size_t i = 0;
+
+	// Finish off a word started by an earlier write first
+	for (; i < bytes && size_ % 8; i++, size_++) {
+		pending_ |= u64(in[i]) << (size_ % 8 * 8);
+		if (size_ % 8 == 7) {
+			update(pending_);
+			pending_ = 0;
+		}
+	}
+
+	for (; i + 8 <= bytes; i += 8, size_ += 8) {
+		u64 word;
+		memcpy(&word, in + i, 8);
+		update(LE(word));
+	}
+
+	for (; i < bytes; i++, size_++)
+		pending_ |= u64(in[i]) << (size_ % 8 * 8);
+
+	return count;
+}
+
+bool Store::Hasher::seek(long offset, Seek origin) {
+	if (origin == Seek::Cur && offset == 0)
+		return true;
+
+	setError(Error::InvalidOperation);
+	return false;
+}
+
+long Store::Hasher::tell() {
+	return long(size_);
+}
+
+// Two lanes that each see every word differently, so they're as good as independent
+void Store::Hasher::update(u64 word) {
+	h_[0] = (h_[0] ^ mix(word)) * 0x9E3779B97F4A7C15ull;
+	h_[1] = std::rotl(h_[1] ^ mix(word ^ 0xC2B2AE3D27D4EB4Full), 31) * 0xFF51AFD7ED558CCDull;
+}
+
+Store::Digest Store::Hasher::digest() const {
+	Hasher copy(false);
+	copy.h_[0] = h_[0];
+	copy.h_[1] = h_[1];
+
+	// Size is mixed in too, so trailing zeroes count
+	if (size_ % 8)
+		copy.update(pending_);
+
+	return {
+		.hash = { mix(copy.h_[0] ^ size_), mix(copy.h_[1] + size_) },
+		.size = size_
+	};
+}
+
+Store::Digest Store::digest(std::span<const u8> bytes) {
+	Hasher hasher(false);
+	hasher.writeSpan(bytes);
+	return hasher.digest();
+}
+
+/* ======================== *
+ *          Store           *
+ * ======================== */
+
+DataPtr Store::intern(const DataPtr& data) {
+	if (!data)
+		return data;
+
+	u64 h = hash(data->span());
+
+	std::lock_guard lock(mutex_);
+
+	auto [begin, end] = tones_.equal_range(h);
+	for (auto it = begin; it != end; it++) {
+		const auto& existing = it->second;
+
+		// Already the shared copy, so there's nothing to count
+		if (existing == data)
+			return existing;
+
+		if (std::ranges::equal(existing->span(), data->span())) {
+			stats_.items++;
+			stats_.bytes += data->size();
+			stats_.bytesSaved += data->size();
+			return existing;
+		}
+	}
+
+	tones_.emplace(h, data);
+	stats_.items++;
+	stats_.unique++;
+	stats_.bytes += data->size();
+	return data;
+}
+
+/**
+ * Writes to a temporary file next to (path) then renames it over, so if (path) is a hard link
+ * left by an earlier run, the other names linked to it are left alone rather than written
+ * through. Also means there's never half a file at (path).
+ */
+static void replaceFile(const fs::path& path, const Store::Writer& writer) {
+	static std::atomic<u64> counter = 0;
+
+	fs::path tmpPath = path;
+	tmpPath += ".tmp" + std::to_string(counter++);
+
+	try {
+		io::BufferedFileIO file(tmpPath, "wb");
+		writer(file);
+		file.close();
+	} catch (...) {
+		std::error_code ec;
+		fs::remove(tmpPath, ec);
+		throw;
+	}
+
+	fs::rename(tmpPath, path);
+}
+
+fs::path Store::write(const fs::path& path, std::span<const u8> bytes, bool link) {
+	return write(path, digest(bytes), [&](io::DataIO& io) { io.writeSpan(bytes); }, link);
+}
+
+fs::path Store::write(const fs::path& path, const Digest& digest, const Writer& writer, bool link) {
+	fs::path existing;
+	{
+		std::lock_guard lock(mutex_);
+		if (auto it = files_.find(digest); it != files_.end())
+			existing = it->second;
+	}
+
+	// Something may have deleted it since, in which case this becomes the copy to link to
+	std::error_code ec;
+	if (!existing.empty() && fs::exists(existing, ec)) {
+		bool saved = true;
+
+		if (!link) {
+			// Nothing to do, the caller refers to the earlier file
+		} else if (fs::exists(path, ec) && fs::equivalent(path, existing, ec)) {
+			// Already linked from a previous run
+		} else {
+			fs::remove(path, ec);
+			fs::create_hard_link(existing, path, ec);
+
+			if (ec) {
+				fs::copy_file(existing, path, fs::copy_options::overwrite_existing);
+				saved = false;
+			}
+		}
+
+		std::lock_guard lock(mutex_);
+		stats_.items++;
+		stats_.bytes += digest.size;
+		if (saved)
+			stats_.bytesSaved += digest.size;
+
+		return link ? path : existing;
+	}
+
+	replaceFile(path, writer);
+
+	std::lock_guard lock(mutex_);
+	files_.insert_or_assign(digest, path);
+	stats_.items++;
+	stats_.unique++;
+	stats_.bytes += digest.size;
+	return path;
+}
+
+Store::Stats Store::stats() const {
+	std::lock_guard lock(mutex_);
+	return stats_;
+}
+
+} // namespace manatools::tone
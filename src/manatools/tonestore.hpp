@@ -0,0 +1,118 @@
+#pragma once
+#include <functional>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+
+#include "filesystem.hpp"
+#include "io.hpp"
+#include "tone.hpp"
+#include "types.hpp"
+#include "utils.hpp"
+
+namespace manatools::tone {
+	/**
+	 * Keeps track of tone data by its contents, so the same sample turning up in different
+	 * banks (or several times in one) only needs storing or writing out once.
+	 * Safe to share between threads.
+	 */
+	class Store {
+	public:
+		struct Stats {
+			size_t items = 0;      // Tones interned and files written
+			size_t unique = 0;     // How many of those hadn't been seen before
+			size_t bytes = 0;      // Size of everything given
+			size_t bytesSaved = 0; // How much of that didn't need to be stored/written again
+		};
+
+		/**
+		 * 128 bits of hash and the size of what was hashed, which is what written files are
+		 * told apart by. It's not cryptographic, but two different tones matching by accident
+		 * isn't something that's going to happen, so files never need reading back to check.
+		 */
+		struct Digest {
+			u64 hash[2];
+			size_t size;
+
+			bool operator==(const Digest&) const = default;
+		};
+
+		/**
+		 * Works out a Digest from whatever's written to it, so something like a WAV can be
+		 * identified while it's being encoded without keeping any of it. Writes only go
+		 * forwards, and seeking or reading is an error.
+		 */
+		class Hasher : public io::DataIO {
+		public:
+			Hasher(bool exceptions = true) : io::DataIO(exceptions, true) {}
+
+			size_t read(void* buf, size_t size, size_t count) override;
+			size_t write(const void* buf, size_t size, size_t count) override;
+			bool seek(long offset, Seek origin) override;
+			long tell() override;
+
+			Digest digest() const;
+
+		private:
+			void update(u64 word);
+
+			u64 h_[2] = { 0x6A09E667F3BCC908ull, 0xBB67AE8584CAA73Bull };
+			u64 pending_ = 0; // Bytes that haven't made a whole word yet, little endian
+			size_t size_ = 0;
+		};
+
+		// Writes a file's contents to (io), for write() to only call when they're needed
+		using Writer = std::function<void(io::DataIO& io)>;
+
+		Store() = default;
+
+		/**
+		 * Returns the data already in the store with the same contents as (data), or adds
+		 * (data) and returns it if there isn't any. Replacing tone data with what this returns
+		 * before saving lets the per-bank sharing in Bank::save pick up identical tones that
+		 * weren't loaded as the same data.
+		 */
+		DataPtr intern(const DataPtr& data);
+
+		void intern(Tone& tone) {
+			if (tone.data)
+				tone.data = intern(tone.data);
+		}
+
+		/**
+		 * Writes (bytes) to (path), unless the same bytes have already been written through
+		 * this store. In that case (path) is hard linked to the earlier file if (link) is
+		 * set (falling back to a copy if the filesystem can't), or nothing is written at all
+		 * if not so the caller can refer to the earlier file instead.
+		 * Returns the path the bytes can be found at.
+		 */
+		fs::path write(const fs::path& path, std::span<const u8> bytes, bool link = true);
+
+		/**
+		 * The same, but for contents that are never all in memory at once. (digest) must be
+		 * what a Hasher gives for what (writer) writes, and (writer) is only called if nothing
+		 * matching it has been written yet, so a file can be streamed straight from whatever
+		 * makes it.
+		 */
+		fs::path write(const fs::path& path, const Digest& digest, const Writer& writer, bool link = true);
+
+		Stats stats() const;
+
+		// 64-bit hash of (bytes), good enough to tell tones apart but not cryptographic
+		static u64 hash(std::span<const u8> bytes);
+
+		static Digest digest(std::span<const u8> bytes);
+
+	private:
+		MT_DISABLE_COPY(Store)
+
+		struct DigestHash {
+			size_t operator()(const Digest& d) const { return d.hash[0]; }
+		};
+
+		mutable std::mutex mutex_;
+		std::unordered_multimap<u64, DataPtr> tones_;
+		std::unordered_map<Digest, fs::path, DigestHash> files_;
+		Stats stats_;
+	};
+} // namespace manatools::tone
@@ -1,13 +1,17 @@
 #pragma once
+#include <bit>
 #include <concepts>
 #include <optional>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
+#include "endian.hpp"
 #include "filesystem.hpp"
 #include "io.hpp"
 #include "types.hpp"
+#include "utils.hpp"
 
 namespace manatools::wav {
 	struct SamplerChunk {
@@ -31,21 +35,58 @@ namespace manatools::wav {
 	};
 
 	/**
+	 * Writes a WAV out in one forward pass, a block of samples at a time, so the whole thing
+	 * never has to be in memory and nothing has to be seeked back to and patched. The catch
+	 * is the number of samples has to be known up front, as every chunk size is worked out
+	 * from it before anything's written.
+	 *
 	 * Only supports PCM. ADPCM can't loop seamlessly with WAV :(
 	 * Unfortunate, as software I've tried can straight up play Yamaha ADPCM so long as the WAV 
 	 * format tag is 0x20, including FL Studio, therefore making re-encoding less necessary.
 	 */
 	template <std::integral T>
+	class Writer {
+	public:
+		// (frames) is samples per channel, and the header is written right away
+		Writer(io::DataIO& io, u16 channels, u32 sampleRate, size_t frames,
+		       const std::optional<SamplerChunk>& sampler = std::nullopt, bool swapBytes = true);
+
+		// Interleaved, if there's more than one channel
+		void write(std::span<const T> samples);
+
+		// Throws if fewer samples were written than promised
+		void finish();
+
+	private:
+		MT_DISABLE_COPY(Writer)
+
+		static constexpr u32 FMT_SIZE = 16;
+		static constexpr u32 SMPL_HEADER_SIZE = 36;
+		static constexpr u32 SMPL_LOOP_SIZE = 24;
+
+		io::DataIO& io_;
+		u32 sampleRate_;
+		std::optional<SamplerChunk> sampler_;
+		bool swapBytes_;
+
+		size_t remaining_;
+		size_t dataBytes_;
+	};
+
+	/**
+	 * For building up a whole WAV in memory and saving it in one go. Saving goes through
+	 * Writer, so there's only the one place that knows the layout.
+	 */
+	template <std::integral T>
 	class WAV {
 	public:
+		// Samples in (data) are interleaved when there's more than one channel
 		WAV(u16 channels, u32 sampleRate) : channels(channels), sampleRate(sampleRate) {
-			// no need for stereo at the moment
 			if (channels < 1)
 				throw std::invalid_argument("WAV channels cannot be less than 1");
-			else if (channels > 1)
-				throw std::invalid_argument("Only mono WAVs are currently supported");
 		}
 
+		void save(io::DataIO& io, bool swapBytes = true);
 		void save(const fs::path& path, bool swapBytes = true);
 
 		size_t bitdepth() const { return sizeof(T) * 8; }
@@ -58,92 +99,127 @@ namespace manatools::wav {
 	};
 
 	template <std::integral T>
-	inline void WAV<T>::save(const fs::path& path, bool swapBytes) {
-		io::FileIO io(path, "wb");
-		
-		io.writeStr("RIFF");
+	inline Writer<T>::Writer(io::DataIO& io, u16 channels, u32 sampleRate, size_t frames,
+	                         const std::optional<SamplerChunk>& sampler, bool swapBytes) :
+		io_(io),
+		sampleRate_(sampleRate),
+		sampler_(sampler),
+		swapBytes_(swapBytes),
+		remaining_(frames * channels),
+		dataBytes_(frames * channels * sizeof(T))
+	{
+		if (channels < 1)
+			throw std::invalid_argument("WAV channels cannot be less than 1");
+
+		// blocks must be padded to be even, apparently
+		size_t riffSize = 4 + (8 + FMT_SIZE) + (8 + utils::roundUp(dataBytes_, 2));
+		if (sampler_)
+			riffSize += 8 + SMPL_HEADER_SIZE + sampler_->loops.size() * SMPL_LOOP_SIZE;
+
+		if (riffSize > UINT32_MAX)
+			throw std::runtime_error("WAV data is too big");
 
-		// Not worth it creating a proper RIFF implementation until loading WAVs is a feature.
-		// Just hopping back and forth will do for now.
-		auto riffChunkSizePos = io.tell();
-		io.writeU32LE(0); // Will be replaced with proper size
+		io.writeStr("RIFF");
+		io.writeU32LE(riffSize);
 
 		io.writeStr("WAVE");
-		{
-			io.writeStr("fmt ");                       //    chunkId:
-			io.writeU32LE(16);                         //  chunkSize:
-			io.writeU16LE(1);                          //     format: PCM = 1
-			io.writeU16LE(1);                          //   channels: Only support mono (1) currently
-			io.writeU32LE(sampleRate);                 // sampleRate: 22050 Hz, 44100 Hz, etc
-			io.writeU32LE(sampleRate * 1 * sizeof(T)); //   byteRate: sampleRate * channels * (bitdepth / 8)
-			io.writeU16LE(1 * sizeof(T));              // blockAlign: channels * (bitdepth / 8)
-			io.writeU16LE(bitdepth());                 //   bitdepth: sizeof(SampleType) * 8
-
-			io.writeStr("data");                       //    chunkId:
-			io.writeU32LE(data.size() * sizeof(T));    //  chunkSize: Size in bytes
-
-			if (!swapBytes || std::endian::native == std::endian::little || sizeof(T) == 1) {
-				io.writeVec(data);
-			} else {
-				// byte swapping fun time
-				// buffer it as to not hammer fwrite (even though that should buffer stuff already)
-				T buf[512];
-
-				size_t dataI = 0;
-				while (dataI != data.size()) {
-					size_t bufI = 0;
-					while (bufI < std::size(buf) && dataI < data.size()) {
-						buf[bufI++] = LE(data[dataI++]);
-					}
-
-					io.write(buf, sizeof(T), bufI);
-				}
-			}
+		io.writeStr("fmt ");                              //    chunkId:
+		io.writeU32LE(FMT_SIZE);                          //  chunkSize:
+		io.writeU16LE(1);                                 //     format: PCM = 1
+		io.writeU16LE(channels);                          //   channels: Samples in (data) are interleaved
+		io.writeU32LE(sampleRate);                        // sampleRate: 22050 Hz, 44100 Hz, etc
+		io.writeU32LE(sampleRate * channels * sizeof(T)); //   byteRate: sampleRate * channels * (bitdepth / 8)
+		io.writeU16LE(channels * sizeof(T));              // blockAlign: channels * (bitdepth / 8)
+		io.writeU16LE(sizeof(T) * 8);                     //   bitdepth: sizeof(SampleType) * 8
+
+		io.writeStr("data");                              //    chunkId:
+		io.writeU32LE(dataBytes_);                        //  chunkSize: Size in bytes
+	}
 
-			// blocks must be padded to be even, apparently
-			if ((data.size() * sizeof(T)) & 1)
-				io.writeU8(0);
-
-			/**
-			 * Prevent GCC (but not Clang) from complaining that `sampler->loops` may be used uninitialised.
-			 * It should be initialised...? If sampler is initialised (which it is at that point), then the 
-			 * loop vector should be too.
-			 */
-			#if defined(__GNUG__) && !defined(__clang__)
-				#pragma GCC diagnostic push
-				#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
-			#endif
-
-			if (sampler) {
-				io.writeStr("smpl");                                //           chunkId:
-				io.writeU32LE(36 + (sampler->loops.size() * 24));   //         chunkSize:
-				io.writeU32LE(0);                                   //      manufacturer:
-				io.writeU32LE(0);                                   //           product:
-				io.writeU32LE((1. / sampleRate) * 1e9);             //      samplePeriod: Period of 1 sample in nanoseconds
-				io.writeU32LE(sampler->midiUnityNote);              //     midiUnityNote: Seemingly baseNote
-				io.writeU32LE(sampler->midiPitchFraction);          // midiPitchFraction: Seemingly fineTune
-				io.writeU32LE(0);                                   //       smpteFormat:
-				io.writeU32LE(0);                                   //       smpteOffset:
-				io.writeU32LE(sampler->loops.size());               //       sampleLoops: Number of loops
-				io.writeU32LE(0);                                   //       samplerData:
-				for (size_t i = 0; i < sampler->loops.size(); i++) {
-					const auto& loop = sampler->loops[i];
-					io.writeU32LE(i);                           // identifier: (hence the more verbose for loop)
-					io.writeU32LE(static_cast<u32>(loop.type)); //       type:
-					io.writeU32LE(loop.start);                  //      start: In samples
-					io.writeU32LE(loop.end);                    //        end: In samples
-					io.writeU32LE(0);                           //   fraction:
-					io.writeU32LE(loop.playCount);              //  playCount: Number of times to play the loop (0 is infinite)
-				}
+	template <std::integral T>
+	inline void Writer<T>::write(std::span<const T> samples) {
+		if (samples.size() > remaining_)
+			throw std::runtime_error("Wrote more samples to WAV than it was created with");
+
+		remaining_ -= samples.size();
+
+		if (!swapBytes_ || std::endian::native == std::endian::little || sizeof(T) == 1) {
+			io_.write(samples.data(), sizeof(T), samples.size());
+			return;
+		}
+
+		// byte swapping fun time
+		// buffer it as to not hammer fwrite (even though that should buffer stuff already)
+		T buf[512];
+
+		size_t i = 0;
+		while (i != samples.size()) {
+			size_t bufI = 0;
+			while (bufI < std::size(buf) && i < samples.size()) {
+				buf[bufI++] = LE(samples[i++]);
 			}
 
-			#if defined(__GNUG__) && !defined(__clang__)
-				#pragma GCC diagnostic pop
-			#endif
+			io_.write(buf, sizeof(T), bufI);
+		}
+	}
+
+	template <std::integral T>
+	inline void Writer<T>::finish() {
+		if (remaining_)
+			throw std::runtime_error("Wrote fewer samples to WAV than it was created with");
+
+		if (dataBytes_ & 1)
+			io_.writeU8(0);
+
+		/**
+		 * Prevent GCC (but not Clang) from complaining that `sampler->loops` may be used uninitialised.
+		 * It should be initialised...? If sampler is initialised (which it is at that point), then the 
+		 * loop vector should be too.
+		 */
+		#if defined(__GNUG__) && !defined(__clang__)
+			#pragma GCC diagnostic push
+			#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+		#endif
+
+		if (sampler_) {
+			const auto& loops = sampler_->loops;
+			io_.writeStr("smpl");                                             //           chunkId:
+			io_.writeU32LE(SMPL_HEADER_SIZE + loops.size() * SMPL_LOOP_SIZE); //         chunkSize:
+			io_.writeU32LE(0);                                                //      manufacturer:
+			io_.writeU32LE(0);                                                //           product:
+			io_.writeU32LE((1. / sampleRate_) * 1e9);                         //      samplePeriod: Period of 1 sample in nanoseconds
+			io_.writeU32LE(sampler_->midiUnityNote);                          //     midiUnityNote: Seemingly baseNote
+			io_.writeU32LE(sampler_->midiPitchFraction);                      // midiPitchFraction: Seemingly fineTune
+			io_.writeU32LE(0);                                                //       smpteFormat:
+			io_.writeU32LE(0);                                                //       smpteOffset:
+			io_.writeU32LE(loops.size());                                     //       sampleLoops: Number of loops
+			io_.writeU32LE(0);                                                //       samplerData:
+			for (size_t i = 0; i < loops.size(); i++) {
+				const auto& loop = loops[i];
+				io_.writeU32LE(i);                           // identifier: (hence the more verbose for loop)
+				io_.writeU32LE(static_cast<u32>(loop.type)); //       type:
+				io_.writeU32LE(loop.start);                  //      start: In samples
+				io_.writeU32LE(loop.end);                    //        end: In samples
+				io_.writeU32LE(0);                           //   fraction:
+				io_.writeU32LE(loop.playCount);              //  playCount: Number of times to play the loop (0 is infinite)
+			}
 		}
 
-		auto size = io.tell() - (riffChunkSizePos + 4);
-		io.jump(riffChunkSizePos);
-		io.writeU32LE(size);
+		#if defined(__GNUG__) && !defined(__clang__)
+			#pragma GCC diagnostic pop
+		#endif
+	}
+
+	template <std::integral T>
+	inline void WAV<T>::save(io::DataIO& io, bool swapBytes) {
+		Writer<T> writer(io, channels, sampleRate, data.size() / channels, sampler, swapBytes);
+		writer.write(data);
+		writer.finish();
+	}
+
+	template <std::integral T>
+	inline void WAV<T>::save(const fs::path& path, bool swapBytes) {
+		io::FileIO io(path, "wb");
+		save(io, swapBytes);
 	}
 } // namespace manatools::wav
@@ -0,0 +1,60 @@
+#pragma once
+#include <cassert>
+#include <cstring>
+#include <span>
+
+#include "endian.hpp"
+#include "fourcc.hpp"
+#include "types.hpp"
+
+namespace manatools::io {
+	/**
+	 * Fills a buffer that's already been sized to fit everything, front to back, without
+	 * any virtual calls, seeking or growing. Every byte written is also added to a running
+	 * sum, as the bank formats end with a checksum of that sort.
+	 * Writing past the end is a bug in whatever worked out the size, not something bad data
+	 * can cause, so it's only asserted.
+	 */
+	class Writer {
+	public:
+		explicit Writer(std::span<u8> buf) : buf_(buf) {}
+
+		void writeU8(u8 in)                      { put(&in, sizeof(in)); }
+		void writeS8(s8 in)                      { put(&in, sizeof(in)); }
+		void writeU16LE(u16 in)                  { in = LE(in); put(&in, sizeof(in)); }
+		void writeU32LE(u32 in)                  { in = LE(in); put(&in, sizeof(in)); }
+		void writeBool(bool in)                  { writeU8(in); }
+		void writeFourCC(const FourCC in)        { put(in.data(), 4); }
+		void writeSpan(std::span<const u8> in)   { put(in.data(), in.size()); }
+
+		template <typename T, size_t N>
+		void writeArrT(const T (&in)[N])         { put(in, sizeof(T) * N); }
+
+		// The buffer starts zeroed, so padding only has to be skipped over
+		void forward(size_t count) {
+			assert(cur_ + count <= buf_.size());
+			cur_ += count;
+		}
+
+		size_t tell() const                      { return cur_; }
+
+		u32 sum() const                          { return sum_; }
+		void resetSum()                          { sum_ = 0; }
+
+	private:
+		void put(const void* in, size_t count) {
+			assert(cur_ + count <= buf_.size());
+			u8* out = buf_.data() + cur_;
+			memcpy(out, in, count);
+
+			for (size_t i = 0; i < count; i++)
+				sum_ += out[i];
+
+			cur_ += count;
+		}
+
+		std::span<u8> buf_;
+		size_t cur_ = 0;
+		u32 sum_ = 0;
+	};
+} // namespace manatools::io
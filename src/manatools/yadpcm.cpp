@@ -1,9 +1,32 @@
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdio>
+#include <cstdlib>
+#include <vector>
 
 #include "yadpcm.hpp"
+#include "threadpool.hpp"
 #include "types.hpp"
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define YADPCM_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	#define YADPCM_NEON
+	#include <arm_neon.h>
+#endif
+
+// MSVC lets intrinsics be used anywhere, GCC and Clang need to be told per function
+#if defined(__GNUC__) || defined(__clang__)
+	#define YADPCM_TARGET(isa) __attribute__((target(isa)))
+#else
+	#define YADPCM_TARGET(isa)
+#endif
+
 // Adapted from https://github.com/superctr/adpcm/blob/master/ymz_codec.c
 namespace manatools::yadpcm {
 
@@ -11,24 +34,39 @@ static const int stepTable[8] = {
 	230, 230, 230, 230, 307, 409, 512, 614
 };
 
+/**
+ * Everything a nibble decides, looked up in one go instead of masking and branching
+ * on the sign every sample.
+ */
+struct NibbleInfo {
+	s32 mag;     // 1 + (delta * 2)
+	s32 sign;    // -1 if negative, 0 otherwise
+	s32 stepMul; // stepTable[delta]
+};
+
+static constexpr auto nibbleTable = [] {
+	std::array<NibbleInfo, 16> table{};
+	for (int n = 0; n < 16; n++) {
+		table[n] = { 1 + ((n & 7) << 1), (n & 8) ? -1 : 0, stepTable[n & 7] };
+	}
+	return table;
+}();
+
 static s16 step(u8 step, s16& history, s16& stepSize) {
-	int sign = step & 8;
-	int delta = step & 7;
-	int diff = ((1 + (delta << 1)) * stepSize) >> 3;
-	int newVal = history;
-	int nStep = (stepTable[delta] * stepSize) >> 8;
+	const NibbleInfo& n = nibbleTable[step & 15];
 
-	diff = std::clamp(diff, 0, 32767);
+	int diff = std::clamp((n.mag * stepSize) >> 3, 0, 32767);
+	diff = (diff ^ n.sign) - n.sign;
 
-	if (sign > 0)
-		newVal -= diff;
-	else
-		newVal += diff;
+	stepSize = std::clamp((n.stepMul * stepSize) >> 8, 127, 24576);
+	history = std::clamp(history + diff, -32768, 32767);
 
-	stepSize = std::clamp(nStep, 127, 24576);
-	history = newVal = std::clamp(newVal, -32768, 32767);
+	return history;
+}
 
-	return newVal;
+// Truncates towards zero, so a plain shift won't do
+static s16 highPassFilter(s16 history) {
+	return history * 254 / 256;
 }
 
 size_t Context::encode(const s16* in, u8* out, size_t len) {
@@ -68,12 +106,127 @@ size_t Context::encode(const s16* in, u8* out, size_t len) {
 	return out - start;
 }
 
+size_t Context::encodeSearch(const s16* in, u8* out, size_t len, uint width, bool highPass) {
+	constexpr size_t BLOCK = 32;
+	constexpr size_t MAX_WIDTH = 16;
+	constexpr size_t MAX_CANDIDATES = MAX_WIDTH * 4;
+
+	struct Path {
+		s16 history;
+		s16 stepSize;
+		u8 nib;
+		u8 parent;
+		u64 error;
+	};
+
+	width = std::clamp<uint>(width, 1, MAX_WIDTH);
+
+	const u8* start = out;
+
+	// Which nibble every surviving path took at each sample of the block, and which path it came from
+	u8 nibs[BLOCK][MAX_WIDTH];
+	u8 parents[BLOCK][MAX_WIDTH];
+
+	Path paths[MAX_WIDTH];
+	Path candidates[MAX_CANDIDATES];
+
+	for (size_t blockStart = 0; blockStart < len; blockStart += BLOCK) {
+		size_t blockLen = std::min(BLOCK, len - blockStart);
+
+		size_t numPaths = 1;
+		paths[0] = { history, stepSize, 0, 0, 0 };
+
+		for (size_t i = 0; i < blockLen; i++) {
+			s32 target = in[blockStart + i];
+			size_t numCandidates = 0;
+
+			for (size_t p = 0; p < numPaths; p++) {
+				s16 predicted = highPass ? highPassFilter(paths[p].history) : paths[p].history;
+
+				// The step the plain encoder would pick, the ones either side of it, and zero the other way
+				s32 delta = target - predicted;
+				s32 mag = std::clamp((abs(delta) << 2) / paths[p].stepSize, 0, 7);
+				u8 sign = delta < 0 ? 8 : 0;
+
+				u8 tries[4];
+				size_t numTries = 0;
+				for (s32 m = std::max(mag - 1, 0); m <= std::min(mag + 1, 7); m++)
+					tries[numTries++] = sign | m;
+				tries[numTries++] = sign ^ 8;
+
+				for (size_t t = 0; t < numTries; t++) {
+					Path& c = candidates[numCandidates++];
+					c.history = predicted;
+					c.stepSize = paths[p].stepSize;
+					c.nib = tries[t];
+					c.parent = p;
+
+					s32 err = target - step(c.nib, c.history, c.stepSize);
+					c.error = paths[p].error + u64(s64(err) * err);
+				}
+			}
+
+			std::sort(candidates, candidates + numCandidates, [](const Path& a, const Path& b) {
+				return a.error < b.error;
+			});
+
+			// Paths that end up in the same state will carry on identically, so only keep the best one
+			size_t kept = 0;
+			for (size_t c = 0; c < numCandidates && kept < width; c++) {
+				bool dupe = std::any_of(paths, paths + kept, [&](const Path& p) {
+					return p.history == candidates[c].history && p.stepSize == candidates[c].stepSize;
+				});
+
+				if (dupe)
+					continue;
+
+				paths[kept] = candidates[c];
+				nibs[i][kept] = candidates[c].nib;
+				parents[i][kept] = candidates[c].parent;
+				kept++;
+			}
+
+			numPaths = kept;
+		}
+
+		// Paths are sorted by error, so the first is the best
+		u8 chosen[BLOCK];
+		for (size_t i = blockLen, p = 0; i-- > 0;) {
+			chosen[i] = nibs[i][p];
+			p = parents[i][p];
+		}
+
+		for (size_t i = 0; i < blockLen; i++) {
+			if (!nibble)
+				*out++ = bufSample | (chosen[i] << 4);
+			else
+				bufSample = chosen[i];
+
+			nibble ^= 4;
+		}
+
+		history = paths[0].history;
+		stepSize = paths[0].stepSize;
+	}
+
+	return out - start;
+}
+
+size_t Context::flush(u8* out) {
+	if (nibble)
+		return 0;
+
+	*out = bufSample;
+	nibble = 4;
+	return 1;
+}
+
 size_t Context::decode(const u8* in, s16* out, size_t len, bool highPass) {
 	const u8* start = in;
 
 	for (size_t i = 0; i < len; i++) {
-		s8 step = (*(s8*)in) << nibble;
-		step >>= 4;
+		// Low nibble first (nibble == 4), then high
+		u8 step = *in >> (nibble ^ 4);
 
 		if (!nibble)
 			in++;
@@ -81,7 +234,7 @@ size_t Context::decode(const u8* in, s16* out, size_t len, bool highPass) {
 		nibble ^= 4;
 
 		if (highPass)
-			history = (history) * 254 / 256;
+			history = highPassFilter(history);
 
 		*out++ = yadpcm::step(step, history, stepSize);
 	}
@@ -89,4 +242,563 @@ size_t Context::decode(const u8* in, s16* out, size_t len, bool highPass) {
 	return in - start;
 }
 
+/* ======================== *
+ *       Lane kernels       *
+ * ======================== */
+
+/**
+ * A batch of independent streams decoded side by side, one per SIMD lane.
+ * Each lane decodes (count) samples, but only starts writing output after (warmup)
+ * samples, which is when the state it was started with has hopefully settled into
+ * the same one the real decode would have. The state at that point is kept so it
+ * can be checked afterwards.
+ */
+struct LaneBatch {
+	static constexpr size_t MAX_LANES = 16;
+	static constexpr size_t BLOCK = 32;
+
+	size_t lanes = 0;  // Lanes in use
+	size_t count = 0;  // Multiple of BLOCK
+	size_t warmup = 0; // Multiple of BLOCK
+
+	const u8* in[MAX_LANES]{};
+	s16* out[MAX_LANES]{};
+	s16* steps[MAX_LANES]{}; // stepSize after every output sample
+
+	s16 history[MAX_LANES]{};
+	s16 stepSize[MAX_LANES]{};
+
+	s16 warmHistory[MAX_LANES]{};
+	s16 warmStepSize[MAX_LANES]{};
+};
+
+/**
+ * Nibbles are unpacked into sample-major order so each sample's nibbles for every lane
+ * can be loaded as one vector. stepTable lookups are done here too, as SSE2 can't do
+ * table lookups in registers.
+ */
+struct LaneBlock {
+	alignas(32) u16 nib[LaneBatch::BLOCK][LaneBatch::MAX_LANES];
+	alignas(32) u16 mul[LaneBatch::BLOCK][LaneBatch::MAX_LANES];
+	alignas(32) s16 history[LaneBatch::BLOCK][LaneBatch::MAX_LANES];
+	alignas(32) s16 stepSize[LaneBatch::BLOCK][LaneBatch::MAX_LANES];
+
+	LaneBlock() {
+		// Unused lanes just decode silence
+		for (auto& n : nib) std::fill(std::begin(n), std::end(n), 0);
+		for (auto& m : mul) std::fill(std::begin(m), std::end(m), stepTable[0]);
+	}
+
+	void unpack(const LaneBatch& b, size_t pos) {
+		for (size_t l = 0; l < b.lanes; l++) {
+			const u8* in = b.in[l] + (pos >> 1);
+			for (size_t i = 0; i < LaneBatch::BLOCK; i += 2) {
+				u8 byte = in[i >> 1];
+				nib[i][l]     = byte & 15;
+				nib[i + 1][l] = byte >> 4;
+				mul[i][l]     = stepTable[byte & 7];
+				mul[i + 1][l] = stepTable[(byte >> 4) & 7];
+			}
+		}
+	}
+
+	void store(const LaneBatch& b, size_t pos) {
+		if (pos < b.warmup)
+			return;
+
+		pos -= b.warmup;
+
+		for (size_t l = 0; l < b.lanes; l++) {
+			s16* out = b.out[l] + pos;
+			s16* steps = b.steps[l] + pos;
+			for (size_t i = 0; i < LaneBatch::BLOCK; i++) {
+				out[i] = history[i][l];
+				steps[i] = stepSize[i][l];
+			}
+		}
+	}
+};
+
+static void decodeLanesScalar(LaneBatch& b, bool highPass) {
+	for (size_t l = 0; l < b.lanes; l++) {
+		s16 history = b.history[l];
+		s16 stepSize = b.stepSize[l];
+
+		for (size_t i = 0; i < b.count; i++) {
+			if (i == b.warmup) {
+				b.warmHistory[l] = history;
+				b.warmStepSize[l] = stepSize;
+			}
+
+			u8 byte = b.in[l][i >> 1];
+			u8 nib = (i & 1) ? byte >> 4 : byte & 15;
+
+			if (highPass)
+				history = highPassFilter(history);
+
+			step(nib, history, stepSize);
+
+			if (i >= b.warmup) {
+				b.out[l][i - b.warmup] = history;
+				b.steps[l][i - b.warmup] = stepSize;
+			}
+		}
+
+		b.history[l] = history;
+		b.stepSize[l] = stepSize;
+	}
+}
+
+/**
+ * The vector kernels keep everything in 16-bit lanes, which lines up nicely with the
+ * clamping the scalar code does:
+ *  - history is clamped to s16 range, which is just a saturating add
+ *  - diff and the new step size need up to 24 bit products, so the low and high halves
+ *    are multiplied separately and saturated by hand when the high half is too big
+ *  - the high pass filter truncates towards zero, so |h| - ceil(|h| / 128) is done and
+ *    the sign put back, which is the same as h * 254 / 256
+ */
+#ifdef YADPCM_X86
+
+template <bool HighPass>
+YADPCM_TARGET("sse2") static void decodeLanesSSE2(LaneBatch& b) {
+	LaneBlock block;
+
+	const __m128i c1     = _mm_set1_epi16(1);
+	const __m128i c3     = _mm_set1_epi16(3);
+	const __m128i c7     = _mm_set1_epi16(7);
+	const __m128i c127   = _mm_set1_epi16(127);
+	const __m128i c24576 = _mm_set1_epi16(24576);
+	const __m128i c32767 = _mm_set1_epi16(32767);
+
+	__m128i history  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b.history));
+	__m128i stepSize = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b.stepSize));
+
+	for (size_t pos = 0; pos < b.count; pos += LaneBatch::BLOCK) {
+		if (pos == b.warmup) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(b.warmHistory), history);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(b.warmStepSize), stepSize);
+		}
+
+		block.unpack(b, pos);
+
+		for (size_t i = 0; i < LaneBatch::BLOCK; i++) {
+			__m128i nib = _mm_load_si128(reinterpret_cast<const __m128i*>(block.nib[i]));
+			__m128i mul = _mm_load_si128(reinterpret_cast<const __m128i*>(block.mul[i]));
+
+			if constexpr (HighPass) {
+				__m128i s = _mm_srai_epi16(history, 15);
+				__m128i a = _mm_sub_epi16(_mm_xor_si128(history, s), s);
+				__m128i c = _mm_srli_epi16(_mm_add_epi16(a, c127), 7);
+				history = _mm_sub_epi16(_mm_xor_si128(_mm_sub_epi16(a, c), s), s);
+			}
+
+			__m128i mag  = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nib, c7), 1), c1);
+			__m128i sign = _mm_srai_epi16(_mm_slli_epi16(nib, 12), 15);
+
+			__m128i lo   = _mm_mullo_epi16(mag, stepSize);
+			__m128i hi   = _mm_mulhi_epu16(mag, stepSize);
+			__m128i diff = _mm_or_si128(_mm_srli_epi16(lo, 3), _mm_slli_epi16(hi, 13));
+			__m128i over = _mm_cmpgt_epi16(hi, c3);
+			diff = _mm_or_si128(_mm_andnot_si128(over, diff), _mm_and_si128(over, c32767));
+			diff = _mm_sub_epi16(_mm_xor_si128(diff, sign), sign);
+
+			lo = _mm_mullo_epi16(mul, stepSize);
+			hi = _mm_mulhi_epu16(mul, stepSize);
+			__m128i next = _mm_or_si128(_mm_srli_epi16(lo, 8), _mm_slli_epi16(hi, 8));
+			over = _mm_cmpgt_epi16(hi, c127);
+			next = _mm_or_si128(_mm_andnot_si128(over, next), _mm_and_si128(over, c32767));
+
+			history  = _mm_adds_epi16(history, diff);
+			stepSize = _mm_max_epi16(_mm_min_epi16(next, c24576), c127);
+
+			_mm_store_si128(reinterpret_cast<__m128i*>(block.history[i]), history);
+			_mm_store_si128(reinterpret_cast<__m128i*>(block.stepSize[i]), stepSize);
+		}
+
+		block.store(b, pos);
+	}
+
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(b.history), history);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(b.stepSize), stepSize);
+}
+
+template <bool HighPass>
+YADPCM_TARGET("avx2") static void decodeLanesAVX2(LaneBatch& b) {
+	LaneBlock block;
+
+	const __m256i c1     = _mm256_set1_epi16(1);
+	const __m256i c3     = _mm256_set1_epi16(3);
+	const __m256i c7     = _mm256_set1_epi16(7);
+	const __m256i c127   = _mm256_set1_epi16(127);
+	const __m256i c24576 = _mm256_set1_epi16(24576);
+	const __m256i c32767 = _mm256_set1_epi16(32767);
+
+	__m256i history  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b.history));
+	__m256i stepSize = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b.stepSize));
+
+	for (size_t pos = 0; pos < b.count; pos += LaneBatch::BLOCK) {
+		if (pos == b.warmup) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(b.warmHistory), history);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(b.warmStepSize), stepSize);
+		}
+
+		block.unpack(b, pos);
+
+		for (size_t i = 0; i < LaneBatch::BLOCK; i++) {
+			__m256i nib = _mm256_load_si256(reinterpret_cast<const __m256i*>(block.nib[i]));
+			__m256i mul = _mm256_load_si256(reinterpret_cast<const __m256i*>(block.mul[i]));
+
+			if constexpr (HighPass) {
+				__m256i s = _mm256_srai_epi16(history, 15);
+				__m256i a = _mm256_sub_epi16(_mm256_xor_si256(history, s), s);
+				__m256i c = _mm256_srli_epi16(_mm256_add_epi16(a, c127), 7);
+				history = _mm256_sub_epi16(_mm256_xor_si256(_mm256_sub_epi16(a, c), s), s);
+			}
+
+			__m256i mag  = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(nib, c7), 1), c1);
+			__m256i sign = _mm256_srai_epi16(_mm256_slli_epi16(nib, 12), 15);
+
+			__m256i lo   = _mm256_mullo_epi16(mag, stepSize);
+			__m256i hi   = _mm256_mulhi_epu16(mag, stepSize);
+			__m256i diff = _mm256_or_si256(_mm256_srli_epi16(lo, 3), _mm256_slli_epi16(hi, 13));
+			__m256i over = _mm256_cmpgt_epi16(hi, c3);
+			diff = _mm256_blendv_epi8(diff, c32767, over);
+			diff = _mm256_sub_epi16(_mm256_xor_si256(diff, sign), sign);
+
+			lo = _mm256_mullo_epi16(mul, stepSize);
+			hi = _mm256_mulhi_epu16(mul, stepSize);
+			__m256i next = _mm256_or_si256(_mm256_srli_epi16(lo, 8), _mm256_slli_epi16(hi, 8));
+			over = _mm256_cmpgt_epi16(hi, c127);
+			next = _mm256_blendv_epi8(next, c32767, over);
+
+			history  = _mm256_adds_epi16(history, diff);
+			stepSize = _mm256_max_epi16(_mm256_min_epi16(next, c24576), c127);
+
+			_mm256_store_si256(reinterpret_cast<__m256i*>(block.history[i]), history);
+			_mm256_store_si256(reinterpret_cast<__m256i*>(block.stepSize[i]), stepSize);
+		}
+
+		block.store(b, pos);
+	}
+
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(b.history), history);
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(b.stepSize), stepSize);
+}
+
+#endif // YADPCM_X86
+
+#ifdef YADPCM_NEON
+
+// NEON has widening multiplies and saturating narrows, so no need for the hi/lo dance
+template <bool HighPass>
+static void decodeLanesNEON(LaneBatch& b) {
+	LaneBlock block;
+
+	const uint16x8_t c1     = vdupq_n_u16(1);
+	const uint16x8_t c7     = vdupq_n_u16(7);
+	const uint16x8_t c127   = vdupq_n_u16(127);
+	const uint16x8_t c24576 = vdupq_n_u16(24576);
+	const uint16x8_t c32767 = vdupq_n_u16(32767);
+
+	int16x8_t history  = vld1q_s16(b.history);
+	int16x8_t stepSize = vld1q_s16(b.stepSize);
+
+	for (size_t pos = 0; pos < b.count; pos += LaneBatch::BLOCK) {
+		if (pos == b.warmup) {
+			vst1q_s16(b.warmHistory, history);
+			vst1q_s16(b.warmStepSize, stepSize);
+		}
+
+		block.unpack(b, pos);
+
+		for (size_t i = 0; i < LaneBatch::BLOCK; i++) {
+			uint16x8_t nib = vld1q_u16(block.nib[i]);
+			uint16x8_t mul = vld1q_u16(block.mul[i]);
+
+			if constexpr (HighPass) {
+				int16x8_t s  = vshrq_n_s16(history, 15);
+				uint16x8_t a = vreinterpretq_u16_s16(vsubq_s16(veorq_s16(history, s), s));
+				uint16x8_t c = vshrq_n_u16(vaddq_u16(a, c127), 7);
+				history = vsubq_s16(veorq_s16(vreinterpretq_s16_u16(vsubq_u16(a, c)), s), s);
+			}
+
+			uint16x8_t step = vreinterpretq_u16_s16(stepSize);
+			uint16x8_t mag  = vorrq_u16(vshlq_n_u16(vandq_u16(nib, c7), 1), c1);
+			int16x8_t sign  = vshrq_n_s16(vshlq_n_s16(vreinterpretq_s16_u16(nib), 12), 15);
+
+			uint16x8_t diffU = vcombine_u16(
+				vqshrn_n_u32(vmull_u16(vget_low_u16(mag), vget_low_u16(step)), 3),
+				vqshrn_n_u32(vmull_high_u16(mag, step), 3)
+			);
+			int16x8_t diff = vreinterpretq_s16_u16(vminq_u16(diffU, c32767));
+			diff = vsubq_s16(veorq_s16(diff, sign), sign);
+
+			uint16x8_t next = vcombine_u16(
+				vqshrn_n_u32(vmull_u16(vget_low_u16(mul), vget_low_u16(step)), 8),
+				vqshrn_n_u32(vmull_high_u16(mul, step), 8)
+			);
+
+			history  = vqaddq_s16(history, diff);
+			stepSize = vreinterpretq_s16_u16(vmaxq_u16(vminq_u16(next, c24576), c127));
+
+			vst1q_s16(block.history[i], history);
+			vst1q_s16(block.stepSize[i], stepSize);
+		}
+
+		block.store(b, pos);
+	}
+
+	vst1q_s16(b.history, history);
+	vst1q_s16(b.stepSize, stepSize);
+}
+
+#endif // YADPCM_NEON
+
+/* ======================== *
+ *     Kernel selection     *
+ * ======================== */
+
+static bool cpuHasAVX2() {
+#if defined(YADPCM_X86) && (defined(__GNUC__) || defined(__clang__))
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#elif defined(YADPCM_X86) && defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 0);
+	if (regs[0] < 7)
+		return false;
+
+	// OSXSAVE and AVX, then check the OS actually saves YMM registers
+	__cpuid(regs, 1);
+	if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0)
+		return false;
+	if ((_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(regs, 7, 0);
+	return regs[1] & (1 << 5);
+#else
+	return false;
+#endif
+}
+
+static bool cpuHasSSE2() {
+#if defined(__x86_64__) || defined(_M_X64)
+	return true;
+#elif defined(YADPCM_X86) && (defined(__GNUC__) || defined(__clang__))
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#elif defined(YADPCM_X86) && defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 1);
+	return regs[3] & (1 << 26);
+#else
+	return false;
+#endif
+}
+
+static Kernel bestKernel() {
+	if (cpuHasAVX2())
+		return Kernel::AVX2;
+	if (cpuHasSSE2())
+		return Kernel::SSE2;
+	if (kernelSupported(Kernel::NEON))
+		return Kernel::NEON;
+	return Kernel::Scalar;
+}
+
+static std::atomic<Kernel>& activeKernel() {
+	static std::atomic<Kernel> kernel = bestKernel();
+	return kernel;
+}
+
+Kernel kernel() {
+	return activeKernel();
+}
+
+bool kernelSupported(Kernel kernel) {
+	switch (kernel) {
+		case Kernel::Scalar: return true;
+		case Kernel::SSE2:   return cpuHasSSE2();
+		case Kernel::AVX2:   return cpuHasAVX2();
+	#ifdef YADPCM_NEON
+		case Kernel::NEON:   return true;
+	#else
+		case Kernel::NEON:   return false;
+	#endif
+	}
+	return false;
+}
+
+const char* kernelName(Kernel kernel) {
+	switch (kernel) {
+		case Kernel::Scalar: return "scalar";
+		case Kernel::SSE2:   return "SSE2";
+		case Kernel::AVX2:   return "AVX2";
+		case Kernel::NEON:   return "NEON";
+	}
+	return "";
+}
+
+bool setKernel(Kernel kernel) {
+	if (!kernelSupported(kernel))
+		return false;
+	activeKernel() = kernel;
+	return true;
+}
+
+static size_t laneCount(Kernel kernel) {
+	switch (kernel) {
+		case Kernel::SSE2: return 8;
+		case Kernel::AVX2: return 16;
+		case Kernel::NEON: return 8;
+		default:           return 1;
+	}
+}
+
+static void decodeLanes(Kernel kernel, LaneBatch& b, bool highPass) {
+	switch (kernel) {
+	#ifdef YADPCM_X86
+		case Kernel::SSE2: {
+			highPass ? decodeLanesSSE2<true>(b) : decodeLanesSSE2<false>(b);
+			return;
+		}
+
+		case Kernel::AVX2: {
+			highPass ? decodeLanesAVX2<true>(b) : decodeLanesAVX2<false>(b);
+			return;
+		}
+	#endif
+
+	#ifdef YADPCM_NEON
+		case Kernel::NEON: {
+			highPass ? decodeLanesNEON<true>(b) : decodeLanesNEON<false>(b);
+			return;
+		}
+	#endif
+
+		default: {
+			decodeLanesScalar(b, highPass);
+			return;
+		}
+	}
+}
+
+/* ======================== *
+ *   Speculative decoding   *
+ * ======================== */
+
+/**
+ * How far back each speculative chunk starts decoding before its own output begins.
+ * Step size tends to fall back to its minimum quickly, and the high pass filter pulls
+ * history towards the right value, so by the end of this the guessed state almost always
+ * matches and the chunk doesn't need touching again.
+ */
+constexpr size_t WARMUP = 1024;
+constexpr size_t MIN_CHUNK = 4096;
+
+size_t Context::decodeParallel(const u8* in, s16* out, size_t len, bool highPass) {
+	const u8* start = in;
+
+	// Line up to a byte so every chunk starts on a low nibble
+	if (nibble == 0 && len) {
+		in += decode(in, out, 1, highPass);
+		out++;
+		len--;
+	}
+
+	const Kernel k = kernel();
+	const size_t lanes = laneCount(k);
+	auto& pool = ThreadPool::shared();
+
+	// The first chunk is decoded normally, each batch of lanes takes the rest
+	size_t numChunks = std::min(len / MIN_CHUNK, 1 + lanes * (pool.size() + 1));
+	if (numChunks < 2)
+		return (in - start) + decode(in, out, len, highPass);
+
+	const size_t chunkLen = (len / numChunks) & ~(LaneBatch::BLOCK - 1);
+	const size_t numBatches = (numChunks - 1 + lanes - 1) / lanes;
+
+	std::vector<s16> steps((numChunks - 1) * chunkLen);
+	std::vector<LaneBatch> batches(numBatches);
+
+	for (size_t c = 1; c < numChunks; c++) {
+		auto& b = batches[(c - 1) / lanes];
+		size_t l = (c - 1) % lanes;
+		size_t chunkStart = c * chunkLen;
+
+		b.lanes  = l + 1;
+		b.count  = WARMUP + chunkLen;
+		b.warmup = WARMUP;
+
+		b.in[l]    = in + ((chunkStart - WARMUP) >> 1);
+		b.out[l]   = out + chunkStart;
+		b.steps[l] = steps.data() + ((c - 1) * chunkLen);
+
+		// Whatever the encoder starts off with is as good a guess as any
+		b.history[l]  = 0;
+		b.stepSize[l] = 127;
+	}
+
+	Context first = *this;
+
+	pool.parallelFor(numBatches + 1, [&](size_t i) {
+		if (i == 0) {
+			first.decode(in, out, chunkLen, highPass);
+		} else {
+			decodeLanes(k, batches[i - 1], highPass);
+		}
+	});
+
+	s16 curHistory = first.history;
+	s16 curStepSize = first.stepSize;
+
+	for (size_t c = 1; c < numChunks; c++) {
+		const auto& b = batches[(c - 1) / lanes];
+		size_t l = (c - 1) % lanes;
+
+		if (b.warmHistory[l] != curHistory || b.warmStepSize[l] != curStepSize) {
+			/**
+			 * Guessed wrong, so decode for real until we end up in the same state the
+			 * speculative decode was in at that sample, after which everything matches.
+			 */
+			const u8* chunkIn = in + ((c * chunkLen) >> 1);
+			s16* chunkOut = b.out[l];
+			const s16* chunkSteps = b.steps[l];
+			bool synced = false;
+
+			for (size_t i = 0; i < chunkLen; i++) {
+				u8 byte = chunkIn[i >> 1];
+				u8 nib = (i & 1) ? byte >> 4 : byte & 15;
+
+				if (highPass)
+					curHistory = highPassFilter(curHistory);
+
+				step(nib, curHistory, curStepSize);
+
+				if (curHistory == chunkOut[i] && curStepSize == chunkSteps[i]) {
+					synced = true;
+					break;
+				}
+
+				chunkOut[i] = curHistory;
+			}
+
+			if (!synced)
+				continue;
+		}
+
+		curHistory = b.history[l];
+		curStepSize = b.stepSize[l];
+	}
+
+	history = curHistory;
+	stepSize = curStepSize;
+	nibble = 4;
+
+	size_t done = numChunks * chunkLen;
+	return (in - start) + (done >> 1) + decode(in + (done >> 1), out + done, len - done, highPass);
+}
+
 } // namespace manatools::yadpcm
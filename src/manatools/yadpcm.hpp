@@ -2,25 +2,66 @@
 #include "types.hpp"
 
 namespace manatools::yadpcm {
+	/**
+	 * Decoding has vectorised paths that run several independent streams at once, one per
+	 * lane. The best one the CPU supports is picked on first use.
+	 */
+	enum class Kernel {
+		Scalar,
+		SSE2,
+		AVX2,
+		NEON
+	};
+
+	Kernel kernel();
+	bool kernelSupported(Kernel kernel);
+	const char* kernelName(Kernel kernel);
+
+	// Returns false if the CPU doesn't support (kernel), mostly useful for comparing them
+	bool setKernel(Kernel kernel);
+
 	// The same context should not be used across different audio clips.
 	class Context {
 	public:
 		/**
 		 * Given (len) amount of 16-bit PCM samples in (in), return ADPCM samples in (out).
 		 * Output buffer should be at least (len / 2) elements large.
-		 * 
+		 *
 		 * Returns number of bytes output.
 		 */
 		size_t encode(const s16* in, u8* out, size_t len);
 
+		/**
+		 * Slower encode that, rather than just taking the closest step every sample, keeps
+		 * the (width) best candidate streams and commits to whichever has the least error at
+		 * the end of every block of samples. Error is measured against what decode will give
+		 * back, so (highPass) should match whatever it'll be decoded with.
+		 * (width) is clamped to [1, 16].
+		 *
+		 * Returns number of bytes output.
+		 */
+		size_t encodeSearch(const s16* in, u8* out, size_t len, uint width = 8, bool highPass = true);
+
+		// Writes out the last sample if encoding stopped halfway through a byte, returns bytes output
+		size_t flush(u8* out);
+
 		/**
 		 * Given ADPCM samples in (in), return (len) amount of decoded 16-bit PCM samples in (out).
 		 * Output buffer should be at least (len * 2) elements large.
-		 * 
+		 *
 		 * Returns number of bytes processed.
 		 */
 		size_t decode(const u8* in, s16* out, size_t len, bool highPass = true);
 
+		/**
+		 * Same as decode, but long clips are split into chunks that are decoded at the same
+		 * time across SIMD lanes and the shared thread pool. Every chunk but the first has to
+		 * guess its starting state, so they're checked against the real state afterwards and
+		 * re-decoded where needed, keeping output identical to decode.
+		 * Short clips are just passed to decode.
+		 */
+		size_t decodeParallel(const u8* in, s16* out, size_t len, bool highPass = true);
+
 		void reset() {
 			nibble    = 4;
 			history   = 0;
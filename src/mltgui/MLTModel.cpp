@@ -1,8 +1,10 @@
 #include <QIODevice>
 #include <QMimeData>
 #include <QPalette>
+#include <guicommon/ChangeSet.hpp>
 #include <guicommon/utils.hpp>
 #include <optional>
+#include <vector>
 #include "MLTModel.hpp"
 
 const QString MLTModel::MIMEType = QStringLiteral("application/x-manatools-mltgui-mltmodel");
@@ -43,7 +45,7 @@ QVariant MLTModel::data(const QModelIndex& index, int role) const {
 				}
 				return formatHex(unit.fileDataPtr(), 8);
 			}
-			case 5: return formatHex(unit.data.size());
+			case 5: return formatHex(unit.dataSize());
 		}
 	} else if (role == Qt::TextAlignmentRole) {
 		if (index.column() == 0) {
@@ -146,9 +148,13 @@ bool MLTModel::moveRows(const QModelIndex& srcParent, int srcRow, int count, con
 	    !beginMoveRows({}, srcRow, srcRow + count - 1, {}, destRow))
 		return false;
 
-	mlt->move(srcRow, count, destRow);
+	manatools::mlt::Changes changes;
+	mlt->move(srcRow, count, destRow, &changes);
 
 	endMoveRows();
+
+	// Moving units up also moves their AICA offsets down to follow what's now before them
+	applyChanges(changes);
 	return true;
 }
 
@@ -239,6 +245,56 @@ Qt::DropActions MLTModel::supportedDropActions() const {
 	return Qt::MoveAction;
 }
 
+bool MLTModel::adjust() {
+	manatools::mlt::Changes changes;
+	bool changed = mlt->adjust(&changes);
+	applyChanges(changes);
+	return changed;
+}
+
+bool MLTModel::pack(bool useAICASizes) {
+	manatools::mlt::Changes changes;
+	bool changed = mlt->pack(useAICASizes, &changes);
+	applyChanges(changes);
+	return changed;
+}
+
+bool MLTModel::repack() {
+	manatools::mlt::Changes changes;
+
+	// Persistent indexes (i.e. the selection) have to be told where their units went
+	emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+	bool changed = mlt->repack(&changes);
+
+	if (!changes.from.empty()) {
+		std::vector<int> to(changes.from.size());
+		for (size_t i = 0; i < changes.from.size(); i++)
+			to[changes.from[i]] = static_cast<int>(i);
+
+		const auto oldIndexes = persistentIndexList();
+		QModelIndexList newIndexes;
+		newIndexes.reserve(oldIndexes.size());
+
+		for (const auto& idx : oldIndexes)
+			newIndexes.append(idx.isValid() ? index(to[idx.row()], idx.column()) : QModelIndex());
+
+		changePersistentIndexList(oldIndexes, newIndexes);
+	}
+
+	// Views redraw every row after this anyway, so there's no need to say which cells changed
+	emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+
+	return changed;
+}
+
+// Only the AICA offset and size columns can be changed by these
+void MLTModel::applyChanges(const manatools::mlt::Changes& changes) {
+	ChangeSet changeSet(this);
+	for (size_t row : changes.aica)
+		changeSet.addRow(row, 2, 3);
+	changeSet.commit();
+}
+
 void MLTModel::setMLT(manatools::mlt::MLT* newMLT) {
 	beginResetModel();
 	mlt = newMLT;
@@ -30,6 +30,14 @@ public:
 	QStringList mimeTypes() const override;
 	Qt::DropActions supportedDropActions() const override;
 
+	/**
+	 * Same as the MLT methods, but only the cells that changed are refreshed, and the
+	 * selection follows units that get reordered.
+	 */
+	bool adjust();
+	bool pack(bool useAICASizes);
+	bool repack();
+
 	void setMLT(manatools::mlt::MLT* newMLT);
 
 private:
@@ -42,6 +50,8 @@ private:
 		return true;
 	}
 
+	void applyChanges(const manatools::mlt::Changes& changes);
+
 	QColor dimmedTextColor;
 	QFont headerFont;
 	QFont monoFont;
@@ -14,10 +14,13 @@
 #include <QToolButton>
 #include <QVBoxLayout>
 #include <manatools/io.hpp>
+#include <guicommon/background.hpp>
+#include <guicommon/ChangeSet.hpp>
 #include <guicommon/CursorOverride.hpp>
 #include <guicommon/FourCCDelegate.hpp>
 #include <guicommon/HorizontalLineItemDropStyle.hpp>
 #include <guicommon/utils.hpp>
+#include <algorithm>
 #include <array>
 #include <functional>
 
@@ -51,6 +54,7 @@ MainWindow::MainWindow(QWidget* parent) :
 	QMenu* packMenu = editMenu->addMenu(tr("&Pack"));
 	packMenu->addAction(tr("By &AICA Size"), std::bind(&MainWindow::packMLT, this, true));
 	packMenu->addAction(tr("By &File Size"), std::bind(&MainWindow::packMLT, this, false));
+	packMenu->addAction(tr("&Minimise RAM Usage"), this, &MainWindow::repackMLT);
 	// editMenu->addAction(QIcon::fromTheme("document-properties"), tr("Preference&s"), this, [] { /* TODO */ });
 
 	QMenu* helpMenu = menuBar()->addMenu(tr("&Help"));
@@ -84,6 +88,7 @@ MainWindow::MainWindow(QWidget* parent) :
 
 	setCurrentFile();
 	resetTableLayout();
+	rebuildRAM();
 	updateRAMStatus();
 
 	connect(editMenu, &QMenu::aboutToShow, this, [this]() {
@@ -105,6 +110,44 @@ MainWindow::MainWindow(QWidget* parent) :
 		updateUnitStatus();
 	});
 
+	// Connected before anything else so (ram) is already up to date for them
+	connect(model, &QAbstractTableModel::dataChanged, this, [this](const QModelIndex& tl, const QModelIndex& br) {
+		updateRAMRows(tl.row(), br.row());
+	});
+
+	connect(model, &QAbstractTableModel::rowsInserted, this, [this](const QModelIndex& parent, int first, int last) {
+		Q_UNUSED(parent);
+		ramUnits.insert(ramUnits.begin() + first, last - first + 1, {});
+		for (int row = first; row <= last; row++) {
+			const auto& unit = mlt.units[row];
+			ram.insert(unit.aicaDataPtr, unit.aicaDataSize);
+			ramUnits[row] = { unit.aicaDataPtr, unit.aicaDataSize };
+		}
+	});
+
+	connect(model, &QAbstractTableModel::rowsRemoved, this, [this](const QModelIndex& parent, int first, int last) {
+		Q_UNUSED(parent);
+		for (int row = first; row <= last; row++)
+			ram.erase(ramUnits[row].first, ramUnits[row].second);
+		ramUnits.erase(ramUnits.begin() + first, ramUnits.begin() + last + 1);
+	});
+
+	// Only where they are in the list, any offsets the move changed come after as dataChanged
+	connect(model, &QAbstractTableModel::rowsMoved, this,
+	        [this](const QModelIndex& parent, int start, int end, const QModelIndex& dest, int row) {
+		Q_UNUSED(parent);
+		Q_UNUSED(dest);
+		auto first = ramUnits.begin() + start;
+		auto last = ramUnits.begin() + end + 1;
+		if (row < start)
+			std::rotate(ramUnits.begin() + row, first, last);
+		else
+			std::rotate(first, last, ramUnits.begin() + row);
+	});
+
+	connect(model, &QAbstractTableModel::layoutChanged, this, &MainWindow::rebuildRAM);
+	connect(model, &QAbstractTableModel::modelReset, this, &MainWindow::rebuildRAM);
+
 	connect(model, &QAbstractTableModel::dataChanged, this,
 	        [this](const QModelIndex& tl, const QModelIndex& br, const QList<int>& roles) {
 		Q_UNUSED(tl);
@@ -159,16 +202,21 @@ MainWindow::MainWindow(QWidget* parent) :
 }
 
 bool MainWindow::loadFile(const QString& path) {
-	CursorOverride cursor(Qt::WaitCursor);
+	manatools::mlt::MLT loaded;
 
 	try {
-		mlt = manatools::mlt::load(path.toStdWString());
+		bool done = runInBackground(this, tr("Loading multi-unit file..."), [&](const manatools::Progress& progress) {
+			loaded = manatools::mlt::load(path.toStdWString(), progress);
+		});
+
+		if (!done)
+			return false;
 	} catch (const std::runtime_error& err) {
-		cursor.restore();
 		QMessageBox::warning(this, tr("Open Multi-Unit file"), tr("Failed to load multi-unit file: %1").arg(err.what()));
 		return false;
 	}
 
+	mlt = std::move(loaded);
 	setCurrentFile(path);
 	reloadTable();
 	updateRAMStatus();
@@ -177,7 +225,6 @@ bool MainWindow::loadFile(const QString& path) {
 }
 
 bool MainWindow::saveFile(const QString& path) {
-	CursorOverride cursor(Qt::WaitCursor);
 	QMessageBox::StandardButton btn;
 	QString msg;
 
@@ -203,7 +250,7 @@ bool MainWindow::saveFile(const QString& path) {
 		}
 	}
 
-	if (mlt.aicaUsed() > manatools::mlt::AICA_MAX) {
+	if (ram.highWater() > manatools::mlt::AICA_MAX) {
 		btn = QMessageBox::warning(
 			this,
 			tr("Save Multi-Unit file"),
@@ -216,14 +263,22 @@ bool MainWindow::saveFile(const QString& path) {
 		}
 	}
 
+	// Saving fills in where each unit's data went in the file, so do it on a copy the table isn't reading
+	auto saved = mlt;
+
 	try {
-		mlt.save(path.toStdWString());
+		bool done = runInBackground(this, tr("Saving multi-unit file..."), [&](const manatools::Progress& progress) {
+			saved.save(path.toStdWString(), progress);
+		});
+
+		if (!done)
+			return false;
 	} catch (const std::runtime_error& err) {
-		cursor.restore();
 		QMessageBox::warning(this, tr("Save Multi-Unit file"), tr("Failed to save multi-unit file: %1").arg(err.what()));
 		return false;
 	}
 
+	mlt = std::move(saved);
 	setCurrentFile(path);
 	return true;
 }
@@ -293,8 +348,16 @@ void MainWindow::about() {
 }
 
 void MainWindow::dataModified() {
+	// Whatever adjust changes comes back through dataChanged, which lands back here
+	if (adjusting)
+		return;
+
 	setWindowModified(true);
-	mlt.adjust();
+
+	adjusting = true;
+	model->adjust();
+	adjusting = false;
+
 	updateRAMStatus();
 	updateUnitStatus();
 }
@@ -341,18 +404,29 @@ void MainWindow::packMLT(bool useAICASizes) {
 		}		
 	}
 
-	if (mlt.pack(useAICASizes)) {
-		/**
-		 * Getting all rows that actually changed is a bit ugh, but it's inevitable
-		 * once the time comes to implement undo/redo
-		 * Emitting dataChanged is also kind of wasteful, as then a redundant
-		 * mlt.adjust() would be ran
-		 */
-		emit model->dataChanged(
-			model->index(0, 0),
-			model->index(model->rowCount(), model->columnCount()),
-			{ Qt::DisplayRole, Qt::EditRole }
-		);
+	// Changed rows come back through dataChanged, and so to dataModified
+	model->pack(useAICASizes);
+}
+
+void MainWindow::repackMLT() {
+	const auto btn = QMessageBox::warning(
+		this,
+		tr("Pack MLT"),
+		tr(
+			"Minimising RAM usage moves units around in memory (and in the list, so it stays in "
+			"memory order) to fill gaps left by alignment. Like packing by file size, this can "
+			"break titles that expect a unit to be at a specific place. Would you like to continue?"
+		),
+		QMessageBox::Yes | QMessageBox::No
+	);
+
+	if (btn != QMessageBox::Yes) {
+		return;
+	}
+
+	// This reorders rows rather than changing cells, so doesn't go through dataChanged
+	if (model->repack()) {
+		dataModified();
 	}
 }
 
@@ -381,29 +455,18 @@ void MainWindow::delUnit() {
 }
 
 void MainWindow::clearUnitData() {
-	auto selRows = table->selectionModel()->selectedRows();
-	int tl = -1;
-	int br = -1;
+	const auto selRows = table->selectionModel()->selectedRows();
+	ChangeSet changes(model);
 
-	for (auto& idx : selRows) {
+	for (const auto& idx : selRows) {
 		auto& unit = mlt.units[idx.row()];
-		if (!unit.data.empty()) {
-			if (idx.row() < tl)
-				tl = idx.row();
-			else if (idx.row() > br)
-				br = idx.row();
-
-			unit.data.clear();
+		if (unit.hasData()) {
+			changes.watchRow(idx.row());
+			unit.setData({});
 		}
 	}
 
-	if (tl != -1 || br != -1) {
-		emit model->dataChanged(
-			model->index(tl, 0),
-			model->index(br, model->columnCount()),
-			{ Qt::DisplayRole, Qt::EditRole }
-		);
-	}
+	changes.commit();
 }
 
 bool MainWindow::importUnitDialog() {
@@ -423,10 +486,15 @@ bool MainWindow::importUnitDialog() {
 	if (path.isEmpty())
 		return false;
 
-	// emitting rowChanged should be the responsibility of importUnit, but urghhhhh
+	// refreshing the row should be the responsibility of importUnit, but urghhhhh
+	ChangeSet changes(model);
+	changes.watchRow(curIdx.row());
+
 	bool ret = importUnit(unit, path);
-	if (ret)
-		emitRowChanged(model, curIdx.row());
+
+	// Data the same size as before doesn't look any different, but is still a change
+	if (ret && !changes.commit())
+		dataModified();
 
 	return ret;
 }
@@ -522,7 +590,7 @@ bool MainWindow::importUnit(manatools::mlt::Unit& unit, const QString& path) {
 	try {
 		long fileSize = 0;
 		manatools::io::FileIO file(path.toStdWString(), "rb");
-		u32 nextOffset = mlt.aicaNextOffset(unit.aicaDataPtr);
+		u32 nextOffset = ram.nextOffset(unit.aicaDataPtr);
 
 		file.end();
 		fileSize = file.tell();
@@ -549,9 +617,10 @@ bool MainWindow::importUnit(manatools::mlt::Unit& unit, const QString& path) {
 			unit.aicaDataSize = fileSize;
 		}
 
-		unit.data.resize(fileSize);
+		std::vector<u8> data(fileSize);
 		file.jump(0);
-		file.readVec(unit.data);
+		file.readVec(data);
+		unit.setData(std::move(data));
 	} catch (const std::runtime_error& err) {
 		cursor.restore();
 		QMessageBox::warning(this, tr("Import unit"), tr("Failed to import unit: %1").arg(err.what()));
@@ -573,7 +642,7 @@ bool MainWindow::exportUnit(const manatools::mlt::Unit& unit, const QString& pat
 
 	try {
 		manatools::io::FileIO file(path.toStdWString(), "wb");
-		file.writeVec(unit.data);
+		file.writeSpan(unit.data());
 	} catch (const std::runtime_error& err) {
 		cursor.restore();
 		QMessageBox::warning(this, tr("Export unit"), tr("Failed to export unit: %1").arg(err.what()));
@@ -583,15 +652,40 @@ bool MainWindow::exportUnit(const manatools::mlt::Unit& unit, const QString& pat
 	return true;
 }
 
-void MainWindow::emitRowChanged(QAbstractItemModel* model, int row) {
-	auto topLeft = model->index(row, 0);
-	auto bottomRight = model->index(row, model->columnCount());
-	emit model->dataChanged(topLeft, bottomRight, { Qt::DisplayRole, Qt::EditRole });
+void MainWindow::rebuildRAM() {
+	ram.rebuild(mlt);
+
+	ramUnits.clear();
+	for (const auto& unit : mlt.units)
+		ramUnits.emplace_back(unit.aicaDataPtr, unit.aicaDataSize);
+}
+
+void MainWindow::updateRAMRows(int first, int last) {
+	for (int row = first; row <= last; row++) {
+		const auto& unit = mlt.units[row];
+		auto& [offset, size] = ramUnits[row];
+
+		if (offset == unit.aicaDataPtr && size == unit.aicaDataSize)
+			continue;
+
+		ram.erase(offset, size);
+		ram.insert(unit.aicaDataPtr, unit.aicaDataSize);
+		offset = unit.aicaDataPtr;
+		size = unit.aicaDataSize;
+	}
 }
 
 void MainWindow::updateRAMStatus() {
-	intptr_t avail = manatools::mlt::AICA_MAX - mlt.aicaUsed();
-	ramStatus->setText(tr("%1 (%2) bytes available").arg(avail).arg(formatHex(avail)));
+
+	intptr_t avail = manatools::mlt::AICA_MAX - static_cast<intptr_t>(ram.highWater());
+	u32 gapBytes = ram.gapBytes();
+
+	if (gapBytes) {
+		ramStatus->setText(tr("%1 (%2) bytes available, %3 bytes in gaps")
+		                   .arg(avail).arg(formatHex(avail)).arg(gapBytes));
+	} else {
+		ramStatus->setText(tr("%1 (%2) bytes available").arg(avail).arg(formatHex(avail)));
+	}
 
 	if (avail <= 0)
 		ramStatus->setStyleSheet("QLabel { color: red; }");
@@ -5,6 +5,7 @@
 #include <QTableView>
 #include <manatools/fourcc.hpp>
 #include <manatools/mlt.hpp>
+#include <manatools/mltalloc.hpp>
 
 #include "MLTModel.hpp"
 
@@ -26,6 +27,7 @@ public slots:
 	void selectAll();
 	void versionDialog();
 	void packMLT(bool useAICASizes);
+	void repackMLT();
 	bool addUnit(const manatools::FourCC fourCC);
 	void delUnit();
 	void clearUnitData();
@@ -41,7 +43,8 @@ private:
 	bool importUnit(manatools::mlt::Unit& unit, const QString& path);
 	bool exportUnit(const manatools::mlt::Unit& unit, const QString& path);
 
-	void emitRowChanged(QAbstractItemModel* model, int row);
+	void rebuildRAM();
+	void updateRAMRows(int first, int last);
 	void updateRAMStatus();
 	void updateUnitStatus();
 	bool checkUnitBanksValid(QString* log = nullptr);
@@ -69,5 +72,10 @@ private:
 	QAction* clearUnitAction;
 	QAction* deleteUnitAction;
 
+	bool adjusting = false;
+
 	manatools::mlt::MLT mlt;
+	// Where everything in (mlt) is, updated row by row from the model's signals
+	manatools::mlt::Allocator ram;
+	std::vector<std::pair<u32, u32>> ramUnits; // Offset and size each row was put in (ram) with
 };
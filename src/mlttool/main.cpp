@@ -1,11 +1,15 @@
 #include <cstdio>
 #include <cstring>
+#include <string_view>
 
+#include <manatools/batch.hpp>
 #include <manatools/filesystem.hpp>
 #include <manatools/io.hpp>
 #include <manatools/mlt.hpp>
+#include <manatools/tonestore.hpp>
 #include <manatools/version.hpp>
 
+namespace batch = manatools::batch;
 namespace fs = manatools::fs;
 namespace io = manatools::io;
 
@@ -19,7 +23,7 @@ namespace io = manatools::io;
 #endif
 
 void mltListUnits(const fs::path& mltPath) {
-	auto mlt = manatools::mlt::load(mltPath);
+	auto mlt = manatools::mlt::loadMapped(mltPath);
 
 	printf(HEADING "%4s  %4s  %4s  %13s  %11s  %13s  %11s\n" HEADING_END,
 	       "Unit", "Type", "Bank", "Offset [AICA]", "Size [AICA]", "Offset [File]", "Size [File]");
@@ -30,18 +34,22 @@ void mltListUnits(const fs::path& mltPath) {
 		// Will become misaligned if something is too big, but such chances are low
 		printf("%4zu  %4s  %4hhd  %13x  %11u  %13x  %11zu\n",
 		       u, unit.fourCC.data(), unit.bank, unit.aicaDataPtr, unit.aicaDataSize,
-		       unit.fileDataPtr(), unit.data.size());
+		       unit.fileDataPtr(), unit.dataSize());
 	}
 }
 
-void mltExtractUnits(const fs::path& mltPath, const fs::path& unitOutPath) {
-	auto mlt = manatools::mlt::load(mltPath);
-
+/**
+ * Units with identical contents, such as the same bank packed into several MLTs extracted
+ * through (store), are only written once and hard linked after.
+ */
+void mltExtractUnits(const manatools::mlt::MLT& mlt, const fs::path& mltPath, const fs::path& unitOutPath,
+                     manatools::tone::Store& store) {
 	for (size_t u = 0; u < mlt.units.size(); u++) {
 		const auto& unit = mlt.units[u];
 
-		if (!unit.data.size()) {
-			fprintf(stderr, "Warning: Unit %zu (%s) has no data\n", u, unit.fourCC.data());
+		if (!unit.hasData()) {
+			fprintf(stderr, "Warning: %s: Unit %zu (%s) has no data\n", mltPath.filename().string().c_str(), u,
+			        unit.fourCC.data());
 			continue;
 		}
 
@@ -56,8 +64,7 @@ void mltExtractUnits(const fs::path& mltPath, const fs::path& unitOutPath) {
 
 		fs::path unitName = mltPath.stem().concat('_' + std::to_string(u) += type);
 
-		io::FileIO unitFile(unitOutPath / unitName, "wb");
-		unitFile.writeVec(unit.data);
+		store.write(unitOutPath / unitName, unit.data());
 	}
 }
 
@@ -71,7 +78,40 @@ int main(int argc, char** argv) {
 			if (argc < 4)
 				goto invalid;
 
-			mltExtractUnits(argv[2], argv[3]);
+			// Just the one file is done directly like before batches existed, without the batch report
+			bool single = argc == 4 && !batch::isBatch(argv[2]);
+
+			manatools::tone::Store store;
+			batch::Report report;
+
+			if (single) {
+				mltExtractUnits(manatools::mlt::loadMapped(argv[2]), argv[2], argv[3], store);
+			} else {
+				constexpr std::string_view extensions[] = { ".mlt" };
+				auto inputs = batch::collect(std::span(argv + 2, argc - 3), extensions);
+				fs::path outPath = argv[argc - 1];
+
+				// Units are raw bytes, so the parallel part is just mapping and parsing each file
+				report = batch::run(inputs,
+					[](const batch::Input& input) {
+						return manatools::mlt::loadMapped(input.path);
+					},
+					[&](const batch::Input& input, const manatools::mlt::MLT& mlt) {
+						fs::path outDir = outPath / input.relDir;
+						fs::create_directories(outDir);
+						mltExtractUnits(mlt, input.path, outDir, store);
+					}
+				);
+			}
+
+			auto stats = store.stats();
+			printf("Extracted %zu units (%zu unique), saving %zu bytes\n",
+			       stats.items, stats.unique, stats.bytesSaved);
+
+			if (!single) {
+				report.print();
+				return report.failures.empty() ? 0 : 1;
+			}
 		} else if (!strcmp(argv[1], "list")) {
 			mltListUnits(argv[2]);
 		} else {
@@ -90,7 +130,7 @@ invalid:
 		"mlttool - Dreamcast Multi-Unit file tool [version %s]\n"
 		"https://github.com/dakrk/manatools\n"
 		"\n"
-		"Usage: %s extract <in.mlt> <outdir>\n"
+		"Usage: %s extract <in>... <outdir>\n"
 		"       %s list <in.mlt>\n"
 		"\n"
 		"An MLT file groups multiple audio-related files (called \"units\" or \"blocks\")\n"
@@ -104,6 +144,15 @@ invalid:
 		"A unit's AICA size may be bigger than its file size seemingly as to satisfy\n"
 		"alignment requirements.\n"
 		"\n"
+		"Units with the same contents are only extracted once, and further copies are\n"
+		"hard linked to it, including across all of the given MLT files.\n"
+		"\n"
+		"Each <in> can be an MLT file, a directory to search for MLT files in\n"
+		"(including subdirectories, which are recreated under <outdir>), or @list.txt\n"
+		"to read paths from, one per line. Files are loaded in parallel but always\n"
+		"written in the order given, so the output is the same as doing them one at a\n"
+		"time. A file that fails is reported at the end rather than stopping the rest.\n"
+		"\n"
 		"The aforementioned usage syntax is not final and will be revised.\n",
 		manatools::versionString,
 		argv[0],
@@ -26,13 +26,7 @@ QVariant LayersModel::data(const QModelIndex& index, int role) const {
 		return {};
 
 	if (role == Qt::DisplayRole || role == Qt::EditRole) {
-		switch (index.column()) {
-			case 0: return index.row();
-			case 1: return static_cast<uint>(layer->splits.size());
-			case 2: return layer->delay * 4;
-			case 3: return layer->bendRangeLow;
-			case 4: return layer->bendRangeHigh;
-		}
+		return layerData(*layer, index.row(), index.column());
 	} else if (role == Qt::TextAlignmentRole) {
 		if (index.column() == 0) {
 			return QVariant(Qt::AlignCenter | Qt::AlignVCenter);
@@ -46,6 +40,18 @@ QVariant LayersModel::data(const QModelIndex& index, int role) const {
 	return {};
 }
 
+QVariant LayersModel::layerData(const Layer& layer, int row, int column) {
+	switch (column) {
+		case 0: return row;
+		case 1: return static_cast<uint>(layer.splits.size());
+		case 2: return layer.delay * 4;
+		case 3: return layer.bendRangeLow;
+		case 4: return layer.bendRangeHigh;
+	}
+
+	return {};
+}
+
 QVariant LayersModel::headerData(int section, Qt::Orientation orientation, int role) const {
 	if (role == Qt::DisplayRole && orientation == Qt::Horizontal) {
 		switch (section) {
@@ -109,6 +115,25 @@ bool LayersModel::removeLayer(int at) {
 	return true;
 }
 
+bool LayersModel::setLayer(int row, Layer layer, ChangeSet& changes) {
+	auto* cur = bank->layer(programIdx, row);
+	if (!cur)
+		return false;
+
+	for (int c = 1; c < columnCount(); c++) {
+		if (layerData(*cur, row, c) != layerData(layer, row, c))
+			changes.add(row, c);
+	}
+
+	*cur = std::move(layer);
+	return true;
+}
+
+void LayersModel::splitsChanged(int row, ChangeSet& changes) {
+	if (bank->layer(programIdx, row))
+		changes.add(row, 1);
+}
+
 Qt::ItemFlags LayersModel::flags(const QModelIndex& index) const {
 	Qt::ItemFlags f = QAbstractTableModel::flags(index);
 
@@ -1,12 +1,14 @@
 #pragma once
 #include <QAbstractTableModel>
 #include <QFont>
+#include <guicommon/ChangeSet.hpp>
 #include <manatools/mpb.hpp>
 
 class LayersModel : public QAbstractTableModel {
 	Q_OBJECT
 public:
 	typedef manatools::mpb::Bank Bank;
+	typedef manatools::mpb::Layer Layer;
 	
 	LayersModel(Bank* bank, size_t programIdx, QObject* parent = nullptr);
 
@@ -20,12 +22,24 @@ public:
 	bool addLayer(int at);
 	bool removeLayer(int at);
 
+	/**
+	 * Replaces the layer at (row) and adds whichever of its cells now show something
+	 * different to (changes), which should be one for this model. Returns false if there's
+	 * no layer there.
+	 */
+	bool setLayer(int row, Layer layer, ChangeSet& changes);
+
+	// For when splits were added to or removed from the layer at (row) behind our back
+	void splitsChanged(int row, ChangeSet& changes);
+
 	Qt::ItemFlags flags(const QModelIndex& index) const override;
 
 	void setBank(Bank* newBank);
 	void setPath(size_t newProgramIdx);
 
 private:
+	static QVariant layerData(const Layer& layer, int row, int column);
+
 	template <typename T, typename T2>
 	bool changeData(const QModelIndex& index, T& out, const T2& in) {
 		if (out == in)
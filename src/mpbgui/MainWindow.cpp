@@ -8,9 +8,12 @@
 #include <QTimer>
 #include <stdexcept>
 #include <manatools/sf2.hpp>
+#include <guicommon/background.hpp>
+#include <guicommon/ChangeSet.hpp>
 #include <guicommon/CSV.hpp>
 #include <guicommon/CursorOverride.hpp>
 #include <guicommon/HorizontalLineItemDropStyle.hpp>
+#include <guicommon/ProgramPlayer.hpp>
 #include <guicommon/tone.hpp>
 #include <guicommon/TonePlayer.hpp>
 #include <guicommon/utils.hpp>
@@ -31,7 +34,9 @@ MainWindow::MainWindow(QWidget* parent) :
 	programIdx(0),
 	layerIdx(0),
 	splitIdx(0),
-	tonePlayer(22050, this)
+	tonePlayer(22050, this),
+	programPlayer(this),
+	programPlayerStale(true)
 {
 	ui.setupUi(this);
 	ui.statusbar->hide();
@@ -152,14 +157,14 @@ MainWindow::MainWindow(QWidget* parent) :
 	 */
 	connect(ui.btnLayerAdd, &QPushButton::clicked, this, [this]() {
 		QModelIndex cur = ui.tblLayers->currentIndex();
-		if (cur.isValid())
-			layersModel->addLayer(cur.row());
+		if (cur.isValid() && layersModel->addLayer(cur.row()))
+			splitCountsChanged(false);
 	});
 
 	connect(ui.btnLayerDel, &QPushButton::clicked, this, [this]() {
 		QModelIndex cur = ui.tblLayers->currentIndex();
-		if (cur.isValid())
-			layersModel->removeLayer(cur.row());
+		if (cur.isValid() && layersModel->removeLayer(cur.row()))
+			splitCountsChanged(false);
 	});
 
 	CONNECT_ROW_CHANGED(ui.tblPrograms, setProgram);
@@ -170,6 +175,9 @@ MainWindow::MainWindow(QWidget* parent) :
 	#undef CONNECT_BTN_DEL
 	#undef CONNECT_ROW_CHANGED
 
+	connect(splitsModel, &QAbstractTableModel::rowsInserted, this, [this]() { splitCountsChanged(true); });
+	connect(splitsModel, &QAbstractTableModel::rowsRemoved, this, [this]() { splitCountsChanged(true); });
+
 	// Moving a row doesn't fire currentRowChanged, despite the current row having actually changed
 	connect(programsModel, &QAbstractItemModel::rowsMoved, this, [this]() {
 		setProgram(ui.tblPrograms->currentIndex());
@@ -213,20 +221,33 @@ MainWindow::MainWindow(QWidget* parent) :
 	connect(&tonePlayer, &TonePlayer::playingChanged, this, [this]() {
 		ui.btnSplitPlay->setChecked(tonePlayer.isPlaying());
 	});
+
+	connect(ui.piano, &PianoKeyboardWidget::noteOn, this, [this](int key, int velocity) {
+		if (programPlayerStale)
+			updateProgramPlayer();
+		programPlayer.noteOn(key, velocity);
+	});
+
+	connect(ui.piano, &PianoKeyboardWidget::noteOff, &programPlayer, &ProgramPlayer::noteOff);
 }
 
 bool MainWindow::loadFile(const QString& path) {
-	CursorOverride cursor(Qt::WaitCursor);
+	manatools::mpb::Bank loaded;
+	bool guessToneSize = ui.actionGuessToneSize->isChecked();
 
 	try {
-		bank = manatools::mpb::load(path.toStdWString(), ui.actionGuessToneSize->isChecked());
+		bool done = runInBackground(this, tr("Loading bank..."), [&](const manatools::Progress& progress) {
+			loaded = manatools::mpb::load(path.toStdWString(), guessToneSize, progress);
+		});
+
+		if (!done)
+			return false;
 	} catch (const std::runtime_error& err) {
-		cursor.restore();
 		QMessageBox::warning(this, tr("Open MIDI program/drum bank"), tr("Failed to load bank file: %1").arg(err.what()));
 		return false;
 	}
 
-	cursor.restore();
+	bank = std::move(loaded);
 
 	if (!loadMapFile(path % ".csv")) {
 		loadMapFile(getOutPath(path, true) % "/manatools_mpb_map.csv");
@@ -260,12 +281,15 @@ bool MainWindow::saveFile(const QString& path) {
 	}
 
 	bool doSaveMappings = saveMappingsDialog();
-	CursorOverride cursor(Qt::WaitCursor);
 
 	try {
-		bank.save(path.toStdWString());
+		bool done = runInBackground(this, tr("Saving bank..."), [&](const manatools::Progress& progress) {
+			bank.save(path.toStdWString(), progress);
+		});
+
+		if (!done)
+			return false;
 	} catch (const std::runtime_error& err) {
-		cursor.restore();
 		QMessageBox::warning(this, tr("Save MIDI program/drum bank"), tr("Failed to save bank file: %1").arg(err.what()));
 		return false;
 	}
@@ -362,6 +386,8 @@ bool MainWindow::exportSF2File(const QString& path) {
 void MainWindow::setProgram(const QModelIndex& idx) {
 	if (idx.isValid()) {
 		programIdx = idx.row();
+		programPlayerStale = true;
+		ui.piano->releaseAll();
 		layersModel->setPath(programIdx);
 		ui.tblLayers->setCurrentIndex(layersModel->index(0, 0));
 	}
@@ -486,15 +512,22 @@ bool MainWindow::exportSF2() {
 }
 
 bool MainWindow::importTone() {
-	auto* split = bank.split(programIdx, layerIdx, splitIdx);
+	const auto* split = bank.split(programIdx, layerIdx, splitIdx);
 	if (!split)
 		return false;
 
-	auto metadata = tone::Metadata::fromMPB(*split);
-	bool success = tone::importDialog(split->tone, &metadata, getOutPath(curFile, true), this);
+	auto imported = *split;
+	auto metadata = tone::Metadata::fromMPB(imported);
+	bool success = tone::importDialog(imported.tone, &metadata, getOutPath(curFile, true), this);
 	if (success) {
-		metadata.toMPB(*split);
-		emitRowChanged(splitsModel, splitIdx);
+		metadata.toMPB(imported);
+
+		ChangeSet changes(splitsModel);
+		splitsModel->setSplit(splitIdx, std::move(imported), changes);
+
+		// The tone itself isn't in the table, so it has to be reloaded here if nothing else changed
+		if (!commitEdit(changes))
+			setSplit(splitsModel->index(splitIdx, 0));
 	}
 
 	return success;
@@ -529,25 +562,29 @@ void MainWindow::editVelocities() {
 
 	if (editor.exec() == QDialog::Accepted) {
 		bank.velocities = std::move(editor.velocities);
+		programPlayerStale = true;
 		setWindowModified(true);
 	}
 }
 
 void MainWindow::editLayer() {
-	auto* layer = bank.layer(programIdx, layerIdx);
+	const auto* layer = bank.layer(programIdx, layerIdx);
 	if (!layer)
 		return;
 
-	LayerEditor editor(layer, this);
+	auto edited = *layer;
+	LayerEditor editor(&edited, this);
 	editor.setPath(programIdx, layerIdx);
 
 	if (editor.exec() == QDialog::Accepted) {
-		emitRowChanged(layersModel, layerIdx);
+		ChangeSet changes(layersModel);
+		layersModel->setLayer(layerIdx, std::move(edited), changes);
+		commitEdit(changes);
 	}
 }
 
 void MainWindow::editSplit() {
-	auto* split = bank.split(programIdx, layerIdx, splitIdx);
+	const auto* split = bank.split(programIdx, layerIdx, splitIdx);
 	if (!split)
 		return;
 
@@ -556,14 +593,12 @@ void MainWindow::editSplit() {
 	editor.setPath(programIdx, layerIdx, splitIdx);
 
 	if (editor.exec() == QDialog::Accepted) {
-		/**
-		 * unsafe, but this is a modal, so no other bank operations that may have invalidated this
-		 * pointer should have happened (hopefully)
-		 */
-		*split = std::move(editor.split);
+		ChangeSet changes(splitsModel);
+		splitsModel->setSplit(splitIdx, std::move(editor.split), changes);
 		bank.velocities = std::move(editor.velocities);
 		// TODO: don't change windowModified if split/velocity data hasn't actually changed
-		emitRowChanged(splitsModel, splitIdx);
+		if (!commitEdit(changes))
+			setSplit(splitsModel->index(splitIdx, 0));
 	}
 }
 
@@ -609,10 +644,30 @@ void MainWindow::setCommonTableProps(QTableView* table) {
 	table->verticalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
 }
 
-void MainWindow::emitRowChanged(QAbstractItemModel* model, int row) {
-	auto topLeft = model->index(row, 0);
-	auto bottomRight = model->index(row, model->columnCount());
-	emit model->dataChanged(topLeft, bottomRight, { Qt::DisplayRole, Qt::EditRole });
+/**
+ * Editors change plenty the tables don't show, so even when no cells look any different
+ * the bank has still been changed.
+ */
+bool MainWindow::commitEdit(ChangeSet& changes) {
+	if (changes.commit())
+		return true;
+
+	programPlayerStale = true;
+	setWindowModified(true);
+	return false;
+}
+
+// The current layer's split count, and the current program's total, are all that can change
+void MainWindow::splitCountsChanged(bool layer) {
+	if (layer) {
+		ChangeSet layerChanges(layersModel);
+		layersModel->splitsChanged(layerIdx, layerChanges);
+		layerChanges.commit();
+	}
+
+	ChangeSet programChanges(programsModel);
+	programsModel->splitsChanged(programIdx, programChanges);
+	programChanges.commit();
 }
 
 void MainWindow::connectTableMutations(QAbstractTableModel* model) {
@@ -621,13 +676,19 @@ void MainWindow::connectTableMutations(QAbstractTableModel* model) {
 		Q_UNUSED(tl);
 		Q_UNUSED(br);
 		if (roles.contains(Qt::DisplayRole) || roles.contains(Qt::EditRole) || roles.isEmpty()) {
+			programPlayerStale = true;
 			setWindowModified(true);
 		}
 	});
 
-	connect(model, &QAbstractTableModel::rowsInserted, this, [this]() { setWindowModified(true); });
-	connect(model, &QAbstractTableModel::rowsMoved,    this, [this]() { setWindowModified(true); });
-	connect(model, &QAbstractTableModel::rowsRemoved,  this, [this]() { setWindowModified(true); });
+	auto changed = [this]() {
+		programPlayerStale = true;
+		setWindowModified(true);
+	};
+
+	connect(model, &QAbstractTableModel::rowsInserted, this, changed);
+	connect(model, &QAbstractTableModel::rowsMoved,    this, changed);
+	connect(model, &QAbstractTableModel::rowsRemoved,  this, changed);
 }
 
 void MainWindow::resetTableLayout() {
@@ -643,6 +704,8 @@ void MainWindow::resetTableLayout() {
 }
 
 void MainWindow::reloadTables() {
+	programPlayerStale = true;
+	ui.piano->releaseAll();
 	programsModel->setBank(&bank);
 	layersModel->setBank(&bank);
 	splitsModel->setBank(&bank);
@@ -656,6 +719,17 @@ void MainWindow::resetPiano() {
 	ui.piano->setBaseKey(-1);
 }
 
+void MainWindow::updateProgramPlayer() {
+	const auto* program = bank.program(programIdx);
+	if (program) {
+		programPlayer.setProgram(*program, bank.velocities);
+	} else {
+		programPlayer.clearProgram();
+	}
+
+	programPlayerStale = false;
+}
+
 bool MainWindow::programNameSet() const {
 	for (const auto& program : bank.programs) {
 		const QString* name = std::any_cast<QString>(&program.userData);
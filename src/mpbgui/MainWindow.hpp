@@ -1,6 +1,8 @@
 #pragma once
 #include <QSettings>
 #include <manatools/mpb.hpp>
+#include <guicommon/ChangeSet.hpp>
+#include <guicommon/ProgramPlayer.hpp>
 #include <guicommon/TonePlayer.hpp>
 
 #include "ui_MainWindow.h"
@@ -49,12 +51,14 @@ protected:
 private:
 	static void setCommonTableProps(QTableView* table);
 
-	void emitRowChanged(QAbstractItemModel* table, int row);
+	bool commitEdit(ChangeSet& changes);
+	void splitCountsChanged(bool layer);
 	void connectTableMutations(QAbstractTableModel* model);
 
 	void resetTableLayout();
 	void reloadTables();
 	void resetPiano();
+	void updateProgramPlayer();
 
 	bool programNameSet() const;
 	bool saveMappingsDialog();
@@ -82,5 +86,9 @@ private:
 
 	TonePlayer tonePlayer;
 
+	// Program played from the piano, only copied over when a key's pressed after a change
+	ProgramPlayer programPlayer;
+	bool programPlayerStale;
+
 	std::optional<bool> saveMappings;
 };
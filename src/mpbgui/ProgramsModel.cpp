@@ -206,6 +206,11 @@ Qt::DropActions ProgramsModel::supportedDropActions() const {
 	return Qt::MoveAction;
 }
 
+void ProgramsModel::splitsChanged(int row, ChangeSet& changes) {
+	if (bank->program(row))
+		changes.add(row, 1);
+}
+
 void ProgramsModel::setBank(Bank* newBank) {
 	beginResetModel();
 	bank = newBank;
@@ -1,5 +1,6 @@
 #pragma once
 #include <QAbstractTableModel>
+#include <guicommon/ChangeSet.hpp>
 #include <manatools/mpb.hpp>
 
 class ProgramsModel : public QAbstractTableModel {
@@ -28,6 +29,9 @@ public:
 
 	Qt::ItemFlags flags(const QModelIndex& index) const override;
 
+	// For when splits were added to or removed from the program at (row) behind our back
+	void splitsChanged(int row, ChangeSet& changes);
+
 	void setBank(Bank* newBank);
 
 private:
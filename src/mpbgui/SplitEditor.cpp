@@ -81,6 +81,13 @@ void SplitEditor::init() {
 		ui.btnTonePlay->setChecked(tonePlayer.isPlaying());
 	});
 
+	auto updateWaveformLoop = [this]() {
+		ui.waveform->setLoop(ui.checkLoopOn->isChecked(), ui.spinLoopStart->value(), ui.spinLoopEnd->value());
+	};
+	connect(ui.checkLoopOn, &QCheckBox::toggled, this, updateWaveformLoop);
+	connect(ui.spinLoopStart, &QSpinBox::valueChanged, this, updateWaveformLoop);
+	connect(ui.spinLoopEnd, &QSpinBox::valueChanged, this, updateWaveformLoop);
+
 	CONNECT_AMP_SPINBOX_VALUE(ui.spinAmpAttack, ui.ampEnvelope->amp.attackRate);
 	CONNECT_AMP_SPINBOX_VALUE(ui.spinAmpDecay1, ui.ampEnvelope->amp.decayRate1);
 	CONNECT_AMP_SPINBOX_VALUE(ui.spinAmpDecayLvl, ui.ampEnvelope->amp.decayLevel);
@@ -163,6 +170,7 @@ bool SplitEditor::setLFOWaveType(QComboBox* box, LFOWaveType type) {
 
 void SplitEditor::loadToneData() {
 	tonePlayer.setTone(split.tone);
+	ui.waveform->setTone(split.tone);
 	ui.lblToneInfo->setText(
 		tr("%n samples, %1", "", split.tone.samples())
 			.arg(manatools::tone::formatName(split.tone.format))
@@ -32,18 +32,7 @@ QVariant SplitsModel::data(const QModelIndex& index, int role) const {
 		return {};
 
 	if (role == Qt::DisplayRole || role == Qt::EditRole) {
-		switch (index.column()) {
-			case 0: return index.row();
-			case 1: return split->startNote;
-			case 2: return split->endNote;
-			case 3: return split->baseNote;
-			case 4: return split->velocityLow;
-			case 5: return split->velocityHigh;
-			case 6: return split->directLevel;
-			case 7: return split->panPot;
-			case 8: return split->fx.level;
-			case 9: return split->fx.inputCh;
-		}
+		return splitData(*split, index.row(), index.column());
 	} else if (role == Qt::TextAlignmentRole) {
 		if (index.column() == 0) {
 			return QVariant(Qt::AlignCenter | Qt::AlignVCenter);
@@ -57,6 +46,23 @@ QVariant SplitsModel::data(const QModelIndex& index, int role) const {
 	return {};
 }
 
+QVariant SplitsModel::splitData(const Split& split, int row, int column) {
+	switch (column) {
+		case 0: return row;
+		case 1: return split.startNote;
+		case 2: return split.endNote;
+		case 3: return split.baseNote;
+		case 4: return split.velocityLow;
+		case 5: return split.velocityHigh;
+		case 6: return split.directLevel;
+		case 7: return split.panPot;
+		case 8: return split.fx.level;
+		case 9: return split.fx.inputCh;
+	}
+
+	return {};
+}
+
 QVariant SplitsModel::headerData(int section, Qt::Orientation orientation, int role) const {
 	if (role == Qt::DisplayRole && orientation == Qt::Horizontal) {
 		switch (section) {
@@ -139,6 +145,20 @@ bool SplitsModel::removeRows(int row, int count, const QModelIndex& parent) {
 	return true;
 }
 
+bool SplitsModel::setSplit(int row, Split split, ChangeSet& changes) {
+	auto* cur = bank->split(programIdx, layerIdx, row);
+	if (!cur)
+		return false;
+
+	for (int c = 1; c < columnCount(); c++) {
+		if (splitData(*cur, row, c) != splitData(split, row, c))
+			changes.add(row, c);
+	}
+
+	*cur = std::move(split);
+	return true;
+}
+
 Qt::ItemFlags SplitsModel::flags(const QModelIndex& index) const {
 	Qt::ItemFlags f = QAbstractTableModel::flags(index);
 	if (index.isValid() && index.column() != 0) {
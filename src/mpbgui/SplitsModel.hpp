@@ -1,12 +1,14 @@
 #pragma once
 #include <QAbstractTableModel>
 #include <QFont>
+#include <guicommon/ChangeSet.hpp>
 #include <manatools/mpb.hpp>
 
 class SplitsModel : public QAbstractTableModel {
 	Q_OBJECT
 public:
 	typedef manatools::mpb::Bank Bank;
+	typedef manatools::mpb::Split Split;
 	
 	SplitsModel(Bank* bank, size_t programIdx, size_t layerIdx, QObject* parent = nullptr);
 
@@ -20,12 +22,21 @@ public:
 	bool insertRows(int row, int count, const QModelIndex& parent = {}) override;
 	bool removeRows(int row, int count, const QModelIndex& parent = {}) override;
 
+	/**
+	 * Replaces the split at (row) and adds whichever of its cells now show something
+	 * different to (changes), which should be one for this model. Returns false if there's
+	 * no split there.
+	 */
+	bool setSplit(int row, Split split, ChangeSet& changes);
+
 	Qt::ItemFlags flags(const QModelIndex& index) const override;
 
 	void setBank(Bank* newBank);
 	void setPath(size_t newProgramIdx, size_t newLayerIdx);
 
 private:
+	static QVariant splitData(const Split& split, int row, int column);
+
 	template <typename T, typename T2>
 	bool changeData(const QModelIndex& index, T& out, const T2& in) {
 		if (out == in)
@@ -1,9 +1,74 @@
 #include <cstdio>
 #include <cstring>
+#include <string_view>
+#include <manatools/batch.hpp>
 #include <manatools/version.hpp>
 
 #include "operations.hpp"
 
+namespace batch = manatools::batch;
+
+// MDB (drum bank) files have the same format internally
+constexpr std::string_view EXTENSIONS[] = { ".mpb", ".mdb" };
+
+static int convertBatch(std::span<const char* const> args, const fs::path& outPath) {
+	auto inputs = batch::collect(args, EXTENSIONS);
+
+	/**
+	 * Written in the commit rather than straight after converting, as different inputs can
+	 * end up with the same output (foo.mpb next to foo.mdb, or manifest entries sharing a
+	 * name), and in order like this the last one just wins as it would one at a time.
+	 */
+	auto report = batch::run(inputs,
+		[](const batch::Input& input) {
+			return mpbToSF2(input.path);
+		},
+		[&](const batch::Input& input, sf2cute::SoundFont& sf2) {
+			fs::path outDir = outPath / input.relDir;
+			fs::create_directories(outDir);
+			sf2.Write((outDir / input.path.stem().concat(".sf2")).string());
+		}
+	);
+
+	report.print();
+	return report.failures.empty() ? 0 : 1;
+}
+
+static void printStats(const manatools::tone::Store& store) {
+	auto stats = store.stats();
+	printf("Extracted %zu tones (%zu unique), saving %zu bytes\n",
+	       stats.items, stats.unique, stats.bytesSaved);
+}
+
+// Just the one bank, done directly like before batches existed, without the batch report
+static void extractOne(const fs::path& mpbPath, const fs::path& outPath, ToneExportType exportType) {
+	manatools::tone::Store store;
+	mpbWriteTones(mpbPrepareTones(mpbPath, exportType), outPath, exportType, store);
+	printStats(store);
+}
+
+static int extractBatch(std::span<const char* const> args, const fs::path& outPath, ToneExportType exportType) {
+	auto inputs = batch::collect(args, EXTENSIONS);
+
+	// Shared between every bank given, so a tone they have in common is only written once
+	manatools::tone::Store store;
+
+	auto report = batch::run(inputs,
+		[&](const batch::Input& input) {
+			return mpbPrepareTones(input.path, exportType);
+		},
+		[&](const batch::Input& input, const std::vector<ToneFile>& tones) {
+			fs::path outDir = outPath / input.relDir;
+			fs::create_directories(outDir);
+			mpbWriteTones(tones, outDir, exportType, store);
+		}
+	);
+
+	printStats(store);
+	report.print();
+	return report.failures.empty() ? 0 : 1;
+}
+
 /**
  * TODO: This is atrocious and desperately in need of much better argument parsing code
  * (and only then can I start working on making usage of this nicer)
@@ -17,18 +82,29 @@ int main(int argc, char** argv) {
 			if (argc < 4)
 				goto invalid;
 
-			mpbExportSF2(argv[2], argv[3]);
+			if (argc == 4 && !batch::isBatch(argv[2])) {
+				mpbExportSF2(argv[2], argv[3]);
+			} else {
+				return convertBatch(std::span(argv + 2, argc - 3), argv[argc - 1]);
+			}
 		} else if (!strcmp(argv[1], "extract")) {
 			if (argc < 5)
 				goto invalid;
 
+			ToneExportType exportType;
 			if (!strcmp(argv[2], "wav")) {
-				mpbExtractTones(argv[3], argv[4], ToneExportType::WAV);
+				exportType = ToneExportType::WAV;
 			} else if (!strcmp(argv[2], "dat+txth")) {
-				mpbExtractTones(argv[3], argv[4], ToneExportType::DAT_TXTH);
+				exportType = ToneExportType::DAT_TXTH;
 			} else {
 				goto invalid;
 			}
+
+			if (argc == 5 && !batch::isBatch(argv[3])) {
+				extractOne(argv[3], argv[4], exportType);
+			} else {
+				return extractBatch(std::span(argv + 3, argc - 4), argv[argc - 1], exportType);
+			}
 		} else if (!strcmp(argv[1], "list")) {
 			mpbListInfo(argv[2]);
 		} else {
@@ -52,7 +128,8 @@ invalid:
 		"https://github.com/dakrk/manatools\n"
 		"\n"
 		"Usage: %s convert <in.mpb> <out.sf2>\n"
-		"       %s extract <format> <in.mpb> <outdir>\n"
+		"       %s convert <in>... <outdir>\n"
+		"       %s extract <format> <in>... <outdir>\n"
 		"       %s list <in.mpb>\n"
 		"\n"
 		"Where \"extract\" exports multiple files of <format> to <outdir>.\n"
@@ -60,6 +137,16 @@ invalid:
 		"  - wav - Audio re-encoded into 16-bit PCM. Contains embedded loop data.\n"
 		"  - dat+txth - Raw audio from the file, with an accompanying vgmstream TXTH\n"
 		"    file containing loop data.\n"
+		"Tones with the same contents are only written once, and further copies are\n"
+		"hard linked to it (or referred to by the TXTH for dat+txth), including across\n"
+		"all of the given banks.\n"
+		"\n"
+		"Each <in> can be an MPB file, a directory to search for MPB/MDB files in\n"
+		"(including subdirectories, which are recreated under <outdir>), or @list.txt\n"
+		"to read paths from, one per line. Files are loaded and checked for duplicate\n"
+		"tones in parallel, then written in the order given, so the output is the same\n"
+		"as doing them one at a time. A file that fails is reported at the end rather\n"
+		"than stopping the rest.\n"
 		"\n"
 		"An MPB file is the bank of instruments and samples (called \"tones\") used\n"
 		"for music playback and SFX.\n"
@@ -71,6 +158,7 @@ invalid:
 		manatools::versionString,
 		argv[0],
 		argv[0],
+		argv[0],
 		argv[0]
 	);
 
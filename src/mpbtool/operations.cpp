@@ -1,5 +1,6 @@
 #include <cmath>
 #include <cstdarg>
+#include <optional>
 #include <string>
 
 #include <manatools/io.hpp>
@@ -20,18 +21,39 @@ static void mpbVersionCheck(u32 version) {
 	}
 }
 
-void mpbExportSF2(const fs::path& mpbPath, const fs::path& sf2Path) {
-	auto mpb = manatools::mpb::load(mpbPath);
+sf2cute::SoundFont mpbToSF2(const fs::path& mpbPath) {
+	auto mpb = manatools::mpb::loadMapped(mpbPath);
 	mpbVersionCheck(mpb.version);
 
-	auto sf2 = manatools::sf2::fromMPB(mpb, mpbPath.stem().string());
-	sf2.Write(sf2Path.string());
+	return manatools::sf2::fromMPB(mpb, mpbPath.stem().string());
+}
+
+void mpbExportSF2(const fs::path& mpbPath, const fs::path& sf2Path) {
+	mpbToSF2(mpbPath).Write(sf2Path.string());
+}
+
+static std::optional<manatools::wav::SamplerChunk> toneSampler(const ToneFile& file) {
+	if (!file.loop)
+		return std::nullopt;
+
+	return manatools::wav::SamplerChunk {
+		.midiUnityNote = 60,
+		.midiPitchFraction = 0,
+		.loops = {
+			{
+				.start = file.loopStart,
+				.end = file.loopEnd - 1u
+			}
+		}
+	};
 }
 
-void mpbExtractTones(const fs::path& mpbPath, const fs::path& outPath, ToneExportType exportType) {
-	auto mpb = manatools::mpb::load(mpbPath);
+std::vector<ToneFile> mpbPrepareTones(const fs::path& mpbPath, ToneExportType exportType) {
+	auto mpb = manatools::mpb::loadMapped(mpbPath);
 	mpbVersionCheck(mpb.version);
 
+	std::vector<ToneFile> tones;
+
 	for (size_t p = 0; p < mpb.programs.size(); p++) {
 		const auto& program = mpb.programs[p];
 
@@ -44,7 +66,7 @@ void mpbExtractTones(const fs::path& mpbPath, const fs::path& outPath, ToneExpor
 				const auto& split = layer->splits[s];
 
 				if (!split.tone.data) {
-					fprintf(stderr, "%zu:%zu:%zu has no tone data\n", p, l, s);
+					fprintf(stderr, "%s: %zu:%zu:%zu has no tone data\n", mpbPath.filename().string().c_str(), p, l, s);
 					continue;
 				}
 
@@ -57,48 +79,64 @@ void mpbExtractTones(const fs::path& mpbPath, const fs::path& outPath, ToneExpor
 				filename += std::to_string(l) += '-';
 				filename += std::to_string(s);
 
+				auto& file = tones.emplace_back(ToneFile{
+					.name = std::move(filename),
+					.tone = split.tone,
+					.loop = split.loop,
+					.loopStart = split.loopStart,
+					.loopEnd = split.loopEnd,
+					.digest = {}
+				});
+
+				// The WAV's decoded just to hash it, and again when written only if it's new
 				if (exportType == ToneExportType::WAV) {
-					manatools::wav::WAV<s16> wavFile(1, split.tone.sampleRate);
-
-					if (split.loop) {
-						wavFile.sampler = {
-							.midiUnityNote = 60,
-							.midiPitchFraction = 0,
-							.loops = {
-								{
-									.start = split.loopStart,
-									.end = split.loopEnd - 1u
-								}
-							}
-						};
-					}
-
-					manatools::tone::Decoder decoder(&split.tone);
-					wavFile.data.resize(split.tone.samples());
-					decoder.decode(wavFile.data);
-					
-					wavFile.save(outPath / (filename + ".wav"));
-				} else if (exportType == ToneExportType::DAT_TXTH) {
-					io::FileIO toneDataFile(outPath / (filename + ".dat"), "wb");
-					toneDataFile.writeVec(*split.tone.data);
-
-					io::FileIO txthFile(outPath / (filename + ".dat.txth"), "w");
-					std::string txth; // ditto: see the earlier formatting related comment
-					txth.reserve(175);
-					txth += "codec = "       + std::string(manatools::tone::formatName(split.tone.format)) += '\n';
-					txth += "channels = 1\n";
-					txth += "sample_rate = " + std::to_string(split.tone.sampleRate) += '\n';
-					txth += "data_size = "   + std::to_string(split.tone.data->size()) += '\n';
-					txth += "num_samples = data_size\n";
-					txth += "loop_flag = "   + std::string(split.loop ? "1" : "0") += '\n';
-					txth += "loop_start = "  + std::to_string(split.loopStart) += '\n';
-					txth += "loop_end = "    + std::to_string(split.loopEnd) += '\n';
-					txth += "body_file = "   + filename += ".dat\n";
-					txthFile.writeStr(txth);
+					manatools::tone::Store::Hasher hasher;
+					manatools::tone::saveWAV(file.tone, hasher, toneSampler(file));
+					file.digest = hasher.digest();
+				} else {
+					file.digest = manatools::tone::Store::digest(file.tone.data->span());
 				}
 			}
 		}
 	}
+
+	return tones;
+}
+
+/**
+ * Tones with identical contents, whether shared within the bank or turning up again in
+ * another one extracted through (store), are only written once and hard linked after.
+ * WAVs are streamed straight from the decoder into the file.
+ */
+void mpbWriteTones(const std::vector<ToneFile>& tones, const fs::path& outPath, ToneExportType exportType,
+                   manatools::tone::Store& store)
+{
+	for (const auto& file : tones) {
+		if (exportType == ToneExportType::WAV) {
+			store.write(outPath / (file.name + ".wav"), file.digest, [&](io::DataIO& io) {
+				manatools::tone::saveWAV(file.tone, io, toneSampler(file));
+			});
+		} else if (exportType == ToneExportType::DAT_TXTH) {
+			// Point the TXTH at the first copy of the data rather than making another
+			auto bodyPath = store.write(outPath / (file.name + ".dat"), file.digest, [&](io::DataIO& io) {
+				io.writeSpan(file.tone.data->span());
+			}, false);
+
+			io::FileIO txthFile(outPath / (file.name + ".dat.txth"), "w");
+			std::string txth; // ditto: see the earlier formatting related comment
+			txth.reserve(175);
+			txth += "codec = "       + std::string(manatools::tone::formatName(file.tone.format)) += '\n';
+			txth += "channels = 1\n";
+			txth += "sample_rate = " + std::to_string(file.tone.sampleRate) += '\n';
+			txth += "data_size = "   + std::to_string(file.tone.data->size()) += '\n';
+			txth += "num_samples = data_size\n";
+			txth += "loop_flag = "   + std::string(file.loop ? "1" : "0") += '\n';
+			txth += "loop_start = "  + std::to_string(file.loopStart) += '\n';
+			txth += "loop_end = "    + std::to_string(file.loopEnd) += '\n';
+			txth += "body_file = "   + fs::relative(bodyPath, outPath).generic_string() += '\n';
+			txthFile.writeStr(txth);
+		}
+	}
 }
 
 static void printfDepth(uint depth, const char* format, ...) {
@@ -123,7 +161,7 @@ static void printfDepth(uint depth, const char* format, ...) {
 #define BOOLSTR(b) (b ? "true" : "false")
 
 void mpbListInfo(const fs::path& mpbPath) {
-	auto mpb = manatools::mpb::load(mpbPath);
+	auto mpb = manatools::mpb::loadMapped(mpbPath);
 
 	mpbVersionCheck(mpb.version);
 
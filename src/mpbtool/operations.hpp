@@ -1,4 +1,10 @@
 #pragma once
+#include <string>
+#include <vector>
+#include <manatools/sf2.hpp>
+#include <manatools/tone.hpp>
+#include <manatools/tonestore.hpp>
+
 #include "filesystem.hpp"
 
 enum class ToneExportType {
@@ -6,6 +12,29 @@ enum class ToneExportType {
 	DAT_TXTH
 };
 
+// A tone to be written out, with what's needed to write its loop
+struct ToneFile {
+	std::string name;
+	manatools::tone::Tone tone;
+	bool loop;
+	u32 loopStart;
+	u32 loopEnd;
+
+	// Of whatever file's being exported, so writing only has to encode what's new
+	manatools::tone::Store::Digest digest;
+};
+
+// Converting is split from writing too, so batches don't write the same output path at once
+sf2cute::SoundFont mpbToSF2(const fs::path& mpbPath);
 void mpbExportSF2(const fs::path& mpbPath, const fs::path& sf2Path);
-void mpbExtractTones(const fs::path& mpbPath, const fs::path& wavOutPath, ToneExportType exportType);
+
+/**
+ * Extracting is split in two so batches can load banks in parallel, then write them in
+ * order. Preparing loads everything and works out what each file will be, and writing
+ * goes through (store).
+ */
+std::vector<ToneFile> mpbPrepareTones(const fs::path& mpbPath, ToneExportType exportType);
+void mpbWriteTones(const std::vector<ToneFile>& tones, const fs::path& outPath, ToneExportType exportType,
+                   manatools::tone::Store& store);
+
 void mpbListInfo(const fs::path& mpbPath);
@@ -1,37 +1,30 @@
 #include <cassert>
 #include <cstdio>
 #include <cstring>
-#include <set>
 
 #include <manatools/filesystem.hpp>
 #include <manatools/io.hpp>
 #include <manatools/midi.hpp>
+#include <manatools/mpb.hpp>
 #include <manatools/msb.hpp>
 #include <manatools/msd.hpp>
 #include <manatools/note.hpp>
+#include <manatools/synth.hpp>
+#include <manatools/threadpool.hpp>
 #include <manatools/version.hpp>
 
 namespace fs = manatools::fs;
 namespace io = manatools::io;
 namespace midi = manatools::midi;
+namespace mpb = manatools::mpb;
 namespace msb = manatools::msb;
 namespace msd = manatools::msd;
+namespace synth = manatools::synth;
 
 // more sane way to use visitors in our case
 template <class... Ts>
 struct overloaded : Ts... { using Ts::operator()...; };
 
-struct NoteQueueItem {
-	u32 endTime;
-	u8 channel;
-	u8 note;
-	u8 velocity;
-
-	bool operator<(const NoteQueueItem& rhs) const {
-		return endTime < rhs.endTime;
-	}
-};
-
 static void printBytes(std::span<const u8> bytes) {
 	for (u8 b : bytes) {
 		printf("%02x ", b);
@@ -56,6 +49,29 @@ void msbExtractMSDs(const fs::path& msbPath, const fs::path& msdOutPath) {
 	}
 }
 
+/**
+ * Re-encodes each MSD given rather than copying it as is, so repeated runs of messages are
+ * replaced with references to save on sound RAM.
+ */
+void msbPackMSDs(const fs::path& msbPath, std::span<char*> msdPaths) {
+	msb::MSB msb;
+	size_t inSize = 0;
+	size_t outSize = 0;
+
+	for (const fs::path msdPath : msdPaths) {
+		auto seq = msd::load(msdPath);
+		inSize += fs::file_size(msdPath);
+
+		auto& sequence = msb.sequences.emplace_back();
+		io::DynBufIO io(sequence.data);
+		seq.save(io);
+		outSize += sequence.data.size();
+	}
+
+	msb.save(msbPath);
+	printf("Packed %zu sequences, from %zu bytes to %zu bytes\n", msb.sequences.size(), inSize, outSize);
+}
+
 void msbDumpMSDs(const fs::path& msbPath) {
 	auto msb = msb::load(msbPath);
 
@@ -68,11 +84,11 @@ void msbDumpMSDs(const fs::path& msbPath) {
 		}
 
 		io::DynBufIO io(data.data);
-		auto seq = msd::load(io);
+		msd::Reader seq(io);
 
 		printf("======== Start sequence %zu ========\n", s);
 
-		for (const msd::Message& m : seq.messages) {
+		for (const msd::Message& m : seq) {
 			std::visit(overloaded {
 				[](const msd::Note& msg) {
 					printf("[Ch.%02u] Note             : note=%u (%s%d) velocity=%u gate=%u step=%u\n",
@@ -133,115 +149,48 @@ void msbExportMIDIs(const fs::path& msbPath, const fs::path& midiOutPath) {
 		}
 
 		io::DynBufIO io(data.data);
-		midi::File midiFile;
-		auto seq = msd::load(io);
-
-		midiFile.division = 0x10000 / seq.tpqn;
-
-		std::multiset<NoteQueueItem> noteQueue;
-		u32 curTime = 0;
-		u32 lastTime = 0;
-		u32 delta = 0;
-		bool startLoop = true;
-
-		/**
-		 * rather poor way of doing it especially because it relies on a multiset to make the endtimes
-		 * ordered so it doesn't break by doing negative calculations and underflowing, and that makes me sad
-		 * and I'm not sure produces entirely correct results :(
-		 * I think some note off timings are a bit out of order because of this
-		 * TODO: really revisit this
-		 */
-		auto processNoteQueue = [&](bool flush = false) {
-			for (auto it = noteQueue.begin(); it != noteQueue.end();) {
-				if (curTime >= it->endTime || flush) {
-					u32 delta = it->endTime - lastTime;
-					lastTime = it->endTime;
-					midiFile.events.push_back(midi::NoteOff { delta, it->channel, it->note, it->velocity });
-					it = noteQueue.erase(it);
-				} else {
-					it++;
-				}
-			}
-		};
-
-		for (const msd::Message& m : seq.messages) {
-			processNoteQueue();
-
-			delta = curTime - lastTime;
-			lastTime = curTime;
-
-			std::visit(overloaded {
-				[&](const msd::Note& msg) {
-					midiFile.events.push_back(midi::NoteOn { delta, msg.channel, msg.note, msg.velocity });
-					noteQueue.insert({ curTime + msg.gate, msg.channel, msg.note, msg.velocity });
-					curTime += msg.step;
-				},
+		msd::Reader seq(io);
+		auto midiFile = msd::toMIDI(seq);
 
-				[&](const msd::ControlChange& msg) {
-					midiFile.events.push_back(midi::ControlChange { delta, msg.channel, msg.controller, msg.value });
-					curTime += msg.step;
-				},
-
-				[&](const msd::ProgramChange& msg) {
-					midiFile.events.push_back(midi::ProgramChange { delta, msg.channel, msg.program });
-					curTime += msg.step;
-				},
+		fs::path midiName = msbPath.stem().concat('_' + std::to_string(s) += ".mid");
+		midiFile.save(midiOutPath / midiName);
+	}
+}
 
-				[&](const msd::ChannelPressure& msg) {
-					midiFile.events.push_back(midi::ChannelPressure { delta, msg.channel, msg.pressure });
-					curTime += msg.step;
-				},
+void msbImportMIDI(const fs::path& midiPath, const fs::path& msdPath) {
+	auto midiFile = midi::load(midiPath);
+	auto seq = msd::fromMIDI(midiFile);
+	seq.save(msdPath);
+}
 
-				[&](const msd::PitchWheelChange& msg) {
-					s16 pitch = ((msg.pitch + 64) << 7) - 8192;
-					midiFile.events.push_back(midi::PitchWheelChange { delta, msg.channel, pitch });
-					curTime += msg.step;
-				},
+void msbRender(const fs::path& msbPath, const fs::path& mpbPath, const fs::path& wavOutPath, uint loops) {
+	auto msb = msb::load(msbPath);
+	auto bank = mpb::load(mpbPath);
+	synth::Renderer renderer(bank);
 
-				[&](const msd::Loop& msg) {
-					// Insert a CC31 for Dreamcast compatibility, and loopStart/loopEnd for other software
-					midiFile.events.push_back(midi::ControlChange { delta, 0, 31, msg.unk1 });
-					midiFile.events.push_back(midi::MetaEvent { midi::Marker { 0, startLoop ? "loopStart" : "loopEnd" } });
-					startLoop = !startLoop;
-					curTime += msg.step;
-				},
+	synth::RenderOptions options;
+	options.loops = loops;
 
-				[&](const msd::TempoChange& msg) {
-					midiFile.events.push_back(midi::MetaEvent { midi::SetTempo { delta, static_cast<u32>(msg.tempo * 1000) } });
-					curTime += msg.step;
-				},
+	// Sequences are independent of each other, so each one gets its own thread
+	manatools::ThreadPool::shared().parallelFor(msb.sequences.size(), [&](size_t s) {
+		auto& sequence = msb.sequences[s];
 
-				[&](const msd::SysEx& msg) {
-					/**
-					 * A bit confused here...
-					 * MIDI documents say messages are like:
-					 *   0xF0 <MMA> <Data (could contain size and 0xF7)>
-					 * Yet Sekaiju and whatever MIDI hexpat ImHex comes with seems to do it like:
-					 *   0xF0 <Size> <Data (could contain MMA and 0xF7)>
-					 * Not sure what's right here, and what I should do.
-					 */
-					auto data = msg.data;
-					data.insert(data.begin(), data.size() + 1);
-					data.push_back(static_cast<u8>(midi::Status::EndOfSysEx));
-
-					midiFile.events.push_back(midi::SysEx { delta, data });
-					curTime += msg.step;
-				},
-
-				[](const auto& msg) {
-					(void)msg;
-					assert(!"Recognised MSD message left unhandled");
-				}
-			}, m);
+		if (!sequence.data.size()) {
+			fprintf(stderr, "Warning: Sequence %zu has no data\n", s);
+			return;
 		}
 
-		// flush remaining note offs
-		processNoteQueue(true);
-		midiFile.events.push_back(midi::EndOfTrack { delta });
+		try {
+			io::DynBufIO io(sequence.data);
+			auto seq = msd::load(io);
+			auto wav = renderer.render(seq, options);
 
-		fs::path midiName = msbPath.stem().concat('_' + std::to_string(s) += ".mid");
-		midiFile.save(midiOutPath / midiName);
-	}
+			fs::path wavName = msbPath.stem().concat('_' + std::to_string(s) += ".wav");
+			wav.save(wavOutPath / wavName);
+		} catch (const std::runtime_error& err) {
+			fprintf(stderr, "Warning: Failed to render sequence %zu: %s\n", s, err.what());
+		}
+	});
 }
 
 // TODO: dear god this needs better argument parsing
@@ -255,6 +204,11 @@ int main(int argc, char** argv) {
 				goto invalid;
 
 			msbExtractMSDs(argv[2], argv[3]);
+		} else if (!strcmp(argv[1], "pack")) {
+			if (argc < 4)
+				goto invalid;
+
+			msbPackMSDs(argv[2], std::span(argv + 3, argc - 3));
 		} else if (!strcmp(argv[1], "dump")) {
 			msbDumpMSDs(argv[2]);
 		} else if (!strcmp(argv[1], "exportmidis")) {
@@ -262,6 +216,17 @@ int main(int argc, char** argv) {
 				goto invalid;
 
 			msbExportMIDIs(argv[2], argv[3]);
+		} else if (!strcmp(argv[1], "importmidi")) {
+			if (argc < 4)
+				goto invalid;
+
+			msbImportMIDI(argv[2], argv[3]);
+		} else if (!strcmp(argv[1], "render")) {
+			if (argc < 5)
+				goto invalid;
+
+			uint loops = argc >= 6 ? std::stoul(argv[5]) : 0;
+			msbRender(argv[2], argv[3], argv[4], loops);
 		} else {
 			goto invalid;
 		}
@@ -279,8 +244,11 @@ invalid:
 		"https://github.com/dakrk/manatools\n"
 		"\n"
 		"Usage: %s extract <in.msb> <outdir>\n"
+		"       %s pack <out.msb> <in.msd>...\n"
 		"       %s dump <in.msb>\n"
 		"       %s exportmidis <in.msb> <outdir>\n"
+		"       %s importmidi <in.mid> <out.msd>\n"
+		"       %s render <in.msb> <in.mpb> <outdir> [loops]\n"
 		"\n"
 		"An MSB file is a collection of sequences of MIDI messages.\n"
 		"Typically these are packed inside an MLT, and are used for music.\n"
@@ -293,10 +261,20 @@ invalid:
 		"      storing a file offset and the number of messages to an instance of a\n"
 		"      previously repeated sequence.\n"
 		"\n"
+		"\"pack\" creates an MSB from the given MSD files in order, re-encoding them so\n"
+		"that messages repeated within each are replaced with references.\n"
+		"\"importmidi\" converts a MIDI file (SMF0 or SMF1) to an MSD, ready for \"pack\".\n"
+		"\"render\" plays every sequence against an MPB bank and saves each as a stereo\n"
+		"WAV, repeating looped sections the given number of times. This is only an\n"
+		"approximation of the sound driver, with no filter, LFO or DSP effects.\n"
+		"\n"
 		"The aforementioned usage syntax is not final and will be revised.\n",
 		manatools::versionString,
 		argv[0],
 		argv[0],
+		argv[0],
+		argv[0],
+		argv[0],
 		argv[0]
 	);
 
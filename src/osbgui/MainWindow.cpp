@@ -5,6 +5,7 @@
 #include <QInputDialog>
 #include <QMessageBox>
 #include <QMimeData>
+#include <guicommon/background.hpp>
 #include <guicommon/CSV.hpp>
 #include <guicommon/CursorOverride.hpp>
 #include <guicommon/HorizontalLineItemDropStyle.hpp>
@@ -120,17 +121,22 @@ MainWindow::MainWindow(QWidget* parent) :
 }
 
 bool MainWindow::loadFile(const QString& path) {
-	CursorOverride cursor(Qt::WaitCursor);
+	manatools::osb::Bank loaded;
+	bool guessToneSize = ui.actionGuessToneSize->isChecked();
 
 	try {
-		bank = manatools::osb::load(path.toStdWString(), ui.actionGuessToneSize->isChecked());
+		bool done = runInBackground(this, tr("Loading bank..."), [&](const manatools::Progress& progress) {
+			loaded = manatools::osb::load(path.toStdWString(), guessToneSize, progress);
+		});
+
+		if (!done)
+			return false;
 	} catch (const std::runtime_error& err) {
-		cursor.restore();
 		QMessageBox::warning(this, tr("Open One Shot bank"), tr("Failed to load bank file: %1").arg(err.what()));
 		return false;
 	}
 
-	cursor.restore();
+	bank = std::move(loaded);
 
 	if (!loadMapFile(path % ".csv")) {
 		loadMapFile(getOutPath(path, true) % "/manatools_osb_map.csv");
@@ -163,12 +169,15 @@ bool MainWindow::saveFile(const QString& path) {
 	}
 
 	bool doSaveMappings = saveMappingsDialog();
-	CursorOverride cursor(Qt::WaitCursor);
 
 	try {
-		bank.save(path.toStdWString());
+		bool done = runInBackground(this, tr("Saving bank..."), [&](const manatools::Progress& progress) {
+			bank.save(path.toStdWString(), progress);
+		});
+
+		if (!done)
+			return false;
 	} catch (const std::runtime_error& err) {
-		cursor.restore();
 		QMessageBox::warning(this, tr("Save One Shot bank"), tr("Failed to save bank file: %1").arg(err.what()));
 		return false;
 	}
@@ -373,6 +382,7 @@ bool MainWindow::exportTone() {
 		);
 	} else if (selRows.size()) {
 		tone::FileType fileType;
+		u32 sampleRate;
 		QString fileExt;
 		QString basePath;
 		QDir baseDir;
@@ -380,6 +390,7 @@ bool MainWindow::exportTone() {
 		basePath = tone::exportFolderDialog(
 			getOutPath(curFile, true),
 			&fileType,
+			&sampleRate,
 			this
 		);
 
@@ -405,7 +416,8 @@ bool MainWindow::exportTone() {
 				&metadata,
 				outPath,
 				fileType,
-				this
+				this,
+				sampleRate
 			);
 		}
 	}
@@ -68,6 +68,13 @@ void ProgramEditor::init() {
 		ui.btnTonePlay->setChecked(tonePlayer.isPlaying());
 	});
 
+	auto updateWaveformLoop = [this]() {
+		ui.waveform->setLoop(ui.checkLoopOn->isChecked(), ui.spinLoopStart->value(), ui.spinLoopEnd->value());
+	};
+	connect(ui.checkLoopOn, &QCheckBox::toggled, this, updateWaveformLoop);
+	connect(ui.spinLoopStart, &QSpinBox::valueChanged, this, updateWaveformLoop);
+	connect(ui.spinLoopEnd, &QSpinBox::valueChanged, this, updateWaveformLoop);
+
 	CONNECT_AMP_SPINBOX_VALUE(ui.spinAmpAttack, ui.ampEnvelope->amp.attackRate);
 	CONNECT_AMP_SPINBOX_VALUE(ui.spinAmpDecay1, ui.ampEnvelope->amp.decayRate1);
 	CONNECT_AMP_SPINBOX_VALUE(ui.spinAmpDecayLvl, ui.ampEnvelope->amp.decayLevel);
@@ -125,6 +132,7 @@ bool ProgramEditor::setLFOWaveType(QComboBox* box, LFOWaveType type) {
 
 void ProgramEditor::loadToneData() {
 	tonePlayer.setTone(program.tone);
+	ui.waveform->setTone(program.tone);
 	ui.lblToneInfo->setText(
 		tr("%n samples, %1", "", program.tone.samples())
 			.arg(manatools::tone::formatName(program.tone.format))
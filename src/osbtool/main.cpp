@@ -1,13 +1,17 @@
 #include <cstdio>
 #include <cstdarg>
 #include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
 
+#include <manatools/batch.hpp>
 #include <manatools/filesystem.hpp>
 #include <manatools/io.hpp>
 #include <manatools/osb.hpp>
 #include <manatools/tonedecoder.hpp>
+#include <manatools/tonestore.hpp>
 #include <manatools/version.hpp>
-#include <manatools/wav.hpp>
 
 #ifndef _WIN32
 	#define HEADING "\033[1m"
@@ -19,6 +23,7 @@
 
 #define BOOLSTR(b) (b ? "true" : "false")
 
+namespace batch = manatools::batch;
 namespace fs = manatools::fs;
 namespace io = manatools::io;
 
@@ -27,6 +32,12 @@ enum class ToneExportType {
 	DAT_TXTH
 };
 
+struct ToneFile {
+	std::string name;
+	manatools::tone::Tone tone;
+	manatools::tone::Store::Digest digest; // Of the file being exported
+};
+
 static void printfDepth(uint depth, const char* format, ...) {
 	for (uint i = 0; i < depth; i++)
 		fputs("    ", stdout);
@@ -43,46 +54,74 @@ static void osbVersionCheck(u32 version) {
 	}
 }
 
-void osbExtractTones(const fs::path& osbPath, const fs::path& outPath, ToneExportType exportType) {
+/**
+ * Loads everything and works out what each file will be, so batches can do this part for
+ * many banks at once. A WAV's decoded just to hash it, and again when written only if new.
+ */
+std::vector<ToneFile> osbPrepareTones(const fs::path& osbPath, ToneExportType exportType) {
 	auto osb = manatools::osb::load(osbPath);
 
 	osbVersionCheck(osb.version);
 
+	std::vector<ToneFile> tones;
+
 	for (size_t p = 0; p < osb.programs.size(); p++) {
 		const auto& program = osb.programs[p];
 
 		if (!program.tone.data) {
-			fprintf(stderr, "Program %zu has no tone data\n", p);
+			fprintf(stderr, "%s: Program %zu has no tone data\n", osbPath.filename().string().c_str(), p);
 			continue;
 		}
 
-		std::string filename = osbPath.stem().string() += '_' + std::to_string(p);
+		auto& file = tones.emplace_back(ToneFile{
+			.name = osbPath.stem().string() += '_' + std::to_string(p),
+			.tone = program.tone,
+			.digest = {}
+		});
 
-		// oh so messy
 		if (exportType == ToneExportType::WAV) {
-			manatools::wav::WAV<s16> wavFile(1, program.tone.sampleRate);
+			manatools::tone::Store::Hasher hasher;
+			manatools::tone::saveWAV(file.tone, hasher);
+			file.digest = hasher.digest();
+		} else {
+			file.digest = manatools::tone::Store::digest(file.tone.data->span());
+		}
+	}
 
-			manatools::tone::Decoder decoder(&program.tone);
-			wavFile.data.resize(program.tone.samples());
-			decoder.decode(wavFile.data);
+	return tones;
+}
 
-			wavFile.save(outPath / (filename + ".wav"));
+/**
+ * Tones with identical contents, whether in this bank or another one extracted through
+ * (store), are only written once and hard linked after. WAVs are streamed straight from
+ * the decoder into the file.
+ */
+void osbWriteTones(const std::vector<ToneFile>& tones, const fs::path& outPath, ToneExportType exportType,
+                   manatools::tone::Store& store) {
+	for (const auto& file : tones) {
+		// oh so messy
+		if (exportType == ToneExportType::WAV) {
+			store.write(outPath / (file.name + ".wav"), file.digest, [&](io::DataIO& io) {
+				manatools::tone::saveWAV(file.tone, io);
+			});
 		} else if (exportType == ToneExportType::DAT_TXTH) {
-			io::FileIO toneDataFile(outPath / (filename + ".dat"), "wb");
-			toneDataFile.writeVec(*program.tone.data);
+			// Point the TXTH at the first copy of the data rather than making another
+			auto bodyPath = store.write(outPath / (file.name + ".dat"), file.digest, [&](io::DataIO& io) {
+				io.writeSpan(file.tone.data->span());
+			}, false);
 
-			io::FileIO txthFile(outPath / (filename + ".dat.txth"), "w");
+			io::FileIO txthFile(outPath / (file.name + ".dat.txth"), "w");
 			std::string txth;
 			txth.reserve(120);
-			txth += "codec = "       + std::string(manatools::tone::formatName(program.tone.format)) += '\n';
+			txth += "codec = "       + std::string(manatools::tone::formatName(file.tone.format)) += '\n';
 			txth += "channels = 1\n";
-			txth += "sample_rate = " + std::to_string(program.tone.sampleRate) += '\n';
-			txth += "data_size = "   + std::to_string(program.tone.data->size()) += '\n';
+			txth += "sample_rate = " + std::to_string(file.tone.sampleRate) += '\n';
+			txth += "data_size = "   + std::to_string(file.tone.data->size()) += '\n';
 			txth += "num_samples = data_size\n";
-			txth += "body_file = "   + filename += ".dat\n";
+			txth += "body_file = "   + fs::relative(bodyPath, outPath).generic_string() += '\n';
 			txthFile.writeStr(txth);
 		}
-	}	
+	}
 }
 
 void osbListInfo(const fs::path& mpbPath) {
@@ -134,13 +173,48 @@ int main(int argc, char** argv) {
 			if (argc < 5)
 				goto invalid;
 
+			ToneExportType exportType;
 			if (!strcmp(argv[2], "wav")) {
-				osbExtractTones(argv[3], argv[4], ToneExportType::WAV);
+				exportType = ToneExportType::WAV;
 			} else if (!strcmp(argv[2], "dat+txth")) {
-				osbExtractTones(argv[3], argv[4], ToneExportType::DAT_TXTH);
+				exportType = ToneExportType::DAT_TXTH;
 			} else {
 				goto invalid;
 			}
+
+			// Just the one bank is done directly like before batches existed, without the batch report
+			bool single = argc == 5 && !batch::isBatch(argv[3]);
+
+			manatools::tone::Store store;
+			batch::Report report;
+
+			if (single) {
+				osbWriteTones(osbPrepareTones(argv[3], exportType), argv[4], exportType, store);
+			} else {
+				constexpr std::string_view extensions[] = { ".osb" };
+				auto inputs = batch::collect(std::span(argv + 3, argc - 4), extensions);
+				fs::path outPath = argv[argc - 1];
+
+				report = batch::run(inputs,
+					[&](const batch::Input& input) {
+						return osbPrepareTones(input.path, exportType);
+					},
+					[&](const batch::Input& input, const std::vector<ToneFile>& tones) {
+						fs::path outDir = outPath / input.relDir;
+						fs::create_directories(outDir);
+						osbWriteTones(tones, outDir, exportType, store);
+					}
+				);
+			}
+
+			auto stats = store.stats();
+			printf("Extracted %zu tones (%zu unique), saving %zu bytes\n",
+			       stats.items, stats.unique, stats.bytesSaved);
+
+			if (!single) {
+				report.print();
+				return report.failures.empty() ? 0 : 1;
+			}
 		} else if (!strcmp(argv[1], "list")) {
 			osbListInfo(argv[2]);
 		} else {
@@ -159,7 +233,7 @@ invalid:
 		"osbtool - Dreamcast One Shot Bank tool [version %s]\n"
 		"https://github.com/dakrk/manatools\n"
 		"\n"
-		"Usage: %s extract <format> <in.osb> <outdir>\n"
+		"Usage: %s extract <format> <in>... <outdir>\n"
 		"       %s list <in.osb>\n"
 		"\n"
 		"Where \"extract\" exports multiple files of <format> to <outdir>.\n"
@@ -167,6 +241,16 @@ invalid:
 		"  - wav - Audio re-encoded into 16-bit PCM.\n"
 		"  - dat+txth - Raw audio from the file, with an accompanying vgmstream TXTH\n"
 		"    file.\n"
+		"Tones with the same contents are only written once, and further copies are\n"
+		"hard linked to it (or referred to by the TXTH for dat+txth), including across\n"
+		"all of the given banks.\n"
+		"\n"
+		"Each <in> can be an OSB file, a directory to search for OSB files in\n"
+		"(including subdirectories, which are recreated under <outdir>), or @list.txt\n"
+		"to read paths from, one per line. Files are loaded and checked for duplicate\n"
+		"tones in parallel, then written in the order given, so the output is the same\n"
+		"as doing them one at a time. A file that fails is reported at the end rather\n"
+		"than stopping the rest.\n"
 		"\n"
 		"An OSB file is a collection of samples used for SFX.\n"
 		"\n"